@@ -0,0 +1,528 @@
+/*
+###########################################################################
+    CryptoVote N-API addon
+
+    Exposes the Paillier and AES core to Node without a child process. Every
+    call is queued on the libuv thread pool and returns a Promise; results
+    are Buffers that own their bytes, so nothing is copied on the way back.
+    Fixed-width big-endian integers are packed back to back in one Buffer:
+    plaintexts are keys.plaintextBytes wide, ciphertexts keys.ciphertextBytes.
+
+    Build (from backend/): node-gyp rebuild
+###########################################################################
+*/
+
+#include "paillier.h"
+#include "paillier_fixed.h"
+#include "aes.h"
+//-------------------------------------------------------------
+#include <node_api.h>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gmpxx.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+const char PUBLIC_KEY_MAGIC[4] = {'C', 'V', 'P', 'K'};  // n, g
+const char PRIVATE_KEY_MAGIC[4] = {'C', 'V', 'S', 'K'}; // n, g, lambda, mu
+
+/**
+ * @brief Paillier keys shared between a JS Keys object and the calls using it.
+ * @details The JS object holds one reference and every queued call another,
+ *          so a Keys object collected mid-call does not free the keys under it.
+ */
+struct KeyHandle {
+    shared_ptr<const PaillierKeys> keys;
+    size_t plaintextBytes;
+    size_t ciphertextBytes;
+    bool hasPrivate; // lambda and mu are set: the keys can decrypt
+};
+
+/**
+ * @brief One Promise-returning call run on the libuv thread pool.
+ * @details 'execute' runs off the JS thread and must not touch napi values;
+ *          it fills 'output' or throws. Input Buffers are pinned with
+ *          references until the call settles. With 'fields', the output is
+ *          that many length-prefixed parts (see putPart) and the Promise
+ *          resolves to an object with one Buffer per field.
+ */
+struct AsyncCall {
+    napi_async_work work = nullptr;
+    napi_deferred deferred = nullptr;
+    vector<napi_ref> pinned;
+    function<void()> execute;
+    unique_ptr<vector<Byte>> output;
+    vector<string> fields;
+    string error;
+};
+
+// Throws a JS error and returns the 'undefined' napi expects from a failed callback.
+napi_value throwError(napi_env env, const string& message) {
+    napi_throw_error(env, nullptr, message.c_str());
+    return nullptr;
+}
+
+// Reads a callback's arguments; throws if fewer than 'count' were passed.
+void readArgs(napi_env env, napi_callback_info info, size_t count, napi_value* args) {
+    size_t argc = count;
+    napi_get_cb_info(env, info, &argc, args, nullptr, nullptr);
+    if (argc < count) {
+        throw invalid_argument("Expected " + to_string(count) + " argument(s), got " + to_string(argc));
+    }
+}
+
+// Returns a Buffer argument's bytes in place.
+void bufferArg(napi_env env, napi_value value, const Byte*& data, size_t& length, const char* name) {
+    bool isBuffer = false;
+    napi_is_buffer(env, value, &isBuffer);
+    if (!isBuffer) {
+        throw invalid_argument(string(name) + " must be a Buffer");
+    }
+    void* raw = nullptr;
+    napi_get_buffer_info(env, value, &raw, &length);
+    data = static_cast<const Byte*>(raw);
+}
+
+// Returns the keys wrapped by a Keys object from loadKeys().
+KeyHandle keysArg(napi_env env, napi_value value) {
+    void* raw = nullptr;
+    if (napi_unwrap(env, value, &raw) != napi_ok || raw == nullptr) {
+        throw invalid_argument("keys must come from loadKeys()");
+    }
+    return *static_cast<KeyHandle*>(raw);
+}
+
+// Reads 'count' consecutive big-endian integers of 'width' bytes.
+vector<mpz_class> unpackIntegers(const Byte* data, size_t length, size_t width, const char* name) {
+    if (length % width != 0) {
+        throw invalid_argument(string(name) + " length " + to_string(length) + " is not a multiple of " +
+                               to_string(width) + " bytes");
+    }
+    vector<mpz_class> values(length / width);
+    for (size_t i = 0; i < values.size(); i++) {
+        mpz_import(values[i].get_mpz_t(), width, 1, 1, 1, 0, data + i * width);
+    }
+    return values;
+}
+
+// Writes a non-negative integer as 'width' big-endian bytes, zero-padded on the left.
+void packInteger(const mpz_class& value, Byte* out, size_t width) {
+    size_t bytes = (mpz_sizeinbase(value.get_mpz_t(), 2) + 7) / 8;
+    if (sgn(value) < 0 || bytes > width) {
+        throw runtime_error("Value does not fit in " + to_string(width) + " bytes");
+    }
+    memset(out, 0, width - bytes);
+    size_t written = 0;
+    mpz_export(out + width - bytes, &written, 1, 1, 1, 0, value.get_mpz_t());
+}
+
+// Appends a 4-byte big-endian length and the integer's bytes.
+void putField(vector<Byte>& out, const mpz_class& value) {
+    size_t bytes = (mpz_sizeinbase(value.get_mpz_t(), 2) + 7) / 8;
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<Byte>(bytes >> shift));
+    }
+    size_t start = out.size();
+    out.resize(start + bytes);
+    size_t written = 0;
+    mpz_export(out.data() + start, &written, 1, 1, 1, 0, value.get_mpz_t());
+}
+
+// Appends a 4-byte big-endian length and a part of a multi-field result.
+void putPart(vector<Byte>& out, const vector<Byte>& part) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        out.push_back(static_cast<Byte>(part.size() >> shift));
+    }
+    out.insert(out.end(), part.begin(), part.end());
+}
+
+// Reads a field written by putField and advances 'pos'.
+mpz_class getField(const Byte* data, size_t length, size_t& pos) {
+    if (length - pos < 4) {
+        throw invalid_argument("Truncated key blob");
+    }
+    size_t bytes = 0;
+    for (int i = 0; i < 4; i++) {
+        bytes = (bytes << 8) | data[pos++];
+    }
+    if (length - pos < bytes) {
+        throw invalid_argument("Truncated key blob");
+    }
+    mpz_class value;
+    mpz_import(value.get_mpz_t(), bytes, 1, 1, 1, 0, data + pos);
+    pos += bytes;
+    return value;
+}
+
+// This thread's GMP random state, seeded once from std::random_device.
+gmp_randstate_t& threadRandState() {
+    struct RandState {
+        gmp_randstate_t state;
+        RandState() {
+            random_device rd;
+            mpz_class seed;
+            for (int i = 0; i < 8; i++) {
+                seed = (seed << 32) + rd();
+            }
+            gmp_randinit_mt(state);
+            gmp_randseed(state, seed.get_mpz_t());
+        }
+        ~RandState() { gmp_randclear(state); }
+    };
+    thread_local RandState local;
+    return local.state;
+}
+
+// Runs a call's work off the JS thread, recording any exception.
+void executeCall(napi_env, void* data) {
+    AsyncCall* call = static_cast<AsyncCall*>(data);
+    try {
+        call->execute();
+    } catch (const exception& e) {
+        call->error = e.what();
+    }
+}
+
+// Frees an output vector once its Buffer is collected.
+void freeOutput(napi_env, void*, void* hint) {
+    delete static_cast<vector<Byte>*>(hint);
+}
+
+// Settles the Promise on the JS thread: a Buffer that adopts the output, or an Error.
+void completeCall(napi_env env, napi_status, void* data) {
+    unique_ptr<AsyncCall> call(static_cast<AsyncCall*>(data));
+    for (napi_ref ref : call->pinned) {
+        napi_delete_reference(env, ref);
+    }
+    napi_delete_async_work(env, call->work);
+
+    if (!call->error.empty() || !call->output) {
+        napi_value message, error;
+        napi_create_string_utf8(env, call->error.empty() ? "No result" : call->error.c_str(), NAPI_AUTO_LENGTH,
+                                &message);
+        napi_create_error(env, nullptr, message, &error);
+        napi_reject_deferred(env, call->deferred, error);
+        return;
+    }
+
+    if (!call->fields.empty()) {
+        // Small results (key blobs): each part is copied into its own Buffer
+        const vector<Byte>& bytes = *call->output;
+        napi_value object;
+        napi_create_object(env, &object);
+        size_t pos = 0;
+        for (const string& field : call->fields) {
+            size_t length = 0;
+            for (int i = 0; i < 4; i++) {
+                length = (length << 8) | bytes[pos++];
+            }
+            napi_value buffer;
+            void* unused = nullptr;
+            napi_create_buffer_copy(env, length, bytes.data() + pos, &unused, &buffer);
+            napi_set_named_property(env, object, field.c_str(), buffer);
+            pos += length;
+        }
+        napi_resolve_deferred(env, call->deferred, object);
+        return;
+    }
+
+    vector<Byte>* bytes = call->output.release();
+    napi_value buffer;
+    if (bytes->empty()) {
+        void* unused = nullptr;
+        napi_create_buffer(env, 0, &unused, &buffer);
+        delete bytes;
+    } else {
+        napi_create_external_buffer(env, bytes->size(), bytes->data(), freeOutput, bytes, &buffer);
+    }
+    napi_resolve_deferred(env, call->deferred, buffer);
+}
+
+/**
+ * @brief Queues a call and returns its Promise.
+ * @param env The environment.
+ * @param pin Arguments (Buffers) to keep alive until the call settles.
+ * @param execute Work for the thread pool; sets the output through the pointer it is given.
+ * @param fields Names of the parts the output holds, to resolve to an object (empty = one Buffer).
+ */
+napi_value queueCall(napi_env env, const vector<napi_value>& pin,
+                     const function<void(unique_ptr<vector<Byte>>&)>& execute,
+                     const vector<string>& fields = vector<string>()) {
+    unique_ptr<AsyncCall> call(new AsyncCall());
+    AsyncCall* raw = call.get();
+    call->fields = fields;
+    call->execute = [raw, execute]() { execute(raw->output); };
+    for (napi_value value : pin) {
+        napi_ref ref;
+        napi_create_reference(env, value, 1, &ref);
+        call->pinned.push_back(ref);
+    }
+
+    napi_value promise, name;
+    napi_create_promise(env, &call->deferred, &promise);
+    napi_create_string_utf8(env, "cryptovote", NAPI_AUTO_LENGTH, &name);
+    napi_create_async_work(env, nullptr, name, executeCall, completeCall, raw, &call->work);
+    napi_queue_async_work(env, call->work);
+    call.release(); // Owned by completeCall from here
+    return promise;
+}
+
+// Wraps a callback body so C++ exceptions become JS exceptions.
+napi_value guard(napi_env env, const function<napi_value()>& body) {
+    try {
+        return body();
+    } catch (const exception& e) {
+        return throwError(env, e.what());
+    }
+}
+
+/*
+###########################################################################
+    EXPORTED FUNCTIONS
+###########################################################################
+*/
+
+// generateKeys(bits) -> Promise<{publicKey, privateKey}>: a fresh key pair as two blobs for loadKeys().
+// The public blob is enough for encrypt and tally; only decrypt needs the private one.
+napi_value generateKeys(napi_env env, napi_callback_info info) {
+    return guard(env, [&]() {
+        napi_value args[1];
+        readArgs(env, info, 1, args);
+        int32_t bits = 0;
+        if (napi_get_value_int32(env, args[0], &bits) != napi_ok || bits < 128 || bits > 8192) {
+            throw invalid_argument("bits must be a number from 128 to 8192");
+        }
+        return queueCall(env, {}, [bits](unique_ptr<vector<Byte>>& out) {
+            PaillierKeys keys = genKeyPaillier(bits);
+            vector<Byte> publicKey(PUBLIC_KEY_MAGIC, PUBLIC_KEY_MAGIC + sizeof(PUBLIC_KEY_MAGIC));
+            putField(publicKey, keys.n);
+            putField(publicKey, keys.g);
+            vector<Byte> privateKey(PRIVATE_KEY_MAGIC, PRIVATE_KEY_MAGIC + sizeof(PRIVATE_KEY_MAGIC));
+            putField(privateKey, keys.n);
+            putField(privateKey, keys.g);
+            putField(privateKey, keys.lambda);
+            putField(privateKey, keys.mu);
+            out.reset(new vector<Byte>());
+            putPart(*out, publicKey);
+            putPart(*out, privateKey);
+        }, {"publicKey", "privateKey"});
+    });
+}
+
+// Releases a Keys object's reference when it is collected.
+void freeKeys(napi_env, void* data, void*) {
+    delete static_cast<KeyHandle*>(data);
+}
+
+// loadKeys(blob) -> Keys { bits, plaintextBytes, ciphertextBytes, private }, from a public or a
+// private blob. Parsing is cheap, so it runs inline.
+napi_value loadKeys(napi_env env, napi_callback_info info) {
+    return guard(env, [&]() {
+        napi_value args[1];
+        readArgs(env, info, 1, args);
+        const Byte* data = nullptr;
+        size_t length = 0;
+        bufferArg(env, args[0], data, length, "blob");
+        bool hasPrivate = length >= sizeof(PRIVATE_KEY_MAGIC) &&
+                          memcmp(data, PRIVATE_KEY_MAGIC, sizeof(PRIVATE_KEY_MAGIC)) == 0;
+        if (!hasPrivate && (length < sizeof(PUBLIC_KEY_MAGIC) ||
+                            memcmp(data, PUBLIC_KEY_MAGIC, sizeof(PUBLIC_KEY_MAGIC)) != 0)) {
+            throw invalid_argument("Not a CryptoVote key blob");
+        }
+
+        shared_ptr<PaillierKeys> keys(new PaillierKeys());
+        size_t pos = sizeof(PUBLIC_KEY_MAGIC);
+        keys->n = getField(data, length, pos);
+        keys->g = getField(data, length, pos);
+        if (hasPrivate) {
+            keys->lambda = getField(data, length, pos);
+            keys->mu = getField(data, length, pos);
+        }
+        if (pos != length) {
+            throw invalid_argument("Key blob has trailing bytes");
+        }
+        if (keys->n < 3 || mpz_even_p(keys->n.get_mpz_t())) {
+            throw invalid_argument("Key blob has an invalid modulus");
+        }
+        keys->nSquared = keys->n * keys->n;
+
+        unique_ptr<KeyHandle> handle(new KeyHandle());
+        handle->keys = keys;
+        handle->hasPrivate = hasPrivate;
+        handle->plaintextBytes = (mpz_sizeinbase(keys->n.get_mpz_t(), 2) + 7) / 8;
+        handle->ciphertextBytes = (mpz_sizeinbase(keys->nSquared.get_mpz_t(), 2) + 7) / 8;
+
+        napi_value object, bits, plaintextBytes, ciphertextBytes, isPrivate;
+        napi_create_object(env, &object);
+        napi_create_uint32(env, static_cast<uint32_t>(mpz_sizeinbase(keys->n.get_mpz_t(), 2)), &bits);
+        napi_create_uint32(env, static_cast<uint32_t>(handle->plaintextBytes), &plaintextBytes);
+        napi_create_uint32(env, static_cast<uint32_t>(handle->ciphertextBytes), &ciphertextBytes);
+        napi_set_named_property(env, object, "bits", bits);
+        napi_set_named_property(env, object, "plaintextBytes", plaintextBytes);
+        napi_set_named_property(env, object, "ciphertextBytes", ciphertextBytes);
+        napi_get_boolean(env, hasPrivate, &isPrivate);
+        napi_set_named_property(env, object, "private", isPrivate);
+        if (napi_wrap(env, object, handle.get(), freeKeys, nullptr, nullptr) != napi_ok) {
+            throw runtime_error("Could not attach keys to the object");
+        }
+        handle.release();
+        return object;
+    });
+}
+
+// encrypt(keys, plaintexts) -> Promise<Buffer> of one ciphertext per plaintext.
+napi_value encrypt(napi_env env, napi_callback_info info) {
+    return guard(env, [&]() {
+        napi_value args[2];
+        readArgs(env, info, 2, args);
+        KeyHandle handle = keysArg(env, args[0]);
+        const Byte* data = nullptr;
+        size_t length = 0;
+        bufferArg(env, args[1], data, length, "plaintexts");
+        return queueCall(env, {args[1]}, [handle, data, length](unique_ptr<vector<Byte>>& out) {
+            const PaillierKeys& keys = *handle.keys;
+            vector<mpz_class> plaintexts = unpackIntegers(data, length, handle.plaintextBytes, "plaintexts");
+            out.reset(new vector<Byte>(plaintexts.size() * handle.ciphertextBytes));
+            PaillierScratch& scratch = threadScratch(keys);
+            mpz_class c;
+            for (size_t i = 0; i < plaintexts.size(); i++) {
+                if (plaintexts[i] >= keys.n) {
+                    throw invalid_argument("Plaintext " + to_string(i) + " is not below n");
+                }
+                encVote(c, plaintexts[i], keys, threadRandState(), scratch);
+                packInteger(c, out->data() + i * handle.ciphertextBytes, handle.ciphertextBytes);
+            }
+        });
+    });
+}
+
+// tally(keys, ciphertexts) -> Promise<Buffer>: their product, an encryption of the sum.
+napi_value tally(napi_env env, napi_callback_info info) {
+    return guard(env, [&]() {
+        napi_value args[2];
+        readArgs(env, info, 2, args);
+        KeyHandle handle = keysArg(env, args[0]);
+        const Byte* data = nullptr;
+        size_t length = 0;
+        bufferArg(env, args[1], data, length, "ciphertexts");
+        return queueCall(env, {args[1]}, [handle, data, length](unique_ptr<vector<Byte>>& out) {
+            if (length % handle.ciphertextBytes != 0) {
+                throw invalid_argument("ciphertexts length " + to_string(length) + " is not a multiple of " +
+                                       to_string(handle.ciphertextBytes) + " bytes");
+            }
+            // Streamed straight from the Buffer into the product, one ciphertext at a time
+            unique_ptr<CiphertextProduct> product = makeCiphertextProduct(*handle.keys);
+            mpz_class c;
+            for (size_t offset = 0; offset < length; offset += handle.ciphertextBytes) {
+                mpz_import(c.get_mpz_t(), handle.ciphertextBytes, 1, 1, 1, 0, data + offset);
+                product->multiply(c);
+            }
+            product->value(c);
+            out.reset(new vector<Byte>(handle.ciphertextBytes));
+            packInteger(c, out->data(), handle.ciphertextBytes);
+        });
+    });
+}
+
+// decrypt(keys, ciphertexts) -> Promise<Buffer> of one plaintext per ciphertext.
+napi_value decrypt(napi_env env, napi_callback_info info) {
+    return guard(env, [&]() {
+        napi_value args[2];
+        readArgs(env, info, 2, args);
+        KeyHandle handle = keysArg(env, args[0]);
+        if (!handle.hasPrivate) {
+            throw invalid_argument("decrypt needs keys loaded from the private key blob");
+        }
+        const Byte* data = nullptr;
+        size_t length = 0;
+        bufferArg(env, args[1], data, length, "ciphertexts");
+        return queueCall(env, {args[1]}, [handle, data, length](unique_ptr<vector<Byte>>& out) {
+            const PaillierKeys& keys = *handle.keys;
+            vector<mpz_class> ciphertexts = unpackIntegers(data, length, handle.ciphertextBytes, "ciphertexts");
+            out.reset(new vector<Byte>(ciphertexts.size() * handle.plaintextBytes));
+            PaillierScratch& scratch = threadScratch(keys);
+            mpz_class m;
+            for (size_t i = 0; i < ciphertexts.size(); i++) {
+                decVote(m, ciphertexts[i], keys, scratch);
+                packInteger(m, out->data() + i * handle.plaintextBytes, handle.plaintextBytes);
+            }
+        });
+    });
+}
+
+// Reads a 32-byte AES key argument.
+array<Byte, 32> aesKeyArg(napi_env env, napi_value value) {
+    const Byte* data = nullptr;
+    size_t length = 0;
+    bufferArg(env, value, data, length, "key");
+    if (length != 32) {
+        throw invalid_argument("AES key must be 32 bytes, got " + to_string(length));
+    }
+    array<Byte, 32> key;
+    memcpy(key.data(), data, key.size());
+    return key;
+}
+
+// aesEncrypt(key, plaintext) -> Promise<Buffer>: IV followed by the AES-256-CBC ciphertext.
+napi_value aesEncrypt(napi_env env, napi_callback_info info) {
+    return guard(env, [&]() {
+        napi_value args[2];
+        readArgs(env, info, 2, args);
+        array<Byte, 32> key = aesKeyArg(env, args[0]);
+        const Byte* data = nullptr;
+        size_t length = 0;
+        bufferArg(env, args[1], data, length, "plaintext");
+        return queueCall(env, {args[1]}, [key, data, length](unique_ptr<vector<Byte>>& out) {
+            string plaintext(reinterpret_cast<const char*>(data), length);
+            out.reset(new vector<Byte>(encryptAES256(plaintext, key)));
+        });
+    });
+}
+
+// aesDecrypt(key, ciphertext) -> Promise<Buffer>: the plaintext from aesEncrypt().
+napi_value aesDecrypt(napi_env env, napi_callback_info info) {
+    return guard(env, [&]() {
+        napi_value args[2];
+        readArgs(env, info, 2, args);
+        array<Byte, 32> key = aesKeyArg(env, args[0]);
+        const Byte* data = nullptr;
+        size_t length = 0;
+        bufferArg(env, args[1], data, length, "ciphertext");
+        return queueCall(env, {args[1]}, [key, data, length](unique_ptr<vector<Byte>>& out) {
+            string plaintext = decryptAES256(vector<Byte>(data, data + length), key);
+            out.reset(new vector<Byte>(plaintext.begin(), plaintext.end()));
+        });
+    });
+}
+
+// Registers the exports.
+napi_value init(napi_env env, napi_value exports) {
+    const napi_property_descriptor properties[] = {
+        {"generateKeys", nullptr, generateKeys, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"loadKeys", nullptr, loadKeys, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"encrypt", nullptr, encrypt, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"tally", nullptr, tally, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"decrypt", nullptr, decrypt, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"aesEncrypt", nullptr, aesEncrypt, nullptr, nullptr, nullptr, napi_default, nullptr},
+        {"aesDecrypt", nullptr, aesDecrypt, nullptr, nullptr, nullptr, napi_default, nullptr},
+    };
+    napi_define_properties(env, exports, sizeof(properties) / sizeof(properties[0]), properties);
+    return exports;
+}
+
+} // namespace
+
+NAPI_MODULE(NODE_GYP_MODULE_NAME, init)
@@ -0,0 +1,32 @@
+{
+  "target_defaults": {
+    "include_dirs": ["../include"],
+    "cflags_cc": ["-std=c++17", "-O2"],
+    "cflags_cc!": ["-fno-exceptions", "-fno-rtti"],
+    "xcode_settings": {
+      "GCC_ENABLE_CPP_EXCEPTIONS": "YES",
+      "GCC_ENABLE_CPP_RTTI": "YES"
+    }
+  },
+  "targets": [
+    {
+      "target_name": "cryptovote_core",
+      "type": "static_library",
+      "sources": [
+        "../src/paillier.cpp",
+        "../src/paillier_fixed.cpp",
+        "../src/modmul_simd.cpp",
+        "../src/aes.cpp",
+        "../src/metrics.cpp",
+        "../src/json.cpp"
+      ],
+      "cflags": ["-fPIC"]
+    },
+    {
+      "target_name": "cryptovote",
+      "sources": ["addon/cryptovote_addon.cpp"],
+      "dependencies": ["cryptovote_core"],
+      "libraries": ["-lgmpxx", "-lgmp"]
+    }
+  ]
+}
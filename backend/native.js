@@ -0,0 +1,16 @@
+import { createRequire } from 'module';
+
+// --- Native crypto core ---
+// The N-API addon built by `node-gyp rebuild` (see binding.gyp). Calls run on
+// the libuv thread pool and return Promises of Buffers; `native` is null when
+// the addon has not been built, so the daemon path keeps working without it.
+const require = createRequire(import.meta.url);
+
+let native = null;
+try {
+  native = require('./build/Release/cryptovote.node');
+} catch {
+  native = null;
+}
+
+export default native;
@@ -1,8 +1,10 @@
 import express from 'express';
 import cors from 'cors';
-import { exec } from 'child_process';
+import { spawn } from 'child_process';
+import readline from 'readline';
 import path from 'path';
 import { fileURLToPath } from 'url';
+import native from './native.js';
 
 const app = express();
 const PORT = 3001;
@@ -12,53 +14,214 @@ app.use(express.json());
 const __dirname = path.dirname(fileURLToPath(import.meta.url));
 
 
-let lastSimInputs = {
-  numCandidates: 0,
-  maxVoters: 0,
-  numVotes: 0
-};
+// --- cryptovote daemon ---
+// One long-lived `cryptovote --daemon` process keeps keys, ballots and the
+// running tally in memory. Commands and replies are line-delimited JSON,
+// matched up by "id". The election is snapshotted to election.snap after each
+// simulation and memory-mapped back when the daemon restarts. Lines with an
+// "event" member (simulation progress) arrive ahead of their command's reply.
+let daemon = null;
+let nextId = 1;
+const pending = new Map();
+let progress = null; // Latest progress event of the running simulation
 
-app.post('/simulate', (req, res) => {
-  const { numCandidates, maxVoters, numVotes } = req.body;
-  lastSimInputs = { numCandidates, maxVoters, numVotes };
-
-  const input = `${numCandidates}\n${maxVoters}\n${numVotes}\nn\n`;
-  console.log('✅ /simulate hit');
-  console.log('🟡 Running:', input.replace(/\n/g, '\\n'));
+function startDaemon() {
+  daemon = spawn('./bin/cryptovote', ['--daemon', '--snapshot', 'election.snap'], {
+    cwd: __dirname,
+  });
+  const lines = readline.createInterface({ input: daemon.stdout });
 
-  exec(`echo "${input}" | ./bin/cryptovote`, { cwd: __dirname }, (err, stdout, stderr) => {
-    if (err) {
-      console.error(' Error executing cryptovote:', err);
-      return res.status(500).send({ error: 'Execution failed.' });
+  lines.on('line', (line) => {
+    let reply;
+    try {
+      reply = JSON.parse(line);
+    } catch {
+      console.error(' Unparseable daemon output:', line);
+      return;
+    }
+    const waiter = pending.get(reply.id);
+    if (!waiter) return;
+    if (reply.event) {
+      waiter.onEvent?.(reply);
+      return;
     }
-    res.send({ output: stdout });
+    pending.delete(reply.id);
+    reply.ok ? waiter.resolve(reply) : waiter.reject(new Error(reply.error));
+  });
+
+  daemon.stderr.on('data', (data) => process.stderr.write(data));
+  daemon.on('exit', (code) => {
+    console.error(` cryptovote daemon exited (code ${code})`);
+    for (const waiter of pending.values()) waiter.reject(new Error('Daemon exited.'));
+    pending.clear();
+    daemon = null;
+  });
+}
+
+function sendCommand(cmd, onEvent) {
+  if (!daemon) startDaemon();
+  const id = nextId++;
+  return new Promise((resolve, reject) => {
+    pending.set(id, { resolve, reject, onEvent });
+    daemon.stdin.write(JSON.stringify({ id, ...cmd }) + '\n');
   });
+}
+
+// Renders daemon replies in the text layout the UI parses.
+function formatSimulation(setup, tally, numVotes, cancelled) {
+  const lines = [
+    ` - Number of Candidates: ${setup.numCandidates}`,
+    ` - Max Expected Voters (k): ${setup.maxVoters}`,
+    ` - Encoding Base (M = k + 1): ${setup.maxVoters + 1}`,
+    ...setup.weights.map((w, i) => ` Candidate ${i}: Weight = ${w}`),
+    ` Decrypted total sum: ${tally.decryptedTally}`,
+    ...tally.counts.map((c, i) => ` Candidate ${i}: ${c} votes`),
+    ` Total votes decoded: ${tally.counts.reduce((a, b) => a + b, 0)}`,
+    ` Votes simulated: ${numVotes}`,
+    ...(cancelled ? [' Simulation cancelled: partial results.'] : []),
+    tally.verified
+      ? ' SUCCESS: Paillier tally simulation verified.'
+      : ' FAILED: Discrepancy found in Paillier tally simulation.',
+  ];
+  return lines.join('\n');
+}
+
+app.post('/simulate', async (req, res) => {
+  const { numCandidates, maxVoters, numVotes } = req.body;
+  console.log('✅ /simulate hit', { numCandidates, maxVoters, numVotes });
+
+  try {
+    const setup = await sendCommand({ cmd: 'setup', numCandidates, maxVoters });
+    progress = { records: 0, total: Number(numVotes) };
+    const sim = await sendCommand({ cmd: 'simulate', numVotes, progress: 250 }, (event) => {
+      progress = event;
+    });
+    const tally = await sendCommand({ cmd: 'tally' });
+    await sendCommand({ cmd: 'save' });
+    res.send({ output: formatSimulation(setup, tally, sim.cast, sim.cancelled) });
+  } catch (err) {
+    console.error(' Error executing cryptovote:', err.message);
+    res.status(500).send({ error: 'Execution failed.' });
+  } finally {
+    progress = null;
+  }
+});
+
+// Progress of the running simulation: records, total, recordsPerSec, etaMs.
+app.get('/progress', (req, res) => {
+  res.send(progress ? { running: true, ...progress } : { running: false });
+});
+
+// Stops the running simulation; /simulate then answers with the votes cast so far.
+app.post('/cancel', async (req, res) => {
+  console.log('✅ /cancel hit');
+  try {
+    const reply = await sendCommand({ cmd: 'cancel' });
+    res.send({ cancelled: reply.running });
+  } catch (err) {
+    console.error(' Error cancelling simulation:', err.message);
+    res.status(500).send({ error: 'Cancel failed.' });
+  }
 });
 
-app.post('/decrypt', (req, res) => {
+app.post('/decrypt', async (req, res) => {
   const { index } = req.body;
-  const input = `${lastSimInputs.numCandidates}\n${lastSimInputs.maxVoters}\n${lastSimInputs.numVotes}\ny\n${index}\nn\n`;
+  console.log('✅ /decrypt hit', { index });
+
+  try {
+    const ballot = await sendCommand({ cmd: 'decrypt', index: Number(index) });
+    const output = [
+      `--- Decrypting Ballot #${ballot.index} ---`,
+      ` Decrypted PII: "${ballot.pii}"`,
+      ` Decrypted Plaintext Vote Weight (M^i): ${ballot.weight}`,
+    ].join('\n');
+    res.send({ output });
+  } catch (err) {
+    console.error(' Error executing cryptovote for decrypt:', err.message);
+    res.status(500).send({ error: 'Decryption failed.' });
+  }
+});
 
-  console.log('✅ /decrypt hit');
-  console.log('🟡 Running:', input.replace(/\n/g, '\\n'));
+// --- Stateless crypto (native addon) ---
+// Key generation, encryption, tallying and decryption of caller-supplied values
+// need no election state, so they call the N-API addon in-process instead of a
+// daemon round trip. The key blob (base64) carries the private key and travels
+// with every request. Plaintexts are decimal strings, ciphertexts hex.
 
-  exec(`echo "${input}" | ./bin/cryptovote`, { cwd: __dirname }, (err, stdout, stderr) => {
-    if (err) {
-      console.error(' Error executing cryptovote for decrypt:', err);
-      return res.status(500).send({ error: 'Decryption failed.' });
-    }
+// Packs integers given as strings into one Buffer of fixed-width big-endian values.
+function packIntegers(values, width, parse) {
+  if (!Array.isArray(values)) throw new Error('Expected an array of integers.');
+  const out = Buffer.alloc(values.length * width);
+  values.forEach((value, i) => {
+    const n = parse(String(value));
+    if (n < 0n) throw new Error(`Value ${i} is negative.`);
+    const hex = n.toString(16).padStart(width * 2, '0');
+    if (hex.length > width * 2) throw new Error(`Value ${i} does not fit in ${width} bytes.`);
+    out.write(hex, i * width, 'hex');
+  });
+  return out;
+}
 
-  const lines = stdout.split('\n');
-  const start = lines.findIndex(line => line.includes('--- Decrypting Ballot'));
-  const piiLine = lines.find(line => line.includes('Decrypted PII:'));
-  const weightLine = lines.find(line => line.includes('Decrypted Plaintext Vote Weight'));
+// Splits a Buffer of fixed-width big-endian integers back into BigInts.
+function unpackIntegers(buffer, width) {
+  const values = [];
+  for (let offset = 0; offset < buffer.length; offset += width) {
+    values.push(BigInt('0x' + (buffer.subarray(offset, offset + width).toString('hex') || '0')));
+  }
+  return values;
+}
 
-const cleanOutput = (start !== -1 && piiLine && weightLine)
-  ? [`${lines[start]}`, piiLine, weightLine].join('\n')
-  : ' Could not extract ballot decryption info.';
+const fromDecimal = (s) => BigInt(s);
+const fromHex = (s) => BigInt('0x' + s.replace(/^0x/i, ''));
 
-    res.send({ output: cleanOutput });
+// Registers a POST route served by the addon; answers 503 when it has not been built.
+function nativeRoute(route, handler) {
+  app.post(route, async (req, res) => {
+    if (!native) {
+      res.status(503).send({ error: 'Native addon not built: run npm run build:native.' });
+      return;
+    }
+    try {
+      res.send(await handler(req.body));
+    } catch (err) {
+      console.error(` Error in ${route}:`, err.message);
+      res.status(400).send({ error: err.message });
+    }
   });
+}
+
+const loadKeys = (blob) => native.loadKeys(Buffer.from(String(blob ?? ''), 'base64'));
+
+// Encrypt and tally take the public key; only decrypt needs the private one.
+nativeRoute('/crypto/keys', async ({ bits = 1024 }) => {
+  const { publicKey, privateKey } = await native.generateKeys(Number(bits));
+  const keys = native.loadKeys(publicKey);
+  return {
+    publicKey: publicKey.toString('base64'),
+    privateKey: privateKey.toString('base64'),
+    bits: keys.bits,
+    plaintextBytes: keys.plaintextBytes,
+    ciphertextBytes: keys.ciphertextBytes,
+  };
+});
+
+nativeRoute('/crypto/encrypt', async ({ publicKey: blob, plaintexts }) => {
+  const keys = loadKeys(blob);
+  const packed = packIntegers(plaintexts, keys.plaintextBytes, fromDecimal);
+  const ciphertexts = await native.encrypt(keys, packed);
+  return { ciphertexts: unpackIntegers(ciphertexts, keys.ciphertextBytes).map((c) => c.toString(16)) };
+});
+
+nativeRoute('/crypto/tally', async ({ publicKey: blob, ciphertexts }) => {
+  const keys = loadKeys(blob);
+  const product = await native.tally(keys, packIntegers(ciphertexts, keys.ciphertextBytes, fromHex));
+  return { ciphertext: unpackIntegers(product, keys.ciphertextBytes)[0].toString(16) };
+});
+
+nativeRoute('/crypto/decrypt', async ({ privateKey: blob, ciphertexts }) => {
+  const keys = loadKeys(blob);
+  const plaintexts = await native.decrypt(keys, packIntegers(ciphertexts, keys.ciphertextBytes, fromHex));
+  return { plaintexts: unpackIntegers(plaintexts, keys.plaintextBytes).map((m) => m.toString()) };
 });
 
 app.listen(PORT, () => {
@@ -0,0 +1,582 @@
+/*
+###########################################################################
+    CryptoVote microbenchmarks (Google Benchmark)
+
+    Build (from the repository root):
+        g++ -O2 bench/bench_crypto.cpp src/paillier.cpp src/paillier_fixed.cpp src/modmul_simd.cpp \
+            src/aes.cpp src/metrics.cpp src/json.cpp src/sha256.cpp src/voter_index.cpp src/merkle.cpp \
+            src/audit.cpp src/election.cpp src/ballot_log.cpp src/snapshot.cpp src/tally_tree.cpp -o bench_crypto \
+            -Iinclude -lbenchmark -lgmp -lgmpxx -std=c++11 -pthread
+
+    Run with machine-readable output:
+        ./bench_crypto --benchmark_out=bench.json --benchmark_out_format=json
+###########################################################################
+*/
+
+#include "paillier.h"
+#include "paillier_fixed.h"
+#include "modmul_simd.h"
+#include "aes.h"
+#include "voter_index.h"
+#include "merkle.h"
+#include "audit.h"
+//-------------------------------------------------------------
+#include <benchmark/benchmark.h>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    SHARED FIXTURES
+###########################################################################
+*/
+
+namespace {
+
+const int MAX_VOTERS = 25000;
+const int NUM_CANDIDATES = 10;
+
+// Key generation is slow at 3072 bits, so keys are created once per size.
+const PaillierKeys& keysFor(int bits) {
+    static map<int, PaillierKeys> cache;
+    auto it = cache.find(bits);
+    if (it == cache.end()) {
+        it = cache.emplace(bits, genKeyPaillier(bits)).first;
+    }
+    return it->second;
+}
+
+gmp_randstate_t& benchRandState() {
+    static gmp_randstate_t state;
+    static bool init = false;
+    if (!init) {
+        gmp_randinit_mt(state);
+        gmp_randseed_ui(state, 12345);
+        init = true;
+    }
+    return state;
+}
+
+array<Byte, 32> benchAesKey() {
+    array<Byte, 32> key;
+    for (size_t i = 0; i < key.size(); i++) {
+        key[i] = static_cast<Byte>(i * 7 + 1);
+    }
+    return key;
+}
+
+void KeySizes(benchmark::internal::Benchmark* b) {
+    b->Arg(1024)->Arg(2048)->Arg(3072);
+}
+
+void PiiSizes(benchmark::internal::Benchmark* b) {
+    b->Arg(16)->Arg(64)->Arg(256)->Arg(1024)->Arg(4096);
+}
+
+} // namespace
+
+/*
+###########################################################################
+    PAILLIER
+###########################################################################
+*/
+
+static void BM_GenKeyPaillier(benchmark::State& state) {
+    int bits = static_cast<int>(state.range(0));
+    for (auto _ : state) {
+        PaillierKeys keys = genKeyPaillier(bits);
+        benchmark::DoNotOptimize(keys.n);
+    }
+}
+BENCHMARK(BM_GenKeyPaillier)->Apply(KeySizes)->Unit(benchmark::kMillisecond)->Iterations(3);
+
+static void BM_EncVote(benchmark::State& state) {
+    const PaillierKeys& keys = keysFor(static_cast<int>(state.range(0)));
+    vector<mpz_class> weights = calcWeights(NUM_CANDIDATES, MAX_VOTERS, false);
+    size_t i = 0;
+    for (auto _ : state) {
+        mpz_class c = encVote(weights[i++ % weights.size()], keys, benchRandState());
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EncVote)->Apply(KeySizes)->Unit(benchmark::kMicrosecond);
+
+// In-place variant: reuses the ciphertext's limbs and a presized scratch.
+static void BM_EncVoteScratch(benchmark::State& state) {
+    const PaillierKeys& keys = keysFor(static_cast<int>(state.range(0)));
+    vector<mpz_class> weights = calcWeights(NUM_CANDIDATES, MAX_VOTERS, false);
+    PaillierScratch scratch(keys);
+    mpz_class c;
+    size_t i = 0;
+    for (auto _ : state) {
+        encVote(c, weights[i++ % weights.size()], keys, benchRandState(), scratch);
+        benchmark::DoNotOptimize(c);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EncVoteScratch)->Apply(KeySizes)->Unit(benchmark::kMicrosecond);
+
+static void BM_DecVote(benchmark::State& state) {
+    const PaillierKeys& keys = keysFor(static_cast<int>(state.range(0)));
+    mpz_class c = encVote(mpz_class(42), keys, benchRandState());
+    for (auto _ : state) {
+        mpz_class m = decVote(c, keys);
+        benchmark::DoNotOptimize(m);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_DecVote)->Apply(KeySizes)->Unit(benchmark::kMicrosecond);
+
+static void BM_AddVotes(benchmark::State& state) {
+    const PaillierKeys& keys = keysFor(static_cast<int>(state.range(0)));
+    mpz_class tally = encVote(mpz_class(1), keys, benchRandState());
+    mpz_class c = encVote(mpz_class(1), keys, benchRandState());
+    for (auto _ : state) {
+        tally = addVotes(tally, c, keys);
+        benchmark::DoNotOptimize(tally);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AddVotes)->Apply(KeySizes)->Unit(benchmark::kNanosecond);
+
+static void BM_AddVotesScratch(benchmark::State& state) {
+    const PaillierKeys& keys = keysFor(static_cast<int>(state.range(0)));
+    mpz_class tally = encVote(mpz_class(1), keys, benchRandState());
+    mpz_class c = encVote(mpz_class(1), keys, benchRandState());
+    PaillierScratch scratch(keys);
+    for (auto _ : state) {
+        addVotes(tally, c, keys, scratch);
+        benchmark::DoNotOptimize(tally);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_AddVotesScratch)->Apply(KeySizes)->Unit(benchmark::kNanosecond);
+
+// A 4096-ballot tally: mpz multiply-and-divide against the fixed-limb Montgomery product.
+static void tallyBallots(const PaillierKeys& keys, vector<mpz_class>& ciphertexts) {
+    mpz_class c = encVote(mpz_class(1), keys, benchRandState());
+    ciphertexts.assign(4096, c);
+    for (size_t i = 1; i < ciphertexts.size(); i++) {
+        ciphertexts[i] = addVotes(ciphertexts[i - 1], c, keys);
+    }
+}
+
+static void BM_TallyMpz(benchmark::State& state) {
+    const PaillierKeys& keys = keysFor(static_cast<int>(state.range(0)));
+    vector<mpz_class> ciphertexts;
+    tallyBallots(keys, ciphertexts);
+    PaillierScratch scratch(keys);
+    for (auto _ : state) {
+        mpz_class tally = 1;
+        for (const mpz_class& c : ciphertexts) {
+            addVotes(tally, c, keys, scratch);
+        }
+        benchmark::DoNotOptimize(tally);
+    }
+    state.SetItemsProcessed(state.iterations() * ciphertexts.size());
+}
+BENCHMARK(BM_TallyMpz)->Apply(KeySizes)->Unit(benchmark::kMillisecond);
+
+static void BM_TallyFixed(benchmark::State& state) {
+    const PaillierKeys& keys = keysFor(static_cast<int>(state.range(0)));
+    vector<mpz_class> ciphertexts;
+    tallyBallots(keys, ciphertexts);
+    setSimdLimit(SIMD_SCALAR); // Keep makeCiphertextProduct off the SIMD lanes
+    for (auto _ : state) {
+        mpz_class tally = multiplyCiphertexts(ciphertexts, keys);
+        benchmark::DoNotOptimize(tally);
+    }
+    setSimdLimit(SIMD_AVX512IFMA);
+    state.SetItemsProcessed(state.iterations() * ciphertexts.size());
+}
+BENCHMARK(BM_TallyFixed)->Apply(KeySizes)->Unit(benchmark::kMillisecond);
+
+// Key size, then kernel (0 scalar, 1 AVX2, 2 AVX-512 IFMA) for the multi-buffer tally.
+static void SimdArgs(benchmark::internal::Benchmark* b) {
+    for (int bits : {1024, 2048, 3072}) {
+        for (int level = SIMD_SCALAR; level <= SIMD_AVX512IFMA; level++) {
+            b->Args({bits, level});
+        }
+    }
+}
+
+static void BM_TallySimd(benchmark::State& state) {
+    const PaillierKeys& keys = keysFor(static_cast<int>(state.range(0)));
+    vector<mpz_class> ciphertexts;
+    tallyBallots(keys, ciphertexts);
+    BatchModMul mm(keys.nSquared, static_cast<SimdLevel>(state.range(1)));
+    for (auto _ : state) {
+        mpz_class tally = mm.product(ciphertexts);
+        benchmark::DoNotOptimize(tally);
+    }
+    state.SetLabel(simdLevelName(mm.level()));
+    state.SetItemsProcessed(state.iterations() * ciphertexts.size());
+}
+BENCHMARK(BM_TallySimd)->Apply(SimdArgs)->Unit(benchmark::kMillisecond);
+
+static void BM_EncZero(benchmark::State& state) {
+    const PaillierKeys& keys = keysFor(static_cast<int>(state.range(0)));
+    for (auto _ : state) {
+        mpz_class rn = encZero(keys, benchRandState());
+        benchmark::DoNotOptimize(rn);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EncZero)->Apply(KeySizes)->Unit(benchmark::kMillisecond);
+
+// 'count' encrypted votes at 1024 bits with weights below 2^bits.
+static void weightedBallots(size_t count, int bits, vector<mpz_class>& ciphertexts, vector<mpz_class>& scalars) {
+    const PaillierKeys& keys = keysFor(1024);
+    mt19937_64 rng(count);
+    mpz_class c = encVote(mpz_class(1), keys, benchRandState());
+    ciphertexts.assign(count, c);
+    scalars.clear();
+    for (size_t i = 0; i < count; i++) {
+        c = addVotes(c, c, keys); // Distinct ciphertexts without an encryption each
+        ciphertexts[i] = c;
+        scalars.push_back(mpz_class(static_cast<unsigned long>(rng() >> (64 - bits))));
+    }
+}
+
+static void BM_PlainTally(benchmark::State& state) {
+    vector<mpz_class> ciphertexts, scalars;
+    weightedBallots(static_cast<size_t>(state.range(0)), 1, ciphertexts, scalars);
+    const PaillierKeys& keys = keysFor(1024);
+    for (auto _ : state) {
+        mpz_class tally = 1;
+        for (const mpz_class& c : ciphertexts) {
+            tally = addVotes(tally, c, keys);
+        }
+        benchmark::DoNotOptimize(tally);
+    }
+    state.SetItemsProcessed(state.iterations() * ciphertexts.size());
+}
+BENCHMARK(BM_PlainTally)->Arg(4096)->Unit(benchmark::kMillisecond);
+
+static void BM_WeightedTally(benchmark::State& state) {
+    vector<mpz_class> ciphertexts, scalars;
+    weightedBallots(static_cast<size_t>(state.range(0)), static_cast<int>(state.range(1)), ciphertexts, scalars);
+    const PaillierKeys& keys = keysFor(1024);
+    for (auto _ : state) {
+        mpz_class tally = weightedTally(ciphertexts, scalars, keys);
+        benchmark::DoNotOptimize(tally);
+    }
+    state.SetItemsProcessed(state.iterations() * ciphertexts.size());
+}
+BENCHMARK(BM_WeightedTally)->Args({4096, 16})->Args({4096, 32})->Unit(benchmark::kMillisecond);
+
+static void BM_ScaleVoteTally(benchmark::State& state) {
+    vector<mpz_class> ciphertexts, scalars;
+    weightedBallots(static_cast<size_t>(state.range(0)), static_cast<int>(state.range(1)), ciphertexts, scalars);
+    const PaillierKeys& keys = keysFor(1024);
+    for (auto _ : state) {
+        mpz_class tally = 1;
+        for (size_t i = 0; i < ciphertexts.size(); i++) {
+            tally = addVotes(tally, scaleVote(ciphertexts[i], scalars[i], keys), keys);
+        }
+        benchmark::DoNotOptimize(tally);
+    }
+    state.SetItemsProcessed(state.iterations() * ciphertexts.size());
+}
+BENCHMARK(BM_ScaleVoteTally)->Args({4096, 32})->Unit(benchmark::kMillisecond);
+
+// Revocation: one batch inversion against an inversion per ciphertext.
+static void BM_InvertCiphertexts(benchmark::State& state) {
+    vector<mpz_class> ciphertexts, scalars;
+    weightedBallots(static_cast<size_t>(state.range(0)), 1, ciphertexts, scalars);
+    const PaillierKeys& keys = keysFor(1024);
+    for (auto _ : state) {
+        vector<mpz_class> inverses = invertCiphertexts(ciphertexts, keys);
+        benchmark::DoNotOptimize(inverses);
+    }
+    state.SetItemsProcessed(state.iterations() * ciphertexts.size());
+}
+BENCHMARK(BM_InvertCiphertexts)->Arg(4096)->Unit(benchmark::kMillisecond);
+
+static void BM_InvertEach(benchmark::State& state) {
+    vector<mpz_class> ciphertexts, scalars;
+    weightedBallots(static_cast<size_t>(state.range(0)), 1, ciphertexts, scalars);
+    const PaillierKeys& keys = keysFor(1024);
+    for (auto _ : state) {
+        mpz_class inverse;
+        for (const mpz_class& c : ciphertexts) {
+            mpz_invert(inverse.get_mpz_t(), c.get_mpz_t(), keys.nSquared.get_mpz_t());
+            benchmark::DoNotOptimize(inverse);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * ciphertexts.size());
+}
+BENCHMARK(BM_InvertEach)->Arg(4096)->Unit(benchmark::kMillisecond);
+
+/*
+###########################################################################
+    BASE-M ENCODING
+###########################################################################
+*/
+
+static void BM_CalcWeights(benchmark::State& state) {
+    int candidates = static_cast<int>(state.range(0));
+    for (auto _ : state) {
+        vector<mpz_class> weights = calcWeights(candidates, MAX_VOTERS, false);
+        benchmark::DoNotOptimize(weights.data());
+    }
+}
+BENCHMARK(BM_CalcWeights)->Arg(5)->Arg(50)->Unit(benchmark::kMicrosecond);
+
+static void BM_DecodeTally(benchmark::State& state) {
+    int candidates = static_cast<int>(state.range(0));
+    vector<mpz_class> weights = calcWeights(candidates, MAX_VOTERS, false);
+    mpz_class tally = 0;
+    for (int i = 0; i < candidates; i++) {
+        tally += weights[i] * (i + 1);
+    }
+    for (auto _ : state) {
+        vector<long> counts = decodeTally(tally, candidates, MAX_VOTERS);
+        benchmark::DoNotOptimize(counts.data());
+    }
+}
+BENCHMARK(BM_DecodeTally)->Arg(5)->Arg(50)->Unit(benchmark::kMicrosecond);
+
+/*
+###########################################################################
+    AES-256
+###########################################################################
+*/
+
+static void BM_ExpandKey(benchmark::State& state) {
+    array<Byte, 32> key = benchAesKey();
+    for (auto _ : state) {
+        vector<Block> roundKeys = expandKey(key);
+        benchmark::DoNotOptimize(roundKeys.data());
+    }
+}
+BENCHMARK(BM_ExpandKey)->Unit(benchmark::kNanosecond);
+
+static void BM_EncryptAES256(benchmark::State& state) {
+    array<Byte, 32> key = benchAesKey();
+    string pii(static_cast<size_t>(state.range(0)), 'x');
+    for (auto _ : state) {
+        vector<Byte> c = encryptAES256(pii, key);
+        benchmark::DoNotOptimize(c.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_EncryptAES256)->Apply(PiiSizes)->Unit(benchmark::kMicrosecond);
+
+static void BM_DecryptAES256(benchmark::State& state) {
+    array<Byte, 32> key = benchAesKey();
+    vector<Byte> c = encryptAES256(string(static_cast<size_t>(state.range(0)), 'x'), key);
+    for (auto _ : state) {
+        string pii = decryptAES256(c, key);
+        benchmark::DoNotOptimize(pii.data());
+    }
+    state.SetBytesProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_DecryptAES256)->Apply(PiiSizes)->Unit(benchmark::kMicrosecond);
+
+/*
+###########################################################################
+    VOTER INDEX
+###########################################################################
+*/
+
+static void BM_VoterTag(benchmark::State& state) {
+    array<Byte, 32> key = benchAesKey();
+    HmacSha256 hmac(key.data(), key.size());
+    size_t i = 0;
+    for (auto _ : state) {
+        VoterTag tag = computeVoterTag(hmac, "FName_" + to_string(i) + " LName_" + to_string(i));
+        benchmark::DoNotOptimize(tag);
+        i++;
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VoterTag)->Unit(benchmark::kNanosecond);
+
+// Random 128-bit tags stand in for HMAC outputs, so only the index is timed.
+static vector<VoterTag> randomTags(size_t n, uint64_t seed) {
+    vector<VoterTag> tags(n);
+    uint64_t x = seed;
+    for (VoterTag& tag : tags) {
+        for (size_t b = 0; b < tag.size(); b++) {
+            x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+            tag[b] = static_cast<Byte>(x >> 56);
+        }
+    }
+    return tags;
+}
+
+static void BM_VoterIndexInsert(benchmark::State& state) {
+    size_t n = static_cast<size_t>(state.range(0));
+    bool bloom = state.range(1) != 0;
+    vector<VoterTag> tags = randomTags(n, 1);
+    for (auto _ : state) {
+        VoterIndex index(n, bloom);
+        for (size_t i = 0; i < n; i++) {
+            benchmark::DoNotOptimize(index.insert(tags[i], i));
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_VoterIndexInsert)->Args({1 << 20, 0})->Args({1 << 20, 1})->Unit(benchmark::kMillisecond);
+
+// Looks up voters that are not in the index: the common case during intake.
+static void BM_VoterIndexMiss(benchmark::State& state) {
+    size_t n = static_cast<size_t>(state.range(0));
+    bool bloom = state.range(1) != 0;
+    vector<VoterTag> tags = randomTags(n, 1);
+    vector<VoterTag> absent = randomTags(n, 2);
+    VoterIndex index(n, bloom);
+    for (size_t i = 0; i < n; i++) {
+        index.insert(tags[i], i);
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        size_t ballot;
+        benchmark::DoNotOptimize(index.find(absent[i++ & (n - 1)], ballot));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_VoterIndexMiss)->Args({1 << 20, 0})->Args({1 << 20, 1})->Unit(benchmark::kNanosecond);
+
+/*
+###########################################################################
+    BULLETIN BOARD
+###########################################################################
+*/
+
+// A ballot as intake produces it: 32-byte PII ciphertext and a 2*bits-bit Paillier ciphertext.
+static EncryptedBallot benchBallot(int bits) {
+    const PaillierKeys& keys = keysFor(bits);
+    EncryptedBallot ballot;
+    ballot.aesEncryptedPII = encryptAES256("FName_1 LName_1", benchAesKey());
+    ballot.encWeight = encVote(1, keys, benchRandState());
+    return ballot;
+}
+
+// What intake adds per ballot: one leaf hash plus the amortized O(1) node hashes of an append.
+static void BM_BoardAppend(benchmark::State& state) {
+    EncryptedBallot ballot = benchBallot(static_cast<int>(state.range(0)));
+    MerkleTree board;
+    for (auto _ : state) {
+        board.append(hashBallotLeaf(ballot));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_BoardAppend)->Apply(KeySizes)->Unit(benchmark::kNanosecond);
+
+static void BM_BoardRoot(benchmark::State& state) {
+    MerkleTree board;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        board.append(sha256(reinterpret_cast<const Byte*>(&i), sizeof(i)));
+    }
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(board.root());
+    }
+}
+BENCHMARK(BM_BoardRoot)->Arg((1 << 20) - 1)->Unit(benchmark::kMicrosecond);
+
+static void BM_InclusionProof(benchmark::State& state) {
+    size_t n = static_cast<size_t>(state.range(0));
+    MerkleTree board;
+    for (size_t i = 0; i < n; i++) {
+        board.append(sha256(reinterpret_cast<const Byte*>(&i), sizeof(i)));
+    }
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(board.inclusionProof((i += 7919) % n));
+    }
+}
+BENCHMARK(BM_InclusionProof)->Arg((1 << 20) - 1)->Unit(benchmark::kMicrosecond);
+
+/*
+###########################################################################
+    AUDIT
+###########################################################################
+*/
+
+// A small election whose ballots the audit benchmarks decrypt.
+static Election& auditElection() {
+    static Election election;
+    if (election.weights.empty()) {
+        setupElection(election, NUM_CANDIDATES, MAX_VOTERS, 2048, benchRandState(), false);
+        for (int i = 0; i < 256; i++) {
+            castBallot(election, "FName_" + to_string(i) + " LName_" + to_string(i), i % NUM_CANDIDATES,
+                       benchRandState());
+        }
+    }
+    return election;
+}
+
+// The scan decryptBallotAt() does to turn a weight back into a candidate.
+static void BM_WeightScan(benchmark::State& state) {
+    vector<mpz_class> weights = calcWeights(static_cast<int>(state.range(0)), MAX_VOTERS, false);
+    size_t i = 0;
+    for (auto _ : state) {
+        const mpz_class& weight = weights[(i += 7) % weights.size()];
+        int candidate = -1;
+        for (size_t c = 0; c < weights.size(); c++) {
+            if (weights[c] == weight) {
+                candidate = static_cast<int>(c);
+                break;
+            }
+        }
+        benchmark::DoNotOptimize(candidate);
+    }
+}
+BENCHMARK(BM_WeightScan)->Arg(10)->Arg(100)->Arg(1000)->Unit(benchmark::kNanosecond);
+
+static void BM_WeightIndex(benchmark::State& state) {
+    vector<mpz_class> weights = calcWeights(static_cast<int>(state.range(0)), MAX_VOTERS, false);
+    WeightIndex index;
+    index.assign(weights);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(index.candidate(weights[(i += 7) % weights.size()]));
+    }
+}
+BENCHMARK(BM_WeightIndex)->Arg(10)->Arg(100)->Arg(1000)->Unit(benchmark::kNanosecond);
+
+// Every audit decrypts: the cost a repeated audit pays without the cache.
+static void BM_AuditCold(benchmark::State& state) {
+    Election& election = auditElection();
+    AuditService audit;
+    size_t i = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        audit.reset(election);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(audit.audit(election, i++ % ballotCount(election)));
+    }
+}
+BENCHMARK(BM_AuditCold)->Unit(benchmark::kMicrosecond);
+
+// One cache holding every ballot, shared by all benchmark threads.
+static AuditService& warmAudit() {
+    static AuditService audit;
+    static bool warm = [] {
+        for (size_t i = 0; i < ballotCount(auditElection()); i++) {
+            audit.audit(auditElection(), i);
+        }
+        return true;
+    }();
+    (void)warm;
+    return audit;
+}
+
+static void BM_AuditCached(benchmark::State& state) {
+    Election& election = auditElection();
+    AuditService& audit = warmAudit();
+    size_t i = static_cast<size_t>(state.thread_index()) * 37;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(audit.audit(election, i++ % ballotCount(election)));
+    }
+}
+BENCHMARK(BM_AuditCached)->Unit(benchmark::kMicrosecond)->ThreadRange(1, 8);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,342 @@
+/*
+###########################################################################
+    CryptoVote load harness
+
+    Drives the whole batch flow (key generation, intake of N ballots, tally,
+    decode and a sampled ballot decryption) over a sweep of ballot counts,
+    thread counts and key sizes. Every run is a separate cryptovote process,
+    so peak RSS is per run. One NDJSON line per run goes to the results file
+    with throughput, latency percentiles, peak RSS, CPU time and (with
+    --gmp-arena) GMP allocation counts.
+
+    Build (from the repository root):
+        g++ -O2 bench/load_harness.cpp src/json.cpp -o load_harness -Iinclude -std=c++11
+
+    Run:
+        ./load_harness --binary ./cryptovote --votes 10000,100000,1000000 \
+            --threads 1,4 --key-sizes 1024,2048 --out results.ndjson
+        ./load_harness --votes 100000 --soak 3600 --out soak.ndjson -- --gmp-arena
+###########################################################################
+*/
+
+#include "json.h"
+//-------------------------------------------------------------
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief The sweep to run.
+ *
+ * @param binary Path to the cryptovote executable.
+ * @param votes Ballot counts to sweep.
+ * @param threads Thread counts to sweep (--threads of each run).
+ * @param keySizes Paillier key sizes to sweep.
+ * @param candidates Candidates per election.
+ * @param sample Ballots decrypted and checked after each tally.
+ * @param repeat Runs per configuration per pass.
+ * @param soakSeconds Repeat the whole sweep until this much time has passed (0 = one pass).
+ * @param seed Seed of the first run; each run adds its run number.
+ * @param outPath Results file (NDJSON), or empty for stdout.
+ * @param extraArgs Passed through to every run (everything after "--").
+ */
+struct HarnessOptions {
+    string binary = "./cryptovote";
+    vector<long long> votes = {10000};
+    vector<long long> threads = {1};
+    vector<long long> keySizes = {1024};
+    int candidates = 4;
+    long long sample = 100;
+    int repeat = 1;
+    double soakSeconds = 0;
+    unsigned long seed = 1;
+    string outPath;
+    vector<string> extraArgs;
+};
+
+/**
+ * @brief What one run produced.
+ *
+ * @param exitCode The child's exit code (-1 if it was killed by a signal).
+ * @param report The child's JSON report (empty if it wrote none).
+ * @param usage The child's resource usage from wait4().
+ */
+struct RunResult {
+    int exitCode = -1;
+    string report;
+    struct rusage usage;
+};
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+// Parses "1000,10000" into numbers.
+vector<long long> parseList(const string& flag, const string& text) {
+    vector<long long> values;
+    stringstream in(text);
+    string item;
+    while (getline(in, item, ',')) {
+        char* end = nullptr;
+        long long v = strtoll(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || v <= 0) {
+            throw invalid_argument(flag + " expects positive integers separated by commas, got \"" + text + "\"");
+        }
+        values.push_back(v);
+    }
+    if (values.empty()) {
+        throw invalid_argument(flag + " needs at least one value");
+    }
+    return values;
+}
+
+// Reads the harness's command line.
+HarnessOptions parseOptions(int argc, char* argv[]) {
+    HarnessOptions options;
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--") {
+            options.extraArgs.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        if (i + 1 >= argc) {
+            throw invalid_argument("Missing value for " + arg);
+        }
+        string value = argv[++i];
+        if (arg == "--binary") {
+            options.binary = value;
+        } else if (arg == "--votes") {
+            options.votes = parseList(arg, value);
+        } else if (arg == "--threads") {
+            options.threads = parseList(arg, value);
+        } else if (arg == "--key-sizes") {
+            options.keySizes = parseList(arg, value);
+        } else if (arg == "--candidates") {
+            options.candidates = static_cast<int>(parseList(arg, value)[0]);
+        } else if (arg == "--sample") {
+            options.sample = atoll(value.c_str());
+        } else if (arg == "--repeat") {
+            options.repeat = static_cast<int>(parseList(arg, value)[0]);
+        } else if (arg == "--soak") {
+            options.soakSeconds = atof(value.c_str());
+        } else if (arg == "--seed") {
+            options.seed = strtoul(value.c_str(), nullptr, 10);
+        } else if (arg == "--out") {
+            options.outPath = value;
+        } else {
+            throw invalid_argument("Unknown option " + arg);
+        }
+    }
+    return options;
+}
+
+// Prints the harness's usage.
+void printUsage() {
+    cerr << "Usage: load_harness [options] [-- extra cryptovote options]\n"
+         << "  --binary PATH      cryptovote executable (default ./cryptovote)\n"
+         << "  --votes A,B,...    Ballot counts to sweep (default 10000)\n"
+         << "  --threads A,B,...  Thread counts to sweep (default 1)\n"
+         << "  --key-sizes A,...  Paillier key sizes to sweep (default 1024)\n"
+         << "  --candidates N     Candidates per election (default 4)\n"
+         << "  --sample N         Ballots decrypted and checked per run (default 100)\n"
+         << "  --repeat N         Runs per configuration per pass (default 1)\n"
+         << "  --soak SECONDS     Repeat the sweep until SECONDS have passed\n"
+         << "  --seed S           Seed of the first run (default 1)\n"
+         << "  --out FILE         Append NDJSON results to FILE (default stdout)\n";
+}
+
+// Runs cryptovote with the given arguments, its report going to a temporary file.
+RunResult runChild(const string& binary, vector<string> args) {
+    char reportPath[] = "/tmp/cryptovote-load-XXXXXX";
+    int fd = mkstemp(reportPath);
+    if (fd < 0) {
+        throw runtime_error(string("Cannot create a report file: ") + strerror(errno));
+    }
+    close(fd);
+    args.push_back("--output");
+    args.push_back(reportPath);
+
+    vector<char*> argv;
+    argv.push_back(const_cast<char*>(binary.c_str()));
+    for (string& a : args) {
+        argv.push_back(&a[0]);
+    }
+    argv.push_back(nullptr);
+
+    RunResult result;
+    pid_t pid = fork();
+    if (pid < 0) {
+        unlink(reportPath);
+        throw runtime_error(string("fork failed: ") + strerror(errno));
+    }
+    if (pid == 0) {
+        execv(binary.c_str(), argv.data());
+        perror(binary.c_str());
+        _exit(127);
+    }
+    int status = 0;
+    memset(&result.usage, 0, sizeof(result.usage));
+    wait4(pid, &status, 0, &result.usage);
+    result.exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+
+    ifstream in(reportPath);
+    stringstream text;
+    text << in.rdbuf();
+    result.report = text.str();
+    unlink(reportPath);
+    return result;
+}
+
+// Parses a nested object field of a report ({} if it is missing).
+JsonObject nested(const JsonObject& parent, const string& key) {
+    return parent.has(key) ? parseJsonObject(parent.getString(key)) : JsonObject();
+}
+
+// Copies a field's JSON text into the writer, or null if it is missing.
+void copyField(JsonWriter& w, const JsonObject& from, const string& key, const string& as) {
+    w.key(as);
+    if (from.has(key)) {
+        w.rawValue(from.getString(key));
+    } else {
+        w.rawValue("null");
+    }
+}
+
+// Milliseconds of CPU time in a rusage.
+double cpuMs(const struct rusage& usage) {
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    MAIN
+###########################################################################
+*/
+
+int main(int argc, char* argv[]) {
+    HarnessOptions options;
+    try {
+        options = parseOptions(argc, argv);
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        printUsage();
+        return 1;
+    }
+
+    ofstream file;
+    if (!options.outPath.empty()) {
+        file.open(options.outPath, ios::app);
+        if (!file) {
+            cerr << "Cannot open " << options.outPath << endl;
+            return 1;
+        }
+    }
+    ostream& out = options.outPath.empty() ? cout : file;
+
+    // Latencies reported per run, from the child's metric histograms
+    const char* const operations[] = {"aes_encrypt", "paillier_encrypt", "add_votes", "paillier_decrypt"};
+
+    auto harnessStart = chrono::steady_clock::now();
+    int run = 0;
+    int failures = 0;
+    for (int pass = 0;; pass++) {
+        for (long long keySize : options.keySizes) {
+            for (long long votes : options.votes) {
+                for (long long threads : options.threads) {
+                    for (int r = 0; r < options.repeat; r++, run++) {
+                        vector<string> args = {"--batch",
+                                               "--candidates", to_string(options.candidates),
+                                               "--voters", to_string(votes),
+                                               "--votes", to_string(votes),
+                                               "--key-size", to_string(keySize),
+                                               "--threads", to_string(threads),
+                                               "--seed", to_string(options.seed + run),
+                                               "--decrypt-sample", to_string(options.sample)};
+                        args.insert(args.end(), options.extraArgs.begin(), options.extraArgs.end());
+                        RunResult result = runChild(options.binary, args);
+
+                        JsonObject report;
+                        try {
+                            report = parseJsonObject(result.report);
+                        } catch (const exception&) {
+                            // No report (crash or exec failure): the line still records the run
+                        }
+                        bool verified = report.getBool("verified");
+                        failures += verified && result.exitCode == 0 ? 0 : 1;
+
+                        JsonWriter w;
+                        w.beginObject();
+                        w.field("pass", pass);
+                        w.field("run", run);
+                        w.field("votes", votes);
+                        w.field("threads", threads);
+                        w.field("keySize", keySize);
+                        w.field("exitCode", result.exitCode);
+                        w.field("verified", verified);
+                        if (report.has("error")) {
+                            w.field("error", report.getString("error"));
+                        }
+                        copyField(w, report, "totalMs", "totalMs");
+                        copyField(w, report, "ballotsPerSec", "ballotsPerSec");
+                        w.field("peakRssKb", static_cast<long long>(result.usage.ru_maxrss));
+                        w.field("cpuMs", cpuMs(result.usage));
+
+                        JsonObject metrics = nested(report, "metrics");
+                        w.key("latencyUs").beginObject();
+                        for (const char* op : operations) {
+                            JsonObject m = nested(metrics, op);
+                            w.key(op).beginObject();
+                            copyField(w, m, "p50Us", "p50");
+                            copyField(w, m, "p95Us", "p95");
+                            copyField(w, m, "p99Us", "p99");
+                            w.endObject();
+                        }
+                        w.endObject();
+                        copyField(w, report, "sampleDecrypt", "sampleDecrypt");
+                        JsonObject arena = nested(report, "gmpArena");
+                        if (arena.has("systemAllocs")) {
+                            w.field("gmpSystemAllocs", arena.getInt("systemAllocs"));
+                            w.field("gmpSystemFrees", arena.getInt("systemFrees"));
+                        }
+                        w.endObject();
+                        out << w.str() << endl;
+
+                        fprintf(stderr, "run %d: %lld votes, %lld threads, %lld-bit: %s, %s ballots/s, %ld MiB peak\n",
+                                run, votes, threads, keySize, verified ? "verified" : "FAILED",
+                                report.getString("ballotsPerSec", "?").c_str(), result.usage.ru_maxrss / 1024);
+                    }
+                }
+            }
+        }
+        double elapsed = chrono::duration<double>(chrono::steady_clock::now() - harnessStart).count();
+        if (elapsed >= options.soakSeconds) {
+            break;
+        }
+    }
+    return failures == 0 ? 0 : 2;
+}
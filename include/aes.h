@@ -8,6 +8,14 @@
 
 using namespace std;
 using Byte = unsigned char;
+using Block = array<Byte, 16>;
+
+/**
+ * @brief Expands a 256-bit key into the 15 AES-256 round keys.
+ * @param key The 32-byte (256-bit) AES key.
+ * @return A vector of 15 16-byte round keys.
+ */
+vector<Block> expandKey(const array<Byte, 32>& key);
 
 /**
  * @brief Encrypts plaintext using AES-256 CBC with zero padding.
@@ -0,0 +1,187 @@
+#ifndef AUDIT_H
+#define AUDIT_H
+
+#include "election.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <gmpxx.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Hashes a big integer by its limbs, for maps keyed on plaintext weights.
+ */
+struct MpzHash {
+    size_t operator()(const mpz_class& value) const;
+};
+
+/**
+ * @brief Audit cache counters.
+ *
+ * @param entries Decrypted ballots currently cached.
+ * @param capacity Most ballots the cache holds.
+ * @param hits Lookups answered from the cache.
+ * @param misses Lookups that decrypted the ballot.
+ * @param evictions Least recently used entries dropped to make room.
+ */
+struct AuditStats {
+    size_t entries = 0;
+    size_t capacity = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+};
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Maps each candidate weight (M^i from calcWeights) back to its candidate index.
+ */
+class WeightIndex {
+public:
+    /**
+     * @brief Rebuilds the map from an election's weights.
+     * @param weights The weights, indexed by candidate.
+     */
+    void assign(const vector<mpz_class>& weights);
+
+    /**
+     * @brief Returns the candidate whose weight this is, or -1 if it is not a weight.
+     * @param weight A decrypted vote weight.
+     */
+    int candidate(const mpz_class& weight) const;
+
+    size_t size() const { return candidates.size(); }
+
+private:
+    unordered_map<mpz_class, int, MpzHash> candidates;
+};
+
+/**
+ * @brief A bounded LRU cache of decrypted ballots keyed by ballot index.
+ * @details Split into shards, each with its own lock, list and map, so
+ *          threads auditing different ballots rarely contend; each shard
+ *          evicts its own least recently used entry. Thread-safe.
+ */
+class AuditCache {
+public:
+    /**
+     * @brief Creates an empty cache.
+     * @param capacity Total entries across all shards (at least one per shard).
+     * @param shards Number of independently locked shards (at least 1).
+     */
+    explicit AuditCache(size_t capacity = 4096, size_t shards = 16);
+
+    /**
+     * @brief Looks up a ballot and marks it most recently used.
+     * @param index The ballot index.
+     * @param ballot Receives the cached result on a hit.
+     * @return True on a hit.
+     */
+    bool get(size_t index, DecryptedBallot& ballot);
+
+    /**
+     * @brief Caches a decrypted ballot, evicting the shard's oldest entry when full.
+     * @param index The ballot index.
+     * @param ballot The decrypted ballot.
+     */
+    void put(size_t index, const DecryptedBallot& ballot);
+
+    /**
+     * @brief Drops every entry (the counters are kept).
+     */
+    void clear();
+
+    AuditStats stats() const;
+
+private:
+    struct Shard {
+        mutable mutex lock;
+        list<pair<size_t, DecryptedBallot>> entries; // Most recently used first
+        unordered_map<size_t, list<pair<size_t, DecryptedBallot>>::iterator> slots;
+    };
+
+    // Picks the shard of a ballot index.
+    Shard& shardFor(size_t index);
+
+    vector<unique_ptr<Shard>> shards;
+    size_t shardCapacity;
+    atomic<uint64_t> hits{0};
+    atomic<uint64_t> misses{0};
+    atomic<uint64_t> evictions{0};
+};
+
+/**
+ * @brief Decrypts ballots for audits, resolving their candidates and caching the results.
+ * @details A cast ballot never changes, so its decryption can be reused
+ *          until the election is replaced: call reset() after a setup or a
+ *          load. A service that finds itself used with other keys resets
+ *          itself. Thread-safe for concurrent audits of one election.
+ */
+class AuditService {
+public:
+    /**
+     * @param capacity Decrypted ballots to keep.
+     * @param shards Cache shards.
+     */
+    explicit AuditService(size_t capacity = 4096, size_t shards = 16);
+
+    /**
+     * @brief Forgets all cached ballots and rebuilds the weight map for an election.
+     * @param election The election to audit from now on.
+     */
+    void reset(const Election& election);
+
+    /**
+     * @brief Returns the decrypted PII, weight and candidate of one ballot.
+     * @param election The election holding the ballot.
+     * @param index The ballot index.
+     * @param cached If non-null, set to whether the result came from the cache.
+     * @return The decrypted ballot (candidate -1 if the weight is not a candidate's).
+     * @throws std::out_of_range if the index does not refer to a ballot.
+     */
+    DecryptedBallot audit(const Election& election, size_t index, bool* cached = nullptr);
+
+    /**
+     * @brief Audits several ballots, decrypting each missing one once, in parallel.
+     * @details Repeated indices and ones already cached cost a lookup; the
+     *          rest are split across the worker threads.
+     * @param election The election holding the ballots.
+     * @param indices Ballot indices, in any order and possibly repeated.
+     * @param threads Worker threads for the decryptions (>= 1).
+     * @return The decrypted ballots, in the order of 'indices'.
+     * @throws std::out_of_range if an index does not refer to a ballot.
+     */
+    vector<DecryptedBallot> auditMany(const Election& election, const vector<size_t>& indices, int threads);
+
+    AuditStats stats() const { return cache.stats(); }
+
+private:
+    // Resets if the election's keys are not the ones the cache was filled under.
+    void follow(const Election& election);
+    // Decrypts one ballot and resolves its candidate.
+    DecryptedBallot decrypt(const Election& election, size_t index) const;
+
+    AuditCache cache;
+    WeightIndex weights;
+    mutex resetLock;
+    mpz_class modulus; // n of the election the cache belongs to
+};
+
+#endif // AUDIT_H
@@ -0,0 +1,222 @@
+#ifndef BALLOT_LOG_H
+#define BALLOT_LOG_H
+
+#include "election.h"
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    FILE FORMAT
+###########################################################################
+
+    All integers are little-endian; big integers are a u32 byte length and
+    their magnitude in big-endian byte order, as in snapshots.
+
+    [header, 40 bytes]
+        char magic[8]       "CVWAL\0\0\0"
+        u32  version        BALLOT_LOG_VERSION
+        u32  byteOrder      0x01020304 as written by the host
+        u64  baseBallots    ballotCount() of the snapshot the log follows
+        u8   election[16]   SHA-256 of the Paillier modulus n and voter key, truncated
+    [records]
+        u32  length         bytes of type + payload
+        u32  crc            CRC-32C of type + payload
+        u8   type           1 = ballot, 2 = revocation
+        ballot:      u64 index, u32 unit path length + path, u8 sealed candidate,
+                     u32 PII length + AES bytes, Paillier ciphertext, 16-byte voter tag
+        revocation:  u32 count, then that many u64 ballot indices
+
+    The candidate is XORed with a byte of HMAC(voterKey, "candidate" || index),
+    so the log alone does not reveal how anyone voted. A record that is cut
+    short or fails its CRC ends the log when it may belong to the last commit
+    group: that group was being written when the process died and was never
+    acknowledged. An intact record beyond the largest group that could hold it
+    proves the bad one was synced, so that is corruption and the log is not
+    opened.
+*/
+
+const uint32_t BALLOT_LOG_VERSION = 1;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Group commit settings.
+ *
+ * @param commitDelayMs How long the writer waits for more records before an
+ *                      fsync; bounds the latency added to an acknowledgement.
+ * @param maxBatchBytes Commit at once when this much is buffered. A commit
+ *                      writes at most this much (or one larger record);
+ *                      reopen a log with the value it was written with.
+ */
+struct BallotLogOptions {
+    double commitDelayMs = 1.0;
+    size_t maxBatchBytes = 1 << 20;
+};
+
+/**
+ * @brief What opening a log found and replayed.
+ *
+ * @param ballots Ballot records applied to the election.
+ * @param revocations Ballots revoked by replayed revocation records.
+ * @param skipped Records already contained in the snapshot.
+ * @param tornBytes Bytes of an incomplete or corrupt tail that were cut off.
+ * @param stale True if the log belonged to another election and was set aside.
+ */
+struct BallotLogRecovery {
+    size_t ballots = 0;
+    size_t revocations = 0;
+    size_t skipped = 0;
+    size_t tornBytes = 0;
+    bool stale = false;
+};
+
+/**
+ * @brief Counters since the log was opened.
+ *
+ * @param records Records appended.
+ * @param commits fsyncs issued; records / commits is the mean group size.
+ * @param bytes Bytes written.
+ */
+struct BallotLogStats {
+    uint64_t records = 0;
+    uint64_t commits = 0;
+    uint64_t bytes = 0;
+};
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Append-only write-ahead log of the ballots cast since the last snapshot.
+ * @details Appends only copy a framed record into a memory buffer and return a
+ *          sequence number. A writer thread drains the buffer in groups of
+ *          up to maxBatchBytes, each with a single write() and fdatasync(),
+ *          so every ballot that arrived while the previous fsync was running,
+ *          or within commitDelayMs, shares one disk flush. Callers acknowledge a ballot once waitDurable() returns
+ *          for its sequence number. Thread-safe.
+ */
+class BallotLog {
+public:
+    /**
+     * @brief Opens a log for an election, replaying its records first.
+     * @details Ballots the election's snapshot does not yet hold are appended
+     *          to it and folded into the tally, subtotals, counts and voter
+     *          index; revocations are reapplied. A torn tail is truncated; a bad
+     *          record with intact ones after it is reported, not truncated. A
+     *          log written for other keys is renamed to path + ".stale" and a
+     *          fresh one started. Records are never appended to 'election'
+     *          by the log itself; attach it with election.log afterwards.
+     * @param path The log file (created if missing).
+     * @param election A set-up election, usually just loaded from its snapshot.
+     * @param options Group commit settings.
+     * @throws std::runtime_error on I/O errors, corruption inside the log, or a
+     *         log that does not follow the snapshot.
+     */
+    BallotLog(const string& path, Election& election, const BallotLogOptions& options = BallotLogOptions());
+
+    /**
+     * @brief Commits anything still buffered and stops the writer thread.
+     */
+    ~BallotLog();
+
+    BallotLog(const BallotLog&) = delete;
+    BallotLog& operator=(const BallotLog&) = delete;
+
+    /**
+     * @brief Buffers a ballot record.
+     * @param election The election the ballot was cast into (for the voter key and unit path).
+     * @param index The ballot's index.
+     * @param ballot The stored ballot.
+     * @param candidate The candidate it was cast for.
+     * @return The record's sequence number.
+     * @throws std::runtime_error if an earlier commit failed.
+     */
+    uint64_t appendBallot(const Election& election, size_t index, const EncryptedBallot& ballot, int candidate);
+
+    /**
+     * @brief Buffers a revocation record.
+     * @param indices The revoked ballots.
+     * @return The record's sequence number.
+     * @throws std::runtime_error if an earlier commit failed.
+     */
+    uint64_t appendRevocation(const vector<size_t>& indices);
+
+    /**
+     * @brief Blocks until every record up to a sequence number is on disk.
+     * @param sequence A value returned by an append, or lastSequence().
+     * @throws std::runtime_error if the write or fsync failed.
+     */
+    void waitDurable(uint64_t sequence);
+
+    /**
+     * @brief Starts an empty log after the election was saved to its snapshot.
+     * @details The new log is written to a temporary file and renamed over the
+     *          old one, so a crash leaves one or the other. Records still
+     *          buffered are dropped (the snapshot holds them) and their
+     *          waiters released.
+     * @param election The election as just saved.
+     * @throws std::runtime_error on I/O errors.
+     */
+    void checkpoint(const Election& election);
+
+    uint64_t lastSequence() const;
+    BallotLogStats stats() const;
+    const BallotLogRecovery& recovery() const { return recovered; }
+
+private:
+    // Frames a record and queues it for the writer; returns its sequence number.
+    uint64_t append(const vector<Byte>& body);
+    // Drains the buffer: one write() and one fdatasync() per group.
+    void writerLoop();
+
+    string path;
+    BallotLogOptions options;
+    BallotLogRecovery recovered;
+    int fd = -1;
+
+    mutable mutex lock;
+    mutex fileLock;                 // Held while a group is written, so checkpoint() never swaps the file under it
+    condition_variable wakeWriter;  // Records arrived, or stopping
+    condition_variable committed;   // durableSequence advanced, or failed
+    vector<Byte> pending;           // Framed records not yet written
+    uint64_t pendingRecords = 0;    // Records in 'pending'
+    uint64_t appendedSequence = 0;  // Last sequence number handed out
+    uint64_t durableSequence = 0;   // Last sequence number on disk
+    string failure;                 // First write/fsync error; the log is unusable after it
+    bool stopping = false;
+    BallotLogStats counters;
+    thread writer;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Computes CRC-32C (Castagnoli), using the SSE4.2 instruction when available.
+ * @param data The bytes.
+ * @param length Number of bytes.
+ * @param crc A previous result to continue from (0 to start).
+ * @return The checksum.
+ */
+uint32_t crc32c(const Byte* data, size_t length, uint32_t crc = 0);
+
+#endif // BALLOT_LOG_H
@@ -0,0 +1,158 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+/**
+ * @brief Escalating wait used while a lock-free queue is full or empty.
+ * @details Spins briefly, then yields, then sleeps, so waiting workers do not
+ *          steal a core from the stage they are waiting on.
+ */
+class Backoff {
+public:
+    void pause() {
+        if (spins < 16) {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        } else if (spins < 64) {
+            this_thread::yield();
+        } else {
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+        spins++;
+    }
+    void reset() { spins = 0; }
+
+private:
+    unsigned spins = 0;
+};
+
+/**
+ * @brief A fixed-capacity, lock-free multi-producer/multi-consumer queue.
+ * @details Bounded ring of sequenced cells (Vyukov's MPMC design); capacity is
+ *          rounded up to a power of two. push() waits while the queue is full,
+ *          which gives backpressure from slow consumers to fast producers. After
+ *          close(), push() fails and pop() drains the remaining items before
+ *          returning false.
+ */
+template <typename T>
+class BoundedQueue {
+public:
+    explicit BoundedQueue(size_t capacity) {
+        size_t cap = 2;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        mask = cap - 1;
+        cells.reset(new Cell[cap]);
+        for (size_t i = 0; i < cap; i++) {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    // Non-blocking push. On success 'item' is moved from.
+    bool tryPush(T& item) {
+        size_t pos = enqueuePos.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    cell.data = std::move(item);
+                    cell.sequence.store(pos + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = enqueuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Non-blocking pop.
+    bool tryPop(T& item) {
+        size_t pos = dequeuePos.load(memory_order_relaxed);
+        while (true) {
+            Cell& cell = cells[pos & mask];
+            size_t seq = cell.sequence.load(memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0) {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, memory_order_relaxed)) {
+                    item = std::move(cell.data);
+                    cell.sequence.store(pos + mask + 1, memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // Empty
+            } else {
+                pos = dequeuePos.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    // Waits while full. Returns false if the queue was closed.
+    bool push(T item) {
+        Backoff backoff;
+        while (!closed.load(memory_order_acquire)) {
+            if (tryPush(item)) {
+                return true;
+            }
+            backoff.pause();
+        }
+        return false;
+    }
+
+    // Waits while empty. Returns false once closed and drained.
+    bool pop(T& item) {
+        Backoff backoff;
+        while (true) {
+            if (tryPop(item)) {
+                return true;
+            }
+            if (closed.load(memory_order_acquire)) {
+                return tryPop(item);
+            }
+            backoff.pause();
+        }
+    }
+
+    // No further items are accepted; waiting consumers drain and stop.
+    void close() { closed.store(true, memory_order_release); }
+
+    // Approximate number of queued items.
+    size_t size() const {
+        size_t in = enqueuePos.load(memory_order_relaxed);
+        size_t out = dequeuePos.load(memory_order_relaxed);
+        return in > out ? in - out : 0;
+    }
+
+    size_t capacity() const { return mask + 1; }
+
+private:
+    struct Cell {
+        atomic<size_t> sequence;
+        T data;
+    };
+
+    unique_ptr<Cell[]> cells;
+    size_t mask = 0;
+    alignas(64) atomic<size_t> enqueuePos{0};
+    alignas(64) atomic<size_t> dequeuePos{0};
+    alignas(64) atomic<bool> closed{false};
+};
+
+#endif // BOUNDED_QUEUE_H
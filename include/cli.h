@@ -0,0 +1,146 @@
+#ifndef CLI_H
+#define CLI_H
+
+#include <string>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Command-line options for all run modes.
+ *
+ * @param mode INTERACTIVE (prompted, default), DAEMON, BATCH, CALIBRATE or HELP.
+ * @param socketPath Unix socket path for daemon mode (empty = stdin/stdout).
+ * @param numCandidates The number of candidates (--candidates).
+ * @param max_voters The maximum expected number of voters, k (--voters).
+ * @param num_votes The number of votes to simulate (--votes).
+ * @param keySize The Paillier modulus size in bits (--key-size).
+ * @param threads Total pipeline worker threads (--threads); with tune and no
+ *                --threads, every hardware thread.
+ * @param aesThreads AES stage workers, 0 = derive from threads (--aes-threads).
+ * @param paillierThreads Paillier stage workers, 0 = derive from threads (--paillier-threads).
+ * @param tallyThreads Tally stage workers, 0 = derive from threads (--tally-threads).
+ * @param batchSize Records per pipeline batch, 0 = 64 or tuned (--batch-size).
+ * @param seed Seed for vote choices and Paillier randomness (--seed).
+ * @param inputPath CSV/NDJSON cast-vote file streamed instead of simulating (--input).
+ * @param inputFormat "auto", "csv" or "ndjson" (--input-format).
+ * @param ballotsOut File receiving encrypted ballots as NDJSON (--ballots-out).
+ * @param queueDepth Batches buffered between pipeline stages, 0 = 64 or tuned (--queue-depth).
+ * @param numa Spread pipeline workers over the NUMA nodes, pinned, with per-node tallies (--numa).
+ * @param bloomFilter Use the Bloom filter pre-check for duplicate voters (--no-bloom clears it).
+ * @param outputPath File for the JSON report, or empty for stdout (--output).
+ * @param format "json" for one report document, "ndjson" for one event per line (--format).
+ * @param snapshotPath Daemon: snapshot restored at startup and saved on exit.
+ *                     Batch: file the finished election is saved to (--snapshot).
+ * @param walPath Daemon: ballot log replayed at startup and fsynced before each reply (--wal).
+ * @param walDelayMs Daemon: how long a group commit waits for more ballots (--wal-delay).
+ * @param tree Simulated reporting units per level, e.g. "3,4,5" (--tree).
+ * @param shuffle Mix the vote ciphertexts after tallying and verify the mix (--shuffle).
+ * @param shufflePrecompute Generate the shuffle's randomizers in a separate stage (--shuffle-precompute).
+ * @param shuffleOut File receiving the mixed ciphertexts, one hex value per line (--shuffle-out).
+ * @param revotes Voters who change their vote after the pipeline finishes (--revotes).
+ * @param decryptSample Ballots decrypted and checked after the tally (--decrypt-sample).
+ * @param progressMs Interval between progress events, 0 = none (--progress).
+ * @param gmpArena Serve GMP allocations from per-thread free lists (--gmp-arena).
+ * @param simd Highest multi-buffer kernel to use: "auto", "avx512", "avx2" or "scalar" (--simd).
+ * @param tune Size the pipeline and pick the SIMD kernel from this host's
+ *             cached profile, calibrating it first if there is none (--tune).
+ * @param tuningPath Profile cache, empty = defaultTuningPath() (--tune-file).
+ * @param metricsOut File receiving hot-path metrics when the run ends (--metrics-out).
+ * @param metricsFormat "auto", "json" or "prometheus" (--metrics-format).
+ */
+struct CliOptions {
+    enum Mode { INTERACTIVE, DAEMON, BATCH, CALIBRATE, HELP };
+
+    Mode mode = INTERACTIVE;
+    string socketPath;
+    int numCandidates = 0;
+    int max_voters = 0;
+    int num_votes = 0;
+    int keySize = 1024;
+    int threads = 1;
+    bool hasThreads = false;
+    int aesThreads = 0;
+    int paillierThreads = 0;
+    int tallyThreads = 0;
+    size_t batchSize = 0;
+    unsigned long seed = 0;
+    bool hasSeed = false;
+    string inputPath;
+    string inputFormat = "auto";
+    string ballotsOut;
+    size_t queueDepth = 0;
+    bool numa = false;
+    bool bloomFilter = true;
+    string outputPath;
+    string format = "json";
+    string snapshotPath;
+    string walPath;
+    int walDelayMs = 1;
+    string tree;
+    bool shuffle = false;
+    bool shufflePrecompute = false;
+    string shuffleOut;
+    size_t revotes = 0;
+    size_t decryptSample = 0;
+    int progressMs = 0;
+    bool gmpArena = false;
+    string simd = "auto";
+    bool tune = false;
+    string tuningPath;
+    string metricsOut;
+    string metricsFormat = "auto";
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Parses argv into CliOptions.
+ * @details No arguments selects the interactive prompt. Any batch flag (or
+ *          --batch) selects the non-interactive batch mode; the metrics flags
+ *          apply to every mode.
+ * @param argc Argument count from main().
+ * @param argv Argument vector from main().
+ * @return The parsed options.
+ * @throws std::invalid_argument on unknown flags or malformed values.
+ */
+CliOptions parseCliOptions(int argc, char* argv[]);
+
+/**
+ * @brief Prints the command-line usage summary to stdout.
+ */
+void printUsage();
+
+/**
+ * @brief Runs one election without prompting and writes a JSON/NDJSON report.
+ * @details Reports the parameters, per-stage timings (milliseconds), decoded
+ *          counts, verification status and per-operation metrics. Human-readable
+ *          progress is suppressed; with progressMs, progress events are written
+ *          instead (into the NDJSON report, or to stderr with a JSON report).
+ *          SIGINT or SIGTERM stops the pipeline at its next batch and the run
+ *          finishes with the ballots tallied so far; a second signal kills it.
+ * @param options The parsed batch options.
+ * @return The process exit code (0 on verified success, 3 if verified but cancelled).
+ */
+int runBatch(const CliOptions& options);
+
+/**
+ * @brief Measures this host at --key-size and stores the profile that --tune runs start from.
+ * @details Always re-measures, replacing any cached profile for this CPU
+ *          model and key size, and writes the profile with the pipeline it
+ *          gives for the thread budget to stdout (or --output) as JSON.
+ * @param options The parsed options (keySize, threads, tuningPath, outputPath).
+ * @return The process exit code (0 on success).
+ */
+int runCalibrate(const CliOptions& options);
+
+#endif // CLI_H
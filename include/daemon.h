@@ -0,0 +1,120 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "audit.h"
+#include "ballot_log.h"
+#include "election.h"
+#include "modmul_simd.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <gmpxx.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Cancellation of the running daemon command.
+ * @details Held through a shared_ptr, so a transport thread that outlives the
+ *          DaemonState (the stdin reader) can still answer "cancel" safely.
+ *
+ * @param busy True while a command holds DaemonState::lock.
+ * @param flag Set by "cancel" while 'busy'; a running "simulate" polls it.
+ *             Cleared when a command takes the lock and again when it
+ *             finishes, so a cancel only stops the command running when it
+ *             arrives: queued and later commands never see it.
+ * @param lock Guards 'busy' and orders setting 'flag' against clearing it.
+ */
+struct CommandCancel {
+    mutex lock;
+    bool busy = false;
+    atomic<bool> flag{false};
+};
+
+/**
+ * @brief State owned by a long-lived daemon process.
+ * @details Keys, ballots and the running tally persist across commands, so a
+ *          decrypt request works on the same election that was simulated.
+ *
+ * @param election The in-memory election.
+ * @param rand_state GMP random state used for all encryptions.
+ * @param snapshotPath Default file for the "save" and "load" commands (may be empty).
+ * @param walPath Ballot log following snapshotPath (empty = no log).
+ * @param walOptions Group commit settings for the ballot log.
+ * @param tuningPath Host profile cache; if set, "simulate" is sized from the
+ *                   profile for the election's key size, measured on first use.
+ * @param simdCap The --simd cap, which the profile's kernel never exceeds.
+ * @param running Cleared by the "shutdown" command.
+ * @param cancel Cancellation of the command holding 'lock'.
+ * @param events Where the running command writes progress lines (set by the transport).
+ * @param audit Decrypted ballots served to "decrypt" and "audit" (reset by setup and load).
+ * @param lock Serializes commands arriving on different connections.
+ */
+struct DaemonState {
+    Election election;
+    gmp_randstate_t rand_state;
+    string snapshotPath;
+    string walPath;
+    BallotLogOptions walOptions;
+    string tuningPath;
+    SimdLevel simdCap = SIMD_AVX512IFMA;
+    atomic<bool> running{true};
+    shared_ptr<CommandCancel> cancel = make_shared<CommandCancel>();
+    function<void(const string&)> events;
+    AuditService audit;
+    mutex lock;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Executes one line-delimited JSON command against the daemon state.
+ * @details Supported "cmd" values: setup, simulate, cast, revoke, find, tally,
+ *          subtotals, decrypt, audit, shuffle, board, proof, status, metrics, save, load, cancel, shutdown. The optional "id" member is
+ *          echoed in the reply. "simulate" with "progress":MS writes progress
+ *          events ({"id":..,"event":"progress",...}) to state.events every MS
+ *          milliseconds; "cancel" stops a running "simulate", which replies
+ *          with the ballots cast so far and "cancelled":true. "simulate" with
+ *          "numa":true places its workers as PipelineConfig::numa describes.
+ * @param state The daemon state (the caller must hold state.lock, except for "cancel").
+ * @param line One JSON object, e.g. {"id":1,"cmd":"decrypt","index":4}.
+ * @return A single-line JSON reply with "ok" and either results or "error".
+ */
+string handleDaemonCommand(DaemonState& state, const string& line);
+
+/**
+ * @brief Runs the daemon until "shutdown" or end of input.
+ * @details Reads commands from stdin and writes replies to stdout, or, when a
+ *          socket path is given, listens on a Unix domain socket and serves
+ *          each connection on its own thread. "cancel" is answered at once on
+ *          stdin or on any connection, without waiting for the running command.
+ *          On "shutdown" the listener wakes idle connections, lets any command
+ *          in progress finish and joins every connection thread before the
+ *          state is saved. With a snapshot path, an existing
+ *          snapshot is mapped at startup and the election is saved back on exit.
+ *          With a ballot log as well, the log is replayed on top of the
+ *          snapshot at startup, and every command's reply waits until the
+ *          ballots and revocations it made are on disk. Setup, load and save
+ *          of the default snapshot start a fresh log.
+ * @param socketPath Path of the Unix socket, or empty to use stdin/stdout.
+ * @param snapshotPath Snapshot file to restore from and save to, or empty.
+ * @param walPath Ballot log file, or empty (requires a snapshot path).
+ * @param walOptions Group commit settings for the ballot log.
+ * @param tuningPath Profile cache that sizes "simulate" pipelines (see tuning.h), or empty.
+ * @return The process exit code.
+ */
+int runDaemon(const string& socketPath, const string& snapshotPath = "", const string& walPath = "",
+              const BallotLogOptions& walOptions = BallotLogOptions(), const string& tuningPath = "");
+
+#endif // DAEMON_H
@@ -0,0 +1,276 @@
+#ifndef ELECTION_H
+#define ELECTION_H
+
+#include "merkle.h"
+#include "paillier.h"
+#include "tally_tree.h"
+#include "voter_index.h"
+#include <array>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include <gmpxx.h>
+
+using namespace std;
+using Byte = unsigned char;
+
+class BallotLog;
+class MappedSnapshot;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief All state belonging to one election, kept together in memory.
+ *
+ * @param numCandidates The number of candidates.
+ * @param max_voters The maximum expected number of voters (k).
+ * @param keySize The Paillier modulus size in bits.
+ * @param paillierKeys Paillier public/private keys for vote weights.
+ * @param aes_key AES-256 key used for all PII in this election.
+ * @param weights Precomputed base-M weights [M^0, ..., M^(numCandidates-1)].
+ * @param voterKey HMAC key for voter tags (separate from the AES key).
+ * @param voters Voter tag -> ballot index, covering the first indexedBallots ballots.
+ * @param indexedBallots Number of ballots already added to 'voters'.
+ * @param snapshot Memory-mapped snapshot holding the first ballots, if one was loaded.
+ * @param allBallots Ballots cast in this process, in cast order, after any snapshot ballots.
+ * @param ballotCandidates Plaintext candidate of each ballot in allBallots, kept
+ *                         (like actualVoteCounts) for verification only, so a
+ *                         revocation can correct the counts without decrypting.
+ * @param revoked Indices of superseded or revoked ballots; they stay stored but no longer count.
+ * @param actualVoteCounts Plaintext counts, kept for verification only.
+ * @param encryptedTally Running product of all ballot ciphertexts mod n^2.
+ * @param tree Encrypted subtotals per reporting unit; its root equals encryptedTally.
+ * @param board Merkle tree over the ballots in cast order (the first board.size() of them).
+ * @param log Write-ahead log that every new ballot and revocation is appended to, if attached.
+ */
+struct Election {
+    int numCandidates = 0;
+    int max_voters = 0;
+    int keySize = 1024;
+    PaillierKeys paillierKeys;
+    array<Byte, 32> aes_key;
+    vector<mpz_class> weights;
+    array<Byte, 32> voterKey;
+    VoterIndex voters;
+    size_t indexedBallots = 0;
+    shared_ptr<const MappedSnapshot> snapshot;
+    vector<EncryptedBallot> allBallots;
+    vector<Byte> ballotCandidates;
+    unordered_set<size_t> revoked;
+    vector<int> actualVoteCounts;
+    mpz_class encryptedTally = 1;
+    TallyTree tree;
+    MerkleTree board;
+    shared_ptr<BallotLog> log;
+};
+
+/**
+ * @brief One cast-vote record before encryption.
+ *
+ * @param pii The voter's PII ("FirstName LastName").
+ * @param candidate The chosen candidate index.
+ * @param precinct Reporting unit path such as "north/cook/precinct-17" ("" = none).
+ */
+struct CastVoteRecord {
+    string pii;
+    int candidate;
+    string precinct;
+};
+
+/**
+ * @brief The decrypted contents of a single ballot.
+ *
+ * @param pii The voter's decrypted PII.
+ * @param weight The decrypted vote weight (M^i).
+ * @param candidate The candidate index i, or -1 if the weight is not a known M^i.
+ */
+struct DecryptedBallot {
+    string pii;
+    mpz_class weight;
+    int candidate;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Generates keys and weights for a fresh election, discarding any old state.
+ * @param election The election to (re)initialize.
+ * @param numCandidates The number of candidates (1 to 50).
+ * @param max_voters The maximum expected number of voters (k).
+ * @param keySize The Paillier modulus size in bits.
+ * @param rand_state An initialized GMP random state object.
+ * @param verbose If true, prints progress to stdout like the interactive flow.
+ * @throws std::invalid_argument if the parameters are out of range; 'election'
+ *         is then left as it was.
+ */
+void setupElection(Election& election, int numCandidates, int max_voters, int keySize,
+                   gmp_randstate_t& rand_state, bool verbose = true);
+
+/**
+ * @brief Counts the ballots in an election, including those in a loaded snapshot.
+ * @param election The election.
+ * @return The total number of ballots.
+ */
+size_t ballotCount(const Election& election);
+
+/**
+ * @brief Counts the ballots that still count towards the tally (stored minus revoked).
+ * @param election The election.
+ * @return The number of live ballots.
+ */
+size_t liveBallotCount(const Election& election);
+
+/**
+ * @brief Returns one ballot, reading it from the snapshot mapping if needed.
+ * @param election The election holding the ballot.
+ * @param index The ballot index (0 to ballotCount()-1).
+ * @return A copy of the ballot.
+ * @throws std::out_of_range if the index does not refer to a ballot.
+ */
+EncryptedBallot ballotAt(const Election& election, size_t index);
+
+/**
+ * @brief Returns the candidate a ballot was cast for, as kept for the verification counts.
+ * @param election The election holding the ballot.
+ * @param index The ballot index (0 to ballotCount()-1).
+ * @return The candidate index, or -1 for a ballot restored from a snapshot before version 5.
+ * @throws std::out_of_range if the index does not refer to a ballot.
+ */
+int ballotCandidate(const Election& election, size_t index);
+
+/**
+ * @brief Computes the tag of a voter in this election.
+ * @param election A set-up election.
+ * @param pii The voter's PII (normalized before hashing).
+ * @return The voter's tag.
+ */
+VoterTag voterTagFor(const Election& election, const string& pii);
+
+/**
+ * @brief Adds any ballots not yet indexed (e.g. after a snapshot load) to the voter index.
+ * @param election The election whose index is brought up to date.
+ */
+void syncVoterIndex(Election& election);
+
+/**
+ * @brief Hashes any ballots not yet on the bulletin board (e.g. after a snapshot load) and appends them.
+ * @details Leaves are hashed in parallel batches, then appended in order.
+ * @param election The election whose board is brought up to date.
+ * @param threads Worker threads for hashing (>= 1).
+ */
+void syncBoard(Election& election, int threads);
+
+/**
+ * @brief Finds the ballot cast by a voter, without decrypting any PII.
+ * @param election The election to search.
+ * @param pii The voter's PII.
+ * @param index Receives the ballot index when found.
+ * @return True if the voter has cast a ballot.
+ */
+bool findVoter(Election& election, const string& pii, size_t& index);
+
+/**
+ * @brief Encrypts one ballot, stores it and folds it into the running tally.
+ * @details The ballot is also appended to the bulletin board when the board is up to date.
+ * @param election The election to cast into.
+ * @param pii The voter's PII ("FirstName LastName").
+ * @param candidateIndex The chosen candidate (0 to numCandidates-1).
+ * @param rand_state An initialized GMP random state object.
+ * @param precinct Reporting unit path whose subtotals the ballot is added to ("" = total only).
+ * @return The index of the stored ballot.
+ * @throws std::invalid_argument if the candidate is out of range, the election
+ *         is full, or the voter already has a ballot that has not been revoked.
+ */
+size_t castBallot(Election& election, const string& pii, int candidateIndex,
+                  gmp_randstate_t& rand_state, const string& precinct = "");
+
+/**
+ * @brief Casts a ballot that supersedes the voter's previous one, if any (last ballot counts).
+ * @details The old ballot is revoked (see revokeBallots) and the new one cast
+ *          in the same reporting unit unless another is given. O(depth) work,
+ *          independent of the number of ballots. The new ballot is validated
+ *          and encrypted before the old one is revoked, so on an error neither
+ *          changes.
+ * @param election The election to cast into.
+ * @param pii The voter's PII.
+ * @param candidateIndex The new choice (0 to numCandidates-1).
+ * @param rand_state An initialized GMP random state object.
+ * @param precinct Reporting unit path, or "" to keep the previous ballot's unit.
+ * @param replaced Receives the superseded ballot's index, or stays unchanged if there was none.
+ * @return The index of the new ballot.
+ * @throws std::invalid_argument if the candidate is out of range or the election is full.
+ */
+size_t replaceBallot(Election& election, const string& pii, int candidateIndex, gmp_randstate_t& rand_state,
+                     const string& precinct = "", size_t* replaced = nullptr);
+
+/**
+ * @brief Removes ballots from the running tally and their reporting units' subtotals.
+ * @details The ciphertexts are multiplied together per reporting unit, the
+ *          per-unit products are inverted mod n^2 in one batch (Montgomery's
+ *          trick, a single modular inversion), and each inverse is multiplied
+ *          into its unit's subtotals and the tally. Work is proportional to the
+ *          number of revoked ballots, not the size of the election. Revoked
+ *          voters may cast again. The plaintext verification counts are
+ *          corrected from ballotCandidate(), without decrypting anything.
+ * @param election The election.
+ * @param indices Ballots to revoke; each must exist and not already be revoked.
+ * @throws std::invalid_argument on an unknown, repeated or already revoked index.
+ */
+void revokeBallots(Election& election, const vector<size_t>& indices);
+
+/**
+ * @brief Rebuilds the running tally from every stored ballot.
+ * @details Each worker multiplies a slice of ciphertexts mod n^2; the partial
+ *          products are then combined. Revoked ballots are skipped; the tally
+ *          tree is left as is.
+ * @param election The election whose encryptedTally is recomputed.
+ * @param threads Number of worker threads (>= 1).
+ */
+void recomputeTally(Election& election, int threads);
+
+/**
+ * @brief Decrypts the running tally and decodes it into per-candidate counts.
+ * @param election The election to tally.
+ * @param decryptedTally Receives the decrypted base-M sum.
+ * @return The decoded vote count for each candidate.
+ */
+vector<long> tallyElection(const Election& election, mpz_class& decryptedTally);
+
+/**
+ * @brief Decrypts and decodes the subtotals of several reporting units in one batch.
+ * @param election The election to report on.
+ * @param nodes Tally tree node indices.
+ * @param threads Worker threads for the decryptions (>= 1).
+ * @return The decoded per-candidate counts of each node, in the order of 'nodes'.
+ */
+vector<vector<long>> tallySubtotals(const Election& election, const vector<size_t>& nodes, int threads);
+
+/**
+ * @brief Decrypts the PII and vote weight of one stored ballot.
+ * @param election The election holding the ballot.
+ * @param index The ballot index (0 to ballotCount()-1).
+ * @return The decrypted ballot.
+ * @throws std::out_of_range if the index does not refer to a ballot.
+ */
+DecryptedBallot decryptBallotAt(const Election& election, size_t index);
+
+/**
+ * @brief Serializes one ballot as a single-line JSON object.
+ * @details Fields: "index", "voter" (hex voter tag), "pii" (hex IV + ciphertext)
+ *          and "weight" (hex Paillier ciphertext).
+ * @param index The ballot's position in the input.
+ * @param ballot The ballot to serialize.
+ * @return The JSON text without a trailing newline.
+ */
+string ballotToJson(size_t index, const EncryptedBallot& ballot);
+
+#endif // ELECTION_H
@@ -0,0 +1,55 @@
+#ifndef GMP_ARENA_H
+#define GMP_ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Counters for the GMP arena allocator.
+ *
+ * @param installed True once installGmpArena() has run.
+ * @param systemAllocs Blocks taken from malloc (free-list misses and oversize blocks).
+ * @param systemFrees Blocks handed back to free (oversize blocks, or a full shared list).
+ */
+struct GmpArenaStats {
+    bool installed = false;
+    uint64_t systemAllocs = 0;
+    uint64_t systemFrees = 0;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Routes GMP's limb allocations through per-thread size-class free lists.
+ * @details Blocks are rounded up to a power of two (32 B to 64 KiB) and a
+ *          freed block goes on the freeing thread's list for its class, so once
+ *          a thread has warmed up, mpz growth and temporaries are served without
+ *          calling malloc. Lists that grow too long hand chains of blocks to a
+ *          shared list under a per-class lock, where threads that run dry pick
+ *          them up: ciphertexts allocated by the Paillier stage and freed by the
+ *          tally stage circulate instead of going back to the system. Exiting
+ *          threads hand their lists over too. Blocks over 64 KiB bypass the
+ *          lists. Must be called before any other GMP function, as GMP
+ *          requires for mp_set_memory_functions.
+ */
+void installGmpArena();
+
+/**
+ * @brief Reads the arena's counters.
+ * @return The counters (all zero, installed = false, if the arena is not in use).
+ */
+GmpArenaStats gmpArenaStats();
+
+#endif // GMP_ARENA_H
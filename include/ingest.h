@@ -0,0 +1,105 @@
+#ifndef INGEST_H
+#define INGEST_H
+
+#include "election.h"
+#include "pipeline.h"
+#include <cstddef>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    CLASS / STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Streams cast-vote records from a CSV or NDJSON file in fixed-size chunks.
+ * @details Reads the file through one reusable buffer of 'chunkBytes', so memory
+ *          use does not depend on file size. CSV rows are "pii,candidate" or
+ *          "pii,candidate,precinct" (fields are split at the last commas, and a
+ *          non-numeric last field is taken as the precinct path; a row that
+ *          fits neither form on line 1 is a header). NDJSON rows are
+ *          {"pii":"...","candidate":N} with an optional "precinct". Use "-" for stdin.
+ */
+class RecordReader {
+public:
+    RecordReader(const string& path, const string& format = "auto", size_t chunkBytes = 1 << 20);
+    ~RecordReader();
+
+    RecordReader(const RecordReader&) = delete;
+    RecordReader& operator=(const RecordReader&) = delete;
+
+    /**
+     * @brief Reads the next record.
+     * @param record Receives the parsed record.
+     * @return False at end of file.
+     * @throws std::invalid_argument on a malformed row (message includes path:line).
+     */
+    bool next(CastVoteRecord& record);
+
+    size_t bytesRead() const { return totalBytes; }
+    size_t bytesParsed() const { return totalBytes - (end - begin); } // Bytes of the records returned so far
+    size_t lineNumber() const { return lineNo; }
+
+private:
+    bool nextLine(string& line);
+    bool fill();
+
+    string path;
+    bool ndjson;
+    int fd;
+    vector<char> buffer;
+    size_t begin = 0;
+    size_t end = 0;
+    bool eof = false;
+    size_t totalBytes = 0;
+    size_t lineNo = 0;
+};
+
+/**
+ * @brief Counters collected during a streaming ingest run.
+ *
+ * @param bytes Number of input bytes read.
+ * @param pipeline Record count, timings and per-stage statistics.
+ */
+struct IngestStats {
+    size_t bytes = 0;
+    PipelineStats pipeline;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Adapts a RecordReader into a pipeline RecordSource.
+ * @param reader The reader; it must outlive the returned source.
+ * @return The record source.
+ */
+RecordSource readerSource(RecordReader& reader);
+
+/**
+ * @brief Streams records from a file through the encryption pipeline into the running tally.
+ * @details Records are read in chunks and flow through the bounded queues of
+ *          runPipeline(), so memory is bounded by the queue depths and batch
+ *          size, not by the file size. Ballots are only retained if the config
+ *          asks for keepBallots or ballotsOut.
+ * @param election A set-up election; its tally and actual counts are updated.
+ * @param inputPath CSV/NDJSON file of cast-vote records ("-" for stdin).
+ * @param format "csv", "ndjson" or "auto" (by file extension).
+ * @param config Pipeline sizing and ballot retention options. With a progress
+ *               callback and no expectedRecords, the total of each report is
+ *               estimated from the share of the file parsed so far.
+ * @return Bytes read and pipeline statistics.
+ * @throws std::invalid_argument on malformed input or too many records.
+ * @throws std::runtime_error on I/O errors.
+ */
+IngestStats ingestFile(Election& election, const string& inputPath, const string& format,
+                       const PipelineConfig& config);
+
+#endif // INGEST_H
@@ -0,0 +1,96 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <stdexcept>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief A flat JSON object parsed from one line of input.
+ * @details Scalar values are stored as text (strings are unescaped). Nested
+ *          objects and arrays are kept as their raw, unparsed JSON text.
+ *          Members whose value is null are left out, so they read as absent.
+ *
+ * @param fields Map from member name to its textual value.
+ */
+struct JsonObject {
+    map<string, string> fields;
+
+    bool has(const string& key) const;
+    string getString(const string& key, const string& fallback = "") const;
+    long long getInt(const string& key, long long fallback = 0) const;
+    bool getBool(const string& key, bool fallback = false) const;
+};
+
+/**
+ * @brief Incrementally builds a compact, single-line JSON document.
+ * @details Tracks nesting so commas are inserted automatically. Call key()
+ *          before each value inside an object.
+ */
+class JsonWriter {
+public:
+    JsonWriter& beginObject();
+    JsonWriter& endObject();
+    JsonWriter& beginArray();
+    JsonWriter& endArray();
+    JsonWriter& key(const string& name);
+    JsonWriter& value(const string& v);
+    JsonWriter& value(const char* v);
+    JsonWriter& value(long long v);
+    JsonWriter& value(int v) { return value(static_cast<long long>(v)); }
+    JsonWriter& value(long v) { return value(static_cast<long long>(v)); }
+    JsonWriter& value(unsigned long v) { return value(static_cast<long long>(v)); }
+    JsonWriter& value(unsigned long long v) { return value(static_cast<long long>(v)); }
+    JsonWriter& value(double v);
+    JsonWriter& value(bool v);
+    JsonWriter& rawValue(const string& json);
+
+    // Shorthand for key(name).value(v).
+    template <typename T>
+    JsonWriter& field(const string& name, const T& v) {
+        key(name);
+        return value(v);
+    }
+
+    string str() const { return out.str(); }
+
+private:
+    void separate();
+
+    ostringstream out;
+    vector<bool> firstInScope;
+    bool afterKey = false;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Parses a single JSON object such as {"cmd":"tally","id":3}.
+ * @param text The JSON text (one object, surrounding whitespace allowed).
+ * @return The parsed JsonObject.
+ * @throws std::invalid_argument if the text is not a well-formed JSON object.
+ */
+JsonObject parseJsonObject(const string& text);
+
+/**
+ * @brief Escapes a string for inclusion in a JSON document (without quotes).
+ * @param s The raw string.
+ * @return The escaped string.
+ */
+string jsonEscape(const string& s);
+
+#endif // JSON_H
@@ -0,0 +1,129 @@
+#ifndef MERKLE_H
+#define MERKLE_H
+
+#include "paillier.h"
+#include "sha256.h"
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Append-only Merkle tree over ballots (the bulletin board).
+ * @details Hashes follow RFC 6962 (Certificate Transparency): a leaf is
+ *          SHA-256(0x00 || ballot bytes), an inner node SHA-256(0x01 || left ||
+ *          right), and a tree of n leaves splits at the largest power of two
+ *          below n. Level k keeps the hash of every complete, aligned run of
+ *          2^k leaves, so an append hashes at most log2(n) new nodes (one on
+ *          average) and the root folds the O(log n) complete subtrees on the
+ *          right edge. Nothing is ever rehashed. Not thread-safe: callers
+ *          serialize access.
+ */
+class MerkleTree {
+public:
+    size_t size() const { return levels.empty() ? 0 : levels[0].size(); }
+
+    /**
+     * @brief Adds a leaf hash (see hashBallotLeaf) and completes the subtrees it closes.
+     * @param leaf The leaf hash.
+     */
+    void append(const Digest& leaf);
+
+    /**
+     * @brief Returns the root hash; SHA-256 of the empty string for an empty tree.
+     */
+    Digest root() const;
+
+    /**
+     * @brief Returns one leaf hash.
+     * @param index The leaf index (0 to size()-1).
+     * @throws std::out_of_range if the index is out of range.
+     */
+    const Digest& leaf(size_t index) const;
+
+    /**
+     * @brief Builds the audit path proving a leaf is in the current tree.
+     * @details O(log n) hashes from the stored levels, deepest sibling first,
+     *          as verifyInclusion() expects.
+     * @param index The leaf index (0 to size()-1).
+     * @return The sibling hashes from the leaf up to the root.
+     * @throws std::out_of_range if the index is out of range.
+     */
+    vector<Digest> inclusionProof(size_t index) const;
+
+private:
+    // Hash of leaves [begin, end); 'begin' is a multiple of the largest power of two below the range size.
+    Digest rangeHash(size_t begin, size_t end) const;
+    // Appends the audit path of leaf m within the subtree of leaves [begin, end).
+    void auditPath(size_t m, size_t begin, size_t end, vector<Digest>& path) const;
+
+    vector<vector<Digest>> levels; // levels[k][i] = hash of leaves [i * 2^k, (i + 1) * 2^k)
+};
+
+/**
+ * @brief The right edge of a MerkleTree: enough to append leaves and compute the root.
+ * @details Keeps only the O(log n) complete subtrees on the right edge, so a
+ *          stream of any length is committed to in constant memory. Gives the
+ *          same root as a MerkleTree over the same leaves, but no proofs. Not
+ *          thread-safe.
+ */
+class MerkleFrontier {
+public:
+    size_t size() const { return count; }
+
+    /**
+     * @brief Adds a leaf hash, merging the right-edge subtrees it completes.
+     * @param leaf The leaf hash.
+     */
+    void append(const Digest& leaf);
+
+    /**
+     * @brief Returns the root hash; SHA-256 of the empty string for an empty tree.
+     */
+    Digest root() const;
+
+private:
+    size_t count = 0;
+    vector<Digest> peaks; // peaks[k] = hash of the subtree of 2^k leaves, if bit k of count is set
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Hashes a ballot as a Merkle leaf.
+ * @details The ballot bytes are the big-endian u32 length and bytes of the
+ *          encrypted PII (IV + ciphertext), then the big-endian u32 length and
+ *          bytes of the Paillier ciphertext, so anyone holding the published
+ *          ballot can recompute its leaf on any host.
+ * @param ballot The ballot.
+ * @return SHA-256(0x00 || ballot bytes).
+ */
+Digest hashBallotLeaf(const EncryptedBallot& ballot);
+
+/**
+ * @brief Hashes two child nodes into their parent: SHA-256(0x01 || left || right).
+ */
+Digest hashMerkleNode(const Digest& left, const Digest& right);
+
+/**
+ * @brief Checks an audit path from inclusionProof() against a root (RFC 9162, 2.1.3.2).
+ * @param leaf The leaf hash of the ballot being checked.
+ * @param index The ballot's leaf index.
+ * @param size The number of leaves in the tree the root belongs to.
+ * @param path The audit path.
+ * @param root The published root.
+ * @return True if the path leads from the leaf to the root.
+ */
+bool verifyInclusion(const Digest& leaf, size_t index, size_t size, const vector<Digest>& path, const Digest& root);
+
+#endif // MERKLE_H
@@ -0,0 +1,141 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief The instrumented hot-path operations.
+ */
+enum Metric {
+    METRIC_KEYGEN,
+    METRIC_AES_ENCRYPT,
+    METRIC_AES_DECRYPT,
+    METRIC_PAILLIER_ENCRYPT,
+    METRIC_ADD_VOTES,
+    METRIC_PAILLIER_DECRYPT,
+    METRIC_DECODE,
+    METRIC_ENC_ZERO,
+    METRIC_SCALE_VOTE,
+    METRIC_WEIGHTED_TALLY,
+    METRIC_BATCH_INVERT,
+    METRIC_WAL_COMMIT,
+    METRIC_COUNT
+};
+
+/**
+ * @brief Number of latency histogram buckets per metric.
+ * @details Bucket i counts calls taking at most 2^i microseconds; the last
+ *          bucket is unbounded (+Inf).
+ */
+const int METRIC_BUCKETS = 24;
+
+/**
+ * @brief Totals for one operation, summed over all threads.
+ *
+ * @param name Operation name, e.g. "paillier_encrypt".
+ * @param count Number of calls.
+ * @param totalNs Time spent in those calls (nanoseconds).
+ * @param bytes Bytes processed (plaintext for AES encryption, input for the rest).
+ * @param buckets Non-cumulative latency histogram, METRIC_BUCKETS entries.
+ */
+struct MetricSnapshot {
+    string name;
+    uint64_t count = 0;
+    uint64_t totalNs = 0;
+    uint64_t bytes = 0;
+    vector<uint64_t> buckets;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Records one call of an operation, or a batch of calls timed together.
+ * @details Updates counters owned by the calling thread only, so the hot path
+ *          never contends on a shared cache line or lock. A batch counts as
+ *          'calls' calls of the mean duration in the histogram, for operations
+ *          too short to time one by one.
+ * @param metric The operation.
+ * @param ns Duration of the call(s) in nanoseconds.
+ * @param bytes Bytes processed by the call(s).
+ * @param calls Number of calls timed (>= 1).
+ */
+void recordMetric(Metric metric, uint64_t ns, size_t bytes, uint64_t calls = 1);
+
+/**
+ * @brief Sums the counters of all live and exited threads.
+ * @return One snapshot per Metric, in enum order.
+ */
+vector<MetricSnapshot> snapshotMetrics();
+
+/**
+ * @brief Renders the current metrics as a JSON object.
+ * @details Per operation: count, totalMs, bytes, meanUs, p50Us, p95Us, p99Us and the
+ *          non-zero histogram buckets as {"leUs":..,"count":..}.
+ * @return The JSON text.
+ */
+string metricsToJson();
+
+/**
+ * @brief Renders the current metrics in the Prometheus text exposition format.
+ * @return Histogram "cryptovote_op_duration_seconds" and counters
+ *         "cryptovote_op_bytes_total", both labelled by op.
+ */
+string metricsToPrometheus();
+
+/**
+ * @brief Writes the current metrics to a file.
+ * @param path Destination file.
+ * @param format "json", "prometheus", or "auto" (prometheus for .prom/.txt files).
+ * @throws std::invalid_argument on an unknown format.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void writeMetricsFile(const string& path, const string& format = "auto");
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Times the enclosing scope and records it against a metric.
+ */
+class MetricTimer {
+public:
+    explicit MetricTimer(Metric metric, size_t bytes = 0)
+        : metric(metric), bytes(bytes), start(chrono::steady_clock::now()) {}
+
+    ~MetricTimer() {
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        recordMetric(metric, static_cast<uint64_t>(ns), bytes);
+    }
+
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+
+    // Sets the byte count when it is only known after the work is done.
+    void setBytes(size_t n) { bytes = n; }
+
+private:
+    Metric metric;
+    size_t bytes;
+    chrono::steady_clock::time_point start;
+};
+
+#endif // METRICS_H
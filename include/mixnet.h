@@ -0,0 +1,89 @@
+#ifndef MIXNET_H
+#define MIXNET_H
+
+#include "election.h"
+#include <cstddef>
+#include <vector>
+#include <gmpxx.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Options for a re-encryption shuffle.
+ *
+ * @param threads Worker threads re-randomizing ciphertexts (>= 1).
+ * @param seed Seed for the permutation and the per-worker random states
+ *             (0 = draw one from std::random_device).
+ * @param randomizers Optional precomputed r^n mod n^2 values (see
+ *                    precomputeRandomizers); at least one per ciphertext.
+ *                    When null, each worker generates its own on the fly.
+ */
+struct MixConfig {
+    int threads = 1;
+    unsigned long seed = 0;
+    const vector<mpz_class>* randomizers = nullptr;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Generates a pool of Paillier randomizers ahead of a shuffle.
+ * @details Each entry is r^n mod n^2 for a fresh r, the only modular
+ *          exponentiation in a re-encryption. Computing the pool before the
+ *          election closes leaves a single multiplication per ciphertext for
+ *          the shuffle itself.
+ * @param keys The election's Paillier keys.
+ * @param count Number of randomizers to generate.
+ * @param threads Worker threads (>= 1).
+ * @param seed Seed for the per-worker random states (0 = random_device).
+ * @return The randomizers.
+ */
+vector<mpz_class> precomputeRandomizers(const PaillierKeys& keys, size_t count, int threads, unsigned long seed);
+
+/**
+ * @brief Permutes ciphertexts and re-randomizes each one.
+ * @details out[i] = in[pi(i)] * r_i^n mod n^2 for a uniformly random
+ *          permutation pi (Fisher-Yates). Every output decrypts to the same
+ *          plaintext as its source, but neither its position nor its value
+ *          links it back to the input. The permutation is drawn on the calling
+ *          thread; the re-randomization is split across config.threads workers.
+ *          The permutation is not returned.
+ * @param ciphertexts The Paillier ciphertexts to mix.
+ * @param keys The Paillier keys they were encrypted under.
+ * @param config Thread count, seed and optional precomputed randomizers.
+ * @return The shuffled, re-randomized ciphertexts.
+ * @throws std::invalid_argument if fewer randomizers than ciphertexts are supplied.
+ */
+vector<mpz_class> shuffleCiphertexts(const vector<mpz_class>& ciphertexts, const PaillierKeys& keys,
+                                     const MixConfig& config);
+
+/**
+ * @brief Mixes the vote-weight ciphertexts of every ballot in an election.
+ * @details The PII ciphertexts are left out, so the output carries only the
+ *          votes. Revoked ballots are skipped. The product of the output
+ *          still decrypts to the tally.
+ * @param election The election whose ballots are mixed (including snapshot ballots).
+ * @param config Thread count, seed and optional precomputed randomizers.
+ * @return The shuffled, re-randomized vote-weight ciphertexts.
+ */
+vector<mpz_class> shuffleElection(const Election& election, const MixConfig& config);
+
+/**
+ * @brief Homomorphically sums a list of ciphertexts.
+ * @param ciphertexts The ciphertexts.
+ * @param keys The Paillier keys.
+ * @return The product of the ciphertexts mod n^2 (1 for an empty list).
+ */
+mpz_class sumCiphertexts(const vector<mpz_class>& ciphertexts, const PaillierKeys& keys);
+
+#endif // MIXNET_H
@@ -0,0 +1,152 @@
+#ifndef MODMUL_SIMD_H
+#define MODMUL_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <gmpxx.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Vector instruction sets the multi-buffer kernels can use, weakest first.
+ */
+enum SimdLevel {
+    SIMD_SCALAR,     // GMP only
+    SIMD_AVX2,       // 4 lanes, 26-bit digits, vpmuludq
+    SIMD_AVX512IFMA, // 8 lanes, 52-bit digits, vpmadd52luq / vpmadd52huq
+};
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Multi-buffer Montgomery multiplication of many values mod one N.
+ * @details A tally multiplies thousands of ciphertexts together mod the same
+ *          n^2. This class keeps one running product in each SIMD lane:
+ *          numbers are split into 52-bit (IFMA) or 26-bit (AVX2) digits,
+ *          stored digit-interleaved across 8 or 4 lanes, and every
+ *          multiply-accumulate of the word-serial Montgomery loop advances all
+ *          lanes at once. The modulus is shared, so its digits are broadcast.
+ *          At SIMD_SCALAR every call falls back to mpz arithmetic.
+ *          Immutable after construction; safe to share between threads.
+ */
+class BatchModMul {
+public:
+    /**
+     * @param modulus An odd modulus (n^2 of a Paillier key), at most 8192 bits.
+     * @param level Kernel to use; clamped to what the CPU supports.
+     * @throws std::invalid_argument if the modulus is even or too large.
+     */
+    explicit BatchModMul(const mpz_class& modulus, SimdLevel level);
+
+    /**
+     * @brief Multiplies a list of values together mod N.
+     * @details Lane l accumulates values l, l + lanes, l + 2*lanes, ...; the
+     *          lane results and the R^-count factor are folded in once at the end.
+     * @param values The factors.
+     * @return The product mod N (1 for an empty list).
+     */
+    mpz_class product(const vector<mpz_class>& values) const;
+
+    SimdLevel level() const { return simd; }
+    size_t lanes() const { return laneCount; }
+
+    /**
+     * @brief Streaming form of product(): multiply values in one at a time.
+     * @details Values are buffered until every lane has one, then a single
+     *          kernel pass folds them into the lane accumulators. The
+     *          BatchModMul must outlive it. Not thread-safe.
+     */
+    class Accumulator {
+    public:
+        explicit Accumulator(const BatchModMul& owner);
+
+        // Multiplies a value into the product.
+        void multiply(const mpz_class& value);
+
+        // Writes the product so far (1 if nothing was multiplied in).
+        void value(mpz_class& out) const;
+
+        size_t count() const { return factors; }
+
+    private:
+        const BatchModMul& mm;
+        mpz_class scalar;         // The product at SIMD_SCALAR
+        vector<uint64_t> acc;     // Lane accumulators, digit-interleaved
+        vector<uint64_t> pending; // Next factor per lane
+        size_t filled = 0;        // Lanes of 'pending' holding a value
+        size_t factors = 0;       // Values multiplied in, excluding padding
+    };
+
+private:
+    friend class Accumulator;
+
+    // Splits a value into digits and writes them to one lane of an interleaved buffer.
+    void toLane(uint64_t* buffer, size_t lane, const mpz_class& value) const;
+    // Reads one lane of an interleaved buffer back into an mpz.
+    void fromLane(mpz_class& out, const uint64_t* buffer, size_t lane) const;
+    // Fills every lane of a buffer with the same value.
+    void broadcast(vector<uint64_t>& buffer, const mpz_class& value) const;
+    // out = a * b * R^-1 mod N in every lane; 'out' may alias 'a' or 'b'.
+    void kernel(uint64_t* out, const uint64_t* a, const uint64_t* b) const;
+
+    mpz_class modulus;
+    SimdLevel simd;
+    size_t laneCount;
+    int radix;                 // Bits per digit
+    size_t digits;             // K, with R = 2^(radix * K) > N
+    vector<uint64_t> modDigits;
+    uint64_t negInverse;       // -N^-1 mod 2^radix
+    mpz_class rModN;           // R mod N (1 in Montgomery form)
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Returns the kernel to use: the best this CPU supports, capped by setSimdLimit().
+ * @details AVX2 is returned only when the limit is SIMD_AVX2 itself. Four
+ *          32 x 32-bit lanes lose to GMP's 64 x 64-bit mulx on every size
+ *          measured, so a CPU without IFMA otherwise gets SIMD_SCALAR.
+ */
+SimdLevel detectSimdLevel();
+
+/**
+ * @brief Caps the level detectSimdLevel() reports, e.g. to compare kernels.
+ * @param level The highest level to use.
+ */
+void setSimdLimit(SimdLevel level);
+
+/**
+ * @brief Returns the cap set by setSimdLimit() (SIMD_AVX512IFMA when none was set).
+ */
+SimdLevel currentSimdLimit();
+
+/**
+ * @brief Parses "scalar", "avx2", "avx512" or "auto" (no cap).
+ * @param name The level's name.
+ * @return The level.
+ * @throws std::invalid_argument for any other name.
+ */
+SimdLevel parseSimdLevel(const string& name);
+
+/**
+ * @brief Names a level: "scalar", "avx2" or "avx512ifma".
+ */
+string simdLevelName(SimdLevel level);
+
+#endif // MODMUL_SIMD_H
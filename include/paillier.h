@@ -3,6 +3,7 @@
 
 #include <gmpxx.h>
 #include <vector>
+#include <array>
 #include <string>
 #include <gmp.h>
 #include <cstdint> 
@@ -33,15 +34,56 @@ struct PaillierKeys {
     mpz_class mu;       // Private key component mu = (L(g^lambda mod n^2))^-1 mod n
 };
 
+/**
+ * @brief Preallocated temporaries for the in-place Paillier operations.
+ * @details Every buffer is presized for a product of two residues mod n^2, so
+ *          repeated encryptions, decryptions and tally updates reuse the same
+ *          limbs instead of allocating and freeing mpz values per call. Keep one
+ *          per thread (see threadScratch); a scratch is not thread-safe.
+ *
+ * @param r The encryption randomizer.
+ * @param gcd gcd(r, n) while drawing r.
+ * @param term1 g^m or c^lambda mod n^2.
+ * @param term2 r^n mod n^2, or L(c^lambda mod n^2).
+ * @param product Unreduced product before the final reduction.
+ * @param bits Size of n^2 in bits the buffers are sized for (0 = not yet sized).
+ */
+struct PaillierScratch {
+    mpz_class r;
+    mpz_class gcd;
+    mpz_class term1;
+    mpz_class term2;
+    mpz_class product;
+    size_t bits = 0;
+
+    PaillierScratch() = default;
+    explicit PaillierScratch(const PaillierKeys& keys) { reserve(keys); }
+
+    /**
+     * @brief Grows the buffers for a key's n^2 (no-op once they are large enough).
+     * @param keys The Paillier keys the scratch will be used with.
+     */
+    void reserve(const PaillierKeys& keys);
+};
+
+/**
+ * @brief Keyed hash identifying a voter without revealing their PII.
+ */
+using VoterTag = array<Byte, 16>;
+
 /**
  * @brief Represents an encrypted ballot containing PII and vote weight.
  *
  * @param aesEncryptedPII IV + AES Ciphertext of "FirstName LastName".
  * @param encWeight Paillier Ciphertext of encoded vote weight (M^i).
+ * @param voterTag HMAC of the normalized PII, used by the voter index.
+ * @param unit Tally tree node (reporting unit) the ballot was counted in, 0 = total only.
  */
 struct EncryptedBallot {
     vector<Byte> aesEncryptedPII;      // IV + DES Ciphertext of "FirstName LastName"
     mpz_class encWeight;                        // Paillier Ciphertext of encoded vote weight (M^i)
+    VoterTag voterTag;                          // HMAC-SHA256/128 of the normalized PII
+    uint32_t unit;                              // Reporting unit in the election's tally tree
 };
 
 /*
@@ -77,6 +119,15 @@ mpz_class mod_inverse(const mpz_class& a, const mpz_class& n);
  */
 mpz_class gen_rand_r(const mpz_class& n, gmp_randstate_t& rand_state);
 
+/**
+ * @brief Draws 'r' like gen_rand_r(), into caller-owned storage.
+ * @param r Receives the random number (may be scratch.r).
+ * @param n The Paillier modulus n. Must be greater than 1.
+ * @param rand_state An initialized GMP random state object.
+ * @param scratch Temporaries sized for n.
+ */
+void gen_rand_r(mpz_class& r, const mpz_class& n, gmp_randstate_t& rand_state, PaillierScratch& scratch);
+
 /**
  * @brief Generates a probable prime number of a specified bit size.
  * @details Uses GMP functions to find a probable prime number.
@@ -91,9 +142,10 @@ mpz_class generate_prime(int bits, gmp_randstate_t& rand_state);
  * @details Calculates weights M^i where M = max_voters + 1.
  * @param numCandidates The number of candidates.
  * @param max_voters The maximum expected number of voters (k).
+ * @param verbose If true, prints the encoding parameters and weights to stdout.
  * @return A vector containing the weights [M^0, M^1, ... M^(numCandidates-1)].
  */
-vector<mpz_class> calcWeights(int numCandidates, int max_voters);
+vector<mpz_class> calcWeights(int numCandidates, int max_voters, bool verbose = true);
 
 /**
  * @brief Retrieves the pre-computed weight for a candidate index.
@@ -122,6 +174,17 @@ PaillierKeys genKeyPaillier(int bitSize);
  */
 mpz_class encVote(const mpz_class& vote, const PaillierKeys& keys, gmp_randstate_t& rand_state);
 
+/**
+ * @brief Encrypts a vote weight like encVote(), without allocating temporaries.
+ * @param ciphertext Receives g^vote * r^n mod n^2; reusing the same object keeps its limbs.
+ * @param vote The plaintext vote weight (0 <= vote < n).
+ * @param keys A PaillierKeys struct containing the public key components.
+ * @param rand_state An initialized GMP random state object for generating 'r'.
+ * @param scratch The calling thread's temporaries.
+ */
+void encVote(mpz_class& ciphertext, const mpz_class& vote, const PaillierKeys& keys, gmp_randstate_t& rand_state,
+             PaillierScratch& scratch);
+
 /**
  * @brief Decrypts a Paillier ciphertext using the private key.
  * @details Applies the Paillier decryption formula: m = L(c^lambda mod n^2) * mu mod n.
@@ -131,6 +194,15 @@ mpz_class encVote(const mpz_class& vote, const PaillierKeys& keys, gmp_randstate
  */
 mpz_class decVote(const mpz_class& ciphertext, const PaillierKeys& keys);
 
+/**
+ * @brief Decrypts a ciphertext like decVote(), without allocating temporaries.
+ * @param plaintext Receives L(c^lambda mod n^2) * mu mod n.
+ * @param ciphertext The Paillier ciphertext to decrypt.
+ * @param keys A PaillierKeys struct containing the private key components.
+ * @param scratch The calling thread's temporaries.
+ */
+void decVote(mpz_class& plaintext, const mpz_class& ciphertext, const PaillierKeys& keys, PaillierScratch& scratch);
+
 /**
  * @brief Homomorphically adds two encrypted Paillier votes.
  * @details Exploits the property E(m1) * E(m2) = E(m1 + m2) by multiplying ciphertexts.
@@ -141,6 +213,108 @@ mpz_class decVote(const mpz_class& ciphertext, const PaillierKeys& keys);
  */
 mpz_class addVotes(const mpz_class& c1, const mpz_class& c2, const PaillierKeys& keys);
 
+/**
+ * @brief Folds an encrypted vote into an accumulator in place: acc = acc * c mod n^2.
+ * @details The unreduced product goes through scratch.product, so a presized
+ *          accumulator never reallocates.
+ * @param acc The running tally or subtotal.
+ * @param ciphertext The ciphertext to add.
+ * @param keys A PaillierKeys struct.
+ * @param scratch The calling thread's temporaries.
+ */
+void addVotes(mpz_class& acc, const mpz_class& ciphertext, const PaillierKeys& keys, PaillierScratch& scratch);
+
+/**
+ * @brief Returns the calling thread's scratch, sized for the given keys.
+ * @details Lets the value-returning operations and code without its own
+ *          scratch reuse one set of buffers per thread.
+ * @param keys The Paillier keys about to be used.
+ * @return A thread-local PaillierScratch.
+ */
+PaillierScratch& threadScratch(const PaillierKeys& keys);
+
+/**
+ * @brief Homomorphically subtracts one encrypted vote from another.
+ * @details E(m1) * E(m2)^-1 = E(m1 - m2), with the inverse taken mod n^2.
+ * @param c1 The ciphertext to subtract from.
+ * @param c2 The ciphertext to subtract.
+ * @param keys A PaillierKeys struct.
+ * @return A ciphertext of (plaintext1 - plaintext2) mod n.
+ * @throws std::invalid_argument if c2 is not invertible mod n^2 (not a valid ciphertext).
+ */
+mpz_class subVotes(const mpz_class& c1, const mpz_class& c2, const PaillierKeys& keys);
+
+/**
+ * @brief Inverts many ciphertexts mod n^2 with a single modular inversion.
+ * @details Montgomery's trick: prefix products, one inversion of the full
+ *          product, then a backward pass that peels off each inverse, for
+ *          3(k-1) multiplications plus one inversion instead of k inversions.
+ * @param ciphertexts The ciphertexts to invert.
+ * @param keys A PaillierKeys struct.
+ * @return The inverse of each ciphertext mod n^2, in the same order.
+ * @throws std::invalid_argument if any ciphertext is not invertible mod n^2.
+ */
+vector<mpz_class> invertCiphertexts(const vector<mpz_class>& ciphertexts, const PaillierKeys& keys);
+
+/**
+ * @brief Generates a fresh Paillier randomizer, i.e. an encryption of zero.
+ * @details Computes r^n mod n^2 for a random r co-prime to n. Multiplying a
+ *          ciphertext by it re-randomizes the ciphertext without changing its
+ *          plaintext. Randomizers can be precomputed ahead of a shuffle.
+ * @param keys A PaillierKeys struct containing the public key components.
+ * @param rand_state An initialized GMP random state object for generating 'r'.
+ * @return r^n mod n^2.
+ */
+mpz_class encZero(const PaillierKeys& keys, gmp_randstate_t& rand_state);
+
+/**
+ * @brief Generates a randomizer like encZero(), without allocating temporaries.
+ * @param rn Receives r^n mod n^2.
+ * @param keys A PaillierKeys struct containing the public key components.
+ * @param rand_state An initialized GMP random state object for generating 'r'.
+ * @param scratch The calling thread's temporaries.
+ */
+void encZero(mpz_class& rn, const PaillierKeys& keys, gmp_randstate_t& rand_state, PaillierScratch& scratch);
+
+/**
+ * @brief Re-randomizes a ciphertext: c * r^n mod n^2 decrypts to the same plaintext.
+ * @param ciphertext The Paillier ciphertext.
+ * @param keys A PaillierKeys struct containing the public key components.
+ * @param rand_state An initialized GMP random state object for generating 'r'.
+ * @return A fresh ciphertext of the same plaintext.
+ */
+mpz_class reEncrypt(const mpz_class& ciphertext, const PaillierKeys& keys, gmp_randstate_t& rand_state);
+
+/**
+ * @brief Homomorphically multiplies an encrypted vote by a plaintext scalar.
+ * @details Exploits E(m)^k = E(k * m) by raising the ciphertext to k mod n^2,
+ *          e.g. for a shareholder ballot that counts k times.
+ * @param ciphertext The Paillier ciphertext.
+ * @param k The non-negative scalar.
+ * @param keys A PaillierKeys struct.
+ * @return A ciphertext of (k * plaintext) mod n.
+ * @throws std::invalid_argument if k is negative.
+ */
+mpz_class scaleVote(const mpz_class& ciphertext, const mpz_class& k, const PaillierKeys& keys);
+
+/**
+ * @brief Computes a weighted encrypted tally, the product of c_i^k_i mod n^2.
+ * @details Uses Pippenger's bucket method: the scalars are cut into c-bit
+ *          windows, and for each window every ciphertext is multiplied into
+ *          the bucket of its digit once, then the buckets are combined with
+ *          2^(c+1) multiplications via running products. The window width is
+ *          chosen from the number of pairs and the widest scalar, so the cost
+ *          is about (bits / c) multiplications per ballot instead of one
+ *          exponentiation per ballot, and does not grow with the total weight.
+ * @param ciphertexts The Paillier ciphertexts.
+ * @param scalars The non-negative weight of each ciphertext.
+ * @param keys A PaillierKeys struct.
+ * @return A ciphertext of sum(k_i * m_i) mod n (1, an encryption of 0, when empty).
+ * @throws std::invalid_argument if the lists differ in length or a scalar is negative.
+ */
+mpz_class weightedTally(const vector<mpz_class>& ciphertexts, const vector<mpz_class>& scalars,
+                        const PaillierKeys& keys);
+
 /**
  * @brief Prompts user for a ballot index and decrypts/displays the PII and vote weight.
  * @details Handles user input for the index and calls decryption functions.
@@ -157,9 +331,20 @@ void decryptBallot(const vector<EncryptedBallot>& allBallots,
 /**
  * @brief Generates a random 32-byte AES key.
  * @param rand_state An initialized GMP random state object.
+ * @param verbose If true, prints the generated key to stdout.
  * @return A 32-byte array representing the AES key.
  */
-array<Byte, 32> genKeyAES(gmp_randstate_t& rand_state);
+array<Byte, 32> genKeyAES(gmp_randstate_t& rand_state, bool verbose = true);
+
+/**
+ * @brief Decodes a decrypted base-M tally into per-candidate vote counts.
+ * @details Repeatedly takes the tally modulo M = max_voters + 1 and divides by M.
+ * @param decryptedTally The final decrypted tally.
+ * @param numCandidates The number of candidates.
+ * @param max_voters The maximum number of voters (k).
+ * @return A vector with the decoded vote count for each candidate.
+ */
+vector<long> decodeTally(const mpz_class& decryptedTally, int numCandidates, int max_voters);
 
 /**
  * @brief Prints the decrypted tally and verifies the results against the actual vote counts.
@@ -0,0 +1,217 @@
+#ifndef PAILLIER_FIXED_H
+#define PAILLIER_FIXED_H
+
+#include "modmul_simd.h"
+#include "paillier.h"
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gmp.h>
+#include <gmpxx.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Montgomery arithmetic mod n^2 for one key size, on fixed-size limb arrays.
+ * @details Residues are exactly LIMBS limbs, little-endian, so every operation
+ *          runs on the mpn layer with sizes known at compile time: no
+ *          normalization, no reallocation and no division. A product costs one
+ *          mpn_mul_n (or mpn_sqr) plus a word-by-word REDC, instead of mpz_mul
+ *          followed by a long division. Exponentiations are left to mpz_powm,
+ *          which already runs Montgomery on mpn internally.
+ * @tparam KeyBits Size of n in bits (a multiple of GMP_NUMB_BITS / 2).
+ */
+template <int KeyBits>
+class FixedPaillier {
+public:
+    static constexpr size_t LIMBS = 2 * KeyBits / GMP_NUMB_BITS; // Limbs of n^2
+    static_assert(2 * KeyBits % GMP_NUMB_BITS == 0, "n^2 must fill whole limbs");
+    static_assert(GMP_NAIL_BITS == 0, "Nail builds of GMP are not supported");
+
+    using Residue = array<mp_limb_t, LIMBS>;
+
+    /**
+     * @param keys Paillier keys whose n^2 fits in LIMBS limbs.
+     * @throws std::invalid_argument if n^2 is of another size.
+     */
+    explicit FixedPaillier(const PaillierKeys& keys) : nSquared(keys.nSquared) {
+        if (mpz_size(nSquared.get_mpz_t()) != LIMBS) {
+            throw invalid_argument("FixedPaillier<" + to_string(KeyBits) + "> cannot hold a " +
+                                   to_string(mpz_sizeinbase(nSquared.get_mpz_t(), 2)) + "-bit n^2");
+        }
+        memcpy(mod.data(), mpz_limbs_read(nSquared.get_mpz_t()), sizeof(mod));
+
+        // -N^-1 mod 2^64 by Newton iteration; each step doubles the correct bits
+        mp_limb_t inverse = mod[0];
+        for (int i = 0; i < 6; i++) {
+            inverse *= 2 - mod[0] * inverse;
+        }
+        negInverse = -inverse;
+
+        mpz_class r = 1;
+        mpz_mul_2exp(r.get_mpz_t(), r.get_mpz_t(), LIMBS * GMP_NUMB_BITS);
+        rModN = r % nSquared;
+    }
+
+    // Copies a value below n^2 into a residue (reduced first if it is not).
+    void load(Residue& out, const mpz_class& x) const {
+        mpz_srcptr src = x.get_mpz_t();
+        size_t size = mpz_size(src);
+        if (sgn(x) < 0 || size > LIMBS || (size == LIMBS && mpn_cmp(mpz_limbs_read(src), mod.data(), LIMBS) >= 0)) {
+            mpz_class reduced;
+            mpz_mod(reduced.get_mpz_t(), src, nSquared.get_mpz_t());
+            load(out, reduced);
+            return;
+        }
+        memcpy(out.data(), mpz_limbs_read(src), size * sizeof(mp_limb_t));
+        memset(out.data() + size, 0, (LIMBS - size) * sizeof(mp_limb_t));
+    }
+
+    // Copies a residue into an mpz.
+    void store(mpz_class& out, const Residue& x) const {
+        mp_ptr dst = mpz_limbs_write(out.get_mpz_t(), LIMBS);
+        memcpy(dst, x.data(), sizeof(Residue));
+        mp_size_t size = LIMBS;
+        while (size > 0 && x[size - 1] == 0) {
+            size--;
+        }
+        mpz_limbs_finish(out.get_mpz_t(), size);
+    }
+
+    // out = a * b * R^-1 mod n^2, with R = 2^(LIMBS * GMP_NUMB_BITS). 'out' may alias either input.
+    void montMul(Residue& out, const Residue& a, const Residue& b) const {
+        mp_limb_t t[2 * LIMBS];
+        if (&a == &b) {
+            mpn_sqr(t, a.data(), LIMBS);
+        } else {
+            mpn_mul_n(t, a.data(), b.data(), LIMBS);
+        }
+
+        // Clear one low limb per step; the carry out of limb i + LIMBS rides into the next step
+        mp_limb_t carry = 0;
+        for (size_t i = 0; i < LIMBS; i++) {
+            mp_limb_t q = t[i] * negInverse;
+            mp_limb_t c = mpn_addmul_1(t + i, mod.data(), LIMBS, q);
+            mp_limb_t sum = t[i + LIMBS] + c;
+            mp_limb_t overflow = sum < c;
+            sum += carry;
+            overflow += sum < carry;
+            t[i + LIMBS] = sum;
+            carry = overflow;
+        }
+        if (carry || mpn_cmp(t + LIMBS, mod.data(), LIMBS) >= 0) {
+            mpn_sub_n(out.data(), t + LIMBS, mod.data(), LIMBS);
+        } else {
+            memcpy(out.data(), t + LIMBS, sizeof(Residue));
+        }
+    }
+
+    /**
+     * @brief Undoes the R^-1 picked up by 'count' montMul calls on plain inputs.
+     * @param value A product of plain residues times R^-count, as an mpz.
+     * @param count Number of montMul calls that produced it.
+     */
+    void unscale(mpz_class& value, size_t count) const {
+        if (count == 0) {
+            return;
+        }
+        mpz_class factor;
+        mpz_powm_ui(factor.get_mpz_t(), rModN.get_mpz_t(), count, nSquared.get_mpz_t());
+        value = value * factor % nSquared;
+    }
+
+    const mpz_class& modulus() const { return nSquared; }
+
+private:
+    mpz_class nSquared;
+    mpz_class rModN; // R mod n^2
+    Residue mod;
+    mp_limb_t negInverse;
+};
+
+template <int KeyBits>
+constexpr size_t FixedPaillier<KeyBits>::LIMBS;
+
+/**
+ * @brief A running product of ciphertexts mod n^2 (a homomorphic sum of votes).
+ * @details Created by makeCiphertextProduct(), which picks the multi-buffer
+ *          SIMD backend when the CPU has AVX-512 IFMA, otherwise the fixed-limb
+ *          backend for 1024, 2048 and 3072-bit keys and plain mpz arithmetic
+ *          for any other size. Not thread-safe: keep one per worker.
+ */
+class CiphertextProduct {
+public:
+    virtual ~CiphertextProduct() {}
+
+    /**
+     * @brief Multiplies a ciphertext into the product.
+     * @param ciphertext A Paillier ciphertext under the product's keys.
+     */
+    virtual void multiply(const mpz_class& ciphertext) = 0;
+
+    /**
+     * @brief Writes the product so far (1 if nothing was multiplied in).
+     * @param out Receives the product mod n^2.
+     */
+    virtual void value(mpz_class& out) const = 0;
+
+    /**
+     * @brief Name of the arithmetic in use, e.g. "simd-avx512ifma", "fixed-1024" or "mpz".
+     */
+    virtual string backend() const = 0;
+
+    // Number of ciphertexts multiplied in.
+    size_t count() const { return factors; }
+
+protected:
+    size_t factors = 0;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Creates an empty ciphertext product for the given keys.
+ * @details Uses BatchModMul lanes when detectSimdLevel() allows (keys up
+ *          to 4096 bits). Otherwise dispatches on the size of n^2 at run time:
+ *          keys from genKeyPaillier(1024 / 2048 / 3072) get FixedPaillier<1024 /
+ *          2048 / 3072>, any other size the mpz implementation.
+ * @param keys The Paillier keys (must outlive the product).
+ * @return A product equal to 1 (an encryption of 0).
+ */
+unique_ptr<CiphertextProduct> makeCiphertextProduct(const PaillierKeys& keys);
+
+/**
+ * @brief Creates an empty ciphertext product using a given SIMD level.
+ * @details Like makeCiphertextProduct(keys), but takes the level instead of
+ *          reading detectSimdLevel(), so callers can try kernels without
+ *          changing the process-wide limit. The level is clamped to what the
+ *          CPU supports; check backend() for the kernel actually used.
+ * @param keys The Paillier keys (must outlive the product).
+ * @param level The SIMD level to use, SIMD_SCALAR for the fixed-limb or mpz backend.
+ * @return A product equal to 1 (an encryption of 0).
+ */
+unique_ptr<CiphertextProduct> makeCiphertextProduct(const PaillierKeys& keys, SimdLevel level);
+
+/**
+ * @brief Multiplies a list of ciphertexts together with the fastest backend for the key.
+ * @param ciphertexts The ciphertexts.
+ * @param keys The Paillier keys.
+ * @return The product mod n^2 (1 for an empty list).
+ */
+mpz_class multiplyCiphertexts(const vector<mpz_class>& ciphertexts, const PaillierKeys& keys);
+
+#endif // PAILLIER_FIXED_H
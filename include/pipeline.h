@@ -0,0 +1,224 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "election.h"
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Produces the next batch of records for the pipeline.
+ * @details Called repeatedly from the parse stage's thread. Append up to
+ *          'maxRecords' records to 'batch' and return false when exhausted.
+ */
+typedef function<bool(vector<CastVoteRecord>& batch, size_t maxRecords)> RecordSource;
+
+/**
+ * @brief How far a pipeline run has got.
+ *
+ * @param parsed Records accepted by the parse stage so far.
+ * @param encrypted Records through the Paillier stage.
+ * @param records Records tallied (the run's result if it stopped now).
+ * @param total Records expected in all, or 0 if unknown.
+ * @param elapsedMs Time since the run started.
+ * @param recordsPerSec Tallied records per second, smoothed over recent intervals.
+ * @param etaMs Estimated time to finish, or -1 without a total or a rate.
+ */
+struct PipelineProgress {
+    size_t parsed = 0;
+    size_t encrypted = 0;
+    size_t records = 0;
+    size_t total = 0;
+    double elapsedMs = 0;
+    double recordsPerSec = 0;
+    double etaMs = -1;
+};
+
+/**
+ * @brief Receives progress reports; called on the thread that runs the pipeline.
+ */
+typedef function<void(const PipelineProgress& progress)> ProgressCallback;
+
+/**
+ * @brief Worker counts and buffering for the parse -> AES -> Paillier -> tally pipeline.
+ *
+ * @param aesThreads Workers encrypting PII with AES-256.
+ * @param paillierThreads Workers encrypting vote weights with Paillier.
+ * @param tallyThreads Workers folding ciphertexts into partial tallies.
+ * @param queueDepth Capacity (in batches) of each queue between stages.
+ * @param batchSize Records per batch.
+ * @param seed Seed for the per-worker Paillier random states.
+ * @param keepBallots If true, ballots are appended to election.allBallots and
+ *                    their voters to the election's voter index.
+ * @param ballotsOut If non-empty, ballots are written here as NDJSON.
+ * @param bloomFilter If true, duplicate checks consult a Bloom filter first.
+ * @param sampleBallots Ballots to copy into PipelineStats::samples, chosen
+ *                      uniformly at random (by a seeded hash of their index).
+ * @param progress If set, called every progressIntervalMs while the run lasts.
+ * @param progressIntervalMs Time between progress reports.
+ * @param expectedRecords Records the source will produce, for the ETA (0 = unknown).
+ * @param cancel If set, the run stops soon after the flag turns true and
+ *               returns what was tallied so far (PipelineStats::cancelled).
+ * @param numa Spread the AES, Paillier and tally workers over the NUMA nodes
+ *             and pin each to its node's CPUs (see runPipeline).
+ */
+struct PipelineConfig {
+    int aesThreads = 1;
+    int paillierThreads = 1;
+    int tallyThreads = 1;
+    size_t queueDepth = 64;
+    size_t batchSize = 64;
+    unsigned long seed = 0;
+    bool keepBallots = false;
+    string ballotsOut;
+    bool bloomFilter = true;
+    size_t sampleBallots = 0;
+    ProgressCallback progress;
+    double progressIntervalMs = 500;
+    size_t expectedRecords = 0;
+    const atomic<bool>* cancel = nullptr;
+    bool numa = false;
+};
+
+/**
+ * @brief A ballot kept aside for spot-check decryption.
+ *
+ * @param index Position of the record in this run's input.
+ * @param candidate The candidate the record voted for.
+ * @param ballot The encrypted ballot as it was tallied.
+ */
+struct SampledBallot {
+    size_t index;
+    int candidate;
+    EncryptedBallot ballot;
+};
+
+/**
+ * @brief Throughput and input-queue occupancy for one pipeline stage.
+ *
+ * @param name Stage name: parse, aes, paillier or tally.
+ * @param workers Number of worker threads in the stage.
+ * @param items Records processed by the stage.
+ * @param busyMs Time spent processing, summed over workers.
+ * @param itemsPerSec Items divided by the stage's wall-clock active time.
+ * @param maxQueueDepth Largest observed depth of the stage's input queue (batches).
+ * @param avgQueueDepth Mean depth of the input queue, sampled on every push.
+ */
+struct StageStats {
+    string name;
+    int workers = 0;
+    size_t items = 0;
+    double busyMs = 0;
+    double itemsPerSec = 0;
+    size_t maxQueueDepth = 0;
+    double avgQueueDepth = 0;
+};
+
+/**
+ * @brief Results of one pipeline run.
+ *
+ * @param records Number of records that passed through every stage.
+ * @param duplicates Records dropped because their voter had already voted.
+ * @param wallMs Total elapsed time of the run.
+ * @param stages Per-stage statistics in pipeline order.
+ * @param samples Up to config.sampleBallots ballots, in input order.
+ * @param cancelled True if config.cancel stopped the run before its input ended.
+ * @param numaNodes Nodes the workers were spread over (0 without config.numa).
+ * @param boardBallots Leaves of this run's bulletin board when ballots are not
+ *        kept (election.board is then left alone).
+ * @param boardRoot Root of that board.
+ */
+struct PipelineStats {
+    size_t records = 0;
+    size_t duplicates = 0;
+    double wallMs = 0;
+    vector<StageStats> stages;
+    vector<SampledBallot> samples;
+    bool cancelled = false;
+    int numaNodes = 0;
+    size_t boardBallots = 0;
+    Digest boardRoot = sha256(nullptr, 0);
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Splits a total thread budget across the pipeline stages.
+ * @details Paillier encryption dominates the per-ballot cost, so it receives
+ *          most workers; AES gets roughly one in eight and tally one.
+ * @param threads Total worker threads available (>= 1).
+ * @param config The config whose stage thread counts are overwritten.
+ */
+void sizePipeline(int threads, PipelineConfig& config);
+
+/**
+ * @brief Runs records through parse -> AES -> Paillier -> tally stages.
+ * @details Each stage has its own worker pool and the stages are joined by
+ *          bounded lock-free queues, so AES, Paillier and accumulation overlap
+ *          and a slow stage applies backpressure to the ones before it. Tally
+ *          workers keep partial products that are merged into
+ *          election.encryptedTally at the end; actualVoteCounts is updated.
+ *          The parse stage tags every voter and drops records whose voter
+ *          already has a ballot in the election or earlier in the input.
+ *          Tally workers also keep one partial product per reporting unit,
+ *          which is folded into election.tree (the unit and its ancestors)
+ *          with the other results at the end. Kept ballots are appended to
+ *          election.log, if one is attached, once the whole run has succeeded
+ *          and before the tallies change; if the log fails, the run's
+ *          ballots are dropped and the election is left as it was.
+ *          Paillier workers also hash each ballot as a bulletin board leaf.
+ *          With config.keepBallots the leaves are appended to election.board
+ *          in input order at the end (skipped while the board lags behind the
+ *          stored ballots). Otherwise they are folded, in input order as they
+ *          arrive, into an O(log n) frontier whose root ends up in the stats,
+ *          so memory stays bounded.
+ *          The calling thread reports progress and watches the cancel flag.
+ *          On cancellation every stage stops at its next batch, batches in
+ *          flight are dropped, and the results cover exactly the records that
+ *          were tallied: the election stays consistent, with the stored
+ *          ballots renumbered without gaps.
+ *          With config.numa, worker t of each stage is pinned to the CPUs of
+ *          node t % N, where N is the number of nodes (at most the Paillier
+ *          worker count). Each node's Paillier workers hand their batches only
+ *          to tally workers on the same node, so the ciphertexts, which are
+ *          allocated by the thread that encrypts them, are read where they
+ *          live. The last tally worker to finish on a node reduces that node's
+ *          partial products, and only N node results cross the interconnect
+ *          in the final merge. The tally stage gets at least one worker per node.
+ * @param election A set-up election.
+ * @param source Supplies record batches (called from the parse thread).
+ * @param config Stage sizes and options.
+ * @return Record count, wall time and per-stage statistics.
+ * @throws std::invalid_argument on bad records or when max_voters would be exceeded.
+ * @throws std::runtime_error on I/O errors.
+ */
+PipelineStats runPipeline(Election& election, const RecordSource& source, const PipelineConfig& config);
+
+/**
+ * @brief Creates a source of simulated voters with random candidate choices.
+ * @param count Number of records to produce.
+ * @param firstId Number used in the first generated name ("FName_<id> LName_<id>").
+ * @param numCandidates Candidates to choose between.
+ * @param seed Seed for the choices.
+ * @param fanout Reporting units per level (see parseFanout); voters are spread
+ *               uniformly over the leaf units. Empty = no units.
+ * @return The record source.
+ */
+RecordSource simulatedSource(size_t count, size_t firstId, int numCandidates, unsigned long seed,
+                             const vector<int>& fanout = vector<int>());
+
+#endif // PIPELINE_H
@@ -0,0 +1,98 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+using Byte = unsigned char;
+using Digest = array<Byte, 32>;
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Incremental SHA-256 (FIPS 180-4).
+ */
+class Sha256 {
+public:
+    Sha256();
+
+    /**
+     * @brief Absorbs more message bytes.
+     * @param data The bytes to hash.
+     * @param length Number of bytes.
+     */
+    void update(const Byte* data, size_t length);
+
+    /**
+     * @brief Pads the message and returns the digest. The object must not be reused.
+     * @return The 32-byte digest.
+     */
+    Digest finish();
+
+private:
+    void compress(const Byte* block);
+
+    uint32_t state[8];
+    Byte buffer[64];
+    size_t buffered = 0;
+    uint64_t totalBytes = 0;
+};
+
+/**
+ * @brief HMAC-SHA256 (RFC 2104) with the key schedule precomputed.
+ * @details The inner and outer padded-key blocks are hashed once in the
+ *          constructor, so each mac() of a short message costs two SHA-256
+ *          compressions instead of four.
+ */
+class HmacSha256 {
+public:
+    /**
+     * @brief Prepares the keyed inner and outer hash states.
+     * @param key The HMAC key.
+     * @param length Key length in bytes (keys over 64 bytes are hashed first).
+     */
+    HmacSha256(const Byte* key, size_t length);
+
+    /**
+     * @brief Computes the MAC of a message.
+     * @param data The message bytes.
+     * @param length Number of bytes.
+     * @return The 32-byte MAC.
+     */
+    Digest mac(const Byte* data, size_t length) const;
+
+private:
+    Sha256 inner;
+    Sha256 outer;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Hashes a byte string with SHA-256.
+ * @param data The message bytes.
+ * @param length Number of bytes.
+ * @return The 32-byte digest.
+ */
+Digest sha256(const Byte* data, size_t length);
+
+/**
+ * @brief Formats a digest (or any byte string) as lowercase hex.
+ * @param data The bytes.
+ * @param length Number of bytes.
+ * @return The hex string.
+ */
+string toHex(const Byte* data, size_t length);
+
+#endif // SHA256_H
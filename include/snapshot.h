@@ -0,0 +1,153 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "election.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/*
+###########################################################################
+    FILE FORMAT
+###########################################################################
+
+    All integers are little-endian. Big integers are stored as a u32 byte
+    length followed by their magnitude in big-endian byte order.
+
+    [header, 64 bytes]
+        char magic[8]       "CVSNAP\0\0"
+        u32  version        SNAPSHOT_VERSION
+        u32  byteOrder      0x01020304 as written by the host
+        i32  numCandidates, max_voters, keySize
+        u32  reserved
+        u64  ballotCount
+        u64  metaOffset, metaSize
+        u64  indexOffset
+    [meta]   n, nSquared, lambda, g, mu, encryptedTally, aes_key (32 bytes),
+             voterKey (32 bytes, v2+), numCandidates weights,
+             numCandidates i64 actual vote counts, then (v3+) the tally tree:
+             u32 nodeCount and per node, root first and parents before
+             children: u32 parent, u32 name length + name bytes, u64 ballots,
+             subtotal; then (v4+) u64 revokedCount and that many u64 indices
+    [data]   per ballot: AES bytes, the length-prefixed Paillier ciphertext,
+             then the 16-byte voter tag (v2+), the u32 reporting unit (v4+)
+             and the u8 candidate, sealed as in ballot logs (v5+)
+    [index]  per ballot: u64 dataOffset, u32 piiLength, u32 weightLength
+
+    Version 1 files (no voter key or tags) still load; their ballots are not
+    added to the voter index. Version 1 and 2 files have no tally tree; they
+    load with only the root, holding the whole tally. Ballots in files before
+    version 4 are all live and counted in the root. Ballots in files before
+    version 5 carry no candidate; revoking one leaves the verification counts
+    as they are.
+*/
+
+const uint32_t SNAPSHOT_VERSION = 5;
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief A read-only, memory-mapped election snapshot.
+ * @details Opening only validates the header; ballots are decoded from the
+ *          mapping on demand, so reopening costs the same for ten ballots or ten
+ *          million. The mapping stays valid after the file is replaced or removed.
+ */
+class MappedSnapshot {
+public:
+    /**
+     * @brief Maps a snapshot file and validates its header.
+     * @param path The snapshot file.
+     * @throws std::runtime_error if the file cannot be opened or mapped, or is not a valid snapshot.
+     */
+    explicit MappedSnapshot(const string& path);
+    ~MappedSnapshot();
+
+    MappedSnapshot(const MappedSnapshot&) = delete;
+    MappedSnapshot& operator=(const MappedSnapshot&) = delete;
+
+    size_t ballotCount() const { return count; }
+
+    /**
+     * @brief Decodes one ballot from the mapping.
+     * @param index The ballot index (0 to ballotCount()-1).
+     * @return A copy of the ballot.
+     * @throws std::out_of_range if the index is out of range.
+     * @throws std::runtime_error if the index entry points outside the data section.
+     */
+    EncryptedBallot ballot(size_t index) const;
+
+    /**
+     * @brief Reads only the voter tag of one ballot (all zero in version 1 files).
+     * @param index The ballot index (0 to ballotCount()-1).
+     * @return The voter tag.
+     * @throws std::out_of_range if the index is out of range.
+     */
+    VoterTag voterTag(size_t index) const;
+
+    /**
+     * @brief Reads the sealed candidate of one ballot (see candidateMask()).
+     * @param index The ballot index (0 to ballotCount()-1).
+     * @param sealed Receives the candidate XORed with its mask.
+     * @return False for files before version 5, which do not store it.
+     * @throws std::out_of_range if the index is out of range.
+     */
+    bool sealedCandidate(size_t index, Byte& sealed) const;
+
+    /**
+     * @brief Restores everything except the ballots into an election.
+     * @details Version 1 files have no voter key; a fresh one is generated.
+     * @param election Receives keys, weights, counts and the running tally.
+     */
+    void restoreMetadata(Election& election) const;
+
+private:
+    // Reads and bounds-checks one index entry; returns a pointer to the ballot's data.
+    const Byte* entryAt(size_t index, uint32_t& piiLength, uint32_t& weightLength) const;
+
+    string path;
+    const Byte* base = nullptr;
+    size_t length = 0;
+    size_t count = 0;
+    uint32_t version = 0;
+    uint64_t metaOffset = 0;
+    uint64_t metaSize = 0;
+    uint64_t indexOffset = 0;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Writes an election, including every ballot, to a snapshot file.
+ * @details Writes to a temporary file in the same directory, fsyncs it, then
+ *          renames it over 'path', so readers see either the old or the new
+ *          snapshot and never a partial one.
+ * @param election A set-up election.
+ * @param path Destination file.
+ * @return Number of bytes written.
+ * @throws std::invalid_argument if the election has not been set up.
+ * @throws std::runtime_error on I/O errors.
+ */
+size_t saveSnapshot(const Election& election, const string& path);
+
+/**
+ * @brief Replaces an election with the contents of a snapshot file.
+ * @details Keys and metadata are decoded into the election; ballots stay in
+ *          the mapped file and are read through ballotAt(). New ballots are
+ *          appended to election.allBallots after the mapped ones.
+ * @param election The election to replace.
+ * @param path The snapshot file.
+ * @throws std::runtime_error if the file is missing or invalid.
+ */
+void loadSnapshot(Election& election, const string& path);
+
+#endif // SNAPSHOT_H
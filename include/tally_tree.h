@@ -0,0 +1,162 @@
+#ifndef TALLY_TREE_H
+#define TALLY_TREE_H
+
+#include "paillier.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <gmpxx.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief One reporting unit (region, county, precinct, ...) in the tally tree.
+ *
+ * @param name The unit's own name, e.g. "precinct-17" ("" for the root).
+ * @param path Slash-separated names from the root, e.g. "north/cook/precinct-17".
+ * @param parent Index of the parent node (the root is its own parent).
+ * @param depth Distance from the root (0 for the root).
+ * @param ballots Ballots cast in this unit and all units below it.
+ * @param subtotal Encrypted sum of those ballots (product of ciphertexts mod n^2).
+ * @param children Indices of the child nodes, in creation order.
+ */
+struct TallyNode {
+    string name;
+    string path;
+    size_t parent = 0;
+    int depth = 0;
+    uint64_t ballots = 0;
+    mpz_class subtotal = 1;
+    vector<size_t> children;
+};
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Encrypted subtotals for a hierarchy of reporting units.
+ * @details Node 0 is the election total. A ballot cast in a precinct is
+ *          multiplied into the precinct's subtotal and every ancestor's, so it
+ *          costs O(depth) modular multiplications, and any subtotal can be
+ *          decrypted at any time without rescanning ballots. Not thread-safe:
+ *          callers serialize access.
+ */
+class TallyTree {
+public:
+    TallyTree();
+
+    /**
+     * @brief Finds or creates the node for a path such as "north/cook/precinct-17".
+     * @details Empty path components are ignored, so "" and "/" name the root.
+     * @param path Slash-separated unit names from the top level down.
+     * @return The node's index.
+     */
+    size_t resolve(const string& path);
+
+    /**
+     * @brief Looks up an existing node.
+     * @param path Slash-separated unit names.
+     * @param node Receives the node's index when found.
+     * @return True if the node exists.
+     */
+    bool find(const string& path, size_t& node) const;
+
+    /**
+     * @brief Finds or creates a named child node.
+     * @param parent The parent's index.
+     * @param name The child's name (must not contain '/').
+     * @return The child's index.
+     * @throws std::invalid_argument if the parent does not exist or the name is invalid.
+     */
+    size_t child(size_t parent, const string& name);
+
+    /**
+     * @brief Folds encrypted votes into a node and all of its ancestors.
+     * @param node The node the votes were cast in.
+     * @param ciphertext A ballot ciphertext or a product of several.
+     * @param ballots Number of ballots in 'ciphertext'.
+     * @param keys The election's Paillier keys.
+     */
+    void add(size_t node, const mpz_class& ciphertext, uint64_t ballots, const PaillierKeys& keys);
+
+    /**
+     * @brief Takes previously added votes back out of a node and all of its ancestors.
+     * @param node The node the votes were counted in.
+     * @param inverse Inverse mod n^2 of the ciphertext (or product) being removed.
+     * @param ballots Number of ballots being removed.
+     * @param keys The election's Paillier keys.
+     */
+    void remove(size_t node, const mpz_class& inverse, uint64_t ballots, const PaillierKeys& keys);
+
+    /**
+     * @brief Overwrites a node's counters, e.g. when restoring a snapshot.
+     * @param node The node's index.
+     * @param ballots Ballots cast in the node's subtree.
+     * @param subtotal Encrypted subtotal of those ballots.
+     */
+    void restore(size_t node, uint64_t ballots, const mpz_class& subtotal);
+
+    /**
+     * @brief Lists a node and its descendants, breadth first.
+     * @param node The subtree's root.
+     * @param levels How many levels below 'node' to include (0 = only the node).
+     * @return Node indices, parents before children.
+     */
+    vector<size_t> subtree(size_t node, int levels) const;
+
+    const TallyNode& node(size_t index) const { return nodes.at(index); }
+    size_t size() const { return nodes.size(); }
+
+private:
+    vector<TallyNode> nodes;
+    unordered_map<string, size_t> byPath; // Canonical paths only
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Decrypts several subtotals at once.
+ * @details The decryptions are independent, so they are spread across worker
+ *          threads; election-night reporting of a whole level then costs about
+ *          one decryption per thread instead of one per unit.
+ * @param tree The tally tree.
+ * @param nodes Indices of the nodes to decrypt.
+ * @param keys The election's Paillier keys.
+ * @param threads Worker threads (>= 1).
+ * @return The decrypted base-M sums, in the order of 'nodes'.
+ */
+vector<mpz_class> decryptSubtotals(const TallyTree& tree, const vector<size_t>& nodes, const PaillierKeys& keys,
+                                   int threads);
+
+/**
+ * @brief Parses a simulated hierarchy such as "3,4,5" (3 regions of 4 counties of 5 precincts).
+ * @param spec Comma-separated fan-out per level.
+ * @return The fan-out per level (empty for an empty spec).
+ * @throws std::invalid_argument on malformed input or more than 1,000,000 leaves.
+ */
+vector<int> parseFanout(const string& spec);
+
+/**
+ * @brief Names a simulated unit path for a given leaf number.
+ * @param leaf Leaf number (0 to the product of the fan-outs - 1).
+ * @param fanout Fan-out per level, as returned by parseFanout().
+ * @return A path such as "region-2/county-1/precinct-4" (one component per level).
+ */
+string simulatedUnitPath(size_t leaf, const vector<int>& fanout);
+
+#endif // TALLY_TREE_H
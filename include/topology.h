@@ -0,0 +1,60 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief One NUMA node: a socket (or sub-socket domain) and the CPUs attached to its memory.
+ *
+ * @param id The kernel's node number.
+ * @param cpus CPUs of the node this process may run on.
+ */
+struct NumaNode {
+    int id = 0;
+    vector<int> cpus;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Parses a kernel CPU or node list such as "0-3,8,10-11".
+ * @param list The list.
+ * @return The numbers, ascending.
+ * @throws std::invalid_argument on a malformed list.
+ */
+vector<int> parseCpuList(const string& list);
+
+/**
+ * @brief Returns the NUMA nodes this process can run on.
+ * @details Read from /sys/devices/system/node and intersected with the
+ *          process's CPU affinity, so nodes outside a cpuset or taskset are
+ *          left out. Without NUMA information (a kernel without NUMA support,
+ *          or another OS) all allowed CPUs are reported as one node 0.
+ * @return The nodes, by id, each with at least one CPU.
+ */
+vector<NumaNode> numaNodes();
+
+/**
+ * @brief Restricts the calling thread to a set of CPUs.
+ * @details Linux places pages on the node of the thread that first touches
+ *          them, so memory a pinned thread allocates and fills stays on its
+ *          node. A no-op on systems without thread affinity.
+ * @param cpus The CPUs (e.g. a NumaNode's).
+ * @return True if the affinity was set.
+ */
+bool pinThreadToCpus(const vector<int>& cpus);
+
+#endif // TOPOLOGY_H
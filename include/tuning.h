@@ -0,0 +1,131 @@
+#ifndef TUNING_H
+#define TUNING_H
+
+#include "modmul_simd.h"
+#include "paillier.h"
+#include "pipeline.h"
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Measured per-operation costs of one host at one key size.
+ * @details The costs are medians in nanoseconds per operation. Everything
+ *          tunePipeline() sets is derived from them, so one profile serves
+ *          any thread budget.
+ *
+ * @param cpu CPU model name (from /proc/cpuinfo), part of the cache key.
+ * @param keySize Paillier modulus size in bits, part of the cache key.
+ * @param encVoteNs One encVote (AES stage excluded).
+ * @param decVoteNs One decVote.
+ * @param addVotesNs One ciphertext folded into a tally with the fastest kernel.
+ *                   Callers cap detectSimdLevel() at 'simd' to get that kernel.
+ * @param aesNs One encryptAES256 of a typical name.
+ * @param simd The fastest tally kernel measured on this host.
+ * @param hwThreads Hardware threads when the profile was measured.
+ * @param calibratedAt Unix time of the measurement.
+ */
+struct TuningProfile {
+    string cpu;
+    int keySize = 0;
+    uint64_t encVoteNs = 0;
+    uint64_t decVoteNs = 0;
+    uint64_t addVotesNs = 0;
+    uint64_t aesNs = 0;
+    SimdLevel simd = SIMD_SCALAR;
+    unsigned hwThreads = 0;
+    long long calibratedAt = 0;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Returns this host's CPU model name, or "unknown".
+ */
+string cpuModelName();
+
+/**
+ * @brief Returns the default profile cache: $XDG_CACHE_HOME/cryptovote-tuning.ndjson,
+ *        else ~/.cache/cryptovote-tuning.ndjson, else the file in the working directory.
+ */
+string defaultTuningPath();
+
+/**
+ * @brief Microbenchmarks encVote, decVote, addVotes and AES on this host.
+ * @details Each operation is repeated for about 200 ms (at least 8 times)
+ *          and the median is kept. The tally is timed on every SIMD kernel
+ *          the CPU has up to the setSimdLimit() cap, and the fastest is
+ *          recorded. The cap itself is not changed. Takes about a second at
+ *          1024 bits and grows with the key size. The calibration's own
+ *          operations are counted in the hot-path metrics.
+ * @param keys Keys of the size to calibrate for.
+ * @param keySize Their modulus size in bits.
+ * @return The measured profile.
+ */
+TuningProfile calibrateHost(const PaillierKeys& keys, int keySize);
+
+/**
+ * @brief Looks up the cached profile for this CPU and a key size.
+ * @param path The profile cache (one JSON profile per line); a missing file is empty.
+ * @param keySize The key size in bits.
+ * @param profile Receives the profile when found.
+ * @return True if a profile for this CPU model and key size was cached.
+ */
+bool loadTuningProfile(const string& path, int keySize, TuningProfile& profile);
+
+/**
+ * @brief Stores a profile, replacing any cached one for the same CPU model and key size.
+ * @details The file is rewritten to a temporary name and renamed into
+ *          place, so concurrent runs never read a half-written cache.
+ * @param path The profile cache.
+ * @param profile The profile to store.
+ * @throws std::runtime_error if the file cannot be written.
+ */
+void saveTuningProfile(const string& path, const TuningProfile& profile);
+
+/**
+ * @brief Returns the cached profile for the keys' size, calibrating and caching it if there is none.
+ * @param path The profile cache.
+ * @param keys The election's keys.
+ * @param keySize Their modulus size in bits.
+ * @param calibrated If non-null, set to whether the host was measured now.
+ * @return The profile.
+ * @throws std::runtime_error if a new profile cannot be written.
+ */
+TuningProfile tuningProfileFor(const string& path, const PaillierKeys& keys, int keySize,
+                               bool* calibrated = nullptr);
+
+/**
+ * @brief Sizes a pipeline from a profile.
+ * @details Workers are split in proportion to each stage's per-record cost,
+ *          so the stages run at about the same rate (at least one each).
+ *          Batches are made large enough that the cheapest stage spends about
+ *          50 us per batch, keeping queue hand-offs below a few percent of
+ *          its time, but small enough that a Paillier batch takes under 20 ms,
+ *          which bounds the idle tail at the end of a run and the delay of a
+ *          cancel. Each queue holds two batches per consumer, at least four.
+ * @param profile The host's profile.
+ * @param threads Total worker threads (>= 1).
+ * @param config The config whose thread counts, batch size and queue depth are overwritten.
+ */
+void tunePipeline(const TuningProfile& profile, int threads, PipelineConfig& config);
+
+/**
+ * @brief Serializes a profile, with the pipeline it gives for a thread budget, as one JSON line.
+ * @param profile The profile.
+ * @param threads Thread budget for the derived pipeline fields (0 = leave them out).
+ */
+string tuningProfileToJson(const TuningProfile& profile, int threads = 0);
+
+#endif // TUNING_H
@@ -0,0 +1,135 @@
+#ifndef VOTER_INDEX_H
+#define VOTER_INDEX_H
+
+#include "paillier.h"
+#include "sha256.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+/**
+ * @brief Maps voter tags to ballot indices for O(1) lookup and duplicate detection.
+ * @details An open-addressing table with linear probing, kept at most half
+ *          full. Tags are HMAC outputs and therefore already uniformly
+ *          distributed, so their low bits are used directly as the slot
+ *          number. An optional Bloom filter (about 10 bits per expected
+ *          voter and 7 probes, roughly 1% false positives) answers most
+ *          "new voter" checks without touching the table.
+ */
+class VoterIndex {
+public:
+    /**
+     * @brief Creates an empty index.
+     * @param expected Number of voters to size the table and Bloom filter for.
+     * @param useBloom If true, lookups check the Bloom filter first.
+     */
+    explicit VoterIndex(size_t expected = 0, bool useBloom = true);
+
+    /**
+     * @brief Grows the table (and rebuilds the Bloom filter) for 'expected' voters.
+     * @param expected Number of voters the index should hold without rehashing.
+     */
+    void reserve(size_t expected);
+
+    /**
+     * @brief Adds a voter unless the tag is already present.
+     * @param tag The voter's tag.
+     * @param ballot The ballot index to associate with it.
+     * @param existing If non-null and the tag is present, receives its ballot index.
+     * @return True if inserted, false if the voter was already indexed.
+     */
+    bool insert(const VoterTag& tag, size_t ballot, size_t* existing = nullptr);
+
+    /**
+     * @brief Points an indexed voter at a different ballot, e.g. after a re-vote.
+     * @param tag The voter's tag.
+     * @param ballot The new ballot index.
+     * @return False if the voter is not indexed.
+     */
+    bool update(const VoterTag& tag, size_t ballot);
+
+    /**
+     * @brief Looks up a voter.
+     * @param tag The voter's tag.
+     * @param ballot Receives the ballot index when found.
+     * @return True if the tag is indexed.
+     */
+    bool find(const VoterTag& tag, size_t& ballot) const;
+
+    /**
+     * @brief Bloom filter pre-check.
+     * @param tag The voter's tag.
+     * @return False if the tag is definitely absent; true if it may be present
+     *         (always true when the filter is disabled).
+     */
+    bool mayContain(const VoterTag& tag) const;
+
+    size_t size() const { return count; }
+    size_t capacity() const { return slots.size(); }
+
+private:
+    struct Slot {
+        uint64_t lo;
+        uint64_t hi;
+        uint64_t ballotPlusOne; // 0 marks an empty slot
+    };
+
+    void rehash(size_t newCapacity);
+    void bloomAdd(uint64_t lo, uint64_t hi);
+    bool bloomTest(uint64_t lo, uint64_t hi) const;
+
+    vector<Slot> slots;
+    size_t mask = 0;
+    size_t count = 0;
+    bool useBloom;
+    vector<uint64_t> bloom;
+    size_t bloomMask = 0;
+};
+
+/*
+###########################################################################
+    FUNCTION PROTOTYPES
+###########################################################################
+*/
+
+/**
+ * @brief Canonicalizes PII before tagging.
+ * @details Trims leading/trailing whitespace, collapses internal runs of
+ *          whitespace to one space and lowercases ASCII letters, so
+ *          "  Jane   DOE" and "jane doe" get the same tag.
+ * @param pii The raw PII.
+ * @return The normalized PII.
+ */
+string normalizePii(const string& pii);
+
+/**
+ * @brief Computes a voter's tag: HMAC-SHA256 of the normalized PII, truncated to 128 bits.
+ * @details The tag is deterministic for a given election key, so it supports
+ *          lookups and duplicate detection, but it reveals nothing about the
+ *          PII without the key.
+ * @param hmac HMAC keyed with the election's voter key.
+ * @param pii The raw PII.
+ * @return The 16-byte tag.
+ */
+VoterTag computeVoterTag(const HmacSha256& hmac, const string& pii);
+
+/**
+ * @brief Returns the byte a ballot's candidate is XORed with in ballot logs and snapshots.
+ * @details One byte of HMAC(voterKey, "candidate" || index), so a file that
+ *          stores candidates next to ballots does not show how anyone voted.
+ * @param hmac HMAC keyed with the election's voter key.
+ * @param index The ballot index.
+ * @return The mask.
+ */
+Byte candidateMask(const HmacSha256& hmac, size_t index);
+
+#endif // VOTER_INDEX_H
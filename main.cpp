@@ -1,6 +1,16 @@
 #include "paillier.h" 
 #include "aes.h"      
+#include "cli.h"
+#include "daemon.h"
+#include "election.h"
+#include "gmp_arena.h"
+#include "metrics.h"
+#include "modmul_simd.h"
+#include "pipeline.h"
+#include "tuning.h"
 #include <iostream>
+#include <iomanip>
+#include <thread>
 #include <vector>
 #include <string>
 #include <stdexcept>
@@ -10,7 +20,63 @@
 using namespace std;
 using Byte = unsigned char;
 
-int main() {
+int runInteractive();
+
+// Writes the hot-path metrics requested with --metrics-out, if any.
+int writeMetrics(const CliOptions& options, int code) {
+    if (options.metricsOut.empty()) {
+        return code;
+    }
+    try {
+        writeMetricsFile(options.metricsOut, options.metricsFormat);
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        return code ? code : 1;
+    }
+    return code;
+}
+
+int main(int argc, char* argv[]) {
+    // --- Command-Line Modes ---
+    // No arguments keeps the interactive prompt; see printUsage() for the rest.
+    CliOptions options;
+    try {
+        options = parseCliOptions(argc, argv);
+    } catch (const exception& e) {
+        cerr << e.what() << endl;
+        printUsage();
+        return 1;
+    }
+    if (options.gmpArena) {
+        installGmpArena(); // Before the first GMP allocation
+    }
+    setSimdLimit(parseSimdLevel(options.simd));
+    switch (options.mode) {
+        case CliOptions::HELP:
+            printUsage();
+            return 0;
+        case CliOptions::DAEMON: {
+            BallotLogOptions wal;
+            wal.commitDelayMs = options.walDelayMs;
+            string tuningPath;
+            if (options.tune) {
+                tuningPath = options.tuningPath.empty() ? defaultTuningPath() : options.tuningPath;
+            }
+            return writeMetrics(options, runDaemon(options.socketPath, options.snapshotPath, options.walPath, wal,
+                                                   tuningPath));
+        }
+        case CliOptions::BATCH:
+            return writeMetrics(options, runBatch(options));
+        case CliOptions::CALIBRATE:
+            return writeMetrics(options, runCalibrate(options));
+        case CliOptions::INTERACTIVE:
+            break;
+    }
+    return writeMetrics(options, runInteractive());
+}
+
+// Runs the prompted simulation.
+int runInteractive() {
     // --- Variable Declarations ---
     int numCandidates = 0;
     int max_voters = 0;
@@ -18,12 +84,7 @@ int main() {
     int paillierKeySize = 1024;
     gmp_randstate_t rand_state;
     bool rand_init = false;
-    PaillierKeys paillierKeys;
-    array<Byte, 32> aes_key;
-    vector<mpz_class> weights;
-    vector<EncryptedBallot> allBallots;
-    vector<int> actualVoteCounts;
-    mpz_class encryptedTally;
+    Election election;
     mpz_class decryptedTally;
 
     try {
@@ -38,7 +99,7 @@ int main() {
             cout << "Enter the number of votes to simulate for this test run: ";
             cin >> num_votes;
         } else {
-            // Piped from backend
+            // Piped input
             cin >> numCandidates >> max_voters >> num_votes;
         }
         cout << "----------------------------------------" << endl;
@@ -49,64 +110,35 @@ int main() {
         gmp_randinit_mt(rand_state);
         unsigned long seed = static_cast<unsigned long>(time(nullptr));
         gmp_randseed_ui(rand_state, seed);
-        srand(time(nullptr)); // Seed C's rand()
         rand_init = true;
         cout << "Random states initialized." << endl;
 
-        // --- Key Generation ---
-        cout << "Generating Paillier keys (Size: " << paillierKeySize << " bits)..." << endl;
-        paillierKeys = genKeyPaillier(paillierKeySize);
-        cout << "Paillier keys generated." << endl;
-        aes_key = genKeyAES(rand_state);
+        // --- Key Generation & Weights ---
+        setupElection(election, numCandidates, max_voters, paillierKeySize, rand_state);
 
-        // --- Simulation & Encryption ---
+        // --- Simulation, Encryption & Tallying ---
+        // PII encryption, Paillier encryption and accumulation run as overlapping
+        // pipeline stages, each with its own worker pool.
         cout << "Simulating and encrypting " << num_votes << " votes..." << endl;
-        weights = calcWeights(numCandidates, max_voters);
-        allBallots.clear();
-        allBallots.reserve(num_votes);
-        actualVoteCounts.assign(numCandidates, 0);
-
-        for (int i = 0; i < num_votes; i++) {
-            // Generate simulated PII
-            string firstName = "FName_" + to_string(i);
-            string lastName = "LName_" + to_string(i);
-            string pii = firstName + " " + lastName;
-
-            // Encrypt PII using AES
-            vector<Byte> enc_pii = encryptAES256(pii, aes_key);
-
-            // Simulate a random vote choice
-            int voterChoice = rand() % numCandidates;
-            actualVoteCounts[voterChoice]++;
-
-            // Get the corresponding plaintext weight
-            mpz_class plaintextWeight = getVoteWeight(voterChoice, weights);
-
-            // Encrypt the weight using Paillier
-            mpz_class enc_weight = encVote(plaintextWeight, paillierKeys, rand_state);
-
-            // Store the encrypted ballot
-            allBallots.push_back({enc_pii, enc_weight});
-        }
-        cout << num_votes << " votes processed and encrypted." << endl;
-
-        // --- Tallying---
-        cout << "Tallying Paillier encrypted votes..." << endl;
-        if (!allBallots.empty()) {
-            encryptedTally = allBallots[0].encWeight;
-            for (size_t i = 1; i < allBallots.size(); i++) {
-                encryptedTally = addVotes(encryptedTally, allBallots[i].encWeight, paillierKeys);
-            }
-            cout << "Tallying complete." << endl;
-        }
-        else {
-            cout << " No votes to tally." << endl;
+        PipelineConfig config;
+        sizePipeline(static_cast<int>(thread::hardware_concurrency()), config);
+        config.keepBallots = true;
+        config.seed = seed;
+        PipelineStats stats = runPipeline(election, simulatedSource(num_votes, 0, numCandidates, seed), config);
+        cout << stats.records << " votes processed, encrypted and tallied in "
+             << fixed << setprecision(1) << stats.wallMs << " ms." << endl;
+        for (const StageStats& stage : stats.stages) {
+            cout << " - " << left << setw(9) << stage.name << right
+                 << stage.workers << " worker(s), " << setprecision(0) << stage.itemsPerSec
+                 << " ballots/s, max queue depth " << stage.maxQueueDepth << endl;
         }
+        cout.unsetf(ios::floatfield);
+        cout << setprecision(6);
 
         // --- Decryption ---
-        if (!allBallots.empty()) {
+        if (!election.allBallots.empty()) {
              cout << "Decrypting final Paillier tally..." << endl;
-             decryptedTally = decVote(encryptedTally, paillierKeys);
+             decryptedTally = decVote(election.encryptedTally, election.paillierKeys);
              cout << " Decrypted total sum: " << decryptedTally << endl;
         }
         else {
@@ -116,7 +148,7 @@ int main() {
 
 
         // --- Results & Verification ---
-        bool success = printResults(decryptedTally, numCandidates, max_voters, actualVoteCounts, num_votes);
+        bool success = printResults(decryptedTally, numCandidates, max_voters, election.actualVoteCounts, num_votes);
         if (success) {
             cout << "Results verified successfully." << endl;
         } else {
@@ -125,13 +157,13 @@ int main() {
 
         // --- Individual Decryption with PII ---
         cout << "\n----------------------------------------" << endl;
-        if (!allBallots.empty()) {
+        if (!election.allBallots.empty()) {
             char choice = 'n';
             cout << "Do you want to decrypt a specific ballot? (y/N): ";
             cin >> choice; // Assume y/Y/x input
 
             while (choice == 'y' || choice == 'Y') {
-                decryptBallot(allBallots, paillierKeys, aes_key);
+                decryptBallot(election.allBallots, election.paillierKeys, election.aes_key);
                 cout << "Would you like to decrypt another ballot? (y/N): ";
                 cin >> choice; 
             } 
@@ -154,4 +186,4 @@ int main() {
     }
     cout << "===== Simulation Finished =====\n" << endl;
     return 0;
-}
\ No newline at end of file
+}
@@ -84,6 +84,7 @@ Goal: Decrypt ciphertext (encrypted using this scheme) to get the original plain
 
 */
 #include "aes.h"
+#include "metrics.h"
 #include <array>
 #include <iostream>
 #include <iomanip>
@@ -95,7 +96,6 @@ Goal: Decrypt ciphertext (encrypted using this scheme) to get the original plain
 
 using namespace std;
 using Byte = unsigned char;
-using Block = array<Byte, 16>;
 
 const size_t BLOCK_SIZE = 16;
 const size_t KEY_SIZE = 32;
@@ -429,6 +429,7 @@ void removePadding(vector<Byte>& data) {
 }
 
 vector<Byte> encryptAES256(const string& plaintext, const array<Byte, KEY_SIZE>& key) {
+    MetricTimer timer(METRIC_AES_ENCRYPT, plaintext.size());
     auto roundKeys = expandKey(key);
     Block iv = generateRandomIV();
     vector<Byte> paddedText = padData(plaintext);
@@ -455,6 +456,7 @@ vector<Byte> encryptAES256(const string& plaintext, const array<Byte, KEY_SIZE>&
 }
 
 string decryptAES256(const vector<Byte>& ciphertext, const array<Byte, KEY_SIZE>& key) {
+    MetricTimer timer(METRIC_AES_DECRYPT, ciphertext.size());
     if (ciphertext.size() < BLOCK_SIZE || (ciphertext.size() - BLOCK_SIZE) % BLOCK_SIZE != 0) {
         throw invalid_argument("Invalid ciphertext size");
     }
@@ -0,0 +1,230 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "audit.h"
+#include "aes.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <exception>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+// Hashes a big integer by its limbs.
+size_t MpzHash::operator()(const mpz_class& value) const {
+    const mpz_srcptr z = value.get_mpz_t();
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ static_cast<uint64_t>(z->_mp_size);
+    for (size_t i = 0, n = mpz_size(z); i < n; i++) {
+        h = (h ^ static_cast<uint64_t>(mpz_getlimbn(z, i))) * 0xBF58476D1CE4E5B9ULL;
+        h ^= h >> 31;
+    }
+    return static_cast<size_t>(h);
+}
+
+// Rebuilds the map from an election's weights.
+void WeightIndex::assign(const vector<mpz_class>& weights) {
+    candidates.clear();
+    candidates.reserve(weights.size());
+    for (size_t i = 0; i < weights.size(); i++) {
+        candidates.emplace(weights[i], static_cast<int>(i));
+    }
+}
+
+// Returns the candidate whose weight this is, or -1.
+int WeightIndex::candidate(const mpz_class& weight) const {
+    auto it = candidates.find(weight);
+    return it == candidates.end() ? -1 : it->second;
+}
+
+AuditCache::AuditCache(size_t capacity, size_t shardCount) {
+    shardCount = max<size_t>(1, shardCount);
+    shardCapacity = max<size_t>(1, (capacity + shardCount - 1) / shardCount);
+    for (size_t i = 0; i < shardCount; i++) {
+        shards.emplace_back(new Shard());
+    }
+}
+
+// Picks the shard of a ballot index.
+AuditCache::Shard& AuditCache::shardFor(size_t index) {
+    // Audits often walk consecutive indices; mix them so neighbours land on different shards
+    uint64_t h = static_cast<uint64_t>(index) * 0x9E3779B97F4A7C15ULL;
+    return *shards[(h >> 32) % shards.size()];
+}
+
+// Looks up a ballot and marks it most recently used.
+bool AuditCache::get(size_t index, DecryptedBallot& ballot) {
+    Shard& shard = shardFor(index);
+    lock_guard<mutex> guard(shard.lock);
+    auto it = shard.slots.find(index);
+    if (it == shard.slots.end()) {
+        misses.fetch_add(1, memory_order_relaxed);
+        return false;
+    }
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    ballot = it->second->second;
+    hits.fetch_add(1, memory_order_relaxed);
+    return true;
+}
+
+// Caches a decrypted ballot, evicting the shard's oldest entry when full.
+void AuditCache::put(size_t index, const DecryptedBallot& ballot) {
+    Shard& shard = shardFor(index);
+    lock_guard<mutex> guard(shard.lock);
+    auto it = shard.slots.find(index);
+    if (it != shard.slots.end()) {
+        it->second->second = ballot;
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+    if (shard.entries.size() >= shardCapacity) {
+        shard.slots.erase(shard.entries.back().first);
+        shard.entries.pop_back();
+        evictions.fetch_add(1, memory_order_relaxed);
+    }
+    shard.entries.emplace_front(index, ballot);
+    shard.slots[index] = shard.entries.begin();
+}
+
+// Drops every entry.
+void AuditCache::clear() {
+    for (unique_ptr<Shard>& shard : shards) {
+        lock_guard<mutex> guard(shard->lock);
+        shard->entries.clear();
+        shard->slots.clear();
+    }
+}
+
+AuditStats AuditCache::stats() const {
+    AuditStats s;
+    for (const unique_ptr<Shard>& shard : shards) {
+        lock_guard<mutex> guard(shard->lock);
+        s.entries += shard->entries.size();
+    }
+    s.capacity = shardCapacity * shards.size();
+    s.hits = hits.load();
+    s.misses = misses.load();
+    s.evictions = evictions.load();
+    return s;
+}
+
+AuditService::AuditService(size_t capacity, size_t shards) : cache(capacity, shards) {}
+
+// Forgets all cached ballots and rebuilds the weight map.
+void AuditService::reset(const Election& election) {
+    lock_guard<mutex> guard(resetLock);
+    cache.clear();
+    weights.assign(election.weights);
+    modulus = election.paillierKeys.n;
+}
+
+// Resets if the election's keys are not the ones the cache was filled under.
+void AuditService::follow(const Election& election) {
+    {
+        lock_guard<mutex> guard(resetLock);
+        if (modulus == election.paillierKeys.n && weights.size() == election.weights.size()) {
+            return;
+        }
+    }
+    reset(election);
+}
+
+// Decrypts one ballot and resolves its candidate.
+DecryptedBallot AuditService::decrypt(const Election& election, size_t index) const {
+    EncryptedBallot ballot = ballotAt(election, index);
+    DecryptedBallot result;
+    result.pii = decryptAES256(ballot.aesEncryptedPII, election.aes_key);
+    result.weight = decVote(ballot.encWeight, election.paillierKeys);
+    result.candidate = weights.candidate(result.weight);
+    return result;
+}
+
+// Returns the decrypted PII, weight and candidate of one ballot.
+DecryptedBallot AuditService::audit(const Election& election, size_t index, bool* cached) {
+    follow(election);
+    DecryptedBallot result;
+    bool hit = cache.get(index, result);
+    if (!hit) {
+        result = decrypt(election, index);
+        cache.put(index, result);
+    }
+    if (cached) {
+        *cached = hit;
+    }
+    return result;
+}
+
+// Audits several ballots, decrypting each missing one once, in parallel.
+vector<DecryptedBallot> AuditService::auditMany(const Election& election, const vector<size_t>& indices,
+                                                int threads) {
+    follow(election);
+
+    // Collapse repeats, then serve what the cache holds
+    unordered_map<size_t, size_t> position; // ballot index -> slot in 'distinct'
+    vector<size_t> distinct;
+    for (size_t index : indices) {
+        if (position.emplace(index, distinct.size()).second) {
+            distinct.push_back(index);
+        }
+    }
+    vector<DecryptedBallot> found(distinct.size());
+    vector<size_t> missing; // Slots in 'distinct' to decrypt
+    for (size_t d = 0; d < distinct.size(); d++) {
+        if (!cache.get(distinct[d], found[d])) {
+            if (distinct[d] >= ballotCount(election)) {
+                throw out_of_range("Ballot " + to_string(distinct[d]) + " does not exist");
+            }
+            missing.push_back(d);
+        }
+    }
+
+    threads = max(1, min(threads, static_cast<int>(missing.size())));
+    exception_ptr error;
+    mutex errorLock;
+    auto worker = [&](size_t begin, size_t end) {
+        try {
+            for (size_t i = begin; i < end; i++) {
+                size_t d = missing[i];
+                found[d] = decrypt(election, distinct[d]);
+                cache.put(distinct[d], found[d]);
+            }
+        } catch (...) {
+            lock_guard<mutex> guard(errorLock);
+            if (!error) {
+                error = current_exception();
+            }
+        }
+    };
+    vector<thread> pool;
+    size_t chunk = (missing.size() + threads - 1) / threads;
+    for (int t = 1; t < threads; t++) {
+        size_t begin = min(missing.size(), t * chunk);
+        pool.emplace_back(worker, begin, min(missing.size(), begin + chunk));
+    }
+    worker(0, min(missing.size(), chunk)); // The calling thread takes the first share
+    for (thread& th : pool) {
+        th.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+
+    vector<DecryptedBallot> results;
+    results.reserve(indices.size());
+    for (size_t index : indices) {
+        results.push_back(found[position[index]]);
+    }
+    return results;
+}
@@ -0,0 +1,623 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "ballot_log.h"
+#include "metrics.h"
+#include "sha256.h"
+#include "voter_index.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <nmmintrin.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    ENCODING HELPERS
+###########################################################################
+*/
+
+namespace {
+
+const char LOG_MAGIC[8] = {'C', 'V', 'W', 'A', 'L', 0, 0, 0};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const size_t HEADER_SIZE = 40;
+const size_t FRAME_SIZE = 8; // u32 length + u32 crc
+const Byte RECORD_BALLOT = 1;
+const Byte RECORD_REVOCATION = 2;
+
+struct LogHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    uint64_t baseBallots;
+    Byte election[16];
+};
+static_assert(sizeof(LogHeader) == HEADER_SIZE, "ballot log header must be 40 bytes");
+
+string errnoText(const string& what, const string& path) {
+    return what + " " + path + ": " + strerror(errno);
+}
+
+// Table for the bytewise CRC-32C fallback (reflected polynomial 0x82F63B78).
+struct Crc32cTable {
+    uint32_t entry[256];
+    Crc32cTable() {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) {
+                c = (c >> 1) ^ (0x82F63B78 & (0 - (c & 1)));
+            }
+            entry[i] = c;
+        }
+    }
+};
+
+__attribute__((target("sse4.2")))
+uint32_t crc32cHardware(const Byte* data, size_t length, uint32_t c) {
+    uint64_t c64 = c;
+    for (; length >= 8; data += 8, length -= 8) {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        c64 = _mm_crc32_u64(c64, word);
+    }
+    c = static_cast<uint32_t>(c64);
+    for (; length > 0; data++, length--) {
+        c = _mm_crc32_u8(c, *data);
+    }
+    return c;
+}
+
+uint32_t crc32cSoftware(const Byte* data, size_t length, uint32_t c) {
+    static const Crc32cTable table;
+    for (; length > 0; data++, length--) {
+        c = table.entry[(c ^ *data) & 0xFF] ^ (c >> 8);
+    }
+    return c;
+}
+
+// Identifies the election a log belongs to: its keys, truncated to 16 bytes.
+array<Byte, 16> electionFingerprint(const Election& election) {
+    vector<Byte> bytes((mpz_sizeinbase(election.paillierKeys.n.get_mpz_t(), 2) + 7) / 8);
+    size_t n = 0;
+    mpz_export(bytes.data(), &n, 1, 1, 1, 0, election.paillierKeys.n.get_mpz_t());
+    bytes.resize(n);
+    bytes.insert(bytes.end(), election.voterKey.begin(), election.voterKey.end());
+    Digest digest = sha256(bytes.data(), bytes.size());
+    array<Byte, 16> fingerprint;
+    copy(digest.begin(), digest.begin() + fingerprint.size(), fingerprint.begin());
+    return fingerprint;
+}
+
+/**
+ * @brief Appends fixed-size values, byte strings and big integers to a record body.
+ */
+class RecordWriter {
+public:
+    explicit RecordWriter(vector<Byte>& out) : out(out) {}
+
+    void write(const void* data, size_t n) {
+        const Byte* p = static_cast<const Byte*>(data);
+        out.insert(out.end(), p, p + n);
+    }
+
+    template <typename T>
+    void put(const T& v) { write(&v, sizeof(v)); }
+
+    void putBytes(const void* data, size_t n) {
+        put(static_cast<uint32_t>(n));
+        write(data, n);
+    }
+
+    void putMpz(const mpz_class& z) {
+        size_t n = 0;
+        size_t start = out.size();
+        out.resize(start + 4 + (mpz_sizeinbase(z.get_mpz_t(), 2) + 7) / 8);
+        mpz_export(out.data() + start + 4, &n, 1, 1, 1, 0, z.get_mpz_t());
+        uint32_t len = static_cast<uint32_t>(n);
+        memcpy(out.data() + start, &len, 4);
+        out.resize(start + 4 + n);
+    }
+
+private:
+    vector<Byte>& out;
+};
+
+/**
+ * @brief Bounds-checked cursor over one record body.
+ */
+class RecordReader {
+public:
+    RecordReader(const Byte* p, size_t n, const string& path) : p(p), end(p + n), path(path) {}
+
+    const Byte* take(size_t n) {
+        if (static_cast<size_t>(end - p) < n) {
+            throw runtime_error("Malformed record in ballot log " + path);
+        }
+        const Byte* at = p;
+        p += n;
+        return at;
+    }
+
+    template <typename T>
+    T get() {
+        T v;
+        memcpy(&v, take(sizeof(T)), sizeof(T));
+        return v;
+    }
+
+    const Byte* getBytes(uint32_t& length) {
+        length = get<uint32_t>();
+        return take(length);
+    }
+
+    mpz_class getMpz() {
+        uint32_t len = 0;
+        const Byte* bytes = getBytes(len);
+        mpz_class z;
+        mpz_import(z.get_mpz_t(), len, 1, 1, 1, 0, bytes);
+        return z;
+    }
+
+private:
+    const Byte* p;
+    const Byte* end;
+    string path;
+};
+
+// Writes a whole buffer, retrying on short writes.
+void writeAll(int fd, const Byte* data, size_t size, const string& path) {
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = ::write(fd, data + done, size - done);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n < 0) {
+            throw runtime_error(errnoText("Write error on", path));
+        }
+        done += static_cast<size_t>(n);
+    }
+}
+
+// Fsyncs the directory holding a file, so a rename into it survives a crash.
+void syncDirectory(const string& path) {
+    size_t slash = path.find_last_of('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+}
+
+// Writes an empty log for an election next to 'path' and renames it into place; returns it open for appending.
+int createLog(const string& path, const Election& election) {
+    LogHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, LOG_MAGIC, sizeof(header.magic));
+    header.version = BALLOT_LOG_VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.baseBallots = ballotCount(election);
+    array<Byte, 16> fingerprint = electionFingerprint(election);
+    memcpy(header.election, fingerprint.data(), fingerprint.size());
+
+    string tmpPath = path + ".tmp." + to_string(getpid());
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        throw runtime_error(errnoText("Cannot create", tmpPath));
+    }
+    try {
+        writeAll(fd, reinterpret_cast<const Byte*>(&header), sizeof(header), tmpPath);
+        if (fsync(fd) < 0) {
+            throw runtime_error(errnoText("fsync failed on", tmpPath));
+        }
+        if (rename(tmpPath.c_str(), path.c_str()) < 0) {
+            throw runtime_error(errnoText("Cannot rename ballot log to", path));
+        }
+    } catch (...) {
+        close(fd);
+        unlink(tmpPath.c_str());
+        throw;
+    }
+    syncDirectory(path);
+    return fd;
+}
+
+// Applies one ballot record to the election, unless the snapshot already holds it.
+void replayBallot(Election& election, RecordReader& in, const HmacSha256& hmac, BallotLogRecovery& recovered,
+                  const string& path) {
+    size_t index = static_cast<size_t>(in.get<uint64_t>());
+    uint32_t length = 0;
+    const Byte* unitPath = in.getBytes(length);
+    string unit(reinterpret_cast<const char*>(unitPath), length);
+    Byte sealed = in.get<Byte>();
+    const Byte* pii = in.getBytes(length);
+
+    EncryptedBallot ballot;
+    ballot.aesEncryptedPII.assign(pii, pii + length);
+    ballot.encWeight = in.getMpz();
+    memcpy(ballot.voterTag.data(), in.take(ballot.voterTag.size()), ballot.voterTag.size());
+
+    size_t expected = ballotCount(election);
+    if (index < expected) {
+        recovered.skipped++;
+        return;
+    }
+    if (index > expected) {
+        throw runtime_error("Ballot log " + path + " skips from ballot " + to_string(expected) + " to " +
+                            to_string(index));
+    }
+    ballot.unit = static_cast<uint32_t>(election.tree.resolve(unit));
+    int candidate = sealed ^ candidateMask(hmac, index);
+
+    const PaillierKeys& keys = election.paillierKeys;
+    addVotes(election.encryptedTally, ballot.encWeight, keys, threadScratch(keys));
+    election.tree.add(ballot.unit, ballot.encWeight, 1, keys);
+    if (candidate < election.numCandidates) {
+        election.actualVoteCounts[candidate]++;
+    }
+    election.allBallots.push_back(std::move(ballot));
+    election.ballotCandidates.push_back(static_cast<Byte>(candidate));
+    recovered.ballots++;
+}
+
+// Reapplies a revocation record, leaving out ballots the snapshot already has revoked.
+void replayRevocation(Election& election, RecordReader& in, BallotLogRecovery& recovered) {
+    uint32_t count = in.get<uint32_t>();
+    vector<size_t> indices;
+    for (uint32_t i = 0; i < count; i++) {
+        size_t index = static_cast<size_t>(in.get<uint64_t>());
+        if (!election.revoked.count(index)) {
+            indices.push_back(index);
+        }
+    }
+    if (indices.empty()) {
+        recovered.skipped++;
+        return;
+    }
+    revokeBallots(election, indices);
+    recovered.revocations += indices.size();
+}
+
+// Length of the intact record framed at offset, or 0 if it is cut short or fails its CRC.
+uint32_t intactFrame(const Byte* base, size_t offset, size_t fileSize) {
+    if (fileSize - offset < FRAME_SIZE) {
+        return 0;
+    }
+    uint32_t length, crc;
+    memcpy(&length, base + offset, 4);
+    memcpy(&crc, base + offset + 4, 4);
+    // Cheap checks first: the CRC only runs over a length that fits and a known type
+    if (length == 0 || length > fileSize - offset - FRAME_SIZE) {
+        return 0;
+    }
+    Byte type = base[offset + FRAME_SIZE];
+    if (type != RECORD_BALLOT && type != RECORD_REVOCATION) {
+        return 0;
+    }
+    return crc32c(base + offset + FRAME_SIZE, length) == crc ? length : 0;
+}
+
+// True if a bad record is corruption of an acknowledged one rather than a torn tail.
+// A commit group is at most maxBatch bytes, or one larger record, and the next group
+// is only written once it is on disk. So an intact record past the group that could
+// hold the bad one proves that group was synced; records inside it prove nothing, as
+// its pages may have reached the disk in any order. Only one group's worth of offsets
+// past that point is searched.
+bool corruptBeforeIntact(const Byte* base, size_t offset, size_t fileSize, size_t maxBatch) {
+    uint32_t length;
+    memcpy(&length, base + offset, 4);
+    size_t group = maxBatch;
+    if (length <= fileSize - offset - FRAME_SIZE) {
+        group = max(group, FRAME_SIZE + length); // The bad record may be a group of its own
+    }
+    if (group >= fileSize - offset) {
+        return false;
+    }
+    size_t end = offset + group + min(maxBatch, fileSize - offset - group);
+    for (size_t next = offset + group; next + FRAME_SIZE < end; next++) {
+        if (intactFrame(base, next, fileSize) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+// Opens a log for an election, replaying its records first.
+BallotLog::BallotLog(const string& path, Election& election, const BallotLogOptions& options)
+    : path(path), options(options) {
+
+    if (election.weights.empty()) {
+        throw invalid_argument("Election has not been set up");
+    }
+    int readFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (readFd < 0 && errno != ENOENT) {
+        throw runtime_error(errnoText("Cannot open", path));
+    }
+    size_t validEnd = 0;
+    size_t fileSize = 0;
+    if (readFd >= 0) {
+        struct stat st;
+        if (fstat(readFd, &st) < 0) {
+            close(readFd);
+            throw runtime_error(errnoText("Cannot stat", path));
+        }
+        fileSize = static_cast<size_t>(st.st_size);
+    }
+
+    if (fileSize > 0) {
+        void* mapped = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, readFd, 0);
+        close(readFd);
+        readFd = -1;
+        if (mapped == MAP_FAILED) {
+            throw runtime_error(errnoText("Cannot map", path));
+        }
+        const Byte* base = static_cast<const Byte*>(mapped);
+        try {
+            LogHeader header;
+            if (fileSize < HEADER_SIZE || memcmp(base, LOG_MAGIC, sizeof(LOG_MAGIC)) != 0) {
+                throw runtime_error(path + " is not a CryptoVote ballot log");
+            }
+            memcpy(&header, base, sizeof(header));
+            if (header.byteOrder != BYTE_ORDER_MARK) {
+                throw runtime_error(path + " was written on a host with a different byte order");
+            }
+            if (header.version > BALLOT_LOG_VERSION) {
+                throw runtime_error(path + ": unsupported ballot log version " + to_string(header.version));
+            }
+            array<Byte, 16> fingerprint = electionFingerprint(election);
+            if (memcmp(header.election, fingerprint.data(), fingerprint.size()) != 0) {
+                recovered.stale = true;
+            } else if (header.baseBallots > ballotCount(election)) {
+                throw runtime_error("Ballot log " + path + " follows a snapshot of " +
+                                    to_string(header.baseBallots) + " ballots, but the election holds " +
+                                    to_string(ballotCount(election)));
+            } else {
+                // Replay up to the first record that is cut short or fails its CRC
+                HmacSha256 hmac(election.voterKey.data(), election.voterKey.size());
+                size_t offset = HEADER_SIZE;
+                while (fileSize - offset >= FRAME_SIZE) {
+                    uint32_t length = intactFrame(base, offset, fileSize);
+                    if (length == 0) {
+                        if (corruptBeforeIntact(base, offset, fileSize, options.maxBatchBytes)) {
+                            // Acknowledged ballots follow it: truncating would lose them
+                            throw runtime_error("Ballot log " + path + " has a corrupt record at byte " +
+                                                to_string(offset) + " followed by intact ones; refusing to truncate");
+                        }
+                        break;
+                    }
+                    const Byte* body = base + offset + FRAME_SIZE;
+                    RecordReader in(body + 1, length - 1, path);
+                    if (body[0] == RECORD_BALLOT) {
+                        replayBallot(election, in, hmac, recovered, path);
+                    } else {
+                        replayRevocation(election, in, recovered);
+                    }
+                    offset += FRAME_SIZE + length;
+                }
+                validEnd = offset;
+                recovered.tornBytes = fileSize - offset;
+                syncVoterIndex(election);
+            }
+        } catch (...) {
+            munmap(mapped, fileSize);
+            throw;
+        }
+        munmap(mapped, fileSize);
+    } else if (readFd >= 0) {
+        close(readFd);
+    }
+
+    if (recovered.stale) {
+        string aside = path + ".stale";
+        if (rename(path.c_str(), aside.c_str()) < 0) {
+            throw runtime_error(errnoText("Cannot move stale ballot log to", aside));
+        }
+    }
+    if (validEnd == 0) {
+        fd = createLog(path, election);
+    } else {
+        fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+        if (fd < 0) {
+            throw runtime_error(errnoText("Cannot open", path));
+        }
+        if (recovered.tornBytes > 0 && (ftruncate(fd, static_cast<off_t>(validEnd)) < 0 || fdatasync(fd) < 0)) {
+            close(fd);
+            throw runtime_error(errnoText("Cannot truncate torn tail of", path));
+        }
+    }
+    writer = thread(&BallotLog::writerLoop, this);
+}
+
+// Commits anything still buffered and stops the writer thread.
+BallotLog::~BallotLog() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    wakeWriter.notify_all();
+    writer.join();
+    close(fd);
+}
+
+// Buffers a ballot record.
+uint64_t BallotLog::appendBallot(const Election& election, size_t index, const EncryptedBallot& ballot, int candidate) {
+    HmacSha256 hmac(election.voterKey.data(), election.voterKey.size());
+    const string& unit = election.tree.node(ballot.unit).path;
+
+    vector<Byte> body;
+    body.reserve(64 + unit.size() + ballot.aesEncryptedPII.size() + mpz_size(ballot.encWeight.get_mpz_t()) * 8);
+    RecordWriter out(body);
+    out.put(RECORD_BALLOT);
+    out.put(static_cast<uint64_t>(index));
+    out.putBytes(unit.data(), unit.size());
+    out.put(static_cast<Byte>(candidate ^ candidateMask(hmac, index)));
+    out.putBytes(ballot.aesEncryptedPII.data(), ballot.aesEncryptedPII.size());
+    out.putMpz(ballot.encWeight);
+    out.write(ballot.voterTag.data(), ballot.voterTag.size());
+    return append(body);
+}
+
+// Buffers a revocation record.
+uint64_t BallotLog::appendRevocation(const vector<size_t>& indices) {
+    vector<Byte> body;
+    body.reserve(5 + indices.size() * 8);
+    RecordWriter out(body);
+    out.put(RECORD_REVOCATION);
+    out.put(static_cast<uint32_t>(indices.size()));
+    for (size_t index : indices) {
+        out.put(static_cast<uint64_t>(index));
+    }
+    return append(body);
+}
+
+// Frames a record and queues it for the writer.
+uint64_t BallotLog::append(const vector<Byte>& body) {
+    uint32_t frame[2] = {static_cast<uint32_t>(body.size()), crc32c(body.data(), body.size())};
+
+    lock_guard<mutex> guard(lock);
+    if (!failure.empty()) {
+        throw runtime_error(failure);
+    }
+    const Byte* header = reinterpret_cast<const Byte*>(frame);
+    pending.insert(pending.end(), header, header + sizeof(frame));
+    pending.insert(pending.end(), body.begin(), body.end());
+    pendingRecords++;
+    counters.records++;
+    wakeWriter.notify_one();
+    return ++appendedSequence;
+}
+
+// Blocks until every record up to a sequence number is on disk.
+void BallotLog::waitDurable(uint64_t sequence) {
+    unique_lock<mutex> guard(lock);
+    committed.wait(guard, [&]() { return durableSequence >= sequence || !failure.empty(); });
+    if (durableSequence < sequence) {
+        throw runtime_error(failure);
+    }
+}
+
+// Starts an empty log after the election was saved to its snapshot.
+void BallotLog::checkpoint(const Election& election) {
+    lock_guard<mutex> guard(lock);
+    lock_guard<mutex> file(fileLock); // Waits out a commit in progress
+    int fresh = createLog(path, election);
+    close(fd);
+    fd = fresh;
+    pending.clear();
+    pendingRecords = 0;
+    durableSequence = appendedSequence;
+    committed.notify_all();
+}
+
+uint64_t BallotLog::lastSequence() const {
+    lock_guard<mutex> guard(lock);
+    return appendedSequence;
+}
+
+BallotLogStats BallotLog::stats() const {
+    lock_guard<mutex> guard(lock);
+    return counters;
+}
+
+// Drains the buffer: one write() and one fdatasync() per group.
+void BallotLog::writerLoop() {
+    vector<Byte> batch;
+    unique_lock<mutex> guard(lock);
+    while (true) {
+        wakeWriter.wait(guard, [&]() { return stopping || !pending.empty(); });
+        if (pending.empty()) {
+            break;
+        }
+        // Give concurrent clients a moment to join this commit
+        if (!stopping && options.commitDelayMs > 0 && pending.size() < options.maxBatchBytes) {
+            wakeWriter.wait_for(guard, chrono::duration<double, milli>(options.commitDelayMs),
+                                [&]() { return stopping || pending.size() >= options.maxBatchBytes; });
+        }
+        if (pending.empty() || !failure.empty()) {
+            pending.clear();
+            pendingRecords = 0;
+            continue;
+        }
+        // Whole records up to maxBatchBytes (at least one): replay relies on that bound
+        size_t take = 0;
+        size_t records = 0;
+        while (take < pending.size()) {
+            uint32_t length;
+            memcpy(&length, pending.data() + take, 4);
+            if (records > 0 && take + FRAME_SIZE + length > options.maxBatchBytes) {
+                break;
+            }
+            take += FRAME_SIZE + length;
+            records++;
+        }
+        batch.assign(pending.begin(), pending.begin() + take);
+        pending.erase(pending.begin(), pending.begin() + take);
+        pendingRecords -= records;
+        uint64_t through = appendedSequence - pendingRecords;
+
+        // Appends continue into 'pending' while this group is written
+        unique_lock<mutex> file(fileLock);
+        guard.unlock();
+        string error;
+        {
+            MetricTimer timer(METRIC_WAL_COMMIT, batch.size());
+            try {
+                writeAll(fd, batch.data(), batch.size(), path);
+                if (fdatasync(fd) < 0) {
+                    throw runtime_error(errnoText("fsync failed on", path));
+                }
+            } catch (const exception& e) {
+                error = e.what();
+            }
+        }
+        file.unlock();
+        guard.lock();
+
+        if (!error.empty()) {
+            failure = "Ballot log failed, ballots are no longer durable: " + error;
+        } else {
+            durableSequence = max(durableSequence, through);
+            counters.commits++;
+            counters.bytes += batch.size();
+        }
+        committed.notify_all();
+    }
+}
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Computes CRC-32C, using the SSE4.2 instruction when available.
+uint32_t crc32c(const Byte* data, size_t length, uint32_t crc) {
+    static const bool hardware = __builtin_cpu_supports("sse4.2");
+    uint32_t c = ~crc;
+    c = hardware ? crc32cHardware(data, length, c) : crc32cSoftware(data, length, c);
+    return ~c;
+}
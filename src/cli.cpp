@@ -0,0 +1,761 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "cli.h"
+#include "aes.h"
+#include "election.h"
+#include "gmp_arena.h"
+#include "ingest.h"
+#include "mixnet.h"
+#include "modmul_simd.h"
+#include "pipeline.h"
+#include "snapshot.h"
+#include "tuning.h"
+#include "voter_index.h"
+#include "json.h"
+#include "metrics.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <csignal>
+#include <cstring>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+// Parses a non-negative integer flag value.
+long long parseNumber(const string& flag, const string& text) {
+    try {
+        size_t used = 0;
+        long long v = stoll(text, &used);
+        if (used != text.size() || v < 0) {
+            throw invalid_argument(text);
+        }
+        return v;
+    } catch (const exception&) {
+        throw invalid_argument(flag + " expects a non-negative integer, got \"" + text + "\"");
+    }
+}
+
+// Parses an int flag value in [minimum, INT_MAX].
+int parseInt(const string& flag, const string& text, int minimum) {
+    long long v = parseNumber(flag, text);
+    if (v < minimum || v > INT_MAX) {
+        throw invalid_argument(flag + " expects an integer from " + to_string(minimum) + " to " +
+                               to_string(INT_MAX) + ", got \"" + text + "\"");
+    }
+    return static_cast<int>(v);
+}
+
+/**
+ * @brief Collects per-stage results and writes them as JSON or NDJSON.
+ * @details In NDJSON mode every stage is written (and flushed) as soon as it
+ *          finishes; in JSON mode everything is written as one document at the end.
+ */
+class BatchReport {
+public:
+    BatchReport(ostream& out, bool ndjson) : out(out), ndjson(ndjson) {}
+
+    void stage(const string& name, double ms, long long count) {
+        JsonWriter w;
+        w.beginObject();
+        if (ndjson) {
+            w.field("event", "stage");
+        }
+        w.field("stage", name).field("ms", ms).field("count", count);
+        w.endObject();
+        if (ndjson) {
+            out << w.str() << '\n' << flush;
+        } else {
+            stages.push_back(w.str());
+        }
+    }
+
+    // Writes a progress event at once: into an NDJSON report, or to stderr beside a JSON one.
+    void progress(const string& stage, const PipelineProgress& p) {
+        JsonWriter w;
+        w.beginObject();
+        w.field("event", "progress").field("stage", stage);
+        w.field("parsed", p.parsed).field("encrypted", p.encrypted).field("records", p.records);
+        if (p.total > 0) {
+            w.field("total", p.total);
+        }
+        w.field("elapsedMs", p.elapsedMs).field("recordsPerSec", p.recordsPerSec);
+        if (p.etaMs >= 0) {
+            w.field("etaMs", p.etaMs);
+        }
+        w.endObject();
+        (ndjson ? out : cerr) << w.str() << '\n' << flush;
+    }
+
+    // Records per-stage worker counts, throughput and queue depths.
+    void pipeline(const PipelineStats& stats) {
+        for (const StageStats& s : stats.stages) {
+            JsonWriter w;
+            w.beginObject();
+            if (ndjson) {
+                w.field("event", "pipeline");
+            }
+            w.field("stage", s.name).field("workers", s.workers).field("items", s.items);
+            w.field("busyMs", s.busyMs).field("itemsPerSec", s.itemsPerSec);
+            w.field("maxQueueDepth", s.maxQueueDepth).field("avgQueueDepth", s.avgQueueDepth);
+            w.endObject();
+            if (ndjson) {
+                out << w.str() << '\n' << flush;
+            } else {
+                pipelineStages.push_back(w.str());
+            }
+        }
+    }
+
+    // Writes the final result; 'fields' is the body of a JSON object without braces.
+    void finish(const string& fields) {
+        if (ndjson) {
+            out << "{\"event\":\"result\"," << fields << "}\n" << flush;
+            return;
+        }
+        out << '{' << fields << ",\"stages\":[";
+        for (size_t i = 0; i < stages.size(); i++) {
+            out << (i ? "," : "") << stages[i];
+        }
+        out << "],\"pipeline\":[";
+        for (size_t i = 0; i < pipelineStages.size(); i++) {
+            out << (i ? "," : "") << pipelineStages[i];
+        }
+        out << "]}\n" << flush;
+    }
+
+private:
+    ostream& out;
+    bool ndjson;
+    vector<string> stages;
+    vector<string> pipelineStages;
+};
+
+double msSince(chrono::steady_clock::time_point start) {
+    return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+}
+
+// Nearest-rank percentile of sorted samples (0 for none).
+double percentile(const vector<double>& sorted, double q) {
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t rank = static_cast<size_t>(ceil(q * sorted.size()));
+    return sorted[min(max<size_t>(rank, 1), sorted.size()) - 1];
+}
+
+// Set by SIGINT/SIGTERM during a batch run; the pipeline polls it.
+atomic<bool> batchCancel(false);
+
+extern "C" void onBatchSignal(int) {
+    batchCancel.store(true);
+}
+
+// Writes this process's peak RSS and CPU time so far as a "resources" object.
+void writeResources(JsonWriter& result) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    result.key("resources").beginObject();
+    result.field("peakRssKb", static_cast<long long>(usage.ru_maxrss));
+    result.field("userCpuMs", usage.ru_utime.tv_sec * 1e3 + usage.ru_utime.tv_usec / 1e3);
+    result.field("systemCpuMs", usage.ru_stime.tv_sec * 1e3 + usage.ru_stime.tv_usec / 1e3);
+    result.field("minorFaults", static_cast<long long>(usage.ru_minflt));
+    result.endObject();
+}
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Parses argv into CliOptions.
+CliOptions parseCliOptions(int argc, char* argv[]) {
+    CliOptions options;
+
+    for (int i = 1; i < argc; i++) {
+        string arg = argv[i];
+        auto next = [&]() -> string {
+            if (i + 1 >= argc) {
+                throw invalid_argument(arg + " requires a value");
+            }
+            return argv[++i];
+        };
+
+        if (arg == "--help" || arg == "-h") {
+            options.mode = CliOptions::HELP;
+        } else if (arg == "--daemon") {
+            options.mode = CliOptions::DAEMON;
+        } else if (arg == "--socket") {
+            options.mode = CliOptions::DAEMON;
+            options.socketPath = next();
+        } else if (arg == "--batch") {
+            options.mode = CliOptions::BATCH;
+        } else if (arg == "--candidates") {
+            options.numCandidates = parseInt(arg, next(), 1);
+        } else if (arg == "--voters") {
+            options.max_voters = parseInt(arg, next(), 1);
+        } else if (arg == "--votes") {
+            options.num_votes = parseInt(arg, next(), 0);
+        } else if (arg == "--key-size") {
+            options.keySize = parseInt(arg, next(), 1);
+        } else if (arg == "--threads") {
+            options.threads = parseInt(arg, next(), 1);
+            options.hasThreads = true;
+        } else if (arg == "--seed") {
+            options.seed = static_cast<unsigned long>(parseNumber(arg, next()));
+            options.hasSeed = true;
+        } else if (arg == "--aes-threads") {
+            options.aesThreads = parseInt(arg, next(), 0);
+        } else if (arg == "--paillier-threads") {
+            options.paillierThreads = parseInt(arg, next(), 0);
+        } else if (arg == "--tally-threads") {
+            options.tallyThreads = parseInt(arg, next(), 0);
+        } else if (arg == "--batch-size") {
+            options.batchSize = static_cast<size_t>(parseNumber(arg, next()));
+        } else if (arg == "--input") {
+            options.inputPath = next();
+        } else if (arg == "--input-format") {
+            options.inputFormat = next();
+        } else if (arg == "--ballots-out") {
+            options.ballotsOut = next();
+        } else if (arg == "--queue-depth") {
+            options.queueDepth = static_cast<size_t>(parseNumber(arg, next()));
+        } else if (arg == "--numa") {
+            options.numa = true;
+        } else if (arg == "--no-bloom") {
+            options.bloomFilter = false;
+        } else if (arg == "--output") {
+            options.outputPath = next();
+        } else if (arg == "--format") {
+            options.format = next();
+            if (options.format != "json" && options.format != "ndjson") {
+                throw invalid_argument("--format must be json or ndjson");
+            }
+        } else if (arg == "--tree") {
+            options.tree = next();
+            parseFanout(options.tree);
+        } else if (arg == "--shuffle") {
+            options.shuffle = true;
+        } else if (arg == "--shuffle-precompute") {
+            options.shuffle = true;
+            options.shufflePrecompute = true;
+        } else if (arg == "--shuffle-out") {
+            options.shuffle = true;
+            options.shuffleOut = next();
+        } else if (arg == "--decrypt-sample") {
+            options.decryptSample = static_cast<size_t>(parseNumber(arg, next()));
+        } else if (arg == "--progress") {
+            options.progressMs = parseInt(arg, next(), 0);
+        } else if (arg == "--revotes") {
+            options.revotes = static_cast<size_t>(parseNumber(arg, next()));
+        } else if (arg == "--snapshot") {
+            options.snapshotPath = next();
+            continue;
+        } else if (arg == "--wal") {
+            options.walPath = next();
+            continue;
+        } else if (arg == "--wal-delay") {
+            options.walDelayMs = parseInt(arg, next(), 0);
+            continue;
+        } else if (arg == "--calibrate") {
+            options.mode = CliOptions::CALIBRATE;
+        } else if (arg == "--tune") {
+            options.tune = true;
+            continue;
+        } else if (arg == "--tune-file") {
+            options.tune = true;
+            options.tuningPath = next();
+            continue;
+        } else if (arg == "--gmp-arena") {
+            options.gmpArena = true;
+            continue;
+        } else if (arg == "--simd") {
+            options.simd = next();
+            parseSimdLevel(options.simd);
+            continue;
+        } else if (arg == "--metrics-out") {
+            options.metricsOut = next();
+            continue;
+        } else if (arg == "--metrics-format") {
+            options.metricsFormat = next();
+            if (options.metricsFormat != "auto" && options.metricsFormat != "json" &&
+                options.metricsFormat != "prometheus") {
+                throw invalid_argument("--metrics-format must be auto, json or prometheus");
+            }
+            continue;
+        } else {
+            throw invalid_argument("Unknown option " + arg);
+        }
+
+        // Any election parameter implies batch mode
+        if (options.mode == CliOptions::INTERACTIVE && arg != "--daemon" && arg != "--socket") {
+            options.mode = CliOptions::BATCH;
+        }
+    }
+
+    if (options.threads < 1) {
+        options.threads = 1;
+    }
+    return options;
+}
+
+// Prints the command-line usage summary.
+void printUsage() {
+    cout << "Usage:\n"
+         << "  cryptovote                      Interactive simulation (prompts for input)\n"
+         << "  cryptovote --daemon             Serve JSON commands on stdin/stdout\n"
+         << "  cryptovote --socket PATH        Serve JSON commands on a Unix socket\n"
+         << "  cryptovote [--batch] OPTIONS    Run once and write a JSON report\n"
+         << "  cryptovote --calibrate          Measure this host at --key-size and cache its tuning profile\n"
+         << "\nBatch options:\n"
+         << "  --candidates N   Number of candidates (1-50)\n"
+         << "  --voters K       Maximum expected voters (defaults to the vote count)\n"
+         << "  --votes N        Votes to simulate (ignored with --input)\n"
+         << "  --key-size BITS  Paillier modulus size (default 1024)\n"
+         << "  --threads T      Total worker threads, split across pipeline stages (default 1)\n"
+         << "  --aes-threads N, --paillier-threads N, --tally-threads N\n"
+         << "                   Override the per-stage worker counts\n"
+         << "  --batch-size N   Records per pipeline batch (default 64, or tuned)\n"
+         << "  --seed S         Seed for vote choices and encryption randomness\n"
+         << "  --input FILE     Stream cast-vote records from a CSV or NDJSON file\n"
+         << "  --input-format F auto (by extension), csv or ndjson\n"
+         << "  --ballots-out F  Write encrypted ballots to F as NDJSON\n"
+         << "  --queue-depth N  Batches buffered between pipeline stages (default 64, or tuned)\n"
+         << "  --numa           Pin pipeline workers to NUMA nodes and tally each node's ballots locally\n"
+         << "  --no-bloom       Check for duplicate voters without the Bloom filter\n"
+         << "  --output FILE    Write the report to FILE instead of stdout\n"
+         << "  --format F       json (one document) or ndjson (one event per line)\n"
+         << "  --snapshot FILE  Save the finished election (keys, ballots, tally) to FILE\n"
+         << "  --tree R,C,P     Spread simulated voters over R regions x C counties x P precincts\n"
+         << "                   and report every unit's subtotal\n"
+         << "  --shuffle        Re-encryption shuffle of the vote ciphertexts, verified against the tally\n"
+         << "  --shuffle-precompute\n"
+         << "                   Generate the shuffle's randomizers in a separate stage first\n"
+         << "  --shuffle-out F  Write the mixed ciphertexts to F, one hex value per line\n"
+         << "  --revotes N      Revoke N random ballots in one batch and re-cast them for new choices\n"
+         << "  --decrypt-sample N\n"
+         << "                   Decrypt N randomly chosen ballots after the tally and check their votes\n"
+         << "  --progress MS    Report progress every MS milliseconds (into NDJSON output, else stderr);\n"
+         << "                   SIGINT/SIGTERM stop the run and report the ballots tallied so far\n"
+         << "\nDaemon options:\n"
+         << "  --snapshot FILE  Restore from FILE at startup if it exists; save to it on exit\n"
+         << "  --wal FILE       Log every ballot to FILE and fsync it before replying; replay it at startup\n"
+         << "  --wal-delay MS   Wait up to MS milliseconds to group ballots into one fsync (default 1)\n"
+         << "\nTuning (batch and daemon):\n"
+         << "  --tune           Size the pipeline stages, batches and queues and pick the tally kernel\n"
+         << "                   from this host's profile, measuring it first if none is cached;\n"
+         << "                   without --threads, uses every hardware thread\n"
+         << "  --tune-file F    Profile cache (default ~/.cache/cryptovote-tuning.ndjson)\n"
+         << "\nAllocation (any mode):\n"
+         << "  --gmp-arena      Serve GMP number storage from per-thread free lists instead of malloc\n"
+         << "\nArithmetic (any mode):\n"
+         << "  --simd L         Ciphertext products on auto (default), avx512, avx2 or scalar lanes\n"
+         << "\nMetrics (any mode):\n"
+         << "  --metrics-out F  Write operation counters and latency histograms to F on exit\n"
+         << "  --metrics-format auto (prometheus for .prom/.txt), json or prometheus\n";
+}
+
+// Runs one election without prompting and writes the report.
+int runBatch(const CliOptions& options) {
+    ofstream file;
+    if (!options.outputPath.empty()) {
+        file.open(options.outputPath);
+        if (!file) {
+            cerr << "Cannot open output file " << options.outputPath << endl;
+            return 1;
+        }
+    }
+    ostream& out = options.outputPath.empty() ? cout : file;
+    BatchReport report(out, options.format == "ndjson");
+
+    unsigned long seed = options.hasSeed ? options.seed : static_cast<unsigned long>(time(nullptr));
+    gmp_randstate_t rand_state;
+    gmp_randinit_mt(rand_state);
+    gmp_randseed_ui(rand_state, seed);
+
+    // The first signal cancels the run; SA_RESETHAND lets a second one kill it
+    struct sigaction cancelAction, oldInt, oldTerm;
+    memset(&cancelAction, 0, sizeof(cancelAction));
+    cancelAction.sa_handler = onBatchSignal;
+    cancelAction.sa_flags = SA_RESETHAND;
+    sigemptyset(&cancelAction.sa_mask);
+    batchCancel = false;
+    sigaction(SIGINT, &cancelAction, &oldInt);
+    sigaction(SIGTERM, &cancelAction, &oldTerm);
+
+    int threads = options.tune && !options.hasThreads ? max(1, static_cast<int>(thread::hardware_concurrency()))
+                                                       : options.threads;
+    int code = 0;
+    try {
+        auto runStart = chrono::steady_clock::now();
+        if (options.progressMs > 0) {
+            report.progress("keygen", PipelineProgress()); // Feedback before the first stage ends
+        }
+
+        if (options.numCandidates < 1) {
+            throw invalid_argument("--candidates is required");
+        }
+        bool streaming = !options.inputPath.empty();
+        if (streaming && options.max_voters < 1) {
+            throw invalid_argument("--voters is required with --input");
+        }
+        int max_voters = options.max_voters > 0 ? options.max_voters : max(1, options.num_votes);
+
+        // --- Key Generation ---
+        Election election;
+        auto start = chrono::steady_clock::now();
+        setupElection(election, options.numCandidates, max_voters, options.keySize, rand_state, false);
+        report.stage("keygen", msSince(start), 1);
+
+        // --- Tuning: this host's measured costs size the pipeline ---
+        PipelineConfig pipeline;
+        TuningProfile profile;
+        bool calibrated = false;
+        if (options.tune) {
+            start = chrono::steady_clock::now();
+            string path = options.tuningPath.empty() ? defaultTuningPath() : options.tuningPath;
+            profile = tuningProfileFor(path, election.paillierKeys, election.keySize, &calibrated);
+            if (calibrated) {
+                report.stage("calibrate", msSince(start), 1);
+            }
+            tunePipeline(profile, threads, pipeline);
+            setSimdLimit(min(currentSimdLimit(), profile.simd));
+        } else {
+            sizePipeline(threads, pipeline);
+        }
+
+        // --- Pipeline: parse -> AES -> Paillier -> tally ---
+        if (options.aesThreads > 0) {
+            pipeline.aesThreads = options.aesThreads;
+        }
+        if (options.paillierThreads > 0) {
+            pipeline.paillierThreads = options.paillierThreads;
+        }
+        if (options.tallyThreads > 0) {
+            pipeline.tallyThreads = options.tallyThreads;
+        }
+        if (options.queueDepth > 0) {
+            pipeline.queueDepth = options.queueDepth;
+        }
+        if (options.batchSize > 0) {
+            pipeline.batchSize = options.batchSize;
+        }
+        pipeline.seed = seed;
+        pipeline.ballotsOut = options.ballotsOut;
+        pipeline.keepBallots = !options.snapshotPath.empty() || options.shuffle || options.revotes > 0;
+        pipeline.bloomFilter = options.bloomFilter;
+        pipeline.numa = options.numa;
+        pipeline.sampleBallots = options.decryptSample;
+        pipeline.cancel = &batchCancel;
+        if (options.progressMs > 0) {
+            string stageName = streaming ? "ingest" : "simulate";
+            pipeline.progressIntervalMs = options.progressMs;
+            pipeline.expectedRecords = streaming ? 0 : static_cast<size_t>(max(0, options.num_votes));
+            pipeline.progress = [&report, stageName](const PipelineProgress& p) { report.progress(stageName, p); };
+        }
+
+        start = chrono::steady_clock::now();
+        PipelineStats stats;
+        if (streaming) {
+            stats = ingestFile(election, options.inputPath, options.inputFormat, pipeline).pipeline;
+        } else {
+            RecordSource source = simulatedSource(options.num_votes, 0, options.numCandidates, seed,
+                                                  parseFanout(options.tree));
+            stats = runPipeline(election, source, pipeline);
+        }
+        double intakeMs = msSince(start);
+        report.stage(streaming ? "ingest" : "simulate", intakeMs, stats.records);
+        report.pipeline(stats);
+        size_t numVotes = stats.records;
+        // A cancelled run still decrypts and checks what it tallied, but skips the optional extras
+        bool cancelled = stats.cancelled || batchCancel;
+
+        // --- Re-voting: revoke a batch of ballots, then cast their replacements ---
+        size_t revoked = 0;
+        if (options.revotes > 0 && !cancelled) {
+            size_t count = ballotCount(election);
+            vector<size_t> picks(count);
+            iota(picks.begin(), picks.end(), 0);
+            mt19937_64 rng(seed ^ 0x5245564FULL);
+            shuffle(picks.begin(), picks.end(), rng);
+            picks.resize(min(options.revotes, count));
+
+            // Read each voter back before their ballot stops counting
+            vector<string> pii(picks.size());
+            vector<string> paths(picks.size());
+            for (size_t i = 0; i < picks.size(); i++) {
+                pii[i] = decryptBallotAt(election, picks[i]).pii;
+                paths[i] = election.tree.node(ballotAt(election, picks[i]).unit).path;
+            }
+
+            start = chrono::steady_clock::now();
+            revokeBallots(election, picks);
+            report.stage("revoke", msSince(start), picks.size());
+
+            start = chrono::steady_clock::now();
+            uniform_int_distribution<int> choice(0, election.numCandidates - 1);
+            for (size_t i = 0; i < picks.size(); i++) {
+                castBallot(election, pii[i], choice(rng), rand_state, paths[i]);
+            }
+            report.stage("revote", msSince(start), picks.size());
+            revoked = picks.size();
+        }
+
+        // --- Decryption & Decoding ---
+        start = chrono::steady_clock::now();
+        mpz_class decryptedTally = decVote(election.encryptedTally, election.paillierKeys);
+        report.stage("decrypt", msSince(start), 1);
+
+        start = chrono::steady_clock::now();
+        vector<long> counts = decodeTally(decryptedTally, election.numCandidates, election.max_voters);
+        report.stage("decode", msSince(start), election.numCandidates);
+
+        if (!options.snapshotPath.empty()) {
+            start = chrono::steady_clock::now();
+            saveSnapshot(election, options.snapshotPath);
+            report.stage("snapshot", msSince(start), ballotCount(election));
+        }
+
+        // --- Reporting-unit subtotals, decrypted as one batch ---
+        vector<size_t> units;
+        vector<vector<long>> unitCounts;
+        bool treeVerified = true;
+        if (election.tree.size() > 1) {
+            start = chrono::steady_clock::now();
+            units = election.tree.subtree(0, INT_MAX);
+            unitCounts = tallySubtotals(election, units, threads);
+            report.stage("subtotals", msSince(start), units.size());
+
+            // The root must match the tally, and every unit's counts its ballots
+            treeVerified = unitCounts[0] == counts;
+            for (size_t i = 0; i < units.size(); i++) {
+                long sum = 0;
+                for (long c : unitCounts[i]) {
+                    sum += c;
+                }
+                treeVerified = treeVerified && static_cast<uint64_t>(sum) == election.tree.node(units[i]).ballots;
+            }
+        }
+
+        // --- Spot checks: decrypt a random sample of the tallied ballots ---
+        bool sampleVerified = true;
+        vector<double> sampleMs;
+        if (!stats.samples.empty()) {
+            HmacSha256 hmac(election.voterKey.data(), election.voterKey.size());
+            start = chrono::steady_clock::now();
+            for (const SampledBallot& sample : stats.samples) {
+                auto one = chrono::steady_clock::now();
+                bool piiOk = false;
+                try {
+                    // The PII must decrypt to the voter whose tag the ballot carries
+                    string pii = decryptAES256(sample.ballot.aesEncryptedPII, election.aes_key);
+                    piiOk = !pii.empty() && computeVoterTag(hmac, pii) == sample.ballot.voterTag;
+                } catch (const exception&) {
+                    piiOk = false;
+                }
+                mpz_class weight = decVote(sample.ballot.encWeight, election.paillierKeys);
+                sampleMs.push_back(msSince(one));
+                sampleVerified = sampleVerified && piiOk && weight == election.weights[sample.candidate];
+            }
+            report.stage("sample-decrypt", msSince(start), sampleMs.size());
+            sort(sampleMs.begin(), sampleMs.end());
+        }
+
+        // --- Re-encryption Shuffle ---
+        bool shuffleVerified = true;
+        if (options.shuffle && !cancelled) {
+            MixConfig mix;
+            mix.threads = threads;
+            mix.seed = seed;
+            vector<mpz_class> randomizers;
+            if (options.shufflePrecompute) {
+                start = chrono::steady_clock::now();
+                randomizers = precomputeRandomizers(election.paillierKeys, liveBallotCount(election), threads,
+                                                    seed + 1);
+                mix.randomizers = &randomizers;
+                report.stage("shuffle-precompute", msSince(start), randomizers.size());
+            }
+
+            start = chrono::steady_clock::now();
+            vector<mpz_class> mixed = shuffleElection(election, mix);
+            report.stage("shuffle", msSince(start), mixed.size());
+
+            start = chrono::steady_clock::now();
+            shuffleVerified = decVote(sumCiphertexts(mixed, election.paillierKeys), election.paillierKeys) ==
+                              decryptedTally;
+            report.stage("shuffle-verify", msSince(start), mixed.size());
+
+            if (!options.shuffleOut.empty()) {
+                ofstream mixFile(options.shuffleOut);
+                for (const mpz_class& c : mixed) {
+                    mixFile << c.get_str(16) << '\n';
+                }
+                if (!mixFile.flush()) {
+                    throw runtime_error("Cannot write shuffle output " + options.shuffleOut);
+                }
+            }
+        }
+
+        // --- Results & Verification ---
+        bool verified = shuffleVerified && treeVerified && sampleVerified;
+        JsonWriter result;
+        result.beginObject();
+        result.field("ok", true);
+        result.field("numCandidates", election.numCandidates);
+        result.field("maxVoters", election.max_voters);
+        result.field("numVotes", numVotes);
+        result.field("duplicates", stats.duplicates);
+        if (options.revotes > 0) {
+            result.field("revotes", revoked);
+        }
+        result.field("keySize", election.keySize);
+        result.field("threads", threads);
+        result.field("batchSize", pipeline.batchSize);
+        result.field("queueDepth", pipeline.queueDepth);
+        if (options.numa) {
+            result.field("numaNodes", stats.numaNodes);
+        }
+        result.field("seed", seed);
+        result.field("decryptedTally", decryptedTally.get_str());
+        result.key("counts").beginArray();
+        for (long c : counts) {
+            result.value(c);
+        }
+        result.endArray();
+        result.key("expectedCounts").beginArray();
+        for (int i = 0; i < election.numCandidates; i++) {
+            result.value(election.actualVoteCounts[i]);
+            verified = verified && counts[i] == election.actualVoteCounts[i];
+        }
+        result.endArray();
+        if (!units.empty()) {
+            result.key("subtotals").beginArray();
+            for (size_t i = 0; i < units.size(); i++) {
+                const TallyNode& node = election.tree.node(units[i]);
+                result.beginObject();
+                result.field("unit", node.path);
+                result.field("depth", node.depth);
+                result.field("ballots", node.ballots);
+                result.key("counts").beginArray();
+                for (long c : unitCounts[i]) {
+                    result.value(c);
+                }
+                result.endArray();
+                result.endObject();
+            }
+            result.endArray();
+            result.field("treeVerified", treeVerified);
+        }
+        if (options.shuffle && !cancelled) {
+            result.field("shuffleVerified", shuffleVerified);
+        }
+        if (!sampleMs.empty()) {
+            result.key("sampleDecrypt").beginObject();
+            result.field("count", sampleMs.size());
+            result.field("verified", sampleVerified);
+            result.field("p50Ms", percentile(sampleMs, 0.50));
+            result.field("p95Ms", percentile(sampleMs, 0.95));
+            result.field("p99Ms", percentile(sampleMs, 0.99));
+            result.field("maxMs", sampleMs.back());
+            result.endObject();
+        }
+        // Without kept ballots the pipeline folded only the board's root
+        Digest boardRoot = pipeline.keepBallots ? election.board.root() : stats.boardRoot;
+        result.key("board").beginObject();
+        result.field("ballots", pipeline.keepBallots ? election.board.size() : stats.boardBallots);
+        result.field("root", toHex(boardRoot.data(), boardRoot.size()));
+        result.endObject();
+        if (cancelled) {
+            result.field("cancelled", true);
+        }
+        result.field("verified", verified);
+        result.field("totalMs", msSince(runStart));
+        result.field("ballotsPerSec", intakeMs > 0 ? numVotes / (intakeMs / 1e3) : 0.0);
+        writeResources(result);
+        result.field("simd", simdLevelName(detectSimdLevel()));
+        if (options.tune) {
+            result.field("tuned", calibrated ? "calibrated" : "cached");
+            result.key("tuning").rawValue(tuningProfileToJson(profile));
+        }
+        GmpArenaStats arena = gmpArenaStats();
+        if (arena.installed) {
+            result.key("gmpArena").beginObject();
+            result.field("systemAllocs", arena.systemAllocs);
+            result.field("systemFrees", arena.systemFrees);
+            result.endObject();
+        }
+        result.key("metrics").rawValue(metricsToJson());
+        result.endObject();
+
+        string body = result.str();
+        report.finish(body.substr(1, body.size() - 2));
+        code = !verified ? 2 : cancelled ? 3 : 0;
+    } catch (const exception& e) {
+        JsonWriter error;
+        error.beginObject().field("ok", false).field("error", string(e.what())).endObject();
+        string body = error.str();
+        report.finish(body.substr(1, body.size() - 2));
+        cerr << "Critical Error in Batch: " << e.what() << endl;
+        code = 1;
+    }
+
+    sigaction(SIGINT, &oldInt, nullptr);
+    sigaction(SIGTERM, &oldTerm, nullptr);
+    gmp_randclear(rand_state);
+    return code;
+}
+
+// Measures this host and stores its tuning profile.
+int runCalibrate(const CliOptions& options) {
+    int threads = options.hasThreads ? options.threads : max(1, static_cast<int>(thread::hardware_concurrency()));
+    try {
+        string path = options.tuningPath.empty() ? defaultTuningPath() : options.tuningPath;
+        PaillierKeys keys = genKeyPaillier(options.keySize);
+        TuningProfile profile = calibrateHost(keys, options.keySize);
+        saveTuningProfile(path, profile);
+
+        string json = tuningProfileToJson(profile, threads);
+        if (options.outputPath.empty()) {
+            cout << json << endl;
+        } else {
+            ofstream file(options.outputPath);
+            if (!(file << json << '\n')) {
+                throw runtime_error("Cannot write " + options.outputPath);
+            }
+        }
+        cerr << "Tuning profile for " << profile.cpu << " at " << profile.keySize << " bits saved to " << path
+             << endl;
+    } catch (const exception& e) {
+        cerr << "Calibration failed: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
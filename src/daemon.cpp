@@ -0,0 +1,899 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "daemon.h"
+#include "ballot_log.h"
+#include "gmp_arena.h"
+#include "json.h"
+#include "merkle.h"
+#include "metrics.h"
+#include "mixnet.h"
+#include "pipeline.h"
+#include "snapshot.h"
+#include "tuning.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    COMMAND HANDLERS
+###########################################################################
+*/
+
+namespace {
+
+// Returns a request's id as JSON (a number or a string), or "" if it has none.
+string requestIdJson(const JsonObject& req) {
+    if (!req.has("id")) {
+        return "";
+    }
+    // Echo numeric ids as numbers and anything else as a string
+    string id = req.getString("id");
+    bool numeric = !id.empty() && id.find_first_not_of("0123456789") == string::npos;
+    return numeric ? id : "\"" + jsonEscape(id) + "\"";
+}
+
+void requireSetup(const DaemonState& state) {
+    if (state.election.weights.empty()) {
+        throw invalid_argument("No election: send \"setup\" first");
+    }
+}
+
+// Saves the election to the daemon's snapshot and starts the ballot log over from it.
+void checkpointLog(DaemonState& state, const shared_ptr<BallotLog>& log) {
+    saveSnapshot(state.election, state.snapshotPath);
+    if (log) {
+        log->checkpoint(state.election);
+        state.election.log = log;
+    } else {
+        state.election.log = make_shared<BallotLog>(state.walPath, state.election, state.walOptions);
+    }
+}
+
+void cmdSetup(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    int numCandidates = static_cast<int>(req.getInt("numCandidates"));
+    int maxVoters = static_cast<int>(req.getInt("maxVoters"));
+    int keySize = static_cast<int>(req.getInt("keySize", 1024));
+
+    shared_ptr<BallotLog> log = state.election.log;
+    setupElection(state.election, numCandidates, maxVoters, keySize, state.rand_state, false);
+    state.audit.reset(state.election);
+    if (!state.walPath.empty()) {
+        // The keys must be durable before any ballot encrypted under them
+        checkpointLog(state, log);
+    }
+
+    reply.field("numCandidates", numCandidates);
+    reply.field("maxVoters", maxVoters);
+    reply.field("keySize", keySize);
+    reply.key("weights").beginArray();
+    for (const mpz_class& w : state.election.weights) {
+        reply.value(w.get_str());
+    }
+    reply.endArray();
+}
+
+void cmdSimulate(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    requireSetup(state);
+    long long numVotes = req.getInt("numVotes");
+    long long room = state.election.max_voters - static_cast<long long>(liveBallotCount(state.election));
+    if (numVotes < 0 || numVotes > room) {
+        throw invalid_argument("numVotes must be between 0 and " + to_string(room));
+    }
+    PipelineConfig config;
+    int threads = max(1, static_cast<int>(thread::hardware_concurrency()));
+    bool calibrated = false;
+    if (!state.tuningPath.empty()) {
+        TuningProfile profile = tuningProfileFor(state.tuningPath, state.election.paillierKeys,
+                                                 state.election.keySize, &calibrated);
+        tunePipeline(profile, threads, config);
+        setSimdLimit(min(state.simdCap, profile.simd));
+    } else {
+        sizePipeline(threads, config);
+    }
+    config.keepBallots = true;
+    config.numa = req.getBool("numa");
+    config.seed = gmp_urandomb_ui(state.rand_state, 32);
+    config.cancel = &state.cancel->flag;
+    long long progressMs = req.getInt("progress");
+    if (progressMs > 0 && state.events) {
+        // Progress lines carry the request's id and an "event" member, ahead of the reply
+        string idJson = requestIdJson(req);
+        function<void(const string&)> emit = state.events;
+        config.progressIntervalMs = static_cast<double>(progressMs);
+        config.expectedRecords = static_cast<size_t>(numVotes);
+        config.progress = [idJson, emit](const PipelineProgress& p) {
+            JsonWriter event;
+            event.beginObject();
+            if (!idJson.empty()) {
+                event.key("id").rawValue(idJson);
+            }
+            event.field("event", "progress").field("stage", "simulate");
+            event.field("records", p.records).field("total", p.total);
+            event.field("elapsedMs", p.elapsedMs).field("recordsPerSec", p.recordsPerSec);
+            if (p.etaMs >= 0) {
+                event.field("etaMs", p.etaMs);
+            }
+            event.endObject();
+            emit(event.str());
+        };
+    }
+    size_t firstId = ballotCount(state.election);
+    PipelineStats stats = runPipeline(
+        state.election,
+        simulatedSource(static_cast<size_t>(numVotes), firstId, state.election.numCandidates, config.seed,
+                        parseFanout(req.getString("tree"))),
+        config);
+
+    reply.field("cast", stats.records);
+    reply.field("duplicates", stats.duplicates);
+    reply.field("ballots", ballotCount(state.election));
+    if (stats.cancelled) {
+        reply.field("cancelled", true);
+    }
+    if (calibrated) {
+        reply.field("calibrated", true);
+    }
+}
+
+void cmdCast(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    requireSetup(state);
+    if (!req.has("pii") || !req.has("candidate")) {
+        throw invalid_argument("cast requires \"pii\" and \"candidate\"");
+    }
+    if (req.getBool("replace")) {
+        size_t replaced = SIZE_MAX;
+        size_t index = replaceBallot(state.election, req.getString("pii"), static_cast<int>(req.getInt("candidate")),
+                                     state.rand_state, req.getString("precinct"), &replaced);
+        reply.field("index", index);
+        if (replaced != SIZE_MAX) {
+            reply.field("replaced", replaced);
+        }
+        return;
+    }
+    size_t index = castBallot(state.election, req.getString("pii"),
+                              static_cast<int>(req.getInt("candidate")), state.rand_state,
+                              req.getString("precinct"));
+    reply.field("index", index);
+}
+
+// Parses a JSON array of non-negative integers such as [3,17,42].
+vector<size_t> parseIndexList(const string& raw) {
+    if (raw.size() < 2 || raw.front() != '[' || raw.back() != ']') {
+        throw invalid_argument("\"indices\" must be an array of ballot indices");
+    }
+    vector<size_t> indices;
+    string body = raw.substr(1, raw.size() - 2);
+    size_t start = 0;
+    while (start < body.size()) {
+        size_t comma = body.find(',', start);
+        if (comma == string::npos) {
+            comma = body.size();
+        }
+        string item = body.substr(start, comma - start);
+        item.erase(0, item.find_first_not_of(" \t"));
+        item.erase(item.find_last_not_of(" \t") + 1);
+        if (item.empty() || item.find_first_not_of("0123456789") != string::npos) {
+            throw invalid_argument("\"indices\" must be an array of ballot indices");
+        }
+        indices.push_back(static_cast<size_t>(stoull(item)));
+        start = comma + 1;
+    }
+    return indices;
+}
+
+void cmdRevoke(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    requireSetup(state);
+    vector<size_t> indices;
+    if (req.has("indices")) {
+        indices = parseIndexList(req.getString("indices"));
+    } else if (req.getInt("index", -1) >= 0) {
+        indices.push_back(static_cast<size_t>(req.getInt("index")));
+    } else {
+        throw invalid_argument("revoke requires \"index\" or \"indices\"");
+    }
+    revokeBallots(state.election, indices);
+    reply.field("revoked", indices.size());
+    reply.field("live", liveBallotCount(state.election));
+}
+
+void cmdFind(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    requireSetup(state);
+    if (!req.has("pii")) {
+        throw invalid_argument("find requires \"pii\"");
+    }
+    size_t index = 0;
+    bool found = findVoter(state.election, req.getString("pii"), index);
+    reply.field("found", found);
+    if (found) {
+        reply.field("index", index);
+    }
+}
+
+void cmdTally(DaemonState& state, const JsonObject&, JsonWriter& reply) {
+    requireSetup(state);
+    mpz_class decryptedTally;
+    vector<long> counts = tallyElection(state.election, decryptedTally);
+
+    bool verified = true;
+    reply.field("ballots", ballotCount(state.election));
+    reply.field("decryptedTally", decryptedTally.get_str());
+    reply.key("counts").beginArray();
+    for (int i = 0; i < state.election.numCandidates; i++) {
+        reply.value(counts[i]);
+        verified = verified && counts[i] == state.election.actualVoteCounts[i];
+    }
+    reply.endArray();
+    reply.field("verified", verified);
+}
+
+void cmdSubtotals(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    requireSetup(state);
+    string path = req.getString("unit");
+    size_t root = 0;
+    if (!state.election.tree.find(path, root)) {
+        throw invalid_argument("Unknown reporting unit \"" + path + "\"");
+    }
+    vector<size_t> units = state.election.tree.subtree(root, static_cast<int>(req.getInt("levels", 1)));
+    vector<vector<long>> counts =
+        tallySubtotals(state.election, units, max(1u, thread::hardware_concurrency()));
+
+    reply.key("units").beginArray();
+    for (size_t i = 0; i < units.size(); i++) {
+        const TallyNode& node = state.election.tree.node(units[i]);
+        reply.beginObject();
+        reply.field("unit", node.path);
+        reply.field("depth", node.depth);
+        reply.field("ballots", node.ballots);
+        reply.key("counts").beginArray();
+        for (long c : counts[i]) {
+            reply.value(c);
+        }
+        reply.endArray();
+        reply.endObject();
+    }
+    reply.endArray();
+}
+
+void cmdDecrypt(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    requireSetup(state);
+    long long index = req.getInt("index", -1);
+    if (index < 0) {
+        throw invalid_argument("decrypt requires a non-negative \"index\"");
+    }
+    bool cached = false;
+    DecryptedBallot ballot = state.audit.audit(state.election, static_cast<size_t>(index), &cached);
+
+    reply.field("index", index);
+    reply.field("revoked", state.election.revoked.count(static_cast<size_t>(index)) > 0);
+    reply.field("pii", ballot.pii);
+    reply.field("weight", ballot.weight.get_str());
+    reply.field("candidate", ballot.candidate);
+    reply.field("cached", cached);
+}
+
+void cmdAudit(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    requireSetup(state);
+    vector<size_t> indices;
+    if (req.has("indices")) {
+        indices = parseIndexList(req.getString("indices"));
+    } else if (req.getInt("index", -1) >= 0) {
+        indices.push_back(static_cast<size_t>(req.getInt("index")));
+    } else {
+        throw invalid_argument("audit requires \"index\" or \"indices\"");
+    }
+    AuditStats before = state.audit.stats();
+    vector<DecryptedBallot> ballots =
+        state.audit.auditMany(state.election, indices, static_cast<int>(max(1u, thread::hardware_concurrency())));
+    AuditStats after = state.audit.stats();
+
+    reply.key("ballots").beginArray();
+    for (size_t i = 0; i < indices.size(); i++) {
+        reply.beginObject();
+        reply.field("index", indices[i]);
+        reply.field("revoked", state.election.revoked.count(indices[i]) > 0);
+        reply.field("pii", ballots[i].pii);
+        reply.field("weight", ballots[i].weight.get_str());
+        reply.field("candidate", ballots[i].candidate);
+        reply.endObject();
+    }
+    reply.endArray();
+    reply.field("hits", after.hits - before.hits);
+    reply.field("misses", after.misses - before.misses);
+}
+
+void cmdBoard(DaemonState& state, const JsonObject&, JsonWriter& reply) {
+    requireSetup(state);
+    syncBoard(state.election, max(1u, thread::hardware_concurrency()));
+    Digest root = state.election.board.root();
+    reply.field("ballots", state.election.board.size());
+    reply.field("root", toHex(root.data(), root.size()));
+}
+
+void cmdProof(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    requireSetup(state);
+    long long index = req.getInt("index", -1);
+    if (index < 0) {
+        throw invalid_argument("proof requires a non-negative \"index\"");
+    }
+    syncBoard(state.election, max(1u, thread::hardware_concurrency()));
+    const MerkleTree& board = state.election.board;
+    vector<Digest> path = board.inclusionProof(static_cast<size_t>(index));
+    const Digest& leaf = board.leaf(static_cast<size_t>(index));
+    Digest root = board.root();
+
+    reply.field("index", index);
+    reply.field("ballots", board.size());
+    reply.field("root", toHex(root.data(), root.size()));
+    reply.field("leaf", toHex(leaf.data(), leaf.size()));
+    reply.key("path").beginArray();
+    for (const Digest& d : path) {
+        reply.value(toHex(d.data(), d.size()));
+    }
+    reply.endArray();
+    reply.field("verified", verifyInclusion(leaf, static_cast<size_t>(index), board.size(), path, root));
+}
+
+void cmdShuffle(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    requireSetup(state);
+    MixConfig mix;
+    // One worker per hardware thread at most, like the other commands
+    long long cores = max(1u, thread::hardware_concurrency());
+    mix.threads = static_cast<int>(min(max(1LL, req.getInt("threads", cores)), cores));
+    mix.seed = gmp_urandomb_ui(state.rand_state, 32) | 1;
+    vector<mpz_class> randomizers;
+
+    auto start = chrono::steady_clock::now();
+    if (req.getBool("precompute")) {
+        randomizers = precomputeRandomizers(state.election.paillierKeys, liveBallotCount(state.election), mix.threads,
+                                            mix.seed + 1);
+        mix.randomizers = &randomizers;
+    }
+    vector<mpz_class> mixed = shuffleElection(state.election, mix);
+    double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+    const PaillierKeys& keys = state.election.paillierKeys;
+    bool verified = decVote(sumCiphertexts(mixed, keys), keys) == decVote(state.election.encryptedTally, keys);
+    reply.field("count", mixed.size());
+    reply.field("ms", ms);
+    reply.field("verified", verified);
+    if (req.getBool("ciphertexts")) {
+        reply.key("ciphertexts").beginArray();
+        for (const mpz_class& c : mixed) {
+            reply.value(c.get_str(16));
+        }
+        reply.endArray();
+    }
+}
+
+void cmdStatus(DaemonState& state, const JsonObject&, JsonWriter& reply) {
+    reply.field("ready", !state.election.weights.empty());
+    reply.field("numCandidates", state.election.numCandidates);
+    reply.field("maxVoters", state.election.max_voters);
+    reply.field("keySize", state.election.keySize);
+    reply.field("ballots", ballotCount(state.election));
+    reply.field("revoked", state.election.revoked.size());
+    GmpArenaStats arena = gmpArenaStats();
+    if (arena.installed) {
+        reply.field("gmpSystemAllocs", arena.systemAllocs);
+    }
+    if (state.election.log) {
+        BallotLogStats wal = state.election.log->stats();
+        reply.key("wal").beginObject();
+        reply.field("records", wal.records);
+        reply.field("commits", wal.commits);
+        reply.field("bytes", wal.bytes);
+        reply.endObject();
+    }
+    AuditStats audit = state.audit.stats();
+    reply.key("audit").beginObject();
+    reply.field("entries", audit.entries);
+    reply.field("capacity", audit.capacity);
+    reply.field("hits", audit.hits);
+    reply.field("misses", audit.misses);
+    reply.field("evictions", audit.evictions);
+    reply.endObject();
+}
+
+void cmdMetrics(DaemonState&, const JsonObject& req, JsonWriter& reply) {
+    string format = req.getString("format", "json");
+    if (format == "json") {
+        reply.key("metrics").rawValue(metricsToJson());
+    } else if (format == "prometheus") {
+        reply.field("text", metricsToPrometheus());
+    } else {
+        throw invalid_argument("format must be json or prometheus");
+    }
+}
+
+// Resolves the snapshot file for save/load: "path" or the daemon's --snapshot.
+string snapshotPathFor(const DaemonState& state, const JsonObject& req) {
+    string path = req.getString("path", state.snapshotPath);
+    if (path.empty()) {
+        throw invalid_argument("No snapshot path: pass \"path\" or start with --snapshot");
+    }
+    return path;
+}
+
+void cmdSave(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    requireSetup(state);
+    string path = snapshotPathFor(state, req);
+    size_t bytes = saveSnapshot(state.election, path);
+    if (state.election.log && path == state.snapshotPath) {
+        state.election.log->checkpoint(state.election);
+    }
+    reply.field("path", path);
+    reply.field("bytes", bytes);
+    reply.field("ballots", ballotCount(state.election));
+}
+
+void cmdLoad(DaemonState& state, const JsonObject& req, JsonWriter& reply) {
+    string path = snapshotPathFor(state, req);
+    shared_ptr<BallotLog> log = state.election.log;
+    loadSnapshot(state.election, path);
+    state.audit.reset(state.election);
+    if (!state.walPath.empty() && path == state.snapshotPath) {
+        // The log follows this snapshot: replay it on top, as at startup
+        if (log) {
+            log->waitDurable(log->lastSequence());
+        }
+        state.election.log = make_shared<BallotLog>(state.walPath, state.election, state.walOptions);
+        reply.field("replayed", state.election.log->recovery().ballots);
+    } else if (!state.walPath.empty()) {
+        // The log only ever follows the daemon's own snapshot
+        checkpointLog(state, log);
+    }
+    reply.field("path", path);
+    reply.field("numCandidates", state.election.numCandidates);
+    reply.field("maxVoters", state.election.max_voters);
+    reply.field("keySize", state.election.keySize);
+    reply.field("ballots", ballotCount(state.election));
+}
+
+// Stops the running command, if any; returns whether one was running.
+bool requestCancel(CommandCancel& cancel) {
+    lock_guard<mutex> guard(cancel.lock);
+    if (cancel.busy) {
+        cancel.flag = true;
+    }
+    return cancel.busy;
+}
+
+// Never takes the command lock: runCommand() serves it ahead of the command it cancels.
+void cmdCancel(DaemonState& state, const JsonObject&, JsonWriter& reply) {
+    reply.field("running", requestCancel(*state.cancel));
+}
+
+void cmdShutdown(DaemonState& state, const JsonObject&, JsonWriter&) {
+    state.running = false;
+}
+
+/*
+###########################################################################
+    TRANSPORTS
+###########################################################################
+*/
+
+// Formats an "ok":false reply, echoing the request's id.
+string errorReply(const string& idJson, const string& message) {
+    JsonWriter reply;
+    reply.beginObject();
+    if (!idJson.empty()) {
+        reply.key("id").rawValue(idJson);
+    }
+    reply.field("ok", false);
+    reply.field("error", message);
+    reply.endObject();
+    return reply.str();
+}
+
+// Returns true for a "cancel" request, which must not wait behind the command it cancels.
+bool isCancel(const string& line) {
+    if (line.find("cancel") == string::npos) {
+        return false;
+    }
+    try {
+        return parseJsonObject(line).getString("cmd") == "cancel";
+    } catch (const exception&) {
+        return false;
+    }
+}
+
+// Answers a "cancel" line from the shared cancel alone, as handleDaemonCommand() would.
+string cancelReply(CommandCancel& cancel, const string& line) {
+    string idJson;
+    try {
+        idJson = requestIdJson(parseJsonObject(line));
+    } catch (const exception& e) {
+        return errorReply(idJson, e.what());
+    }
+    JsonWriter reply;
+    reply.beginObject();
+    if (!idJson.empty()) {
+        reply.key("id").rawValue(idJson);
+    }
+    reply.field("ok", true);
+    reply.field("running", requestCancel(cancel));
+    reply.endObject();
+    return reply.str();
+}
+
+// Runs one command and returns its reply once the ballots it logged are on disk.
+// 'events' receives any progress lines the command writes before its reply.
+string runCommand(DaemonState& state, const string& line, bool& stop,
+                  const function<void(const string&)>& events) {
+    if (isCancel(line)) {
+        stop = false;
+        return handleDaemonCommand(state, line);
+    }
+    string reply;
+    shared_ptr<BallotLog> log;
+    uint64_t sequence = 0;
+    {
+        lock_guard<mutex> guard(state.lock);
+        {
+            lock_guard<mutex> cancelGuard(state.cancel->lock);
+            state.cancel->busy = true;
+            state.cancel->flag = false;
+        }
+        state.events = events;
+        reply = handleDaemonCommand(state, line);
+        state.events = nullptr;
+        stop = !state.running;
+        log = state.election.log;
+        sequence = log ? log->lastSequence() : 0;
+        // A cancel belongs to the command it reached; the next one starts clean
+        lock_guard<mutex> cancelGuard(state.cancel->lock);
+        state.cancel->busy = false;
+        state.cancel->flag = false;
+    }
+    // Waiting outside the lock lets other connections' ballots join the same commit
+    if (log) {
+        try {
+            log->waitDurable(sequence);
+        } catch (const exception& e) {
+            string idJson;
+            try {
+                idJson = requestIdJson(parseJsonObject(line));
+            } catch (const exception&) {
+            }
+            reply = errorReply(idJson, e.what());
+        }
+    }
+    return reply;
+}
+
+// Serves newline-delimited commands on stdin/stdout.
+// A reader thread queues commands for this thread, so a "cancel" line is seen while a command runs.
+int serveStdio(DaemonState& state) {
+    // Shared with the reader, which may still be blocked in getline() when this returns
+    struct Inbox {
+        mutex lock;
+        condition_variable ready;
+        deque<string> lines;
+        bool closed = false;
+        mutex outLock;
+    };
+    auto inbox = make_shared<Inbox>();
+    function<void(const string&)> write = [inbox](const string& text) {
+        lock_guard<mutex> guard(inbox->outLock);
+        cout << text << '\n' << flush;
+    };
+    // The reader never touches 'state', which is gone once this returns: only the shared cancel
+    shared_ptr<CommandCancel> cancel = state.cancel;
+    thread([cancel, inbox, write]() {
+        string line;
+        while (getline(cin, line)) {
+            if (line.empty()) {
+                continue;
+            }
+            if (isCancel(line)) {
+                write(cancelReply(*cancel, line));
+                continue;
+            }
+            lock_guard<mutex> guard(inbox->lock);
+            inbox->lines.push_back(line);
+            inbox->ready.notify_one();
+        }
+        lock_guard<mutex> guard(inbox->lock);
+        inbox->closed = true;
+        inbox->ready.notify_one();
+    }).detach();
+
+    while (state.running) {
+        string line;
+        {
+            unique_lock<mutex> guard(inbox->lock);
+            inbox->ready.wait(guard, [&]() { return !inbox->lines.empty() || inbox->closed; });
+            if (inbox->lines.empty()) {
+                break;
+            }
+            line = std::move(inbox->lines.front());
+            inbox->lines.pop_front();
+        }
+        bool stop = false;
+        write(runCommand(state, line, stop, write));
+    }
+    return 0;
+}
+
+// Writes the whole buffer to a socket, retrying on short writes.
+bool sendAll(int fd, const string& data) {
+    size_t sent = 0;
+    while (sent < data.size()) {
+        ssize_t n = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<size_t>(n);
+    }
+    return true;
+}
+
+// Open socket connections, so the listener can unblock and join them before the state goes away.
+struct Connections {
+    mutex lock;
+    set<int> fds;                     // Connections not yet closed
+    map<thread::id, thread> threads;  // One per connection
+    vector<thread::id> finished;      // Threads that have returned from serveConnection
+    int listenFd = -1;
+};
+
+// Closes a connection's socket; the listener never shuts down an fd once it has left 'fds'.
+void closeConnection(Connections& conns, int clientFd) {
+    lock_guard<mutex> guard(conns.lock);
+    conns.fds.erase(clientFd);
+    close(clientFd);
+}
+
+// Serves one socket connection until the client disconnects or the daemon stops.
+void serveConnection(DaemonState& state, Connections& conns, int clientFd) {
+    string pending;
+    char buf[4096];
+    bool open = true;
+
+    while (open) {
+        ssize_t n = read(clientFd, buf, sizeof(buf));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        pending.append(buf, static_cast<size_t>(n));
+
+        size_t newline;
+        while (open && (newline = pending.find('\n')) != string::npos) {
+            string line = pending.substr(0, newline);
+            pending.erase(0, newline + 1);
+            if (line.empty()) {
+                continue;
+            }
+            bool stop = false;
+            string reply = runCommand(state, line, stop,
+                                      [clientFd](const string& event) { sendAll(clientFd, event + "\n"); });
+            open = sendAll(clientFd, reply + "\n") && !stop;
+            if (stop) {
+                // Unblock accept(); the listener stays open until every connection is joined
+                shutdown(conns.listenFd, SHUT_RDWR);
+            }
+        }
+    }
+    closeConnection(conns, clientFd);
+    lock_guard<mutex> guard(conns.lock);
+    conns.finished.push_back(this_thread::get_id());
+}
+
+// Joins connection threads that have finished.
+void reapConnections(Connections& conns) {
+    vector<thread> done;
+    {
+        lock_guard<mutex> guard(conns.lock);
+        for (thread::id id : conns.finished) {
+            auto it = conns.threads.find(id);
+            done.push_back(std::move(it->second));
+            conns.threads.erase(it);
+        }
+        conns.finished.clear();
+    }
+    for (thread& t : done) {
+        t.join();
+    }
+}
+
+// Listens on a Unix domain socket, one thread per connection.
+int serveSocket(DaemonState& state, const string& socketPath) {
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        throw invalid_argument("Socket path too long: " + socketPath);
+    }
+    strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+
+    Connections conns;
+    conns.listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conns.listenFd < 0) {
+        throw runtime_error(string("socket: ") + strerror(errno));
+    }
+    unlink(socketPath.c_str());
+    if (bind(conns.listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+        listen(conns.listenFd, 16) < 0) {
+        string err = strerror(errno);
+        close(conns.listenFd);
+        throw runtime_error("bind/listen on " + socketPath + ": " + err);
+    }
+    cerr << "cryptovote daemon listening on " << socketPath << endl;
+
+    while (state.running) {
+        int clientFd = accept(conns.listenFd, nullptr, nullptr);
+        if (clientFd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        reapConnections(conns);
+        lock_guard<mutex> guard(conns.lock);
+        conns.fds.insert(clientFd);
+        thread t(serveConnection, ref(state), ref(conns), clientFd);
+        conns.threads[t.get_id()] = std::move(t);
+    }
+
+    // Wake connections blocked in read(); one inside a command finishes it first
+    {
+        lock_guard<mutex> guard(conns.lock);
+        for (int fd : conns.fds) {
+            shutdown(fd, SHUT_RDWR);
+        }
+    }
+    for (auto& entry : conns.threads) {
+        entry.second.join();
+    }
+    close(conns.listenFd);
+    unlink(socketPath.c_str());
+    return 0;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Executes one JSON command and returns the JSON reply.
+string handleDaemonCommand(DaemonState& state, const string& line) {
+    typedef void (*Handler)(DaemonState&, const JsonObject&, JsonWriter&);
+    static const struct { const char* name; Handler fn; } handlers[] = {
+        {"setup", cmdSetup},
+        {"simulate", cmdSimulate},
+        {"cast", cmdCast},
+        {"revoke", cmdRevoke},
+        {"find", cmdFind},
+        {"tally", cmdTally},
+        {"subtotals", cmdSubtotals},
+        {"decrypt", cmdDecrypt},
+        {"audit", cmdAudit},
+        {"shuffle", cmdShuffle},
+        {"board", cmdBoard},
+        {"proof", cmdProof},
+        {"status", cmdStatus},
+        {"metrics", cmdMetrics},
+        {"save", cmdSave},
+        {"load", cmdLoad},
+        {"cancel", cmdCancel},
+        {"shutdown", cmdShutdown},
+    };
+
+    string idJson;
+    try {
+        JsonObject req = parseJsonObject(line);
+        idJson = requestIdJson(req);
+
+        string cmd = req.getString("cmd");
+        Handler handler = nullptr;
+        for (const auto& h : handlers) {
+            if (cmd == h.name) {
+                handler = h.fn;
+                break;
+            }
+        }
+        if (!handler) {
+            throw invalid_argument("Unknown command \"" + cmd + "\"");
+        }
+
+        JsonWriter reply;
+        reply.beginObject();
+        if (!idJson.empty()) {
+            reply.key("id").rawValue(idJson);
+        }
+        reply.field("ok", true);
+        handler(state, req, reply);
+        reply.endObject();
+        return reply.str();
+    } catch (const exception& e) {
+        return errorReply(idJson, e.what());
+    }
+}
+
+// Runs the daemon over stdin/stdout or a Unix socket.
+int runDaemon(const string& socketPath, const string& snapshotPath, const string& walPath,
+              const BallotLogOptions& walOptions, const string& tuningPath) {
+    if (!walPath.empty() && snapshotPath.empty()) {
+        cerr << "A ballot log (--wal) needs a snapshot (--snapshot) to follow" << endl;
+        return 1;
+    }
+    DaemonState state;
+    gmp_randinit_mt(state.rand_state);
+    gmp_randseed_ui(state.rand_state, static_cast<unsigned long>(time(nullptr)));
+    state.snapshotPath = snapshotPath;
+    state.walPath = walPath;
+    state.walOptions = walOptions;
+    state.tuningPath = tuningPath;
+    state.simdCap = currentSimdLimit();
+
+    int code = 0;
+    try {
+        if (!snapshotPath.empty() && access(snapshotPath.c_str(), F_OK) == 0) {
+            loadSnapshot(state.election, snapshotPath);
+            cerr << "cryptovote daemon restored " << ballotCount(state.election)
+                 << " ballots from " << snapshotPath << endl;
+            if (!walPath.empty()) {
+                state.election.log = make_shared<BallotLog>(walPath, state.election, walOptions);
+                const BallotLogRecovery& r = state.election.log->recovery();
+                cerr << "cryptovote daemon replayed " << r.ballots << " ballots and " << r.revocations
+                     << " revocations from " << walPath;
+                if (r.tornBytes > 0) {
+                    cerr << " (dropped a torn tail of " << r.tornBytes << " bytes)";
+                }
+                if (r.stale) {
+                    cerr << " (set aside a log for other keys as " << walPath << ".stale)";
+                }
+                cerr << endl;
+            }
+        }
+        code = socketPath.empty() ? serveStdio(state) : serveSocket(state, socketPath);
+        if (!snapshotPath.empty() && !state.election.weights.empty()) {
+            lock_guard<mutex> guard(state.lock);
+            saveSnapshot(state.election, snapshotPath);
+            if (state.election.log) {
+                state.election.log->checkpoint(state.election);
+            }
+        }
+    } catch (const exception& e) {
+        cerr << "Critical Error in Daemon: " << e.what() << endl;
+        code = 1;
+    }
+    gmp_randclear(state.rand_state);
+    return code;
+}
@@ -0,0 +1,462 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "election.h"
+#include "aes.h"
+#include "ballot_log.h"
+#include "json.h"
+#include "paillier_fixed.h"
+#include "snapshot.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+// A ballot that has been checked and encrypted but not yet stored.
+struct PreparedBallot {
+    EncryptedBallot ballot;
+    int candidate;
+    bool revoting; // The voter is already in the index (with a revoked or superseded ballot)
+};
+
+// Validates a cast and encrypts the ballot, leaving the election's ballots and tallies as they are.
+// 'superseded' is a live ballot of the same voter that is about to be revoked (SIZE_MAX if none).
+PreparedBallot prepareBallot(Election& election, const string& pii, int candidateIndex,
+                             gmp_randstate_t& rand_state, const string& precinct, size_t superseded) {
+
+    if (election.weights.empty()) {
+        throw invalid_argument("Election has not been set up");
+    }
+    if (candidateIndex < 0 || candidateIndex >= election.numCandidates) {
+        throw invalid_argument("Candidate index out of range");
+    }
+    size_t live = liveBallotCount(election) - (superseded != SIZE_MAX ? 1 : 0);
+    if (live >= static_cast<size_t>(election.max_voters)) {
+        throw invalid_argument("Election already holds max_voters ballots");
+    }
+    PreparedBallot prepared;
+    prepared.candidate = candidateIndex;
+    prepared.ballot.voterTag = voterTagFor(election, pii);
+    size_t previous = 0;
+    syncVoterIndex(election);
+    prepared.revoting = election.voters.find(prepared.ballot.voterTag, previous);
+    if (prepared.revoting && previous != superseded && !election.revoked.count(previous)) {
+        throw invalid_argument("Voter has already cast ballot " + to_string(previous));
+    }
+    // Creating the unit's node changes no counts, so it may happen before a later step fails
+    prepared.ballot.unit = static_cast<uint32_t>(election.tree.resolve(precinct));
+
+    // Encrypt PII using AES and the weight using Paillier
+    prepared.ballot.aesEncryptedPII = encryptAES256(pii, election.aes_key);
+    mpz_class plaintextWeight = getVoteWeight(candidateIndex, election.weights);
+    encVote(prepared.ballot.encWeight, plaintextWeight, election.paillierKeys, rand_state,
+            threadScratch(election.paillierKeys));
+    return prepared;
+}
+
+// Logs a prepared ballot under the index storeBallot() will give it. Called before
+// anything changes, so a failed log leaves the election as it was.
+void logBallot(Election& election, const PreparedBallot& prepared) {
+    if (election.log) {
+        election.log->appendBallot(election, ballotCount(election), prepared.ballot, prepared.candidate);
+    }
+}
+
+// Stores a prepared ballot and folds it into the running tally and its unit's subtotals.
+size_t storeBallot(Election& election, PreparedBallot& prepared) {
+    const PaillierKeys& keys = election.paillierKeys;
+    addVotes(election.encryptedTally, prepared.ballot.encWeight, keys, threadScratch(keys));
+    election.tree.add(prepared.ballot.unit, prepared.ballot.encWeight, 1, keys);
+    election.actualVoteCounts[prepared.candidate]++;
+    election.allBallots.push_back(std::move(prepared.ballot));
+    election.ballotCandidates.push_back(static_cast<Byte>(prepared.candidate));
+    const EncryptedBallot& stored = election.allBallots.back();
+    size_t index = ballotCount(election) - 1;
+    if (prepared.revoting) {
+        election.voters.update(stored.voterTag, index);
+    } else {
+        election.voters.insert(stored.voterTag, index);
+    }
+    election.indexedBallots = index + 1;
+    if (election.board.size() == index) {
+        election.board.append(hashBallotLeaf(stored));
+    }
+    return index;
+}
+
+// Inverses that take a set of ballots back out of the tallies, computed before anything changes.
+struct RevocationPlan {
+    vector<size_t> indices;
+    vector<size_t> units;         // Reporting units holding the ballots
+    vector<mpz_class> inverses;   // Per unit, the inverse of its revoked ballots' product
+    vector<uint64_t> counts;      // Per unit, the number of revoked ballots
+    vector<int> candidates;       // Per ballot, for the verification counts (-1 = unknown)
+};
+
+// Validates a revocation and computes its per-unit inverses with one batched inversion.
+RevocationPlan planRevocation(const Election& election, const vector<size_t>& indices) {
+
+    if (election.weights.empty()) {
+        throw invalid_argument("Election has not been set up");
+    }
+    size_t total = ballotCount(election);
+    unordered_set<size_t> batch;
+    for (size_t index : indices) {
+        if (index >= total) {
+            throw invalid_argument("Ballot index " + to_string(index) + " out of range");
+        }
+        if (election.revoked.count(index) || !batch.insert(index).second) {
+            throw invalid_argument("Ballot " + to_string(index) + " is already revoked");
+        }
+    }
+    RevocationPlan plan;
+    plan.indices = indices;
+    if (indices.empty()) {
+        return plan;
+    }
+    const PaillierKeys& keys = election.paillierKeys;
+
+    // One product per reporting unit, then a single batched inversion
+    vector<mpz_class> products;
+    unordered_map<size_t, size_t> slotOf;
+    for (size_t index : indices) {
+        EncryptedBallot ballot = ballotAt(election, index);
+        auto slot = slotOf.emplace(ballot.unit, plan.units.size());
+        if (slot.second) {
+            plan.units.push_back(ballot.unit);
+            products.push_back(ballot.encWeight);
+            plan.counts.push_back(1);
+        } else {
+            products[slot.first->second] = addVotes(products[slot.first->second], ballot.encWeight, keys);
+            plan.counts[slot.first->second]++;
+        }
+        plan.candidates.push_back(ballotCandidate(election, index));
+    }
+    plan.inverses = invertCiphertexts(products, keys);
+    return plan;
+}
+
+// Logs a planned revocation, before anything changes.
+void logRevocation(Election& election, const RevocationPlan& plan) {
+    if (election.log && !plan.indices.empty()) {
+        election.log->appendRevocation(plan.indices);
+    }
+}
+
+// Applies a planned revocation to the tallies and the verification counts.
+void applyRevocation(Election& election, const RevocationPlan& plan) {
+    if (plan.indices.empty()) {
+        return;
+    }
+    const PaillierKeys& keys = election.paillierKeys;
+    for (int c : plan.candidates) {
+        if (c >= 0) {
+            election.actualVoteCounts[c]--;
+        }
+    }
+    for (size_t i = 0; i < plan.units.size(); i++) {
+        election.encryptedTally = addVotes(election.encryptedTally, plan.inverses[i], keys);
+        election.tree.remove(plan.units[i], plan.inverses[i], plan.counts[i], keys);
+    }
+    election.revoked.insert(plan.indices.begin(), plan.indices.end());
+}
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Generates keys and weights for a fresh election.
+void setupElection(Election& election, int numCandidates, int max_voters, int keySize,
+                   gmp_randstate_t& rand_state, bool verbose) {
+
+    if (numCandidates < 1 || numCandidates > 50) {
+        throw invalid_argument("numCandidates must be between 1 and 50");
+    }
+    if (max_voters < 1) {
+        throw invalid_argument("max_voters must be at least 1");
+    }
+    if (keySize < 128 || keySize % 2 != 0) {
+        throw invalid_argument("keySize must be an even number of bits >= 128");
+    }
+
+    // Built aside, so a rejected setup leaves the current election untouched
+    Election fresh;
+    fresh.numCandidates = numCandidates;
+    fresh.max_voters = max_voters;
+    fresh.keySize = keySize;
+
+    if (verbose) {
+        cout << "Generating Paillier keys (Size: " << keySize << " bits)..." << endl;
+    }
+    fresh.paillierKeys = genKeyPaillier(keySize);
+    if (verbose) {
+        cout << "Paillier keys generated." << endl;
+    }
+    fresh.aes_key = genKeyAES(rand_state, verbose);
+    fresh.voterKey = genKeyAES(rand_state, false);
+    fresh.voters.reserve(max_voters);
+    fresh.weights = calcWeights(numCandidates, max_voters, verbose);
+
+    // The full tally (at most k votes in the top digit) must stay below n
+    mpz_class maxTally = fresh.weights.back() * (mpz_class(max_voters) + 1);
+    if (maxTally >= fresh.paillierKeys.n) {
+        throw invalid_argument("numCandidates/max_voters too large for the Paillier key size");
+    }
+
+    fresh.actualVoteCounts.assign(numCandidates, 0);
+    fresh.encryptedTally = 1; // Trivial encryption of 0
+    election = std::move(fresh);
+}
+
+// Counts the ballots in an election, including those in a loaded snapshot.
+size_t ballotCount(const Election& election) {
+    size_t mapped = election.snapshot ? election.snapshot->ballotCount() : 0;
+    return mapped + election.allBallots.size();
+}
+
+// Counts the ballots that still count towards the tally.
+size_t liveBallotCount(const Election& election) {
+    return ballotCount(election) - election.revoked.size();
+}
+
+// Returns one ballot, reading it from the snapshot mapping if needed.
+EncryptedBallot ballotAt(const Election& election, size_t index) {
+    size_t mapped = election.snapshot ? election.snapshot->ballotCount() : 0;
+    if (index < mapped) {
+        return election.snapshot->ballot(index);
+    }
+    if (index - mapped >= election.allBallots.size()) {
+        throw out_of_range("Ballot index " + to_string(index) + " out of range");
+    }
+    return election.allBallots[index - mapped];
+}
+
+// Returns the candidate a ballot was cast for, as kept for the verification counts.
+int ballotCandidate(const Election& election, size_t index) {
+    size_t mapped = election.snapshot ? election.snapshot->ballotCount() : 0;
+    int candidate = -1;
+    if (index < mapped) {
+        Byte sealed = 0;
+        if (election.snapshot->sealedCandidate(index, sealed)) {
+            HmacSha256 hmac(election.voterKey.data(), election.voterKey.size());
+            candidate = sealed ^ candidateMask(hmac, index);
+        }
+    } else if (index - mapped < election.ballotCandidates.size()) {
+        candidate = election.ballotCandidates[index - mapped];
+    } else {
+        throw out_of_range("Ballot index " + to_string(index) + " out of range");
+    }
+    return candidate < election.numCandidates ? candidate : -1;
+}
+
+// Computes the tag of a voter in this election.
+VoterTag voterTagFor(const Election& election, const string& pii) {
+    HmacSha256 hmac(election.voterKey.data(), election.voterKey.size());
+    return computeVoterTag(hmac, pii);
+}
+
+// Adds any ballots not yet indexed to the voter index.
+void syncVoterIndex(Election& election) {
+    static const VoterTag untagged = {};
+    size_t total = ballotCount(election);
+    size_t mapped = election.snapshot ? election.snapshot->ballotCount() : 0;
+    election.voters.reserve(total);
+    for (size_t i = election.indexedBallots; i < total; i++) {
+        VoterTag tag = i < mapped ? election.snapshot->voterTag(i) : election.allBallots[i - mapped].voterTag;
+        size_t existing = 0;
+        if (tag != untagged && !election.voters.insert(tag, i, &existing) && election.revoked.count(existing)) {
+            election.voters.update(tag, i); // A re-vote after a revocation
+        }
+    }
+    election.indexedBallots = total;
+}
+
+// Hashes any ballots not yet on the bulletin board and appends them.
+void syncBoard(Election& election, int threads) {
+    const size_t batch = 4096;
+    threads = max(1, threads);
+    size_t total = ballotCount(election);
+    vector<Digest> leaves;
+    while (election.board.size() < total) {
+        size_t begin = election.board.size();
+        size_t count = min(total - begin, batch * threads);
+        leaves.resize(count);
+        vector<thread> pool;
+        for (int t = 0; t < threads; t++) {
+            pool.emplace_back([&, t]() {
+                for (size_t i = t; i < count; i += threads) {
+                    leaves[i] = hashBallotLeaf(ballotAt(election, begin + i));
+                }
+            });
+        }
+        for (thread& th : pool) {
+            th.join();
+        }
+        for (const Digest& leaf : leaves) {
+            election.board.append(leaf);
+        }
+    }
+}
+
+// Finds the ballot cast by a voter.
+bool findVoter(Election& election, const string& pii, size_t& index) {
+    syncVoterIndex(election);
+    return election.voters.find(voterTagFor(election, pii), index);
+}
+
+// Encrypts one ballot, stores it and folds it into the running tally.
+size_t castBallot(Election& election, const string& pii, int candidateIndex,
+                  gmp_randstate_t& rand_state, const string& precinct) {
+
+    PreparedBallot prepared = prepareBallot(election, pii, candidateIndex, rand_state, precinct, SIZE_MAX);
+    logBallot(election, prepared);
+    return storeBallot(election, prepared);
+}
+
+// Casts a ballot that supersedes the voter's previous one.
+size_t replaceBallot(Election& election, const string& pii, int candidateIndex, gmp_randstate_t& rand_state,
+                     const string& precinct, size_t* replaced) {
+
+    if (election.weights.empty()) {
+        throw invalid_argument("Election has not been set up");
+    }
+    size_t previous = 0;
+    string unitPath = precinct;
+    bool superseding = findVoter(election, pii, previous) && !election.revoked.count(previous);
+    if (superseding && unitPath.empty()) {
+        unitPath = election.tree.node(ballotAt(election, previous).unit).path;
+    }
+
+    // Everything that can fail happens before the election changes
+    RevocationPlan plan;
+    if (superseding) {
+        plan = planRevocation(election, {previous});
+    }
+    PreparedBallot prepared =
+        prepareBallot(election, pii, candidateIndex, rand_state, unitPath, superseding ? previous : SIZE_MAX);
+    if (superseding) {
+        logRevocation(election, plan);
+    }
+    logBallot(election, prepared);
+    if (superseding) {
+        applyRevocation(election, plan);
+        if (replaced) {
+            *replaced = previous;
+        }
+    }
+    return storeBallot(election, prepared);
+}
+
+// Removes ballots from the running tally and their units' subtotals.
+void revokeBallots(Election& election, const vector<size_t>& indices) {
+    RevocationPlan plan = planRevocation(election, indices);
+    logRevocation(election, plan);
+    applyRevocation(election, plan);
+}
+
+// Rebuilds the running tally from every stored ballot.
+void recomputeTally(Election& election, int threads) {
+
+    threads = max(1, threads);
+    const size_t total = ballotCount(election);
+    vector<mpz_class> partials(threads, mpz_class(1));
+
+    auto worker = [&](int t, size_t begin, size_t end) {
+        unique_ptr<CiphertextProduct> product = makeCiphertextProduct(election.paillierKeys);
+        for (size_t i = begin; i < end; i++) {
+            if (!election.revoked.count(i)) {
+                product->multiply(ballotAt(election, i).encWeight);
+            }
+        }
+        product->value(partials[t]);
+    };
+
+    vector<thread> pool;
+    size_t chunk = (total + threads - 1) / threads;
+    for (int t = 0; t < threads; t++) {
+        size_t begin = min(total, t * chunk);
+        size_t end = min(total, begin + chunk);
+        pool.emplace_back(worker, t, begin, end);
+    }
+    for (thread& th : pool) {
+        th.join();
+    }
+
+    election.encryptedTally = 1;
+    for (const mpz_class& partial : partials) {
+        addVotes(election.encryptedTally, partial, election.paillierKeys, threadScratch(election.paillierKeys));
+    }
+}
+
+// Decrypts the running tally and decodes it into per-candidate counts.
+vector<long> tallyElection(const Election& election, mpz_class& decryptedTally) {
+
+    decryptedTally = decVote(election.encryptedTally, election.paillierKeys);
+    return decodeTally(decryptedTally, election.numCandidates, election.max_voters);
+}
+
+// Decrypts and decodes the subtotals of several reporting units.
+vector<vector<long>> tallySubtotals(const Election& election, const vector<size_t>& nodes, int threads) {
+
+    vector<mpz_class> plaintexts = decryptSubtotals(election.tree, nodes, election.paillierKeys, threads);
+    vector<vector<long>> counts;
+    counts.reserve(plaintexts.size());
+    for (const mpz_class& p : plaintexts) {
+        counts.push_back(decodeTally(p, election.numCandidates, election.max_voters));
+    }
+    return counts;
+}
+
+// Decrypts the PII and vote weight of one stored ballot.
+DecryptedBallot decryptBallotAt(const Election& election, size_t index) {
+
+    EncryptedBallot ballot = ballotAt(election, index);
+
+    DecryptedBallot result;
+    result.pii = decryptAES256(ballot.aesEncryptedPII, election.aes_key);
+    result.weight = decVote(ballot.encWeight, election.paillierKeys);
+    result.candidate = -1;
+    for (int i = 0; i < election.numCandidates; i++) {
+        if (election.weights[i] == result.weight) {
+            result.candidate = i;
+            break;
+        }
+    }
+    return result;
+}
+
+// Serializes one ballot as a single-line JSON object.
+string ballotToJson(size_t index, const EncryptedBallot& ballot) {
+
+    JsonWriter w;
+    w.beginObject();
+    w.field("index", index);
+    w.field("voter", toHex(ballot.voterTag.data(), ballot.voterTag.size()));
+    w.field("pii", toHex(ballot.aesEncryptedPII.data(), ballot.aesEncryptedPII.size()));
+    w.field("weight", ballot.encWeight.get_str(16));
+    w.endObject();
+    return w.str();
+}
@@ -0,0 +1,260 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "gmp_arena.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <gmp.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+const size_t HEADER_BYTES = 16;      // Keeps the limbs 16-byte aligned
+const size_t MIN_BLOCK_BYTES = 32;   // Class 0, header included
+const int NUM_CLASSES = 12;          // 32 B .. 64 KiB
+const int OVERSIZE = NUM_CLASSES;    // Class tag of blocks served by malloc directly
+const size_t CHAIN_BLOCKS = 64;      // Blocks moved between a thread and the central lists at once
+const size_t THREAD_BLOCKS = 2 * CHAIN_BLOCKS; // Per class and thread
+const size_t CENTRAL_CHAINS = 256;   // Per class
+
+/**
+ * @brief Stored in front of every block: its size class and usable bytes.
+ */
+struct BlockHeader {
+    size_t sizeClass;
+    size_t usable;
+};
+
+/**
+ * @brief A free block. The first block of a chain on a central list also
+ *        links to the next chain.
+ */
+struct FreeBlock {
+    FreeBlock* next;
+    FreeBlock* nextChain;
+};
+
+/**
+ * @brief One thread's free lists. Trivially destructible, so it stays usable
+ *        while other thread-local destructors still free GMP memory.
+ */
+struct ThreadCache {
+    FreeBlock* lists[NUM_CLASSES];
+    size_t counts[NUM_CLASSES];
+    bool registered;
+    bool closed;
+};
+
+/**
+ * @brief Chains of CHAIN_BLOCKS free blocks shared by all threads, so blocks
+ *        allocated on one pipeline stage and freed on the next flow back.
+ */
+struct CentralLists {
+    mutex lock[NUM_CLASSES];
+    FreeBlock* chains[NUM_CLASSES] = {};
+    size_t counts[NUM_CLASSES] = {};
+};
+
+thread_local ThreadCache cache;
+atomic<bool> installed{false};
+atomic<uint64_t> systemAllocs{0};
+atomic<uint64_t> systemFrees{0};
+
+CentralLists& central() {
+    static CentralLists* instance = new CentralLists(); // Never destroyed: threads may outlive statics
+    return *instance;
+}
+
+size_t classBytes(int sizeClass) {
+    return MIN_BLOCK_BYTES << sizeClass;
+}
+
+int classFor(size_t bytes) {
+    size_t total = bytes + HEADER_BYTES;
+    int sizeClass = 0;
+    while (sizeClass < NUM_CLASSES && classBytes(sizeClass) < total) {
+        sizeClass++;
+    }
+    return sizeClass;
+}
+
+BlockHeader* headerOf(void* ptr) {
+    return reinterpret_cast<BlockHeader*>(static_cast<char*>(ptr) - HEADER_BYTES);
+}
+
+void releaseBlock(BlockHeader* header) {
+    free(header);
+    systemFrees.fetch_add(1, memory_order_relaxed);
+}
+
+// Detaches up to 'count' blocks from a thread list and returns them as a chain.
+FreeBlock* detachChain(int sizeClass, size_t count) {
+    FreeBlock* head = cache.lists[sizeClass];
+    FreeBlock* tail = head;
+    size_t taken = 1;
+    while (taken < count && tail->next) {
+        tail = tail->next;
+        taken++;
+    }
+    cache.lists[sizeClass] = tail->next;
+    cache.counts[sizeClass] -= taken;
+    tail->next = nullptr;
+    return head;
+}
+
+// Moves a chain to the central list, or back to the system if that is full.
+void pushChain(int sizeClass, FreeBlock* chain) {
+    CentralLists& c = central();
+    {
+        lock_guard<mutex> guard(c.lock[sizeClass]);
+        if (c.counts[sizeClass] < CENTRAL_CHAINS) {
+            chain->nextChain = c.chains[sizeClass];
+            c.chains[sizeClass] = chain;
+            c.counts[sizeClass]++;
+            return;
+        }
+    }
+    while (chain) {
+        FreeBlock* next = chain->next;
+        releaseBlock(headerOf(chain));
+        chain = next;
+    }
+}
+
+// Refills an empty thread list with a chain from the central list.
+bool pullChain(int sizeClass) {
+    CentralLists& c = central();
+    lock_guard<mutex> guard(c.lock[sizeClass]);
+    FreeBlock* chain = c.chains[sizeClass];
+    if (!chain) {
+        return false;
+    }
+    c.chains[sizeClass] = chain->nextChain;
+    c.counts[sizeClass]--;
+    size_t count = 0;
+    for (FreeBlock* b = chain; b; b = b->next) {
+        count++;
+    }
+    cache.lists[sizeClass] = chain;
+    cache.counts[sizeClass] = count;
+    return true;
+}
+
+/**
+ * @brief Hands a thread's cached blocks to the central lists when it exits,
+ *        so the next pipeline's workers start warm.
+ */
+struct CacheReleaser {
+    ~CacheReleaser() {
+        cache.closed = true;
+        for (int c = 0; c < NUM_CLASSES; c++) {
+            while (cache.lists[c]) {
+                pushChain(c, detachChain(c, CHAIN_BLOCKS));
+            }
+        }
+    }
+};
+
+void* arenaAlloc(size_t bytes) {
+    int sizeClass = classFor(bytes);
+    if (sizeClass < OVERSIZE && !cache.closed && (cache.lists[sizeClass] || pullChain(sizeClass))) {
+        FreeBlock* block = cache.lists[sizeClass];
+        cache.lists[sizeClass] = block->next;
+        cache.counts[sizeClass]--;
+        return block;
+    }
+
+    size_t usable = sizeClass < OVERSIZE ? classBytes(sizeClass) - HEADER_BYTES : bytes;
+    BlockHeader* header = static_cast<BlockHeader*>(malloc(usable + HEADER_BYTES));
+    if (!header) {
+        fprintf(stderr, "GMP arena: out of memory allocating %zu bytes\n", bytes);
+        abort(); // GMP cannot recover from a failed allocation
+    }
+    systemAllocs.fetch_add(1, memory_order_relaxed);
+    header->sizeClass = static_cast<size_t>(sizeClass);
+    header->usable = usable;
+    return reinterpret_cast<char*>(header) + HEADER_BYTES;
+}
+
+void arenaFree(void* ptr, size_t) {
+    if (!ptr) {
+        return;
+    }
+    BlockHeader* header = headerOf(ptr);
+    int sizeClass = static_cast<int>(header->sizeClass);
+    if (sizeClass >= OVERSIZE) {
+        releaseBlock(header);
+        return;
+    }
+    if (cache.closed) {
+        FreeBlock* block = static_cast<FreeBlock*>(ptr);
+        block->next = nullptr;
+        pushChain(sizeClass, block);
+        return;
+    }
+    if (!cache.registered) {
+        static thread_local CacheReleaser releaser; // Constructed once per thread that caches blocks
+        (void)releaser;
+        cache.registered = true;
+    }
+    FreeBlock* block = static_cast<FreeBlock*>(ptr);
+    block->next = cache.lists[sizeClass];
+    cache.lists[sizeClass] = block;
+    if (++cache.counts[sizeClass] > THREAD_BLOCKS) {
+        pushChain(sizeClass, detachChain(sizeClass, CHAIN_BLOCKS));
+    }
+}
+
+void* arenaRealloc(void* ptr, size_t oldBytes, size_t newBytes) {
+    if (!ptr) {
+        return arenaAlloc(newBytes);
+    }
+    BlockHeader* header = headerOf(ptr);
+    if (newBytes <= header->usable && header->sizeClass < static_cast<size_t>(OVERSIZE)) {
+        return ptr; // Still fits its size class
+    }
+    void* grown = arenaAlloc(newBytes);
+    memcpy(grown, ptr, min(min(oldBytes, header->usable), newBytes));
+    arenaFree(ptr, oldBytes);
+    return grown;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Installs the free-list allocator as GMP's memory functions.
+void installGmpArena() {
+    if (installed.exchange(true)) {
+        return;
+    }
+    mp_set_memory_functions(arenaAlloc, arenaRealloc, arenaFree);
+}
+
+// Reads the arena's counters.
+GmpArenaStats gmpArenaStats() {
+    GmpArenaStats stats;
+    stats.installed = installed.load();
+    stats.systemAllocs = systemAllocs.load(memory_order_relaxed);
+    stats.systemFrees = systemFrees.load(memory_order_relaxed);
+    return stats;
+}
@@ -0,0 +1,241 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "ingest.h"
+#include "json.h"
+//-------------------------------------------------------------
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    RECORD READER
+###########################################################################
+*/
+
+RecordReader::RecordReader(const string& path, const string& format, size_t chunkBytes)
+    : path(path), buffer(chunkBytes < 4096 ? 4096 : chunkBytes) {
+
+    if (format == "auto") {
+        size_t dot = path.rfind('.');
+        string ext = dot == string::npos ? "" : path.substr(dot + 1);
+        ndjson = (ext == "ndjson" || ext == "jsonl" || ext == "json");
+    } else if (format == "csv" || format == "ndjson") {
+        ndjson = (format == "ndjson");
+    } else {
+        throw invalid_argument("Unknown input format " + format);
+    }
+
+    fd = (path == "-") ? STDIN_FILENO : open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Cannot open input file " + path + ": " + strerror(errno));
+    }
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+}
+
+RecordReader::~RecordReader() {
+    if (fd > STDIN_FILENO) {
+        close(fd);
+    }
+}
+
+// Moves any partial line to the front of the buffer and reads more data.
+bool RecordReader::fill() {
+    if (eof) {
+        return false;
+    }
+    if (begin > 0) {
+        memmove(buffer.data(), buffer.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+    }
+    if (end == buffer.size()) {
+        // A single line longer than the buffer: grow rather than fail
+        buffer.resize(buffer.size() * 2);
+    }
+    ssize_t n;
+    do {
+        n = read(fd, buffer.data() + end, buffer.size() - end);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        throw runtime_error("Read error on " + path + ": " + strerror(errno));
+    }
+    if (n == 0) {
+        eof = true;
+        return false;
+    }
+    end += static_cast<size_t>(n);
+    totalBytes += static_cast<size_t>(n);
+    return true;
+}
+
+// Extracts the next line (without the newline) from the buffer.
+bool RecordReader::nextLine(string& line) {
+    while (true) {
+        char* start = buffer.data() + begin;
+        char* newline = static_cast<char*>(memchr(start, '\n', end - begin));
+        if (newline) {
+            line.assign(start, newline);
+            begin += (newline - start) + 1;
+            break;
+        }
+        if (!fill()) {
+            if (begin == end) {
+                return false;
+            }
+            // Last line without a trailing newline
+            line.assign(buffer.data() + begin, buffer.data() + end);
+            begin = end;
+            break;
+        }
+    }
+    lineNo++;
+    if (!line.empty() && line.back() == '\r') {
+        line.pop_back();
+    }
+    return true;
+}
+
+// Reads and parses the next CSV or NDJSON record.
+bool RecordReader::next(CastVoteRecord& record) {
+    string line;
+    while (nextLine(line)) {
+        if (line.empty()) {
+            continue;
+        }
+        string where = path + ":" + to_string(lineNo);
+
+        if (ndjson) {
+            JsonObject obj;
+            try {
+                obj = parseJsonObject(line);
+                if (!obj.has("pii") || !obj.has("candidate")) {
+                    throw invalid_argument("expected \"pii\" and \"candidate\"");
+                }
+                record.pii = obj.getString("pii");
+                long long candidate = obj.getInt("candidate");
+                if (candidate < 0 || candidate > INT_MAX) {
+                    throw invalid_argument("candidate " + to_string(candidate) + " is out of range");
+                }
+                record.candidate = static_cast<int>(candidate);
+                record.precinct = obj.getString("precinct");
+            } catch (const exception& e) {
+                throw invalid_argument(where + ": " + e.what());
+            }
+            return true;
+        }
+
+        auto isNumber = [](const string& field) {
+            return !field.empty() && field.find_first_not_of("0123456789") == string::npos;
+        };
+        size_t comma = line.rfind(',');
+        string choice = comma == string::npos ? "" : line.substr(comma + 1);
+        record.precinct.clear();
+        if (!isNumber(choice) && comma != string::npos && comma > 0) {
+            // Optional third column: pii,candidate,precinct
+            size_t prev = line.rfind(',', comma - 1);
+            string candidate = prev == string::npos ? "" : line.substr(prev + 1, comma - prev - 1);
+            if (isNumber(candidate)) {
+                record.precinct = choice;
+                choice = candidate;
+                comma = prev;
+            }
+        }
+        if (!isNumber(choice)) {
+            if (lineNo == 1) {
+                continue; // Header row
+            }
+            throw invalid_argument(where + ": expected \"pii,candidate[,precinct]\"");
+        }
+        errno = 0;
+        long long candidate = strtoll(choice.c_str(), nullptr, 10);
+        if (errno == ERANGE || candidate > INT_MAX) {
+            throw invalid_argument(where + ": candidate " + choice + " is out of range");
+        }
+        record.pii = line.substr(0, comma);
+        record.candidate = static_cast<int>(candidate);
+        return true;
+    }
+    return false;
+}
+
+/*
+###########################################################################
+    STREAMING INGEST
+###########################################################################
+*/
+
+// Adapts a RecordReader into a pipeline RecordSource.
+RecordSource readerSource(RecordReader& reader) {
+    RecordReader* r = &reader;
+    return [r](vector<CastVoteRecord>& batch, size_t maxRecords) {
+        CastVoteRecord record;
+        while (batch.size() < maxRecords) {
+            if (!r->next(record)) {
+                return false;
+            }
+            batch.push_back(std::move(record));
+        }
+        return true;
+    };
+}
+
+// Streams records from a file through the encryption pipeline.
+IngestStats ingestFile(Election& election, const string& inputPath, const string& format,
+                       const PipelineConfig& config) {
+
+    RecordReader reader(inputPath, format);
+    IngestStats stats;
+    struct stat info;
+    if (!config.progress || config.expectedRecords > 0 || inputPath == "-" || stat(inputPath.c_str(), &info) != 0 ||
+        info.st_size <= 0) {
+        stats.pipeline = runPipeline(election, readerSource(reader), config);
+        stats.bytes = reader.bytesRead();
+        return stats;
+    }
+
+    // Scale the records parsed by the share of the file they took up
+    const double fileBytes = static_cast<double>(info.st_size);
+    auto parsedBytes = make_shared<atomic<size_t>>(0);
+    RecordSource records = readerSource(reader);
+    RecordReader* r = &reader;
+    RecordSource source = [records, r, parsedBytes](vector<CastVoteRecord>& batch, size_t maxRecords) {
+        bool more = records(batch, maxRecords);
+        parsedBytes->store(r->bytesParsed(), memory_order_relaxed);
+        return more;
+    };
+    PipelineConfig estimated = config;
+    ProgressCallback report = config.progress;
+    estimated.progress = [report, parsedBytes, fileBytes](const PipelineProgress& progress) {
+        PipelineProgress scaled = progress;
+        size_t bytes = parsedBytes->load(memory_order_relaxed);
+        if (bytes > 0) {
+            scaled.total = max(progress.parsed, static_cast<size_t>(progress.parsed * (fileBytes / bytes) + 0.5));
+            if (scaled.total > scaled.records && scaled.recordsPerSec > 0) {
+                scaled.etaMs = (scaled.total - scaled.records) / scaled.recordsPerSec * 1e3;
+            }
+        }
+        report(scaled);
+    };
+    stats.pipeline = runPipeline(election, source, estimated);
+    stats.bytes = reader.bytesRead();
+    return stats;
+}
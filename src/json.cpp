@@ -0,0 +1,326 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "json.h"
+//-------------------------------------------------------------
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+using namespace std;
+
+/*
+###########################################################################
+    PARSER HELPERS
+###########################################################################
+*/
+
+namespace {
+
+void skipSpace(const string& text, size_t& pos) {
+    while (pos < text.size() && isspace(static_cast<unsigned char>(text[pos]))) {
+        pos++;
+    }
+}
+
+// Appends a code point to 'out' as UTF-8.
+void appendUtf8(string& out, unsigned long cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    } else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    } else {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+// Parses a quoted string starting at text[pos] == '"'.
+string parseString(const string& text, size_t& pos) {
+    string result;
+    pos++; // opening quote
+    while (pos < text.size() && text[pos] != '"') {
+        char c = text[pos++];
+        if (c != '\\') {
+            result += c;
+            continue;
+        }
+        if (pos >= text.size()) {
+            break;
+        }
+        char esc = text[pos++];
+        switch (esc) {
+            case 'n': result += '\n'; break;
+            case 't': result += '\t'; break;
+            case 'r': result += '\r'; break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'u': {
+                if (pos + 4 > text.size()) {
+                    throw invalid_argument("JSON: truncated \\u escape");
+                }
+                unsigned long cp = strtoul(text.substr(pos, 4).c_str(), nullptr, 16);
+                appendUtf8(result, cp);
+                pos += 4;
+                break;
+            }
+            default: result += esc; break;
+        }
+    }
+    if (pos >= text.size()) {
+        throw invalid_argument("JSON: unterminated string");
+    }
+    pos++; // closing quote
+    return result;
+}
+
+// Skips over a nested object or array and returns its raw text.
+string skipNested(const string& text, size_t& pos) {
+    size_t start = pos;
+    int depth = 0;
+    while (pos < text.size()) {
+        char c = text[pos];
+        if (c == '"') {
+            parseString(text, pos);
+            continue;
+        }
+        if (c == '{' || c == '[') {
+            depth++;
+        } else if (c == '}' || c == ']') {
+            depth--;
+            if (depth == 0) {
+                pos++;
+                return text.substr(start, pos - start);
+            }
+        }
+        pos++;
+    }
+    throw invalid_argument("JSON: unbalanced brackets");
+}
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Parses a single flat JSON object.
+JsonObject parseJsonObject(const string& text) {
+    JsonObject obj;
+    size_t pos = 0;
+
+    skipSpace(text, pos);
+    if (pos >= text.size() || text[pos] != '{') {
+        throw invalid_argument("JSON: expected '{'");
+    }
+    pos++;
+    skipSpace(text, pos);
+    if (pos < text.size() && text[pos] == '}') {
+        return obj;
+    }
+
+    while (pos < text.size()) {
+        skipSpace(text, pos);
+        if (pos >= text.size() || text[pos] != '"') {
+            throw invalid_argument("JSON: expected member name");
+        }
+        string key = parseString(text, pos);
+        skipSpace(text, pos);
+        if (pos >= text.size() || text[pos] != ':') {
+            throw invalid_argument("JSON: expected ':' after \"" + key + "\"");
+        }
+        pos++;
+        skipSpace(text, pos);
+        if (pos >= text.size()) {
+            throw invalid_argument("JSON: missing value for \"" + key + "\"");
+        }
+
+        char c = text[pos];
+        if (c == '"') {
+            obj.fields[key] = parseString(text, pos);
+        } else if (c == '{' || c == '[') {
+            obj.fields[key] = skipNested(text, pos);
+        } else {
+            size_t start = pos;
+            while (pos < text.size() && text[pos] != ',' && text[pos] != '}' &&
+                   !isspace(static_cast<unsigned char>(text[pos]))) {
+                pos++;
+            }
+            string literal = text.substr(start, pos - start);
+            if (literal != "null") { // A null member reads as absent, so getters fall back
+                obj.fields[key] = literal;
+            }
+        }
+
+        skipSpace(text, pos);
+        if (pos < text.size() && text[pos] == ',') {
+            pos++;
+            continue;
+        }
+        if (pos < text.size() && text[pos] == '}') {
+            return obj;
+        }
+        throw invalid_argument("JSON: expected ',' or '}'");
+    }
+    throw invalid_argument("JSON: unterminated object");
+}
+
+// Escapes quotes, backslashes and control characters.
+string jsonEscape(const string& s) {
+    string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\r': out += "\\r"; break;
+            case '\t': out += "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+bool JsonObject::has(const string& key) const {
+    return fields.find(key) != fields.end();
+}
+
+string JsonObject::getString(const string& key, const string& fallback) const {
+    auto it = fields.find(key);
+    return it == fields.end() ? fallback : it->second;
+}
+
+long long JsonObject::getInt(const string& key, long long fallback) const {
+    auto it = fields.find(key);
+    if (it == fields.end()) {
+        return fallback;
+    }
+    try {
+        size_t used = 0;
+        long long v = stoll(it->second, &used);
+        if (used != it->second.size()) {
+            throw invalid_argument("trailing characters");
+        }
+        return v;
+    } catch (const exception&) {
+        throw invalid_argument("\"" + key + "\" must be an integer");
+    }
+}
+
+bool JsonObject::getBool(const string& key, bool fallback) const {
+    auto it = fields.find(key);
+    if (it == fields.end()) {
+        return fallback;
+    }
+    return it->second == "true" || it->second == "1";
+}
+
+/*
+###########################################################################
+    JSON WRITER
+###########################################################################
+*/
+
+// Emits a comma when this is not the first element of the current scope.
+void JsonWriter::separate() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (!firstInScope.empty()) {
+        if (!firstInScope.back()) {
+            out << ',';
+        }
+        firstInScope.back() = false;
+    }
+}
+
+JsonWriter& JsonWriter::beginObject() {
+    separate();
+    out << '{';
+    firstInScope.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endObject() {
+    out << '}';
+    firstInScope.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::beginArray() {
+    separate();
+    out << '[';
+    firstInScope.push_back(true);
+    return *this;
+}
+
+JsonWriter& JsonWriter::endArray() {
+    out << ']';
+    firstInScope.pop_back();
+    return *this;
+}
+
+JsonWriter& JsonWriter::key(const string& name) {
+    separate();
+    out << '"' << jsonEscape(name) << "\":";
+    afterKey = true;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const string& v) {
+    separate();
+    out << '"' << jsonEscape(v) << '"';
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(const char* v) {
+    return value(string(v));
+}
+
+JsonWriter& JsonWriter::value(long long v) {
+    separate();
+    out << v;
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(double v) {
+    separate();
+    if (std::isfinite(v)) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.9g", v);
+        out << buf;
+    } else {
+        out << "null";
+    }
+    return *this;
+}
+
+JsonWriter& JsonWriter::value(bool v) {
+    separate();
+    out << (v ? "true" : "false");
+    return *this;
+}
+
+JsonWriter& JsonWriter::rawValue(const string& json) {
+    separate();
+    out << json;
+    return *this;
+}
@@ -0,0 +1,227 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "merkle.h"
+//-------------------------------------------------------------
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+// Largest power of two strictly below n (n >= 2).
+size_t splitPoint(size_t n) {
+    size_t k = 1;
+    while (k << 1 < n) {
+        k <<= 1;
+    }
+    return k;
+}
+
+// Hashes a u32 as four big-endian bytes, so leaves do not depend on the host.
+void updateBigEndian32(Sha256& h, uint32_t value) {
+    Byte bytes[4] = {static_cast<Byte>(value >> 24), static_cast<Byte>(value >> 16),
+                     static_cast<Byte>(value >> 8), static_cast<Byte>(value)};
+    h.update(bytes, sizeof(bytes));
+}
+
+} // namespace
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+// Adds a leaf hash and completes the subtrees it closes.
+void MerkleTree::append(const Digest& leaf) {
+    if (levels.empty()) {
+        levels.emplace_back();
+    }
+    levels[0].push_back(leaf);
+
+    // Each level whose count turns even gains a parent, as in a binary counter
+    for (size_t k = 0; levels[k].size() % 2 == 0; k++) {
+        if (k + 1 == levels.size()) {
+            levels.emplace_back();
+        }
+        const vector<Digest>& level = levels[k];
+        levels[k + 1].push_back(hashMerkleNode(level[level.size() - 2], level.back()));
+    }
+}
+
+// Returns the root hash.
+Digest MerkleTree::root() const {
+    if (size() == 0) {
+        return sha256(nullptr, 0);
+    }
+    // Fold the complete subtrees of the right edge, smallest first
+    size_t n = size();
+    bool have = false;
+    Digest acc;
+    for (size_t k = 0; k < levels.size(); k++) {
+        if (n >> k & 1) {
+            const Digest& peak = levels[k][(n >> k) - 1];
+            acc = have ? hashMerkleNode(peak, acc) : peak;
+            have = true;
+        }
+    }
+    return acc;
+}
+
+// Returns one leaf hash.
+const Digest& MerkleTree::leaf(size_t index) const {
+    if (index >= size()) {
+        throw out_of_range("Leaf " + to_string(index) + " is not on the board");
+    }
+    return levels[0][index];
+}
+
+// Builds the audit path proving a leaf is in the current tree.
+vector<Digest> MerkleTree::inclusionProof(size_t index) const {
+    if (index >= size()) {
+        throw out_of_range("Leaf " + to_string(index) + " is not on the board");
+    }
+    vector<Digest> path;
+    auditPath(index, 0, size(), path);
+    return path;
+}
+
+// Hash of leaves [begin, end).
+Digest MerkleTree::rangeHash(size_t begin, size_t end) const {
+    size_t n = end - begin;
+    if ((n & (n - 1)) == 0) {
+        // A complete subtree: stored
+        size_t k = 0;
+        while ((size_t(1) << k) < n) {
+            k++;
+        }
+        return levels[k][begin >> k];
+    }
+    size_t k = splitPoint(n);
+    return hashMerkleNode(rangeHash(begin, begin + k), rangeHash(begin + k, end));
+}
+
+// Appends the audit path of leaf m within the subtree of leaves [begin, end).
+void MerkleTree::auditPath(size_t m, size_t begin, size_t end, vector<Digest>& path) const {
+    if (end - begin <= 1) {
+        return;
+    }
+    size_t k = splitPoint(end - begin);
+    if (m < begin + k) {
+        auditPath(m, begin, begin + k, path);
+        path.push_back(rangeHash(begin + k, end));
+    } else {
+        auditPath(m, begin + k, end, path);
+        path.push_back(rangeHash(begin, begin + k));
+    }
+}
+
+// Adds a leaf hash, merging the right-edge subtrees it completes.
+void MerkleFrontier::append(const Digest& leaf) {
+    // Carry up through every level whose bit is set, as in a binary counter
+    Digest carry = leaf;
+    size_t k = 0;
+    for (; count >> k & 1; k++) {
+        carry = hashMerkleNode(peaks[k], carry);
+    }
+    if (k == peaks.size()) {
+        peaks.emplace_back();
+    }
+    peaks[k] = carry;
+    count++;
+}
+
+// Returns the root hash.
+Digest MerkleFrontier::root() const {
+    if (count == 0) {
+        return sha256(nullptr, 0);
+    }
+    bool have = false;
+    Digest acc;
+    for (size_t k = 0; k < peaks.size(); k++) {
+        if (count >> k & 1) {
+            acc = have ? hashMerkleNode(peaks[k], acc) : peaks[k];
+            have = true;
+        }
+    }
+    return acc;
+}
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Hashes a ballot as a Merkle leaf.
+Digest hashBallotLeaf(const EncryptedBallot& ballot) {
+    static const Byte leafPrefix = 0x00;
+    Byte weight[1024];
+    size_t weightBytes = (mpz_sizeinbase(ballot.encWeight.get_mpz_t(), 2) + 7) / 8;
+    vector<Byte> large;
+    Byte* out = weight;
+    if (weightBytes > sizeof(weight)) {
+        large.resize(weightBytes);
+        out = large.data();
+    }
+    mpz_export(out, &weightBytes, 1, 1, 1, 0, ballot.encWeight.get_mpz_t());
+
+    Sha256 h;
+    h.update(&leafPrefix, 1);
+    updateBigEndian32(h, static_cast<uint32_t>(ballot.aesEncryptedPII.size()));
+    h.update(ballot.aesEncryptedPII.data(), ballot.aesEncryptedPII.size());
+    updateBigEndian32(h, static_cast<uint32_t>(weightBytes));
+    h.update(out, weightBytes);
+    return h.finish();
+}
+
+// Hashes two child nodes into their parent.
+Digest hashMerkleNode(const Digest& left, const Digest& right) {
+    static const Byte nodePrefix = 0x01;
+    Sha256 h;
+    h.update(&nodePrefix, 1);
+    h.update(left.data(), left.size());
+    h.update(right.data(), right.size());
+    return h.finish();
+}
+
+// Checks an audit path against a root.
+bool verifyInclusion(const Digest& leaf, size_t index, size_t size, const vector<Digest>& path, const Digest& root) {
+    if (index >= size) {
+        return false;
+    }
+    size_t fn = index;
+    size_t sn = size - 1;
+    Digest r = leaf;
+    for (const Digest& p : path) {
+        if (sn == 0) {
+            return false;
+        }
+        if ((fn & 1) || fn == sn) {
+            r = hashMerkleNode(p, r);
+            while (!(fn & 1) && fn != 0) {
+                fn >>= 1;
+                sn >>= 1;
+            }
+        } else {
+            r = hashMerkleNode(r, p);
+        }
+        fn >>= 1;
+        sn >>= 1;
+    }
+    return sn == 0 && r == root;
+}
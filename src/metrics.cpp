@@ -0,0 +1,276 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "metrics.h"
+#include "json.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    THREAD-LOCAL AGGREGATION
+###########################################################################
+*/
+
+namespace {
+
+const char* const METRIC_NAMES[METRIC_COUNT] = {
+    "keygen",
+    "aes_encrypt",
+    "aes_decrypt",
+    "paillier_encrypt",
+    "add_votes",
+    "paillier_decrypt",
+    "decode",
+    "enc_zero",
+    "scale_vote",
+    "weighted_tally",
+    "batch_invert",
+    "wal_commit",
+};
+
+/**
+ * @brief Counters for one operation on one thread.
+ * @details Only the owning thread writes, so updates are a relaxed load and
+ *          store rather than a locked read-modify-write; the atomics only make
+ *          concurrent snapshots well defined.
+ */
+struct MetricCells {
+    atomic<uint64_t> count{0};
+    atomic<uint64_t> totalNs{0};
+    atomic<uint64_t> bytes{0};
+    atomic<uint64_t> buckets[METRIC_BUCKETS];
+
+    MetricCells() {
+        for (auto& b : buckets) {
+            b.store(0, memory_order_relaxed);
+        }
+    }
+};
+
+struct ThreadMetrics {
+    MetricCells cells[METRIC_COUNT];
+};
+
+void bump(atomic<uint64_t>& cell, uint64_t n) {
+    cell.store(cell.load(memory_order_relaxed) + n, memory_order_relaxed);
+}
+
+/**
+ * @brief Every thread's counters plus the totals of threads that have exited.
+ */
+struct MetricsRegistry {
+    mutex lock;
+    vector<ThreadMetrics*> live;
+    vector<MetricSnapshot> retired;
+
+    MetricsRegistry() : retired(METRIC_COUNT) {
+        for (int m = 0; m < METRIC_COUNT; m++) {
+            retired[m].name = METRIC_NAMES[m];
+            retired[m].buckets.assign(METRIC_BUCKETS, 0);
+        }
+    }
+};
+
+MetricsRegistry& registry() {
+    static MetricsRegistry* instance = new MetricsRegistry(); // Never destroyed: threads may outlive statics
+    return *instance;
+}
+
+// Adds one thread's counters into a snapshot.
+void accumulate(const ThreadMetrics& t, vector<MetricSnapshot>& into) {
+    for (int m = 0; m < METRIC_COUNT; m++) {
+        const MetricCells& c = t.cells[m];
+        into[m].count += c.count.load(memory_order_relaxed);
+        into[m].totalNs += c.totalNs.load(memory_order_relaxed);
+        into[m].bytes += c.bytes.load(memory_order_relaxed);
+        for (int b = 0; b < METRIC_BUCKETS; b++) {
+            into[m].buckets[b] += c.buckets[b].load(memory_order_relaxed);
+        }
+    }
+}
+
+/**
+ * @brief Registers the calling thread's counters on first use and folds them
+ *        into the retired totals when the thread exits.
+ */
+class ThreadMetricsHandle {
+public:
+    ThreadMetricsHandle() : metrics(new ThreadMetrics()) {
+        MetricsRegistry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        r.live.push_back(metrics);
+    }
+
+    ~ThreadMetricsHandle() {
+        MetricsRegistry& r = registry();
+        lock_guard<mutex> guard(r.lock);
+        accumulate(*metrics, r.retired);
+        r.live.erase(find(r.live.begin(), r.live.end(), metrics));
+        delete metrics;
+    }
+
+    ThreadMetrics* metrics;
+};
+
+// Upper bound of histogram bucket b in nanoseconds (the last bucket is unbounded).
+uint64_t bucketBoundNs(int b) {
+    return 1000ULL << b;
+}
+
+int bucketFor(uint64_t ns) {
+    int b = 0;
+    while (b < METRIC_BUCKETS - 1 && ns > bucketBoundNs(b)) {
+        b++;
+    }
+    return b;
+}
+
+// Estimates a quantile as the upper bound of the bucket that contains it.
+double quantileUs(const MetricSnapshot& s, double q) {
+    if (s.count == 0) {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(q * (s.count - 1)) + 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < METRIC_BUCKETS - 1; b++) {
+        seen += s.buckets[b];
+        if (seen >= rank) {
+            return bucketBoundNs(b) / 1e3;
+        }
+    }
+    return bucketBoundNs(METRIC_BUCKETS - 2) / 1e3;
+}
+
+string formatDouble(double v) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9g", v);
+    return buf;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Records one call, or a batch of calls, of an operation in the calling thread's counters.
+void recordMetric(Metric metric, uint64_t ns, size_t bytes, uint64_t calls) {
+    static thread_local ThreadMetricsHandle handle;
+    MetricCells& c = handle.metrics->cells[metric];
+    calls = max<uint64_t>(1, calls);
+    bump(c.count, calls);
+    bump(c.totalNs, ns);
+    bump(c.bytes, bytes);
+    bump(c.buckets[bucketFor(ns / calls)], calls);
+}
+
+// Sums the counters of all live and exited threads.
+vector<MetricSnapshot> snapshotMetrics() {
+    MetricsRegistry& r = registry();
+    lock_guard<mutex> guard(r.lock);
+    vector<MetricSnapshot> totals = r.retired;
+    for (const ThreadMetrics* t : r.live) {
+        accumulate(*t, totals);
+    }
+    return totals;
+}
+
+// Renders the current metrics as a JSON object.
+string metricsToJson() {
+    JsonWriter w;
+    w.beginObject();
+    for (const MetricSnapshot& s : snapshotMetrics()) {
+        w.key(s.name).beginObject();
+        w.field("count", s.count);
+        w.field("totalMs", s.totalNs / 1e6);
+        w.field("bytes", s.bytes);
+        w.field("meanUs", s.count ? s.totalNs / 1e3 / s.count : 0.0);
+        w.field("p50Us", quantileUs(s, 0.50));
+        w.field("p95Us", quantileUs(s, 0.95));
+        w.field("p99Us", quantileUs(s, 0.99));
+        w.key("buckets").beginArray();
+        for (int b = 0; b < METRIC_BUCKETS; b++) {
+            if (s.buckets[b] == 0) {
+                continue;
+            }
+            w.beginObject();
+            if (b < METRIC_BUCKETS - 1) {
+                w.field("leUs", bucketBoundNs(b) / 1e3);
+            } else {
+                w.field("leUs", "+Inf");
+            }
+            w.field("count", s.buckets[b]);
+            w.endObject();
+        }
+        w.endArray();
+        w.endObject();
+    }
+    w.endObject();
+    return w.str();
+}
+
+// Renders the current metrics in the Prometheus text exposition format.
+string metricsToPrometheus() {
+    vector<MetricSnapshot> snapshot = snapshotMetrics();
+    ostringstream out;
+
+    out << "# HELP cryptovote_op_duration_seconds Latency of CryptoVote hot-path operations.\n"
+        << "# TYPE cryptovote_op_duration_seconds histogram\n";
+    for (const MetricSnapshot& s : snapshot) {
+        uint64_t cumulative = 0;
+        for (int b = 0; b < METRIC_BUCKETS; b++) {
+            cumulative += s.buckets[b];
+            string le = b < METRIC_BUCKETS - 1 ? formatDouble(bucketBoundNs(b) / 1e9) : "+Inf";
+            out << "cryptovote_op_duration_seconds_bucket{op=\"" << s.name << "\",le=\"" << le << "\"} "
+                << cumulative << '\n';
+        }
+        out << "cryptovote_op_duration_seconds_sum{op=\"" << s.name << "\"} " << formatDouble(s.totalNs / 1e9) << '\n'
+            << "cryptovote_op_duration_seconds_count{op=\"" << s.name << "\"} " << s.count << '\n';
+    }
+
+    out << "# HELP cryptovote_op_bytes_total Bytes processed by CryptoVote hot-path operations.\n"
+        << "# TYPE cryptovote_op_bytes_total counter\n";
+    for (const MetricSnapshot& s : snapshot) {
+        out << "cryptovote_op_bytes_total{op=\"" << s.name << "\"} " << s.bytes << '\n';
+    }
+    return out.str();
+}
+
+// Writes the current metrics to a file as JSON or Prometheus text.
+void writeMetricsFile(const string& path, const string& format) {
+    string fmt = format;
+    if (fmt == "auto") {
+        auto endsWith = [&](const string& suffix) {
+            return path.size() >= suffix.size() && path.compare(path.size() - suffix.size(), suffix.size(), suffix) == 0;
+        };
+        fmt = endsWith(".prom") || endsWith(".txt") ? "prometheus" : "json";
+    }
+    if (fmt != "json" && fmt != "prometheus") {
+        throw invalid_argument("Metrics format must be json or prometheus, got \"" + format + "\"");
+    }
+
+    ofstream file(path);
+    if (!file) {
+        throw runtime_error("Cannot open metrics file " + path);
+    }
+    file << (fmt == "json" ? metricsToJson() + "\n" : metricsToPrometheus());
+    if (!file.flush()) {
+        throw runtime_error("Write error on " + path);
+    }
+}
@@ -0,0 +1,164 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "mixnet.h"
+#include "paillier_fixed.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+unsigned long resolveSeed(unsigned long seed) {
+    if (seed != 0) {
+        return seed;
+    }
+    random_device rd;
+    return (static_cast<unsigned long>(rd()) << 16) ^ rd();
+}
+
+/**
+ * @brief Splits [0, count) into contiguous ranges, one per worker, and runs
+ *        body(worker, begin, end) on each. The first exception is rethrown.
+ */
+void parallelRanges(size_t count, int threads, const function<void(int, size_t, size_t)>& body) {
+    int workers = static_cast<int>(min<size_t>(max(1, threads), max<size_t>(1, count)));
+    if (workers == 1) {
+        body(0, 0, count);
+        return;
+    }
+
+    exception_ptr error;
+    mutex errorLock;
+    vector<thread> pool;
+    size_t chunk = (count + workers - 1) / workers;
+    for (int t = 0; t < workers; t++) {
+        size_t begin = min(count, t * chunk);
+        size_t end = min(count, begin + chunk);
+        pool.emplace_back([&, t, begin, end]() {
+            try {
+                body(t, begin, end);
+            } catch (...) {
+                lock_guard<mutex> guard(errorLock);
+                if (!error) {
+                    error = current_exception();
+                }
+            }
+        });
+    }
+    for (thread& th : pool) {
+        th.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+}
+
+// Seeds a worker's GMP random state distinctly from the other workers'.
+void seedWorker(gmp_randstate_t& state, unsigned long seed, int worker) {
+    gmp_randinit_mt(state);
+    gmp_randseed_ui(state, seed ^ (0x9E3779B97F4A7C15ULL * (worker + 1)));
+}
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Generates a pool of r^n mod n^2 values across worker threads.
+vector<mpz_class> precomputeRandomizers(const PaillierKeys& keys, size_t count, int threads, unsigned long seed) {
+    vector<mpz_class> pool(count);
+    seed = resolveSeed(seed);
+    parallelRanges(count, threads, [&](int t, size_t begin, size_t end) {
+        gmp_randstate_t local_state;
+        seedWorker(local_state, seed, t);
+        PaillierScratch scratch(keys);
+        for (size_t i = begin; i < end; i++) {
+            encZero(pool[i], keys, local_state, scratch);
+        }
+        gmp_randclear(local_state);
+    });
+    return pool;
+}
+
+// Permutes ciphertexts and multiplies each by a fresh encryption of zero.
+vector<mpz_class> shuffleCiphertexts(const vector<mpz_class>& ciphertexts, const PaillierKeys& keys,
+                                     const MixConfig& config) {
+    size_t count = ciphertexts.size();
+    if (config.randomizers && config.randomizers->size() < count) {
+        throw invalid_argument("Shuffle needs " + to_string(count) + " randomizers, got " +
+                               to_string(config.randomizers->size()));
+    }
+    unsigned long seed = resolveSeed(config.seed);
+
+    // Fisher-Yates is sequential and cheap next to the exponentiations
+    vector<size_t> perm(count);
+    iota(perm.begin(), perm.end(), 0);
+    mt19937_64 rng(seed);
+    for (size_t i = count; i > 1; i--) {
+        uniform_int_distribution<size_t> pick(0, i - 1);
+        swap(perm[i - 1], perm[pick(rng)]);
+    }
+
+    vector<mpz_class> mixed(count);
+    parallelRanges(count, config.threads, [&](int t, size_t begin, size_t end) {
+        PaillierScratch scratch(keys);
+        if (config.randomizers) {
+            for (size_t i = begin; i < end; i++) {
+                mixed[i] = ciphertexts[perm[i]];
+                addVotes(mixed[i], (*config.randomizers)[i], keys, scratch);
+            }
+            return;
+        }
+        gmp_randstate_t local_state;
+        seedWorker(local_state, seed, t);
+        mpz_class rn;
+        for (size_t i = begin; i < end; i++) {
+            encZero(rn, keys, local_state, scratch);
+            mixed[i] = ciphertexts[perm[i]];
+            addVotes(mixed[i], rn, keys, scratch);
+        }
+        gmp_randclear(local_state);
+    });
+    return mixed;
+}
+
+// Mixes the vote-weight ciphertexts of every ballot in an election.
+vector<mpz_class> shuffleElection(const Election& election, const MixConfig& config) {
+    size_t count = ballotCount(election);
+    vector<mpz_class> weights;
+    weights.reserve(liveBallotCount(election));
+    for (size_t i = 0; i < count; i++) {
+        if (!election.revoked.count(i)) {
+            weights.push_back(ballotAt(election, i).encWeight);
+        }
+    }
+    return shuffleCiphertexts(weights, election.paillierKeys, config);
+}
+
+// Multiplies ciphertexts together mod n^2.
+mpz_class sumCiphertexts(const vector<mpz_class>& ciphertexts, const PaillierKeys& keys) {
+    return multiplyCiphertexts(ciphertexts, keys);
+}
@@ -0,0 +1,384 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "modmul_simd.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <gmp.h>
+#include <immintrin.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    KERNELS
+###########################################################################
+*/
+
+namespace {
+
+const size_t MAX_MODULUS_BITS = 8192;
+const size_t MAX_DIGITS_52 = (MAX_MODULUS_BITS + 51) / 52;
+const size_t MAX_DIGITS_26 = (MAX_MODULUS_BITS + 25) / 26;
+
+atomic<int> simdLimit{SIMD_AVX512IFMA};
+
+// x >> count in each 64-bit lane. The zero-masked form avoids GCC 12's
+// -Wmaybe-uninitialized false positive on _mm512_srli_epi64.
+__attribute__((target("avx512f")))
+inline __m512i shiftRight(__m512i x, unsigned count) {
+    return _mm512_maskz_srli_epi64(static_cast<__mmask8>(0xFF), x, count);
+}
+
+/**
+ * @brief 8-lane Montgomery product with 52-bit digits (AVX-512 IFMA).
+ * @details Word-serial Montgomery: for each digit b_i, add a * b_i, pick
+ *          q = t_0 * (-N^-1) mod 2^52 so that t + q * N has a zero low digit,
+ *          and move one digit up. vpmadd52luq / vpmadd52huq add the low and
+ *          high 52 bits of each 52 x 52-bit product to a 64-bit accumulator,
+ *          so carries are left in the accumulators: each one takes at most
+ *          4(K + 1) additions below 2^52, which fits in 64 bits for K < 1000.
+ *          The window slides through acc[] instead of shifting it.
+ */
+__attribute__((target("avx512f,avx512ifma")))
+void montMulIfma(uint64_t* out, const uint64_t* a, const uint64_t* b, const uint64_t* mod, uint64_t negInverse,
+                 size_t K) {
+    __m512i acc[2 * MAX_DIGITS_52 + 2];
+    const __m512i zero = _mm512_setzero_si512();
+    for (size_t j = 0; j < 2 * K + 2; j++) {
+        acc[j] = zero;
+    }
+    const __m512i mask = _mm512_set1_epi64((1ULL << 52) - 1);
+    const __m512i ninv = _mm512_set1_epi64(static_cast<long long>(negInverse));
+
+    for (size_t i = 0; i < K; i++) {
+        __m512i* t = acc + i;
+        const __m512i bi = _mm512_loadu_si512(b + i * 8);
+        for (size_t j = 0; j < K; j++) {
+            const __m512i aj = _mm512_loadu_si512(a + j * 8);
+            t[j] = _mm512_madd52lo_epu64(t[j], aj, bi);
+            t[j + 1] = _mm512_madd52hi_epu64(t[j + 1], aj, bi);
+        }
+        const __m512i q = _mm512_and_si512(_mm512_madd52lo_epu64(zero, t[0], ninv), mask);
+        for (size_t j = 0; j < K; j++) {
+            const __m512i nj = _mm512_set1_epi64(static_cast<long long>(mod[j]));
+            t[j] = _mm512_madd52lo_epu64(t[j], nj, q);
+            t[j + 1] = _mm512_madd52hi_epu64(t[j + 1], nj, q);
+        }
+        t[1] = _mm512_add_epi64(t[1], shiftRight(t[0], 52));
+    }
+
+    // Normalize acc[K..2K] into 52-bit digits, then subtract N from lanes that reached it
+    __m512i carry = zero;
+    for (size_t j = 0; j < K; j++) {
+        __m512i v = _mm512_add_epi64(acc[K + j], carry);
+        _mm512_storeu_si512(out + j * 8, _mm512_and_si512(v, mask));
+        carry = shiftRight(v, 52);
+    }
+    const __m512i top = _mm512_add_epi64(acc[2 * K], carry);
+    __m512i borrow = zero;
+    for (size_t j = 0; j < K; j++) {
+        __m512i d = _mm512_sub_epi64(_mm512_loadu_si512(out + j * 8),
+                                     _mm512_set1_epi64(static_cast<long long>(mod[j])));
+        d = _mm512_sub_epi64(d, borrow);
+        borrow = shiftRight(d, 63);
+        acc[j] = _mm512_and_si512(d, mask);
+    }
+    const __mmask8 reduce = _mm512_cmpge_epu64_mask(top, borrow);
+    for (size_t j = 0; j < K; j++) {
+        _mm512_mask_storeu_epi64(out + j * 8, reduce, acc[j]);
+    }
+}
+
+/**
+ * @brief 4-lane Montgomery product with 26-bit digits (AVX2).
+ * @details Same loop as montMulIfma, but vpmuludq gives the whole 52-bit
+ *          product of two 26-bit digits, so there is no high half. Each
+ *          accumulator takes at most 2(K + 1) products below 2^52.
+ */
+__attribute__((target("avx2")))
+void montMulAvx2(uint64_t* out, const uint64_t* a, const uint64_t* b, const uint64_t* mod, uint64_t negInverse,
+                 size_t K) {
+    __m256i acc[2 * MAX_DIGITS_26 + 2];
+    const __m256i zero = _mm256_setzero_si256();
+    for (size_t j = 0; j < 2 * K + 2; j++) {
+        acc[j] = zero;
+    }
+    const __m256i mask = _mm256_set1_epi64x((1LL << 26) - 1);
+    const __m256i ninv = _mm256_set1_epi64x(static_cast<long long>(negInverse));
+
+    for (size_t i = 0; i < K; i++) {
+        __m256i* t = acc + i;
+        const __m256i bi = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i * 4));
+        for (size_t j = 0; j < K; j++) {
+            const __m256i aj = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + j * 4));
+            t[j] = _mm256_add_epi64(t[j], _mm256_mul_epu32(aj, bi));
+        }
+        const __m256i q = _mm256_and_si256(_mm256_mul_epu32(t[0], ninv), mask);
+        for (size_t j = 0; j < K; j++) {
+            const __m256i nj = _mm256_set1_epi64x(static_cast<long long>(mod[j]));
+            t[j] = _mm256_add_epi64(t[j], _mm256_mul_epu32(nj, q));
+        }
+        t[1] = _mm256_add_epi64(t[1], _mm256_srli_epi64(t[0], 26));
+    }
+
+    __m256i carry = zero;
+    for (size_t j = 0; j < K; j++) {
+        __m256i v = _mm256_add_epi64(acc[K + j], carry);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + j * 4), _mm256_and_si256(v, mask));
+        carry = _mm256_srli_epi64(v, 26);
+    }
+    const __m256i top = _mm256_add_epi64(acc[2 * K], carry);
+    __m256i borrow = zero;
+    for (size_t j = 0; j < K; j++) {
+        __m256i d = _mm256_sub_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(out + j * 4)),
+                                     _mm256_set1_epi64x(static_cast<long long>(mod[j])));
+        d = _mm256_sub_epi64(d, borrow);
+        borrow = _mm256_srli_epi64(d, 63);
+        acc[j] = _mm256_and_si256(d, mask);
+    }
+    // top and borrow are 0 or 1, so the signed compare is safe
+    const __m256i keep = _mm256_cmpgt_epi64(borrow, top);
+    for (size_t j = 0; j < K; j++) {
+        __m256i* dst = reinterpret_cast<__m256i*>(out + j * 4);
+        _mm256_storeu_si256(dst, _mm256_blendv_epi8(acc[j], _mm256_loadu_si256(dst), keep));
+    }
+}
+
+// Writes the low 'digits' radix-bit digits of a non-negative value to out[0], out[stride], ...
+void splitDigits(uint64_t* out, size_t stride, const mpz_class& value, int radix, size_t digits) {
+    const mp_limb_t* limbs = mpz_limbs_read(value.get_mpz_t());
+    size_t size = mpz_size(value.get_mpz_t());
+    uint64_t mask = (1ULL << radix) - 1;
+    for (size_t j = 0; j < digits; j++) {
+        size_t bit = j * radix;
+        size_t index = bit / 64;
+        size_t offset = bit % 64;
+        uint64_t digit = index < size ? limbs[index] >> offset : 0;
+        if (offset + radix > 64 && index + 1 < size) {
+            digit |= limbs[index + 1] << (64 - offset);
+        }
+        out[j * stride] = digit & mask;
+    }
+}
+
+// Returns what the CPU supports, ignoring the limit.
+SimdLevel cpuSimdLevel() {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512ifma")) {
+        return SIMD_AVX512IFMA;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return SIMD_AVX2;
+    }
+    return SIMD_SCALAR;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+// Splits the modulus into digits and precomputes the Montgomery constants.
+BatchModMul::BatchModMul(const mpz_class& modulus, SimdLevel level) : modulus(modulus) {
+    if (mpz_even_p(modulus.get_mpz_t()) || modulus <= 1) {
+        throw invalid_argument("BatchModMul needs an odd modulus greater than 1");
+    }
+    size_t bits = mpz_sizeinbase(modulus.get_mpz_t(), 2);
+    if (bits > MAX_MODULUS_BITS) {
+        throw invalid_argument("BatchModMul supports moduli up to " + to_string(MAX_MODULUS_BITS) + " bits, got " +
+                               to_string(bits));
+    }
+
+    simd = min(level, cpuSimdLevel());
+    laneCount = simd == SIMD_AVX512IFMA ? 8 : simd == SIMD_AVX2 ? 4 : 1;
+    radix = simd == SIMD_AVX512IFMA ? 52 : 26;
+    digits = (bits + radix - 1) / radix;
+    if (simd == SIMD_SCALAR) {
+        return;
+    }
+
+    modDigits.assign(digits, 0);
+    splitDigits(modDigits.data(), 1, modulus, radix, digits);
+
+    // -N^-1 mod 2^64 by Newton iteration, then cut down to one digit
+    uint64_t n0 = mpz_getlimbn(modulus.get_mpz_t(), 0);
+    uint64_t inverse = n0;
+    for (int i = 0; i < 6; i++) {
+        inverse *= 2 - n0 * inverse;
+    }
+    negInverse = (0 - inverse) & ((1ULL << radix) - 1);
+
+    mpz_class r = 1;
+    mpz_mul_2exp(r.get_mpz_t(), r.get_mpz_t(), radix * digits);
+    rModN = r % modulus;
+}
+
+// Multiplies a list of values together through an accumulator.
+mpz_class BatchModMul::product(const vector<mpz_class>& values) const {
+    Accumulator acc(*this);
+    for (const mpz_class& v : values) {
+        acc.multiply(v);
+    }
+    mpz_class result;
+    acc.value(result);
+    return result;
+}
+
+// Writes the radix-bit digits of a value into one lane, reducing it first if it is not below N.
+void BatchModMul::toLane(uint64_t* buffer, size_t lane, const mpz_class& value) const {
+    if (sgn(value) < 0 || value >= modulus) {
+        mpz_class reduced;
+        mpz_mod(reduced.get_mpz_t(), value.get_mpz_t(), modulus.get_mpz_t());
+        toLane(buffer, lane, reduced);
+        return;
+    }
+    splitDigits(buffer + lane, laneCount, value, radix, digits);
+}
+
+// Reassembles one lane's digits into limbs.
+void BatchModMul::fromLane(mpz_class& out, const uint64_t* buffer, size_t lane) const {
+    size_t limbCount = (digits * radix + 63) / 64;
+    mp_limb_t* limbs = mpz_limbs_write(out.get_mpz_t(), limbCount);
+    memset(limbs, 0, limbCount * sizeof(mp_limb_t));
+    for (size_t j = 0; j < digits; j++) {
+        uint64_t digit = buffer[j * laneCount + lane];
+        size_t bit = j * radix;
+        size_t index = bit / 64;
+        size_t offset = bit % 64;
+        limbs[index] |= digit << offset;
+        if (offset + radix > 64) {
+            limbs[index + 1] |= digit >> (64 - offset);
+        }
+    }
+    mp_size_t size = limbCount;
+    while (size > 0 && limbs[size - 1] == 0) {
+        size--;
+    }
+    mpz_limbs_finish(out.get_mpz_t(), size);
+}
+
+// Writes the same value into every lane.
+void BatchModMul::broadcast(vector<uint64_t>& buffer, const mpz_class& value) const {
+    buffer.assign(digits * laneCount, 0);
+    for (size_t lane = 0; lane < laneCount; lane++) {
+        toLane(buffer.data(), lane, value);
+    }
+}
+
+// Runs the kernel for the configured level.
+void BatchModMul::kernel(uint64_t* out, const uint64_t* a, const uint64_t* b) const {
+    if (simd == SIMD_AVX512IFMA) {
+        montMulIfma(out, a, b, modDigits.data(), negInverse, digits);
+    } else {
+        montMulAvx2(out, a, b, modDigits.data(), negInverse, digits);
+    }
+}
+
+// Starts every lane at 1.
+BatchModMul::Accumulator::Accumulator(const BatchModMul& owner) : mm(owner), scalar(1) {
+    if (mm.simd != SIMD_SCALAR) {
+        mm.broadcast(acc, mpz_class(1));
+        pending.assign(mm.digits * mm.laneCount, 0);
+    }
+}
+
+// Buffers a value; a full set of lanes is folded in with one kernel pass.
+void BatchModMul::Accumulator::multiply(const mpz_class& value) {
+    factors++;
+    if (mm.simd == SIMD_SCALAR) {
+        scalar *= value;
+        mpz_mod(scalar.get_mpz_t(), scalar.get_mpz_t(), mm.modulus.get_mpz_t());
+        return;
+    }
+    mm.toLane(pending.data(), filled++, value);
+    if (filled == mm.laneCount) {
+        mm.kernel(acc.data(), acc.data(), pending.data());
+        filled = 0;
+    }
+}
+
+// Pads the pending lanes with R (a Montgomery 1), then folds the lanes together and removes R^-count.
+void BatchModMul::Accumulator::value(mpz_class& out) const {
+    if (mm.simd == SIMD_SCALAR) {
+        out = scalar;
+        return;
+    }
+    vector<uint64_t> lanes(acc);
+    if (filled > 0) {
+        vector<uint64_t> last(pending);
+        for (size_t lane = filled; lane < mm.laneCount; lane++) {
+            mm.toLane(last.data(), lane, mm.rModN);
+        }
+        mm.kernel(lanes.data(), lanes.data(), last.data());
+    }
+
+    mpz_class laneValue, factor;
+    mpz_powm_ui(factor.get_mpz_t(), mm.rModN.get_mpz_t(), factors, mm.modulus.get_mpz_t());
+    out = factor;
+    for (size_t lane = 0; lane < mm.laneCount; lane++) {
+        mm.fromLane(laneValue, lanes.data(), lane);
+        out = out * laneValue % mm.modulus;
+    }
+}
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Returns the CPU's best level, capped by the limit. AVX2 only when asked for by name.
+SimdLevel detectSimdLevel() {
+    static const SimdLevel cpu = cpuSimdLevel();
+    SimdLevel limit = static_cast<SimdLevel>(simdLimit.load());
+    SimdLevel level = min(cpu, limit);
+    return level == SIMD_AVX2 && limit != SIMD_AVX2 ? SIMD_SCALAR : level;
+}
+
+// Caps detectSimdLevel().
+void setSimdLimit(SimdLevel level) {
+    simdLimit.store(level);
+}
+
+// Returns the cap.
+SimdLevel currentSimdLimit() {
+    return static_cast<SimdLevel>(simdLimit.load());
+}
+
+// Maps a command-line name to a level.
+SimdLevel parseSimdLevel(const string& name) {
+    if (name == "scalar") {
+        return SIMD_SCALAR;
+    }
+    if (name == "avx2") {
+        return SIMD_AVX2;
+    }
+    if (name == "avx512" || name == "avx512ifma" || name == "auto") {
+        return SIMD_AVX512IFMA;
+    }
+    throw invalid_argument("Unknown SIMD level '" + name + "' (expected scalar, avx2, avx512 or auto)");
+}
+
+// Names a level.
+string simdLevelName(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX512IFMA:
+            return "avx512ifma";
+        case SIMD_AVX2:
+            return "avx2";
+        default:
+            return "scalar";
+    }
+}
@@ -14,7 +14,9 @@ Due Date:   4/17/2025
 
 #include "paillier.h"
 #include "aes.h"        // For AES encryption/decryption
+#include "metrics.h"
 //-------------------------------------------------------------
+#include <algorithm>
 #include <iostream>
 #include <gmpxx.h>     
 #include <stdexcept>  
@@ -29,6 +31,25 @@ Due Date:   4/17/2025
 using namespace std;
 using Byte = unsigned char;
 
+/*
+###########################################################################
+    STRUCT DEFINITIONS
+###########################################################################
+*/
+
+// Presizes every buffer for a product of two residues mod n^2.
+void PaillierScratch::reserve(const PaillierKeys& keys) {
+    size_t needed = mpz_sizeinbase(keys.nSquared.get_mpz_t(), 2);
+    if (needed <= bits) {
+        return;
+    }
+    bits = needed;
+    mp_bitcnt_t capacity = 2 * needed + GMP_NUMB_BITS;
+    for (mpz_class* buffer : {&r, &gcd, &term1, &term2, &product}) {
+        mpz_realloc2(buffer->get_mpz_t(), capacity);
+    }
+}
+
 /*
 ###########################################################################
     FUNCTION DEFINITIONS
@@ -64,18 +85,28 @@ mpz_class gen_rand_r(const mpz_class& n, gmp_randstate_t& rand_state) {
         throw invalid_argument("gen_rand_r: n must be greater than 1");
     }
     mpz_class random_r;
-    mpz_class gcd_result;
+    PaillierScratch scratch;
+    gen_rand_r(random_r, n, rand_state, scratch);
+    return random_r;
+}
 
-    do {
+// Draws r co-prime to n into caller-owned storage.
+void gen_rand_r(mpz_class& r, const mpz_class& n, gmp_randstate_t& rand_state, PaillierScratch& scratch) {
+    if (n <= 1) {
+        throw invalid_argument("gen_rand_r: n must be greater than 1");
+    }
+    while (true) {
         // Generate random number in [0, n-1]
-        mpz_urandomm(random_r.get_mpz_t(), rand_state, n.get_mpz_t());
-        if (random_r == 0) {
-            continue;
+        mpz_urandomm(r.get_mpz_t(), rand_state, n.get_mpz_t());
+        if (r == 0) {
+            continue; // scratch.gcd still holds an earlier draw's result, so test r itself
         }
         // Check if gcd(r, n) is 1
-        mpz_gcd(gcd_result.get_mpz_t(), random_r.get_mpz_t(), n.get_mpz_t());
-    } while (gcd_result != 1);
-    return random_r;
+        mpz_gcd(scratch.gcd.get_mpz_t(), r.get_mpz_t(), n.get_mpz_t());
+        if (scratch.gcd == 1) {
+            break;
+        }
+    }
 }
 
 // Generates a probable prime number of a specified bit size.
@@ -98,6 +129,7 @@ mpz_class generate_prime(int bits, gmp_randstate_t& rand_state) {
 // Generates Paillier public and private keys.
 PaillierKeys genKeyPaillier(int bitSize) {
 
+    MetricTimer timer(METRIC_KEYGEN);
     PaillierKeys keys;
     mpz_class p, q;
     int primeBits = bitSize / 2;
@@ -144,56 +176,280 @@ PaillierKeys genKeyPaillier(int bitSize) {
 // Encrypts a plaintext vote weight using the Paillier public key.
 mpz_class encVote(const mpz_class& vote, const PaillierKeys& keys, gmp_randstate_t& rand_state) {
 
+    mpz_class ciphertext;
+    encVote(ciphertext, vote, keys, rand_state, threadScratch(keys));
+    return ciphertext;
+}
+
+// Encrypts a vote weight into caller-owned storage using preallocated temporaries.
+void encVote(mpz_class& ciphertext, const mpz_class& vote, const PaillierKeys& keys, gmp_randstate_t& rand_state,
+             PaillierScratch& scratch) {
+
+    MetricTimer timer(METRIC_PAILLIER_ENCRYPT, mpz_size(keys.nSquared.get_mpz_t()) * sizeof(mp_limb_t));
+    scratch.reserve(keys);
+
     // Generate random r co-prime to n
-    mpz_class r = gen_rand_r(keys.n, rand_state);
-    mpz_class term1; // To store g^vote mod n^2
-    mpz_class term2; // To store r^n mod n^2
+    gen_rand_r(scratch.r, keys.n, rand_state, scratch);
 
     // Calculate g^vote mod n^2
-    mpz_powm(term1.get_mpz_t(), keys.g.get_mpz_t(), vote.get_mpz_t(), keys.nSquared.get_mpz_t());
+    mpz_powm(scratch.term1.get_mpz_t(), keys.g.get_mpz_t(), vote.get_mpz_t(), keys.nSquared.get_mpz_t());
     // Calculate r^n mod n^2
-    mpz_powm(term2.get_mpz_t(), r.get_mpz_t(), keys.n.get_mpz_t(), keys.nSquared.get_mpz_t());
+    mpz_powm(scratch.term2.get_mpz_t(), scratch.r.get_mpz_t(), keys.n.get_mpz_t(), keys.nSquared.get_mpz_t());
 
     // Combine terms: ciphertext = (g^vote * r^n) mod n^2
-    mpz_class ciphertext = (term1 * term2) % keys.nSquared;
-    return ciphertext;
+    mpz_mul(scratch.product.get_mpz_t(), scratch.term1.get_mpz_t(), scratch.term2.get_mpz_t());
+    mpz_mod(ciphertext.get_mpz_t(), scratch.product.get_mpz_t(), keys.nSquared.get_mpz_t());
 }
 
 // Decrypts a Paillier ciphertext using the private key.
 mpz_class decVote(const mpz_class& ciphertext, const PaillierKeys& keys) {
 
-    mpz_class term1;
-    
+    mpz_class plaintext;
+    decVote(plaintext, ciphertext, keys, threadScratch(keys));
+    return plaintext;
+}
+
+// Decrypts a ciphertext into caller-owned storage using preallocated temporaries.
+void decVote(mpz_class& plaintext, const mpz_class& ciphertext, const PaillierKeys& keys, PaillierScratch& scratch) {
+
+    MetricTimer timer(METRIC_PAILLIER_DECRYPT, mpz_size(ciphertext.get_mpz_t()) * sizeof(mp_limb_t));
+    if (keys.n == 0) {
+        throw invalid_argument("L_function: n cannot be zero.");
+    }
+    scratch.reserve(keys);
+
     // Calculate c^lambda mod n^2
-    mpz_powm(term1.get_mpz_t(), ciphertext.get_mpz_t(), keys.lambda.get_mpz_t(), keys.nSquared.get_mpz_t());
+    mpz_powm(scratch.term1.get_mpz_t(), ciphertext.get_mpz_t(), keys.lambda.get_mpz_t(), keys.nSquared.get_mpz_t());
 
-    // Apply L function: L(c^lambda mod n^2)
-    mpz_class term2 = L_function(term1, keys.n);
+    // Apply L function: L(c^lambda mod n^2) = (c^lambda - 1) / n
+    mpz_sub_ui(scratch.term1.get_mpz_t(), scratch.term1.get_mpz_t(), 1);
+    mpz_tdiv_q(scratch.term2.get_mpz_t(), scratch.term1.get_mpz_t(), keys.n.get_mpz_t());
 
     // Calculate plaintext
-    mpz_class plaintext = (term2 * keys.mu) % keys.n;
-    return plaintext;
+    mpz_mul(scratch.product.get_mpz_t(), scratch.term2.get_mpz_t(), keys.mu.get_mpz_t());
+    mpz_mod(plaintext.get_mpz_t(), scratch.product.get_mpz_t(), keys.n.get_mpz_t());
 }
 
 // Homomorphically adds two encrypted votes.
 mpz_class addVotes(const mpz_class& c1, const mpz_class& c2, const PaillierKeys& keys) {
 
-    // Perform homomorphic addition via ciphertext multiplication modulo n^2
-    mpz_class result_ciphertext = (c1 * c2) % keys.nSquared;
+    mpz_class result_ciphertext = c1;
+    addVotes(result_ciphertext, c2, keys, threadScratch(keys));
     return result_ciphertext;
 }
 
+// Multiplies a ciphertext into an accumulator mod n^2 in place.
+void addVotes(mpz_class& acc, const mpz_class& ciphertext, const PaillierKeys& keys, PaillierScratch& scratch) {
+
+    MetricTimer timer(METRIC_ADD_VOTES, mpz_size(ciphertext.get_mpz_t()) * sizeof(mp_limb_t));
+    scratch.reserve(keys);
+
+    // Perform homomorphic addition via ciphertext multiplication modulo n^2
+    mpz_mul(scratch.product.get_mpz_t(), acc.get_mpz_t(), ciphertext.get_mpz_t());
+    mpz_mod(acc.get_mpz_t(), scratch.product.get_mpz_t(), keys.nSquared.get_mpz_t());
+}
+
+// Returns the calling thread's scratch, grown for the given keys if needed.
+PaillierScratch& threadScratch(const PaillierKeys& keys) {
+
+    static thread_local PaillierScratch scratch;
+    scratch.reserve(keys);
+    return scratch;
+}
+
+// Homomorphically subtracts c2 from c1.
+mpz_class subVotes(const mpz_class& c1, const mpz_class& c2, const PaillierKeys& keys) {
+
+    mpz_class inverse;
+    if (mpz_invert(inverse.get_mpz_t(), c2.get_mpz_t(), keys.nSquared.get_mpz_t()) == 0) {
+        throw invalid_argument("Ciphertext is not invertible mod n^2");
+    }
+    return addVotes(c1, inverse, keys);
+}
+
+// Inverts many ciphertexts mod n^2 with Montgomery's trick.
+vector<mpz_class> invertCiphertexts(const vector<mpz_class>& ciphertexts, const PaillierKeys& keys) {
+
+    MetricTimer timer(METRIC_BATCH_INVERT);
+    size_t count = ciphertexts.size();
+    vector<mpz_class> inverses(count);
+    if (count == 0) {
+        return inverses;
+    }
+    mpz_srcptr mod = keys.nSquared.get_mpz_t();
+
+    // inverses[i] temporarily holds c_0 * ... * c_i
+    inverses[0] = ciphertexts[0];
+    for (size_t i = 1; i < count; i++) {
+        mpz_mul(inverses[i].get_mpz_t(), inverses[i - 1].get_mpz_t(), ciphertexts[i].get_mpz_t());
+        mpz_mod(inverses[i].get_mpz_t(), inverses[i].get_mpz_t(), mod);
+    }
+
+    mpz_class running; // (c_0 * ... * c_i)^-1
+    if (mpz_invert(running.get_mpz_t(), inverses[count - 1].get_mpz_t(), mod) == 0) {
+        throw invalid_argument("Ciphertext is not invertible mod n^2");
+    }
+    for (size_t i = count - 1; i > 0; i--) {
+        // c_i^-1 = (c_0..c_i)^-1 * (c_0..c_{i-1})
+        mpz_mul(inverses[i].get_mpz_t(), running.get_mpz_t(), inverses[i - 1].get_mpz_t());
+        mpz_mod(inverses[i].get_mpz_t(), inverses[i].get_mpz_t(), mod);
+        mpz_mul(running.get_mpz_t(), running.get_mpz_t(), ciphertexts[i].get_mpz_t());
+        mpz_mod(running.get_mpz_t(), running.get_mpz_t(), mod);
+    }
+    inverses[0] = running;
+    timer.setBytes(count * mpz_size(mod) * sizeof(mp_limb_t));
+    return inverses;
+}
+
+// Generates a fresh randomizer r^n mod n^2 (an encryption of zero).
+mpz_class encZero(const PaillierKeys& keys, gmp_randstate_t& rand_state) {
+
+    mpz_class rn;
+    encZero(rn, keys, rand_state, threadScratch(keys));
+    return rn;
+}
+
+// Generates a randomizer into caller-owned storage using preallocated temporaries.
+void encZero(mpz_class& rn, const PaillierKeys& keys, gmp_randstate_t& rand_state, PaillierScratch& scratch) {
+
+    MetricTimer timer(METRIC_ENC_ZERO, mpz_size(keys.nSquared.get_mpz_t()) * sizeof(mp_limb_t));
+    scratch.reserve(keys);
+    gen_rand_r(scratch.r, keys.n, rand_state, scratch);
+    mpz_powm(rn.get_mpz_t(), scratch.r.get_mpz_t(), keys.n.get_mpz_t(), keys.nSquared.get_mpz_t());
+}
+
+// Re-randomizes a ciphertext without changing its plaintext.
+mpz_class reEncrypt(const mpz_class& ciphertext, const PaillierKeys& keys, gmp_randstate_t& rand_state) {
+
+    return addVotes(ciphertext, encZero(keys, rand_state), keys);
+}
+
+// Raises a ciphertext to a scalar mod n^2.
+mpz_class scaleVote(const mpz_class& ciphertext, const mpz_class& k, const PaillierKeys& keys) {
+
+    MetricTimer timer(METRIC_SCALE_VOTE, mpz_size(ciphertext.get_mpz_t()) * sizeof(mp_limb_t));
+    if (sgn(k) < 0) {
+        throw invalid_argument("Vote scalar must be non-negative");
+    }
+    mpz_class result;
+    mpz_powm(result.get_mpz_t(), ciphertext.get_mpz_t(), k.get_mpz_t(), keys.nSquared.get_mpz_t());
+    return result;
+}
+
+// Computes the product of c_i^k_i mod n^2 with Pippenger's bucket method.
+mpz_class weightedTally(const vector<mpz_class>& ciphertexts, const vector<mpz_class>& scalars,
+                        const PaillierKeys& keys) {
+
+    MetricTimer timer(METRIC_WEIGHTED_TALLY);
+    if (ciphertexts.size() != scalars.size()) {
+        throw invalid_argument("weightedTally needs one scalar per ciphertext");
+    }
+    size_t bits = 0;
+    size_t bytes = 0;
+    for (size_t i = 0; i < scalars.size(); i++) {
+        if (sgn(scalars[i]) < 0) {
+            throw invalid_argument("Vote scalar must be non-negative");
+        }
+        if (sgn(scalars[i]) > 0) {
+            bits = max(bits, mpz_sizeinbase(scalars[i].get_mpz_t(), 2));
+        }
+        bytes += mpz_size(ciphertexts[i].get_mpz_t()) * sizeof(mp_limb_t);
+    }
+    timer.setBytes(bytes);
+    if (bits == 0) {
+        return 1;
+    }
+
+    mpz_srcptr mod = keys.nSquared.get_mpz_t();
+    auto mulmod = [&](mpz_class& acc, const mpz_class& x) {
+        mpz_mul(acc.get_mpz_t(), acc.get_mpz_t(), x.get_mpz_t());
+        mpz_mod(acc.get_mpz_t(), acc.get_mpz_t(), mod);
+    };
+
+    // Window width minimizing windows * (pairs + 2 * 2^c) multiplications
+    int window = 1;
+    double bestCost = 0;
+    for (int c = 1; c <= 16 && static_cast<size_t>(c) <= bits; c++) {
+        size_t windows = (bits + c - 1) / c;
+        double cost = windows * (ciphertexts.size() + 2.0 * (1 << c));
+        if (c == 1 || cost < bestCost) {
+            window = c;
+            bestCost = cost;
+        }
+    }
+    size_t windows = (bits + window - 1) / window;
+
+    vector<mpz_class> buckets(static_cast<size_t>(1) << window);
+    vector<char> used(buckets.size());
+    mpz_class result = 1;
+    bool resultIsOne = true;
+
+    for (size_t w = windows; w-- > 0;) {
+        if (!resultIsOne) {
+            mpz_powm_ui(result.get_mpz_t(), result.get_mpz_t(), 1UL << window, mod);
+        }
+        fill(used.begin(), used.end(), 0);
+
+        // Drop every ciphertext into the bucket of its digit in this window
+        size_t low = w * window;
+        for (size_t i = 0; i < ciphertexts.size(); i++) {
+            size_t digit = 0;
+            for (int b = window - 1; b >= 0; b--) {
+                digit = (digit << 1) | mpz_tstbit(scalars[i].get_mpz_t(), low + b);
+            }
+            if (digit == 0) {
+                continue;
+            }
+            if (used[digit]) {
+                mulmod(buckets[digit], ciphertexts[i]);
+            } else {
+                buckets[digit] = ciphertexts[i];
+                used[digit] = 1;
+            }
+        }
+
+        // prod_d bucket[d]^d as a product of running products, highest digit first
+        mpz_class running, sum;
+        bool runningUsed = false, sumUsed = false;
+        for (size_t d = buckets.size() - 1; d > 0; d--) {
+            if (used[d]) {
+                if (runningUsed) {
+                    mulmod(running, buckets[d]);
+                } else {
+                    running = buckets[d];
+                    runningUsed = true;
+                }
+            }
+            if (runningUsed) {
+                if (sumUsed) {
+                    mulmod(sum, running);
+                } else {
+                    sum = running;
+                    sumUsed = true;
+                }
+            }
+        }
+        if (sumUsed) {
+            mulmod(result, sum);
+            resultIsOne = false;
+        }
+    }
+    return result;
+}
+
 // Calculates and displays the Base-M weights for Paillier encoding.
-vector<mpz_class> calcWeights(int numCandidates, int max_voters) {
+vector<mpz_class> calcWeights(int numCandidates, int max_voters, bool verbose) {
 
     mpz_class M = mpz_class(max_voters) + 1;
 
     // Print parameters used for calculation
-    cout << "\nCalculating weights based on:" << endl;
-    cout << " - Number of Candidates: " << numCandidates << endl;
-    cout << " - Max Expected Voters (k): " << max_voters << endl;
-    cout << " - Encoding Base (M = k + 1): " << M << endl;
-    cout << "-----------------------------------" << endl;
+    if (verbose) {
+        cout << "\nCalculating weights based on:" << endl;
+        cout << " - Number of Candidates: " << numCandidates << endl;
+        cout << " - Max Expected Voters (k): " << max_voters << endl;
+        cout << " - Encoding Base (M = k + 1): " << M << endl;
+        cout << "-----------------------------------" << endl;
+    }
 
     // Initialize vector to store weights
     vector<mpz_class> weights(numCandidates);
@@ -202,13 +458,17 @@ vector<mpz_class> calcWeights(int numCandidates, int max_voters) {
     for (int i = 0; i < numCandidates; ++i) {
         weights[i] = currentWeight;
         // Display the calculated weight for the candidate index
-        cout << " Candidate " << i << ": Weight = " << weights[i] << endl;
+        if (verbose) {
+            cout << " Candidate " << i << ": Weight = " << weights[i] << endl;
+        }
 
         if (i < numCandidates - 1) {
              currentWeight *= M;
         }
     }
-    cout << "-----------------------------------" << endl;
+    if (verbose) {
+        cout << "-----------------------------------" << endl;
+    }
 
     return weights;
 }
@@ -253,9 +513,11 @@ void decryptBallot(const vector<EncryptedBallot>& allBallots,
     cout << "------------------------------" << endl;
 }
 
-array<Byte, 32> genKeyAES(gmp_randstate_t& rand_state) {
+array<Byte, 32> genKeyAES(gmp_randstate_t& rand_state, bool verbose) {
     array<Byte, 32> aes_key;
-    cout << "\nGenerating random 256-bit AES key using GMP..." << endl;
+    if (verbose) {
+        cout << "\nGenerating random 256-bit AES key using GMP..." << endl;
+    }
     mpz_class rand_aes_key;
     // Generate 256 random bits using the provided random state
     mpz_urandomb(rand_aes_key.get_mpz_t(), rand_state, 256);
@@ -273,24 +535,21 @@ array<Byte, 32> genKeyAES(gmp_randstate_t& rand_state) {
                rand_aes_key.get_mpz_t()); // GMP integer to export
 
     // --- Optional: Print the generated key ---
-    char* hex_key_str = mpz_get_str(nullptr, 16, rand_aes_key.get_mpz_t());
-    cout << "Generated AES Key (Hex): " << hex_key_str << endl;
-    free(hex_key_str);
-    cout << "----------------------------------------" << endl;
+    if (verbose) {
+        cout << "Generated AES Key (Hex): " << rand_aes_key.get_str(16) << endl;
+        cout << "----------------------------------------" << endl;
+    }
 
     return aes_key; // Return the generated key
 }
 
-bool printResults(
-    const mpz_class& decryptedTally,
-    int numCandidates,
-    int max_voters, // This is k
-    const vector<int>& actualVoteCounts,
-    int num_votes)
-{
+// Decodes a decrypted base-M tally into per-candidate vote counts.
+vector<long> decodeTally(const mpz_class& decryptedTally, int numCandidates, int max_voters) {
+
+    MetricTimer timer(METRIC_DECODE, mpz_size(decryptedTally.get_mpz_t()) * sizeof(mp_limb_t));
+
     // Calculate M = k + 1
     mpz_class M = mpz_class(max_voters) + 1;
-    cout << "Decoding Paillier results (using M = " << M << ")..." << endl;
     vector<long> decodedCounts(numCandidates);
     mpz_class temp_total = decryptedTally;
 
@@ -301,6 +560,20 @@ bool printResults(
         // Integer division to prepare for the next candidate's count
         temp_total = temp_total / M;
     }
+    return decodedCounts;
+}
+
+bool printResults(
+    const mpz_class& decryptedTally,
+    int numCandidates,
+    int max_voters, // This is k
+    const vector<int>& actualVoteCounts,
+    int num_votes)
+{
+    // Calculate M = k + 1
+    mpz_class M = mpz_class(max_voters) + 1;
+    cout << "Decoding Paillier results (using M = " << M << ")..." << endl;
+    vector<long> decodedCounts = decodeTally(decryptedTally, numCandidates, max_voters);
 
     // --- Verify & Print Results ---
     cout << "\n--- Simulation Results ---" << endl;
@@ -0,0 +1,187 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "paillier_fixed.h"
+#include "metrics.h"
+#include "modmul_simd.h"
+//-------------------------------------------------------------
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+namespace {
+
+/**
+ * @brief Buffers factors and multiplies them in BATCH at a time.
+ * @details One multiply is well under a microsecond, too short to put a clock
+ *          pair around. Each batch is timed once and recorded as BATCH
+ *          add_votes calls. Only the product's own arithmetic is timed, never
+ *          the caller's work between multiply() calls.
+ */
+class BatchedProduct : public CiphertextProduct {
+public:
+    void multiply(const mpz_class& ciphertext) override {
+        pending[filled++] = ciphertext;
+        factors++;
+        if (filled == BATCH) {
+            flush();
+        }
+    }
+
+protected:
+    static const size_t BATCH = 8; // A multiple of every SIMD lane count
+
+    // Multiplies one factor into the running product.
+    virtual void fold(const mpz_class& ciphertext) const = 0;
+
+    // Folds in the buffered factors as one timed batch; value() calls it before reading.
+    void flush() const {
+        if (filled == 0) {
+            return;
+        }
+        size_t bytes = 0;
+        auto start = chrono::steady_clock::now();
+        for (size_t i = 0; i < filled; i++) {
+            fold(pending[i]);
+            bytes += mpz_size(pending[i].get_mpz_t()) * sizeof(mp_limb_t);
+        }
+        auto ns = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - start).count();
+        recordMetric(METRIC_ADD_VOTES, static_cast<uint64_t>(ns), bytes, filled);
+        filled = 0;
+    }
+
+private:
+    mutable mpz_class pending[BATCH];
+    mutable size_t filled = 0;
+};
+
+/**
+ * @brief Product kept as a Montgomery residue: each factor costs one montMul,
+ *        and the accumulated R^-count is removed once, when the value is read.
+ */
+template <int KeyBits>
+class FixedProduct : public BatchedProduct {
+public:
+    explicit FixedProduct(const PaillierKeys& keys) : field(keys) {
+        acc.fill(0);
+        acc[0] = 1;
+    }
+
+    void value(mpz_class& out) const override {
+        flush();
+        field.store(out, acc);
+        field.unscale(out, factors);
+    }
+
+    string backend() const override { return "fixed-" + to_string(KeyBits); }
+
+protected:
+    void fold(const mpz_class& ciphertext) const override {
+        field.load(factor, ciphertext);
+        field.montMul(acc, acc, factor);
+    }
+
+private:
+    FixedPaillier<KeyBits> field;
+    mutable typename FixedPaillier<KeyBits>::Residue acc;
+    mutable typename FixedPaillier<KeyBits>::Residue factor;
+};
+
+/**
+ * @brief Product spread over SIMD lanes: every eighth (IFMA) or fourth (AVX2)
+ *        ciphertext shares a lane, and one kernel pass multiplies a full set in.
+ */
+class SimdProduct : public BatchedProduct {
+public:
+    SimdProduct(const PaillierKeys& keys, SimdLevel level) : mm(keys.nSquared, level), acc(mm) {}
+
+    void value(mpz_class& out) const override {
+        flush();
+        acc.value(out);
+    }
+
+    string backend() const override { return "simd-" + simdLevelName(mm.level()); }
+
+protected:
+    // A full batch fills the lanes exactly, so each flush ends in a kernel pass
+    void fold(const mpz_class& ciphertext) const override { acc.multiply(ciphertext); }
+
+private:
+    BatchModMul mm;
+    mutable BatchModMul::Accumulator acc;
+};
+
+/**
+ * @brief Fallback for key sizes without a fixed-limb specialization.
+ */
+class MpzProduct : public CiphertextProduct {
+public:
+    explicit MpzProduct(const PaillierKeys& keys) : keys(keys), scratch(keys), acc(1) {}
+
+    void multiply(const mpz_class& ciphertext) override {
+        addVotes(acc, ciphertext, keys, scratch);
+        factors++;
+    }
+
+    void value(mpz_class& out) const override { out = acc; }
+
+    string backend() const override { return "mpz"; }
+
+private:
+    const PaillierKeys& keys;
+    PaillierScratch scratch;
+    mpz_class acc;
+};
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Picks the SIMD lanes when the CPU has them, else the fixed-limb backend matching the key's n^2, else mpz.
+unique_ptr<CiphertextProduct> makeCiphertextProduct(const PaillierKeys& keys) {
+    return makeCiphertextProduct(keys, detectSimdLevel());
+}
+
+// Same, with the SIMD level given instead of read from the global limit.
+unique_ptr<CiphertextProduct> makeCiphertextProduct(const PaillierKeys& keys, SimdLevel level) {
+    if (level != SIMD_SCALAR && mpz_sizeinbase(keys.nSquared.get_mpz_t(), 2) <= 8192) {
+        return unique_ptr<CiphertextProduct>(new SimdProduct(keys, level));
+    }
+    switch (mpz_size(keys.nSquared.get_mpz_t())) {
+        case FixedPaillier<1024>::LIMBS:
+            return unique_ptr<CiphertextProduct>(new FixedProduct<1024>(keys));
+        case FixedPaillier<2048>::LIMBS:
+            return unique_ptr<CiphertextProduct>(new FixedProduct<2048>(keys));
+        case FixedPaillier<3072>::LIMBS:
+            return unique_ptr<CiphertextProduct>(new FixedProduct<3072>(keys));
+        default:
+            return unique_ptr<CiphertextProduct>(new MpzProduct(keys));
+    }
+}
+
+// Multiplies a list of ciphertexts together.
+mpz_class multiplyCiphertexts(const vector<mpz_class>& ciphertexts, const PaillierKeys& keys) {
+    unique_ptr<CiphertextProduct> product = makeCiphertextProduct(keys);
+    for (const mpz_class& c : ciphertexts) {
+        product->multiply(c);
+    }
+    mpz_class result;
+    product->value(result);
+    return result;
+}
@@ -0,0 +1,717 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "pipeline.h"
+#include "aes.h"
+#include "ballot_log.h"
+#include "bounded_queue.h"
+#include "paillier_fixed.h"
+#include "sha256.h"
+#include "topology.h"
+#include "voter_index.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    STAGE BOOKKEEPING
+###########################################################################
+*/
+
+namespace {
+
+typedef chrono::steady_clock Clock;
+
+/**
+ * @brief A batch of records travelling through the pipeline.
+ *
+ * @param firstIndex Ballot index of the first record (duplicates are not counted).
+ * @param records The plaintext records (PII is cleared after the AES stage).
+ * @param sources 1-based position of each record in the input, duplicates included, for errors.
+ * @param tags Voter tag of each record, computed by the parse stage.
+ * @param units Tally tree node of each record, resolved by the parse stage.
+ * @param ballots Filled in by the AES and Paillier stages.
+ * @param leaves Bulletin board leaf hash of each ballot, from the Paillier stage.
+ */
+struct PipelineBatch {
+    size_t firstIndex = 0;
+    vector<CastVoteRecord> records;
+    vector<size_t> sources;
+    vector<VoterTag> tags;
+    vector<size_t> units;
+    vector<EncryptedBallot> ballots;
+    vector<Digest> leaves;
+};
+
+/**
+ * @brief A tally worker's product of the ballots it saw for one reporting unit.
+ * @details Every ballot belongs to exactly one unit (the root when it names
+ *          none), so the unit products also multiply out to the worker's share
+ *          of the total and each ballot is multiplied in only once.
+ */
+struct UnitPartial {
+    unique_ptr<CiphertextProduct> product;
+    mpz_class subtotal = 1;
+    uint64_t ballots = 0;
+};
+
+/**
+ * @brief Lock-free counters shared by the workers of one stage.
+ */
+struct StageCounter {
+    atomic<size_t> items{0};
+    atomic<long long> busyNs{0};
+    atomic<long long> firstStartNs{-1};
+    atomic<long long> lastEndNs{0};
+    atomic<size_t> depthSamples{0};
+    atomic<size_t> depthSum{0};
+    atomic<size_t> maxDepth{0};
+    atomic<int> remaining{0};
+
+    void sampleDepth(size_t depth) {
+        depthSamples.fetch_add(1, memory_order_relaxed);
+        depthSum.fetch_add(depth, memory_order_relaxed);
+        size_t seen = maxDepth.load(memory_order_relaxed);
+        while (depth > seen && !maxDepth.compare_exchange_weak(seen, depth, memory_order_relaxed)) {
+        }
+    }
+
+    void record(long long startNs, long long endNs, size_t n) {
+        items.fetch_add(n, memory_order_relaxed);
+        busyNs.fetch_add(endNs - startNs, memory_order_relaxed);
+        long long first = firstStartNs.load(memory_order_relaxed);
+        while ((first < 0 || startNs < first) &&
+               !firstStartNs.compare_exchange_weak(first, startNs, memory_order_relaxed)) {
+        }
+        long long last = lastEndNs.load(memory_order_relaxed);
+        while (endNs > last && !lastEndNs.compare_exchange_weak(last, endNs, memory_order_relaxed)) {
+        }
+    }
+
+    StageStats summarize(const string& name, int workers) const {
+        StageStats stats;
+        stats.name = name;
+        stats.workers = workers;
+        stats.items = items.load();
+        stats.busyMs = busyNs.load() / 1e6;
+        long long activeNs = lastEndNs.load() - max(0LL, firstStartNs.load());
+        stats.itemsPerSec = activeNs > 0 ? stats.items / (activeNs / 1e9) : 0;
+        stats.maxQueueDepth = maxDepth.load();
+        size_t samples = depthSamples.load();
+        stats.avgQueueDepth = samples ? static_cast<double>(depthSum.load()) / samples : 0;
+        return stats;
+    }
+};
+
+// Hash that ranks records for sampling: the k records with the smallest keys form the sample.
+uint64_t sampleKey(size_t index, unsigned long seed) {
+    uint64_t z = index + seed * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+typedef pair<uint64_t, SampledBallot> KeyedSample;
+
+// Destroys a queue made by makeQueue().
+struct QueueDeleter {
+    void operator()(BoundedQueue<PipelineBatch>* queue) const {
+        queue->~BoundedQueue();
+        free(queue);
+    }
+};
+
+typedef unique_ptr<BoundedQueue<PipelineBatch>, QueueDeleter> QueuePtr;
+
+// Heap-allocates a queue on its own cache lines; plain new ignores alignas before C++17.
+QueuePtr makeQueue(size_t capacity) {
+    void* memory = nullptr;
+    if (posix_memalign(&memory, alignof(BoundedQueue<PipelineBatch>), sizeof(BoundedQueue<PipelineBatch>)) != 0) {
+        throw bad_alloc();
+    }
+    try {
+        return QueuePtr(new (memory) BoundedQueue<PipelineBatch>(capacity));
+    } catch (...) {
+        free(memory);
+        throw;
+    }
+}
+
+// Orders samples by key, for a max-heap of the k smallest.
+bool sampleKeyLess(const KeyedSample& a, const KeyedSample& b) {
+    return a.first < b.first;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Splits a total thread budget across the pipeline stages.
+void sizePipeline(int threads, PipelineConfig& config) {
+    threads = max(1, threads);
+    config.aesThreads = max(1, threads / 8);
+    config.tallyThreads = 1;
+    config.paillierThreads = max(1, threads - config.aesThreads - config.tallyThreads);
+}
+
+// Creates a source of simulated voters with random candidate choices.
+RecordSource simulatedSource(size_t count, size_t firstId, int numCandidates, unsigned long seed,
+                             const vector<int>& fanout) {
+    auto produced = make_shared<size_t>(0);
+    auto rng = make_shared<mt19937_64>(seed);
+    size_t units = 1;
+    for (int f : fanout) {
+        units *= static_cast<size_t>(f);
+    }
+    return [=](vector<CastVoteRecord>& batch, size_t maxRecords) {
+        uniform_int_distribution<int> choice(0, numCandidates - 1);
+        uniform_int_distribution<size_t> unit(0, units - 1);
+        while (batch.size() < maxRecords && *produced < count) {
+            string id = to_string(firstId + *produced);
+            int candidate = choice(*rng);
+            string precinct = fanout.empty() ? "" : simulatedUnitPath(unit(*rng), fanout);
+            batch.push_back({"FName_" + id + " LName_" + id, candidate, precinct});
+            (*produced)++;
+        }
+        return *produced < count;
+    };
+}
+
+// Runs records through parse -> AES -> Paillier -> tally stages.
+PipelineStats runPipeline(Election& election, const RecordSource& source, const PipelineConfig& config) {
+
+    if (election.weights.empty()) {
+        throw invalid_argument("Election has not been set up");
+    }
+    const int aesThreads = max(1, config.aesThreads);
+    const int paillierThreads = max(1, config.paillierThreads);
+
+    // NUMA placement: worker t of each stage runs on node t % shards. A node's
+    // Paillier workers feed only that node's tally workers, so ciphertexts are
+    // written and multiplied on the node whose memory holds them.
+    vector<NumaNode> nodes;
+    if (config.numa) {
+        nodes = numaNodes();
+    }
+    const int shards = nodes.empty() ? 1 : min(static_cast<int>(nodes.size()), paillierThreads);
+    const int tallyThreads = max(max(1, config.tallyThreads), shards); // Every shard needs a consumer
+    auto place = [&](int t) {
+        if (!nodes.empty()) {
+            pinThreadToCpus(nodes[t % shards].cpus);
+        }
+    };
+    const size_t batchSize = max<size_t>(1, config.batchSize);
+    syncVoterIndex(election);
+    const size_t room = static_cast<size_t>(election.max_voters) - liveBallotCount(election);
+    const size_t baseIndex = election.allBallots.size();
+    // Kept ballots go on the full board; a streamed run only folds its root
+    const bool trackBoard = config.keepBallots && election.board.size() == ballotCount(election);
+    const bool streamBoard = !config.keepBallots;
+    auto cancelled = [&]() { return config.cancel && config.cancel->load(memory_order_relaxed); };
+
+    ofstream ballotsFile;
+    if (!config.ballotsOut.empty()) {
+        ballotsFile.open(config.ballotsOut);
+        if (!ballotsFile) {
+            throw runtime_error("Cannot open ballot output file " + config.ballotsOut);
+        }
+    }
+
+    BoundedQueue<PipelineBatch> toAes(config.queueDepth);
+    BoundedQueue<PipelineBatch> toPaillier(config.queueDepth);
+    vector<QueuePtr> toTally; // One per shard
+    for (int s = 0; s < shards; s++) {
+        toTally.push_back(makeQueue(config.queueDepth));
+    }
+    auto closeTally = [&]() {
+        for (QueuePtr& queue : toTally) {
+            queue->close();
+        }
+    };
+    StageCounter parseStage, aesStage, paillierStage, tallyStage;
+    aesStage.remaining = aesThreads;
+    paillierStage.remaining = paillierThreads;
+    tallyStage.remaining = tallyThreads;
+
+    const Clock::time_point runStart = Clock::now();
+    auto nowNs = [&]() {
+        return chrono::duration_cast<chrono::nanoseconds>(Clock::now() - runStart).count();
+    };
+
+    // First error wins; every queue is closed so all stages unwind
+    mutex errorLock;
+    exception_ptr error;
+    atomic<bool> failed{false};
+    auto fail = [&]() {
+        {
+            lock_guard<mutex> guard(errorLock);
+            if (!error) {
+                error = current_exception();
+            }
+        }
+        failed = true;
+        toAes.close();
+        toPaillier.close();
+        closeTally();
+    };
+
+    // Stages stop taking batches once the run failed or was cancelled
+    auto stopping = [&]() { return failed || cancelled(); };
+
+    // Pushes a batch downstream, sampling the queue depth it found.
+    auto forward = [&](BoundedQueue<PipelineBatch>& queue, StageCounter& consumer, PipelineBatch& batch) {
+        consumer.sampleDepth(queue.size());
+        return queue.push(std::move(batch));
+    };
+
+    // --- Parse stage (single thread: the source is sequential) ---
+    // Voters are deduplicated here, in input order, against the election's
+    // index and the voters seen earlier in this run; the first ballot wins.
+    size_t duplicates = 0;
+    bool sourceDone = false;
+    auto parseWorker = [&]() {
+        try {
+            HmacSha256 hmac(election.voterKey.data(), election.voterKey.size());
+            VoterIndex seen(min<size_t>(room, 1 << 16), config.bloomFilter);
+            size_t produced = 0;
+            size_t read = 0;
+            bool more = true;
+            while (more && !stopping()) {
+                PipelineBatch batch;
+                batch.firstIndex = produced;
+                batch.records.reserve(batchSize);
+                long long start = nowNs();
+                more = source(batch.records, batchSize);
+
+                size_t kept = 0;
+                batch.tags.resize(batch.records.size());
+                batch.sources.resize(batch.records.size());
+                for (size_t i = 0; i < batch.records.size(); i++) {
+                    VoterTag tag = computeVoterTag(hmac, batch.records[i].pii);
+                    size_t existing;
+                    bool voted = election.voters.find(tag, existing) && !election.revoked.count(existing);
+                    if (voted || !seen.insert(tag, produced + kept)) {
+                        duplicates++;
+                        continue;
+                    }
+                    if (kept != i) {
+                        batch.records[kept] = std::move(batch.records[i]);
+                    }
+                    batch.sources[kept] = read + i + 1;
+                    batch.tags[kept++] = tag;
+                }
+                read += batch.records.size();
+                batch.records.resize(kept);
+                batch.sources.resize(kept);
+                batch.tags.resize(kept);
+                if (batch.records.empty()) {
+                    continue;
+                }
+                batch.units.resize(kept);
+                for (size_t i = 0; i < kept; i++) {
+                    try {
+                        batch.units[i] = election.tree.resolve(batch.records[i].precinct);
+                    } catch (const invalid_argument& e) {
+                        throw invalid_argument("Record " + to_string(batch.sources[i]) + ": " + e.what());
+                    }
+                }
+                produced += batch.records.size();
+                if (produced > room) {
+                    throw invalid_argument("Input has more records than max_voters allows (" +
+                                           to_string(election.max_voters) + ")");
+                }
+                parseStage.record(start, nowNs(), batch.records.size());
+                if (!forward(toAes, aesStage, batch)) {
+                    break;
+                }
+            }
+            sourceDone = !more;
+        } catch (...) {
+            fail();
+        }
+        toAes.close();
+    };
+
+    // --- AES stage ---
+    auto aesWorker = [&](int t) {
+        place(t);
+        try {
+            PipelineBatch batch;
+            while (!stopping() && toAes.pop(batch)) {
+                long long start = nowNs();
+                batch.ballots.resize(batch.records.size());
+                for (size_t i = 0; i < batch.records.size(); i++) {
+                    batch.ballots[i].aesEncryptedPII = encryptAES256(batch.records[i].pii, election.aes_key);
+                    batch.ballots[i].voterTag = batch.tags[i];
+                    batch.ballots[i].unit = static_cast<uint32_t>(batch.units[i]);
+                    batch.records[i].pii.clear();
+                }
+                aesStage.record(start, nowNs(), batch.records.size());
+                if (!forward(toPaillier, paillierStage, batch)) {
+                    break;
+                }
+            }
+        } catch (...) {
+            fail();
+        }
+        if (--aesStage.remaining == 0) {
+            toPaillier.close();
+        }
+    };
+
+    // --- Paillier stage ---
+    auto paillierWorker = [&](int t) {
+        place(t); // Before the first allocation, so the scratch and ciphertexts land on this node
+        gmp_randstate_t local_state;
+        gmp_randinit_mt(local_state);
+        gmp_randseed_ui(local_state, config.seed ^ (0x9E3779B97F4A7C15ULL * (t + 1)));
+        try {
+            PaillierScratch scratch(election.paillierKeys);
+            PipelineBatch batch;
+            while (!stopping() && toPaillier.pop(batch)) {
+                long long start = nowNs();
+                for (size_t i = 0; i < batch.records.size() && !cancelled(); i++) {
+                    int candidate = batch.records[i].candidate;
+                    if (candidate < 0 || candidate >= election.numCandidates) {
+                        throw invalid_argument("Record " + to_string(batch.sources[i]) +
+                                               ": candidate index out of range");
+                    }
+                    encVote(batch.ballots[i].encWeight, election.weights[candidate], election.paillierKeys,
+                            local_state, scratch);
+                }
+                if (cancelled()) {
+                    break; // A part-encrypted batch is dropped
+                }
+                // Leaf hashes are spread over the Paillier workers; a few SHA-256 blocks per ballot
+                if (trackBoard || streamBoard) {
+                    batch.leaves.resize(batch.ballots.size());
+                    for (size_t i = 0; i < batch.ballots.size(); i++) {
+                        batch.leaves[i] = hashBallotLeaf(batch.ballots[i]);
+                    }
+                }
+                paillierStage.record(start, nowNs(), batch.records.size());
+                if (!forward(*toTally[t % shards], tallyStage, batch)) {
+                    break;
+                }
+            }
+        } catch (...) {
+            fail();
+        }
+        gmp_randclear(local_state);
+        if (--paillierStage.remaining == 0) {
+            closeTally();
+        }
+    };
+
+    // --- Tally stage ---
+    vector<vector<int>> counts(tallyThreads, vector<int>(election.numCandidates, 0));
+    vector<unordered_map<size_t, UnitPartial>> unitPartials(tallyThreads);
+    vector<unordered_map<size_t, UnitPartial>> nodePartials(shards); // With NUMA placement
+    unique_ptr<atomic<int>[]> nodeRemaining(new atomic<int>[shards]);
+    for (int s = 0; s < shards; s++) {
+        nodeRemaining[s] = (tallyThreads - s + shards - 1) / shards; // Workers s, s + shards, ...
+    }
+    vector<vector<KeyedSample>> samples(tallyThreads); // Max-heaps of each worker's k smallest keys
+    vector<Digest> leaves;         // Per record, appended to the board in input order
+    MerkleFrontier streamed;       // Without kept ballots: the board's right edge only
+    map<size_t, vector<Digest>> pendingLeaves; // Batches that arrived ahead of the frontier
+    vector<pair<size_t, size_t>> tallied; // (first index, count) of each stored batch
+    mutex storeLock;
+    mutex doneLock;
+    condition_variable done; // The last tally worker finished
+    auto tallyWorker = [&](int t) {
+        place(t);
+        try {
+            PipelineBatch batch;
+            while (!stopping() && toTally[t % shards]->pop(batch)) {
+                long long start = nowNs();
+                for (size_t i = 0; i < batch.records.size(); i++) {
+                    UnitPartial& unit = unitPartials[t][batch.units[i]];
+                    if (!unit.product) {
+                        unit.product = makeCiphertextProduct(election.paillierKeys);
+                    }
+                    unit.product->multiply(batch.ballots[i].encWeight);
+                    unit.ballots++;
+                    counts[t][batch.records[i].candidate]++;
+
+                    // Bottom-k sample: copy only ballots that beat the worker's current k-th key
+                    if (config.sampleBallots == 0) {
+                        continue;
+                    }
+                    size_t index = batch.firstIndex + i;
+                    uint64_t key = sampleKey(index, config.seed);
+                    vector<KeyedSample>& heap = samples[t];
+                    if (heap.size() == config.sampleBallots) {
+                        if (key >= heap.front().first) {
+                            continue;
+                        }
+                        pop_heap(heap.begin(), heap.end(), sampleKeyLess);
+                        heap.pop_back();
+                    }
+                    SampledBallot sample = {index, batch.records[i].candidate, batch.ballots[i]};
+                    heap.push_back(KeyedSample(key, sample));
+                    push_heap(heap.begin(), heap.end(), sampleKeyLess);
+                }
+                {
+                    lock_guard<mutex> guard(storeLock);
+                    if (streamBoard) {
+                        // Fold batches in input order; only those still in flight wait
+                        pendingLeaves[batch.firstIndex] = std::move(batch.leaves);
+                        while (!pendingLeaves.empty() && pendingLeaves.begin()->first == streamed.size()) {
+                            for (const Digest& leaf : pendingLeaves.begin()->second) {
+                                streamed.append(leaf);
+                            }
+                            pendingLeaves.erase(pendingLeaves.begin());
+                        }
+                    }
+                    if (config.keepBallots) {
+                        tallied.push_back(make_pair(batch.firstIndex, batch.ballots.size()));
+                    }
+                    for (size_t i = 0; i < batch.ballots.size(); i++) {
+                        size_t index = batch.firstIndex + i;
+                        if (trackBoard) {
+                            if (leaves.size() <= index) {
+                                leaves.resize(index + 1);
+                            }
+                            leaves[index] = batch.leaves[i];
+                        }
+                        if (ballotsFile.is_open()) {
+                            ballotsFile << ballotToJson(index, batch.ballots[i]) << '\n';
+                        }
+                        if (config.keepBallots) {
+                            size_t slot = baseIndex + index;
+                            if (election.allBallots.size() <= slot) {
+                                election.allBallots.resize(slot + 1);
+                                election.ballotCandidates.resize(slot + 1);
+                            }
+                            election.allBallots[slot] = std::move(batch.ballots[i]);
+                            election.ballotCandidates[slot] = static_cast<Byte>(batch.records[i].candidate);
+                        }
+                    }
+                }
+                tallyStage.record(start, nowNs(), batch.records.size());
+            }
+            for (auto& unit : unitPartials[t]) {
+                unit.second.product->value(unit.second.subtotal);
+            }
+            if (!nodes.empty() && --nodeRemaining[t % shards] == 0) {
+                // Last tally worker on the node: reduce the node's partials here, on local memory
+                PaillierScratch& scratch = threadScratch(election.paillierKeys);
+                for (int w = t % shards; w < tallyThreads; w += shards) {
+                    for (const auto& unit : unitPartials[w]) {
+                        UnitPartial& node = nodePartials[t % shards][unit.first];
+                        addVotes(node.subtotal, unit.second.subtotal, election.paillierKeys, scratch);
+                        node.ballots += unit.second.ballots;
+                    }
+                }
+            }
+        } catch (...) {
+            fail();
+        }
+        lock_guard<mutex> guard(doneLock);
+        if (--tallyStage.remaining == 0) {
+            done.notify_all();
+        }
+    };
+
+    vector<thread> pool;
+    pool.emplace_back(parseWorker);
+    for (int t = 0; t < aesThreads; t++) {
+        pool.emplace_back(aesWorker, t);
+    }
+    for (int t = 0; t < paillierThreads; t++) {
+        pool.emplace_back(paillierWorker, t);
+    }
+    for (int t = 0; t < tallyThreads; t++) {
+        pool.emplace_back(tallyWorker, t);
+    }
+
+    // Report progress and watch for cancellation until the tally stage drains
+    if (config.progress || config.cancel) {
+        const double intervalMs = max(1.0, config.progressIntervalMs);
+        Clock::time_point lastReport = runStart;
+        size_t lastRecords = 0;
+        double rate = 0;
+        bool closed = false;
+        unique_lock<mutex> guard(doneLock);
+        while (!done.wait_for(guard, chrono::milliseconds(20), [&]() { return tallyStage.remaining == 0; })) {
+            if (cancelled() && !closed) {
+                // Wakes stages blocked on a full or empty queue; they see the flag and stop
+                toAes.close();
+                toPaillier.close();
+                closeTally();
+                closed = true;
+            }
+            Clock::time_point now = Clock::now();
+            double sinceMs = chrono::duration<double, milli>(now - lastReport).count();
+            if (!config.progress || sinceMs < intervalMs) {
+                continue;
+            }
+            PipelineProgress progress;
+            progress.parsed = parseStage.items.load();
+            progress.encrypted = paillierStage.items.load();
+            progress.records = tallyStage.items.load();
+            progress.total = config.expectedRecords;
+            progress.elapsedMs = chrono::duration<double, milli>(now - runStart).count();
+            // Batches land in steps, so the rate is smoothed across intervals
+            double instant = (progress.records - lastRecords) / (sinceMs / 1e3);
+            rate = rate > 0 ? 0.7 * rate + 0.3 * instant : instant;
+            progress.recordsPerSec = rate;
+            if (progress.total > progress.records && progress.recordsPerSec > 0) {
+                progress.etaMs = (progress.total - progress.records) / progress.recordsPerSec * 1e3;
+            }
+            lastReport = now;
+            lastRecords = progress.records;
+            guard.unlock();
+            try {
+                config.progress(progress);
+            } catch (...) {
+                fail();
+            }
+            guard.lock();
+        }
+    }
+    if (cancelled()) {
+        // The tally stage may have stopped before the loop saw the flag; release anything still blocked
+        toAes.close();
+        toPaillier.close();
+        closeTally();
+    }
+    for (thread& th : pool) {
+        th.join();
+    }
+    if (error) {
+        if (config.keepBallots) {
+            election.allBallots.resize(baseIndex);
+            election.ballotCandidates.resize(baseIndex);
+        }
+        rethrow_exception(error);
+    }
+    if (ballotsFile.is_open() && !ballotsFile.flush()) {
+        throw runtime_error("Write error on " + config.ballotsOut);
+    }
+
+    // A cancelled run may have dropped batches between tallied ones: close the gaps
+    PipelineStats stats;
+    stats.cancelled = cancelled() && (!sourceDone || tallyStage.items.load() < parseStage.items.load());
+    if (tallyStage.items.load() < parseStage.items.load() && config.keepBallots) {
+        sort(tallied.begin(), tallied.end());
+        size_t kept = 0;
+        for (const pair<size_t, size_t>& range : tallied) {
+            for (size_t i = range.first; i < range.first + range.second; i++, kept++) {
+                if (kept == i) {
+                    continue;
+                }
+                if (config.keepBallots) {
+                    election.allBallots[baseIndex + kept] = std::move(election.allBallots[baseIndex + i]);
+                    election.ballotCandidates[baseIndex + kept] = election.ballotCandidates[baseIndex + i];
+                }
+                if (trackBoard) {
+                    leaves[kept] = leaves[i];
+                }
+            }
+        }
+        if (config.keepBallots) {
+            election.allBallots.resize(baseIndex + kept);
+            election.ballotCandidates.resize(baseIndex + kept);
+        }
+        if (trackBoard) {
+            leaves.resize(kept);
+        }
+    }
+
+    if (config.keepBallots && election.log) {
+        // Logged once the run has succeeded, in index order, so replay never sees a gap,
+        // and before the tallies change, so a failed log leaves the election as it was
+        size_t first = ballotCount(election) - (election.allBallots.size() - baseIndex);
+        try {
+            for (size_t i = baseIndex; i < election.allBallots.size(); i++) {
+                election.log->appendBallot(election, first + i - baseIndex, election.allBallots[i],
+                                           election.ballotCandidates[i]);
+            }
+        } catch (...) {
+            election.allBallots.resize(baseIndex);
+            election.ballotCandidates.resize(baseIndex);
+            throw;
+        }
+    }
+
+    // --- Merge per-worker results ---
+    PaillierScratch& scratch = threadScratch(election.paillierKeys);
+    for (int t = 0; t < tallyThreads; t++) {
+        for (int c = 0; c < election.numCandidates; c++) {
+            election.actualVoteCounts[c] += counts[t][c];
+        }
+    }
+    // Cross-node merge of the per-node reductions, or of every worker's partials
+    const vector<unordered_map<size_t, UnitPartial>>& partials = nodes.empty() ? unitPartials : nodePartials;
+    for (const unordered_map<size_t, UnitPartial>& workerPartials : partials) {
+        // One O(depth) update per reporting unit, not per ballot
+        for (const auto& unit : workerPartials) {
+            addVotes(election.encryptedTally, unit.second.subtotal, election.paillierKeys, scratch);
+            election.tree.add(unit.first, unit.second.subtotal, unit.second.ballots, election.paillierKeys);
+        }
+    }
+    if (config.keepBallots) {
+        syncVoterIndex(election);
+    }
+    for (const Digest& leaf : leaves) {
+        election.board.append(leaf);
+    }
+    if (streamBoard) {
+        // Batches left behind a gap that cancellation dropped close it up, as stored ballots do
+        for (const pair<const size_t, vector<Digest>>& batchLeaves : pendingLeaves) {
+            for (const Digest& leaf : batchLeaves.second) {
+                streamed.append(leaf);
+            }
+        }
+        stats.boardBallots = streamed.size();
+        stats.boardRoot = streamed.root();
+    }
+    vector<KeyedSample> merged;
+    for (vector<KeyedSample>& heap : samples) {
+        merged.insert(merged.end(), heap.begin(), heap.end());
+    }
+    sort(merged.begin(), merged.end(), sampleKeyLess);
+    merged.resize(min(merged.size(), config.sampleBallots));
+    for (const KeyedSample& sample : merged) {
+        stats.samples.push_back(sample.second);
+    }
+    sort(stats.samples.begin(), stats.samples.end(),
+         [](const SampledBallot& a, const SampledBallot& b) { return a.index < b.index; });
+
+    stats.records = tallyStage.items.load();
+    stats.duplicates = duplicates;
+    stats.wallMs = nowNs() / 1e6;
+    stats.stages.push_back(parseStage.summarize("parse", 1));
+    stats.stages.push_back(aesStage.summarize("aes", aesThreads));
+    stats.stages.push_back(paillierStage.summarize("paillier", paillierThreads));
+    stats.stages.push_back(tallyStage.summarize("tally", tallyThreads));
+    stats.numaNodes = nodes.empty() ? 0 : shards;
+    return stats;
+}
@@ -0,0 +1,217 @@
+/*
+==========================================================================
+SHA-256 and HMAC-SHA256
+==========================================================================
+
+SHA-256 processes the message in 64-byte blocks. Each block is expanded to
+64 32-bit words and mixed into the eight-word state over 64 rounds. The
+message is padded with 0x80, zeros, and its bit length as a big-endian u64.
+
+HMAC(K, m) = H((K ^ opad) || H((K ^ ipad) || m)). The two padded-key blocks
+do not depend on the message, so HmacSha256 absorbs them once and copies the
+resulting states for every message.
+*/
+#include "sha256.h"
+#include <algorithm>
+#include <cstring>
+
+using namespace std;
+
+/*
+###########################################################################
+    CONSTANTS
+###########################################################################
+*/
+
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+const uint32_t INITIAL_STATE[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+inline uint32_t loadBE32(const Byte* p) {
+    return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) |
+           (static_cast<uint32_t>(p[2]) << 8) | static_cast<uint32_t>(p[3]);
+}
+
+inline void storeBE32(Byte* p, uint32_t v) {
+    p[0] = static_cast<Byte>(v >> 24);
+    p[1] = static_cast<Byte>(v >> 16);
+    p[2] = static_cast<Byte>(v >> 8);
+    p[3] = static_cast<Byte>(v);
+}
+
+} // namespace
+
+/*
+###########################################################################
+    SHA-256
+###########################################################################
+*/
+
+Sha256::Sha256() {
+    memcpy(state, INITIAL_STATE, sizeof(state));
+}
+
+// Mixes one 64-byte block into the state.
+void Sha256::compress(const Byte* block) {
+    uint32_t w[64];
+    for (int i = 0; i < 16; i++) {
+        w[i] = loadBE32(block + 4 * i);
+    }
+    for (int i = 16; i < 64; i++) {
+        uint32_t s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+        uint32_t s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+        w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+    }
+
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int i = 0; i < 64; i++) {
+        uint32_t S1 = rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25);
+        uint32_t ch = (e & f) ^ (~e & g);
+        uint32_t t1 = h + S1 + ch + K[i] + w[i];
+        uint32_t S0 = rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22);
+        uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+        uint32_t t2 = S0 + maj;
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
+}
+
+// Absorbs more message bytes.
+void Sha256::update(const Byte* data, size_t length) {
+    totalBytes += length;
+    if (buffered > 0) {
+        size_t take = min(length, 64 - buffered);
+        memcpy(buffer + buffered, data, take);
+        buffered += take;
+        data += take;
+        length -= take;
+        if (buffered < 64) {
+            return;
+        }
+        compress(buffer);
+        buffered = 0;
+    }
+    while (length >= 64) {
+        compress(data);
+        data += 64;
+        length -= 64;
+    }
+    memcpy(buffer, data, length);
+    buffered = length;
+}
+
+// Pads the message and returns the digest.
+Digest Sha256::finish() {
+    uint64_t bits = totalBytes * 8;
+    buffer[buffered++] = 0x80;
+    if (buffered > 56) {
+        memset(buffer + buffered, 0, 64 - buffered);
+        compress(buffer);
+        buffered = 0;
+    }
+    memset(buffer + buffered, 0, 56 - buffered);
+    for (int i = 0; i < 8; i++) {
+        buffer[56 + i] = static_cast<Byte>(bits >> (56 - 8 * i));
+    }
+    compress(buffer);
+
+    Digest digest;
+    for (int i = 0; i < 8; i++) {
+        storeBE32(digest.data() + 4 * i, state[i]);
+    }
+    return digest;
+}
+
+/*
+###########################################################################
+    HMAC-SHA256
+###########################################################################
+*/
+
+// Prepares the keyed inner and outer hash states.
+HmacSha256::HmacSha256(const Byte* key, size_t length) {
+    Byte block[64] = {0};
+    if (length > 64) {
+        Digest hashed = sha256(key, length);
+        memcpy(block, hashed.data(), hashed.size());
+    } else {
+        memcpy(block, key, length);
+    }
+
+    Byte pad[64];
+    for (int i = 0; i < 64; i++) {
+        pad[i] = block[i] ^ 0x36;
+    }
+    inner.update(pad, 64);
+    for (int i = 0; i < 64; i++) {
+        pad[i] = block[i] ^ 0x5c;
+    }
+    outer.update(pad, 64);
+}
+
+// Computes the MAC of a message.
+Digest HmacSha256::mac(const Byte* data, size_t length) const {
+    Sha256 in = inner;
+    in.update(data, length);
+    Digest innerDigest = in.finish();
+
+    Sha256 out = outer;
+    out.update(innerDigest.data(), innerDigest.size());
+    return out.finish();
+}
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Hashes a byte string with SHA-256.
+Digest sha256(const Byte* data, size_t length) {
+    Sha256 h;
+    h.update(data, length);
+    return h.finish();
+}
+
+// Formats bytes as lowercase hex.
+string toHex(const Byte* data, size_t length) {
+    static const char digits[] = "0123456789abcdef";
+    string hex(length * 2, '0');
+    for (size_t i = 0; i < length; i++) {
+        hex[2 * i] = digits[data[i] >> 4];
+        hex[2 * i + 1] = digits[data[i] & 0x0F];
+    }
+    return hex;
+}
@@ -0,0 +1,474 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "snapshot.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    ENCODING HELPERS
+###########################################################################
+*/
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = {'C', 'V', 'S', 'N', 'A', 'P', 0, 0};
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const size_t HEADER_SIZE = 64;
+const size_t INDEX_ENTRY_SIZE = 16;
+
+struct SnapshotHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t byteOrder;
+    int32_t numCandidates;
+    int32_t max_voters;
+    int32_t keySize;
+    uint32_t reserved;
+    uint64_t ballotCount;
+    uint64_t metaOffset;
+    uint64_t metaSize;
+    uint64_t indexOffset;
+};
+static_assert(sizeof(SnapshotHeader) == HEADER_SIZE, "snapshot header must be 64 bytes");
+
+struct IndexEntry {
+    uint64_t dataOffset;
+    uint32_t piiLength;
+    uint32_t weightLength;
+};
+static_assert(sizeof(IndexEntry) == INDEX_ENTRY_SIZE, "snapshot index entry must be 16 bytes");
+
+string errnoText(const string& what, const string& path) {
+    return what + " " + path + ": " + strerror(errno);
+}
+
+/**
+ * @brief Buffers output to a file descriptor and tracks the write offset.
+ */
+class FileWriter {
+public:
+    FileWriter(int fd, const string& path) : fd(fd), path(path) { buffer.reserve(1 << 20); }
+
+    void write(const void* data, size_t n) {
+        const Byte* p = static_cast<const Byte*>(data);
+        buffer.insert(buffer.end(), p, p + n);
+        written += n;
+        if (buffer.size() >= (1 << 20)) {
+            flush();
+        }
+    }
+
+    template <typename T>
+    void put(const T& v) { write(&v, sizeof(v)); }
+
+    // Writes a length-prefixed big integer; returns its byte length.
+    uint32_t putMpz(const mpz_class& z) {
+        size_t n = 0;
+        size_t start = buffer.size();
+        buffer.resize(start + 4 + (mpz_sizeinbase(z.get_mpz_t(), 2) + 7) / 8);
+        mpz_export(buffer.data() + start + 4, &n, 1, 1, 1, 0, z.get_mpz_t());
+        uint32_t len = static_cast<uint32_t>(n);
+        memcpy(buffer.data() + start, &len, 4);
+        buffer.resize(start + 4 + n);
+        written += 4 + n;
+        if (buffer.size() >= (1 << 20)) {
+            flush();
+        }
+        return len;
+    }
+
+    void flush() {
+        size_t done = 0;
+        while (done < buffer.size()) {
+            ssize_t n = ::write(fd, buffer.data() + done, buffer.size() - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n < 0) {
+                throw runtime_error(errnoText("Write error on", path));
+            }
+            done += static_cast<size_t>(n);
+        }
+        buffer.clear();
+    }
+
+    uint64_t offset() const { return written; }
+
+private:
+    int fd;
+    string path;
+    vector<Byte> buffer;
+    uint64_t written = 0;
+};
+
+/**
+ * @brief Bounds-checked cursor over the mapped meta section.
+ */
+class MetaReader {
+public:
+    MetaReader(const Byte* p, size_t n, const string& path) : p(p), end(p + n), path(path) {}
+
+    const Byte* take(size_t n) {
+        if (static_cast<size_t>(end - p) < n) {
+            throw runtime_error("Truncated snapshot metadata in " + path);
+        }
+        const Byte* at = p;
+        p += n;
+        return at;
+    }
+
+    template <typename T>
+    T get() {
+        T v;
+        memcpy(&v, take(sizeof(T)), sizeof(T));
+        return v;
+    }
+
+    mpz_class getMpz() {
+        uint32_t len = get<uint32_t>();
+        mpz_class z;
+        mpz_import(z.get_mpz_t(), len, 1, 1, 1, 0, take(len));
+        return z;
+    }
+
+private:
+    const Byte* p;
+    const Byte* end;
+    string path;
+};
+
+// Writes the snapshot body to an open file and returns its size.
+size_t writeSnapshotFile(const Election& election, int fd, const string& path) {
+    FileWriter out(fd, path);
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    out.put(header); // Placeholder, rewritten once the offsets are known
+
+    // --- Meta ---
+    header.metaOffset = out.offset();
+    const PaillierKeys& keys = election.paillierKeys;
+    out.putMpz(keys.n);
+    out.putMpz(keys.nSquared);
+    out.putMpz(keys.lambda);
+    out.putMpz(keys.g);
+    out.putMpz(keys.mu);
+    out.putMpz(election.encryptedTally);
+    out.write(election.aes_key.data(), election.aes_key.size());
+    out.write(election.voterKey.data(), election.voterKey.size());
+    for (const mpz_class& w : election.weights) {
+        out.putMpz(w);
+    }
+    for (int c : election.actualVoteCounts) {
+        out.put(static_cast<int64_t>(c));
+    }
+    out.put(static_cast<uint32_t>(election.tree.size()));
+    for (size_t i = 0; i < election.tree.size(); i++) {
+        const TallyNode& node = election.tree.node(i);
+        out.put(static_cast<uint32_t>(node.parent));
+        out.put(static_cast<uint32_t>(node.name.size()));
+        out.write(node.name.data(), node.name.size());
+        out.put(static_cast<uint64_t>(node.ballots));
+        out.putMpz(node.subtotal);
+    }
+    vector<uint64_t> revoked(election.revoked.begin(), election.revoked.end());
+    sort(revoked.begin(), revoked.end());
+    out.put(static_cast<uint64_t>(revoked.size()));
+    out.write(revoked.data(), revoked.size() * sizeof(uint64_t));
+    header.metaSize = out.offset() - header.metaOffset;
+
+    // --- Ballot data, with the index collected in memory ---
+    size_t total = ballotCount(election);
+    vector<IndexEntry> index(total);
+    HmacSha256 hmac(election.voterKey.data(), election.voterKey.size());
+    for (size_t i = 0; i < total; i++) {
+        EncryptedBallot ballot = ballotAt(election, i);
+        index[i].dataOffset = out.offset();
+        index[i].piiLength = static_cast<uint32_t>(ballot.aesEncryptedPII.size());
+        out.write(ballot.aesEncryptedPII.data(), ballot.aesEncryptedPII.size());
+        index[i].weightLength = out.putMpz(ballot.encWeight);
+        out.write(ballot.voterTag.data(), ballot.voterTag.size());
+        out.put(ballot.unit);
+        int candidate = ballotCandidate(election, i);
+        out.put(static_cast<Byte>((candidate < 0 ? 0xFF : candidate) ^ candidateMask(hmac, i)));
+    }
+
+    // --- Index (8-byte aligned) ---
+    static const Byte zeros[8] = {0};
+    out.write(zeros, (8 - out.offset() % 8) % 8);
+    header.indexOffset = out.offset();
+    out.write(index.data(), index.size() * sizeof(IndexEntry));
+    size_t size = out.offset();
+    out.flush();
+
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.byteOrder = BYTE_ORDER_MARK;
+    header.numCandidates = election.numCandidates;
+    header.max_voters = election.max_voters;
+    header.keySize = election.keySize;
+    header.ballotCount = total;
+    if (pwrite(fd, &header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header))) {
+        throw runtime_error(errnoText("Write error on", path));
+    }
+    return size;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+// Maps a snapshot file and validates its header.
+MappedSnapshot::MappedSnapshot(const string& path) : path(path) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        throw runtime_error(errnoText("Cannot open snapshot", path));
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        string err = errnoText("Cannot stat snapshot", path);
+        close(fd);
+        throw runtime_error(err);
+    }
+    length = static_cast<size_t>(st.st_size);
+    if (length < HEADER_SIZE) {
+        close(fd);
+        throw runtime_error("Not a CryptoVote snapshot: " + path);
+    }
+    void* map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // The mapping keeps the file alive
+    if (map == MAP_FAILED) {
+        throw runtime_error(errnoText("Cannot map snapshot", path));
+    }
+    base = static_cast<const Byte*>(map);
+
+    SnapshotHeader header;
+    memcpy(&header, base, sizeof(header));
+    string problem;
+    if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0) {
+        problem = "not a CryptoVote snapshot";
+    } else if (header.version < 1 || header.version > SNAPSHOT_VERSION) {
+        problem = "unsupported snapshot version " + to_string(header.version);
+    } else if (header.byteOrder != BYTE_ORDER_MARK) {
+        problem = "snapshot was written on a host with a different byte order";
+    } else if (header.metaOffset < HEADER_SIZE || header.metaSize > length ||
+               header.metaOffset > length - header.metaSize ||
+               header.indexOffset > length ||
+               header.ballotCount > (length - header.indexOffset) / INDEX_ENTRY_SIZE) {
+        problem = "snapshot is truncated or corrupt";
+    }
+    if (!problem.empty()) {
+        munmap(const_cast<Byte*>(base), length);
+        throw runtime_error(path + ": " + problem);
+    }
+    count = static_cast<size_t>(header.ballotCount);
+    version = header.version;
+    metaOffset = header.metaOffset;
+    metaSize = header.metaSize;
+    indexOffset = header.indexOffset;
+}
+
+MappedSnapshot::~MappedSnapshot() {
+    munmap(const_cast<Byte*>(base), length);
+}
+
+// Reads and bounds-checks one index entry.
+const Byte* MappedSnapshot::entryAt(size_t index, uint32_t& piiLength, uint32_t& weightLength) const {
+    if (index >= count) {
+        throw out_of_range("Ballot index " + to_string(index) + " out of range");
+    }
+    IndexEntry entry;
+    memcpy(&entry, base + indexOffset + index * INDEX_ENTRY_SIZE, sizeof(entry));
+    uint64_t need = static_cast<uint64_t>(entry.piiLength) + 4 + entry.weightLength +
+                    (version >= 2 ? sizeof(VoterTag) : 0) + (version >= 4 ? sizeof(uint32_t) : 0) +
+                    (version >= 5 ? 1 : 0);
+    if (entry.dataOffset > indexOffset || need > indexOffset - entry.dataOffset) {
+        throw runtime_error(path + ": ballot " + to_string(index) + " points outside the data section");
+    }
+    piiLength = entry.piiLength;
+    weightLength = entry.weightLength;
+    return base + entry.dataOffset;
+}
+
+// Decodes one ballot from the mapping.
+EncryptedBallot MappedSnapshot::ballot(size_t index) const {
+    uint32_t piiLength, weightLength;
+    const Byte* p = entryAt(index, piiLength, weightLength);
+    EncryptedBallot ballot;
+    ballot.aesEncryptedPII.assign(p, p + piiLength);
+    p += piiLength + 4;
+    mpz_import(ballot.encWeight.get_mpz_t(), weightLength, 1, 1, 1, 0, p);
+    p += weightLength;
+    ballot.voterTag.fill(0);
+    ballot.unit = 0;
+    if (version >= 2) {
+        memcpy(ballot.voterTag.data(), p, ballot.voterTag.size());
+        p += ballot.voterTag.size();
+    }
+    if (version >= 4) {
+        memcpy(&ballot.unit, p, sizeof(ballot.unit));
+    }
+    return ballot;
+}
+
+// Reads only the voter tag of one ballot.
+VoterTag MappedSnapshot::voterTag(size_t index) const {
+    uint32_t piiLength, weightLength;
+    const Byte* p = entryAt(index, piiLength, weightLength);
+    VoterTag tag;
+    tag.fill(0);
+    if (version >= 2) {
+        memcpy(tag.data(), p + piiLength + 4 + weightLength, tag.size());
+    }
+    return tag;
+}
+
+// Reads the sealed candidate of one ballot.
+bool MappedSnapshot::sealedCandidate(size_t index, Byte& sealed) const {
+    uint32_t piiLength, weightLength;
+    const Byte* p = entryAt(index, piiLength, weightLength);
+    if (version < 5) {
+        return false;
+    }
+    sealed = p[piiLength + 4 + weightLength + sizeof(VoterTag) + sizeof(uint32_t)];
+    return true;
+}
+
+// Restores everything except the ballots into an election.
+void MappedSnapshot::restoreMetadata(Election& election) const {
+    SnapshotHeader header;
+    memcpy(&header, base, sizeof(header));
+    if (header.numCandidates < 1 || header.numCandidates > 50 || header.max_voters < 1) {
+        throw runtime_error(path + ": invalid election parameters");
+    }
+
+    MetaReader meta(base + metaOffset, static_cast<size_t>(metaSize), path);
+    Election restored;
+    restored.numCandidates = header.numCandidates;
+    restored.max_voters = header.max_voters;
+    restored.keySize = header.keySize;
+    restored.paillierKeys.n = meta.getMpz();
+    restored.paillierKeys.nSquared = meta.getMpz();
+    restored.paillierKeys.lambda = meta.getMpz();
+    restored.paillierKeys.g = meta.getMpz();
+    restored.paillierKeys.mu = meta.getMpz();
+    restored.encryptedTally = meta.getMpz();
+    memcpy(restored.aes_key.data(), meta.take(restored.aes_key.size()), restored.aes_key.size());
+    if (version >= 2) {
+        memcpy(restored.voterKey.data(), meta.take(restored.voterKey.size()), restored.voterKey.size());
+    } else {
+        random_device rd;
+        for (Byte& b : restored.voterKey) {
+            b = static_cast<Byte>(rd());
+        }
+    }
+    for (int i = 0; i < restored.numCandidates; i++) {
+        restored.weights.push_back(meta.getMpz());
+    }
+    for (int i = 0; i < restored.numCandidates; i++) {
+        restored.actualVoteCounts.push_back(static_cast<int>(meta.get<int64_t>()));
+    }
+    if (version >= 3) {
+        uint32_t nodes = meta.get<uint32_t>();
+        for (uint32_t i = 0; i < nodes; i++) {
+            uint32_t parent = meta.get<uint32_t>();
+            uint32_t nameLength = meta.get<uint32_t>();
+            string name(reinterpret_cast<const char*>(meta.take(nameLength)), nameLength);
+            uint64_t ballots = meta.get<uint64_t>();
+            mpz_class subtotal = meta.getMpz();
+            if (i > 0 && (parent >= i || restored.tree.child(parent, name) != i)) {
+                throw runtime_error(path + ": corrupt tally tree");
+            }
+            restored.tree.restore(i, ballots, subtotal);
+        }
+    } else {
+        restored.tree.restore(0, count, restored.encryptedTally);
+    }
+    if (version >= 4) {
+        uint64_t revoked = meta.get<uint64_t>();
+        for (uint64_t i = 0; i < revoked; i++) {
+            uint64_t index = meta.get<uint64_t>();
+            if (index >= count) {
+                throw runtime_error(path + ": revoked ballot index out of range");
+            }
+            restored.revoked.insert(static_cast<size_t>(index));
+        }
+    }
+    restored.voters.reserve(max<size_t>(count, static_cast<size_t>(restored.max_voters)));
+    election = std::move(restored);
+}
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Writes an election to a temporary file and atomically renames it into place.
+size_t saveSnapshot(const Election& election, const string& path) {
+    if (election.weights.empty()) {
+        throw invalid_argument("Election has not been set up");
+    }
+
+    string tmpPath = path + ".tmp." + to_string(getpid());
+    int fd = open(tmpPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        throw runtime_error(errnoText("Cannot create", tmpPath));
+    }
+    size_t size = 0;
+    try {
+        size = writeSnapshotFile(election, fd, tmpPath);
+        if (fsync(fd) < 0) {
+            throw runtime_error(errnoText("fsync failed on", tmpPath));
+        }
+    } catch (...) {
+        close(fd);
+        unlink(tmpPath.c_str());
+        throw;
+    }
+    close(fd);
+
+    if (rename(tmpPath.c_str(), path.c_str()) < 0) {
+        string err = errnoText("Cannot rename snapshot to", path);
+        unlink(tmpPath.c_str());
+        throw runtime_error(err);
+    }
+
+    // Persist the rename itself
+    size_t slash = path.find_last_of('/');
+    string dir = slash == string::npos ? "." : (slash == 0 ? "/" : path.substr(0, slash));
+    int dirFd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return size;
+}
+
+// Replaces an election with the contents of a snapshot file.
+void loadSnapshot(Election& election, const string& path) {
+    shared_ptr<MappedSnapshot> snapshot = make_shared<MappedSnapshot>(path);
+    snapshot->restoreMetadata(election);
+    election.snapshot = snapshot;
+}
@@ -0,0 +1,260 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "tally_tree.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+// Splits a path into its non-empty components.
+vector<string> splitPath(const string& path) {
+    vector<string> parts;
+    size_t start = 0;
+    while (start <= path.size()) {
+        size_t slash = path.find('/', start);
+        if (slash == string::npos) {
+            slash = path.size();
+        }
+        if (slash > start) {
+            parts.push_back(path.substr(start, slash - start));
+        }
+        start = slash + 1;
+    }
+    return parts;
+}
+
+string joinPath(const string& parent, const string& name) {
+    return parent.empty() ? name : parent + "/" + name;
+}
+
+// Drops empty components, so "/a//b/" becomes "a/b".
+string canonicalPath(const string& path) {
+    string canonical;
+    for (const string& name : splitPath(path)) {
+        canonical = joinPath(canonical, name);
+    }
+    return canonical;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+TallyTree::TallyTree() : nodes(1) {
+    byPath[""] = 0;
+}
+
+// Finds or creates the node for a slash-separated path.
+size_t TallyTree::resolve(const string& path) {
+    // Only canonical paths are keys, so arbitrary spellings cannot grow the map
+    auto hit = byPath.find(path);
+    if (hit != byPath.end()) {
+        return hit->second;
+    }
+    string canonical = canonicalPath(path);
+    hit = byPath.find(canonical);
+    if (hit != byPath.end()) {
+        return hit->second;
+    }
+    size_t node = 0;
+    for (const string& name : splitPath(canonical)) {
+        node = child(node, name);
+    }
+    return node;
+}
+
+// Looks up an existing node.
+bool TallyTree::find(const string& path, size_t& node) const {
+    auto hit = byPath.find(path);
+    if (hit == byPath.end()) {
+        hit = byPath.find(canonicalPath(path));
+        if (hit == byPath.end()) {
+            return false;
+        }
+    }
+    node = hit->second;
+    return true;
+}
+
+// Finds or creates a named child node.
+size_t TallyTree::child(size_t parent, const string& name) {
+    if (parent >= nodes.size()) {
+        throw invalid_argument("Tally tree node " + to_string(parent) + " does not exist");
+    }
+    if (name.empty() || name.find('/') != string::npos) {
+        throw invalid_argument("Invalid reporting unit name \"" + name + "\"");
+    }
+    string path = joinPath(nodes[parent].path, name);
+    auto hit = byPath.find(path);
+    if (hit != byPath.end()) {
+        return hit->second;
+    }
+
+    TallyNode node;
+    node.name = name;
+    node.path = path;
+    node.parent = parent;
+    node.depth = nodes[parent].depth + 1;
+    size_t index = nodes.size();
+    nodes.push_back(std::move(node));
+    nodes[parent].children.push_back(index);
+    byPath[path] = index;
+    return index;
+}
+
+// Folds encrypted votes into a node and all of its ancestors.
+void TallyTree::add(size_t node, const mpz_class& ciphertext, uint64_t ballots, const PaillierKeys& keys) {
+    while (true) {
+        TallyNode& n = nodes.at(node);
+        addVotes(n.subtotal, ciphertext, keys, threadScratch(keys));
+        n.ballots += ballots;
+        if (node == 0) {
+            break;
+        }
+        node = n.parent;
+    }
+}
+
+// Takes previously added votes back out of a node and all of its ancestors.
+void TallyTree::remove(size_t node, const mpz_class& inverse, uint64_t ballots, const PaillierKeys& keys) {
+    while (true) {
+        TallyNode& n = nodes.at(node);
+        addVotes(n.subtotal, inverse, keys, threadScratch(keys));
+        n.ballots -= min(ballots, n.ballots);
+        if (node == 0) {
+            break;
+        }
+        node = n.parent;
+    }
+}
+
+// Overwrites a node's counters.
+void TallyTree::restore(size_t node, uint64_t ballots, const mpz_class& subtotal) {
+    TallyNode& n = nodes.at(node);
+    n.ballots = ballots;
+    n.subtotal = subtotal;
+}
+
+// Lists a node and its descendants, breadth first.
+vector<size_t> TallyTree::subtree(size_t node, int levels) const {
+    vector<size_t> out;
+    if (node >= nodes.size()) {
+        return out;
+    }
+    int limit = nodes[node].depth + max(0, levels);
+    out.push_back(node);
+    for (size_t i = 0; i < out.size(); i++) {
+        const TallyNode& n = nodes[out[i]];
+        if (n.depth < limit) {
+            out.insert(out.end(), n.children.begin(), n.children.end());
+        }
+    }
+    return out;
+}
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Decrypts several subtotals across worker threads.
+vector<mpz_class> decryptSubtotals(const TallyTree& tree, const vector<size_t>& nodes, const PaillierKeys& keys,
+                                   int threads) {
+    vector<mpz_class> plaintexts(nodes.size());
+    threads = static_cast<int>(min<size_t>(max(1, threads), max<size_t>(1, nodes.size())));
+
+    exception_ptr error;
+    mutex errorLock;
+    auto worker = [&](size_t begin, size_t end) {
+        try {
+            PaillierScratch scratch(keys);
+            for (size_t i = begin; i < end; i++) {
+                decVote(plaintexts[i], tree.node(nodes[i]).subtotal, keys, scratch);
+            }
+        } catch (...) {
+            lock_guard<mutex> guard(errorLock);
+            if (!error) {
+                error = current_exception();
+            }
+        }
+    };
+
+    vector<thread> pool;
+    size_t chunk = (nodes.size() + threads - 1) / threads;
+    for (int t = 0; t < threads; t++) {
+        size_t begin = min(nodes.size(), t * chunk);
+        size_t end = min(nodes.size(), begin + chunk);
+        pool.emplace_back(worker, begin, end);
+    }
+    for (thread& th : pool) {
+        th.join();
+    }
+    if (error) {
+        rethrow_exception(error);
+    }
+    return plaintexts;
+}
+
+// Parses a comma-separated fan-out such as "3,4,5".
+vector<int> parseFanout(const string& spec) {
+    vector<int> fanout;
+    size_t leaves = 1;
+    size_t start = 0;
+    while (start < spec.size()) {
+        size_t comma = spec.find(',', start);
+        if (comma == string::npos) {
+            comma = spec.size();
+        }
+        string part = spec.substr(start, comma - start);
+        if (part.empty() || part.size() > 7 || part.find_first_not_of("0123456789") != string::npos ||
+            stoi(part) < 1) {
+            throw invalid_argument("Fan-out must be positive integers like \"3,4,5\", got \"" + spec + "\"");
+        }
+        fanout.push_back(stoi(part));
+        leaves *= static_cast<size_t>(fanout.back());
+        if (leaves > 1000000) {
+            throw invalid_argument("Fan-out \"" + spec + "\" has more than 1,000,000 units");
+        }
+        start = comma + 1;
+    }
+    return fanout;
+}
+
+// Names the simulated unit path of one leaf.
+string simulatedUnitPath(size_t leaf, const vector<int>& fanout) {
+    static const char* const LEVEL_NAMES[] = {"region", "county", "precinct", "ward", "block"};
+    vector<size_t> digits(fanout.size());
+    for (size_t level = fanout.size(); level-- > 0;) {
+        digits[level] = leaf % fanout[level];
+        leaf /= fanout[level];
+    }
+    string path;
+    for (size_t level = 0; level < fanout.size(); level++) {
+        string name = level < 5 ? LEVEL_NAMES[level] : "level" + to_string(level + 1);
+        path = joinPath(path, name + "-" + to_string(digits[level] + 1));
+    }
+    return path;
+}
@@ -0,0 +1,134 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "topology.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <pthread.h>
+#include <sched.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+const string NODE_ROOT = "/sys/devices/system/node/";
+
+// Reads the first line of a sysfs file, or "" if it cannot be read.
+string readLine(const string& path) {
+    ifstream file(path);
+    string line;
+    getline(file, line);
+    return line;
+}
+
+// CPUs the process may run on.
+vector<int> allowedCpus() {
+    vector<int> cpus;
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#endif
+    return cpus;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Parses a kernel CPU or node list.
+vector<int> parseCpuList(const string& list) {
+    vector<int> numbers;
+    size_t start = 0;
+    while (start < list.size()) {
+        size_t comma = list.find(',', start);
+        if (comma == string::npos) {
+            comma = list.size();
+        }
+        string item = list.substr(start, comma - start);
+        start = comma + 1;
+        if (item.empty() || item.find_first_not_of("0123456789-\n ") != string::npos) {
+            throw invalid_argument("Malformed CPU list \"" + list + "\"");
+        }
+        size_t dash = item.find('-');
+        int first = stoi(item.substr(0, dash));
+        int last = dash == string::npos ? first : stoi(item.substr(dash + 1));
+        if (last < first) {
+            throw invalid_argument("Malformed CPU list \"" + list + "\"");
+        }
+        for (int n = first; n <= last; n++) {
+            numbers.push_back(n);
+        }
+    }
+    sort(numbers.begin(), numbers.end());
+    numbers.erase(unique(numbers.begin(), numbers.end()), numbers.end());
+    return numbers;
+}
+
+// Returns the NUMA nodes this process can run on.
+vector<NumaNode> numaNodes() {
+    vector<int> allowed = allowedCpus();
+    vector<NumaNode> nodes;
+    try {
+        for (int id : parseCpuList(readLine(NODE_ROOT + "online"))) {
+            NumaNode node;
+            node.id = id;
+            for (int cpu : parseCpuList(readLine(NODE_ROOT + "node" + to_string(id) + "/cpulist"))) {
+                if (binary_search(allowed.begin(), allowed.end(), cpu)) {
+                    node.cpus.push_back(cpu);
+                }
+            }
+            if (!node.cpus.empty()) { // Memory-only nodes and nodes outside our cpuset
+                nodes.push_back(node);
+            }
+        }
+    } catch (const exception&) {
+        nodes.clear(); // Unreadable topology: fall back to one node
+    }
+    if (nodes.empty()) {
+        NumaNode node;
+        node.cpus = allowed;
+        nodes.push_back(node);
+    }
+    return nodes;
+}
+
+// Restricts the calling thread to a set of CPUs.
+bool pinThreadToCpus(const vector<int>& cpus) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu >= 0 && cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return CPU_COUNT(&set) > 0 && pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
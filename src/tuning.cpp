@@ -0,0 +1,306 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "tuning.h"
+#include "aes.h"
+#include "json.h"
+#include "paillier_fixed.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+// Each stage should spend this long per batch, so queue hand-offs stay cheap.
+const double BATCH_WORK_NS = 50e3;
+// Most time one Paillier batch may take (end-of-run tail, cancel latency).
+const double BATCH_LIMIT_NS = 20e6;
+const size_t MAX_BATCH = 4096;
+
+// Median nanoseconds of op(), repeated for about budgetMs and at least minRuns times.
+template <typename Op>
+uint64_t medianNs(Op op, double budgetMs = 200, size_t minRuns = 8) {
+    vector<uint64_t> samples;
+    auto start = chrono::steady_clock::now();
+    while (samples.size() < minRuns ||
+           chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() < budgetMs) {
+        auto one = chrono::steady_clock::now();
+        op();
+        samples.push_back(static_cast<uint64_t>(
+            chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - one).count()));
+    }
+    nth_element(samples.begin(), samples.begin() + samples.size() / 2, samples.end());
+    return samples[samples.size() / 2];
+}
+
+// Trims spaces and tabs from both ends.
+string trim(const string& s) {
+    size_t first = s.find_first_not_of(" \t");
+    if (first == string::npos) {
+        return "";
+    }
+    return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+}
+
+// Reads a profile back from one cache line.
+bool parseProfile(const string& line, TuningProfile& profile) {
+    try {
+        JsonObject obj = parseJsonObject(line);
+        if (!obj.has("cpu") || !obj.has("keySize")) {
+            return false;
+        }
+        profile.cpu = obj.getString("cpu");
+        profile.keySize = static_cast<int>(obj.getInt("keySize"));
+        profile.encVoteNs = static_cast<uint64_t>(obj.getInt("encVoteNs"));
+        profile.decVoteNs = static_cast<uint64_t>(obj.getInt("decVoteNs"));
+        profile.addVotesNs = static_cast<uint64_t>(obj.getInt("addVotesNs"));
+        profile.aesNs = static_cast<uint64_t>(obj.getInt("aesNs"));
+        profile.simd = parseSimdLevel(obj.getString("simd", "scalar"));
+        profile.hwThreads = static_cast<unsigned>(obj.getInt("hwThreads"));
+        profile.calibratedAt = obj.getInt("calibratedAt");
+        return true;
+    } catch (const exception&) {
+        return false; // A line from another version; it is dropped on the next save
+    }
+}
+
+} // namespace
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Returns this host's CPU model name.
+string cpuModelName() {
+    ifstream cpuinfo("/proc/cpuinfo");
+    string line;
+    while (getline(cpuinfo, line)) {
+        // x86 names the model; Arm kernels only give the implementer and part
+        if (line.compare(0, 10, "model name") == 0 || line.compare(0, 8, "CPU part") == 0) {
+            size_t colon = line.find(':');
+            if (colon != string::npos && !trim(line.substr(colon + 1)).empty()) {
+                return trim(line.substr(colon + 1));
+            }
+        }
+    }
+    return "unknown";
+}
+
+// Returns the default profile cache path.
+string defaultTuningPath() {
+    const char* xdg = getenv("XDG_CACHE_HOME");
+    if (xdg && *xdg) {
+        return string(xdg) + "/cryptovote-tuning.ndjson";
+    }
+    const char* home = getenv("HOME");
+    if (home && *home) {
+        string dir = string(home) + "/.cache";
+        mkdir(dir.c_str(), 0700); // Usually exists already
+        if (access(dir.c_str(), W_OK) == 0) {
+            return dir + "/cryptovote-tuning.ndjson";
+        }
+    }
+    return "cryptovote-tuning.ndjson";
+}
+
+// Microbenchmarks encVote, decVote, addVotes and AES on this host.
+TuningProfile calibrateHost(const PaillierKeys& keys, int keySize) {
+    TuningProfile profile;
+    profile.cpu = cpuModelName();
+    profile.keySize = keySize;
+    profile.hwThreads = thread::hardware_concurrency();
+    profile.calibratedAt = static_cast<long long>(time(nullptr));
+
+    gmp_randstate_t rand_state;
+    gmp_randinit_mt(rand_state);
+    gmp_randseed_ui(rand_state, 0x54554E45UL);
+    PaillierScratch scratch(keys);
+
+    // --- Paillier encryption and decryption, as the pipeline and audits call them ---
+    vector<mpz_class> ciphertexts(8);
+    for (mpz_class& c : ciphertexts) {
+        encVote(c, mpz_class(1), keys, rand_state, scratch);
+    }
+    size_t next = 0;
+    mpz_class ciphertext;
+    profile.encVoteNs = medianNs([&] { encVote(ciphertext, mpz_class(1), keys, rand_state, scratch); });
+    mpz_class plaintext;
+    profile.decVoteNs = medianNs([&] {
+        decVote(plaintext, ciphertexts[next++ % ciphertexts.size()], keys, scratch);
+    });
+
+    // --- AES on a name of typical length ---
+    array<Byte, 32> aesKey;
+    for (size_t i = 0; i < aesKey.size(); i++) {
+        aesKey[i] = static_cast<Byte>(i * 31 + 7);
+    }
+    profile.aesNs = medianNs([&] { encryptAES256("FName_123456 LName_123456", aesKey); }, 50, 64);
+
+    // --- Tally products on every kernel the CPU has, up to the --simd cap ---
+    const size_t factors = 256;
+    SimdLevel cap = currentSimdLimit();
+    profile.addVotesNs = 0;
+    for (SimdLevel level : {SIMD_SCALAR, SIMD_AVX2, SIMD_AVX512IFMA}) {
+        if (level > cap) {
+            continue;
+        }
+        if (level != SIMD_SCALAR &&
+            makeCiphertextProduct(keys, level)->backend() != "simd-" + simdLevelName(level)) {
+            continue;
+        }
+        uint64_t ns = medianNs([&] {
+            unique_ptr<CiphertextProduct> product = makeCiphertextProduct(keys, level);
+            for (size_t i = 0; i < factors; i++) {
+                product->multiply(ciphertexts[i % ciphertexts.size()]);
+            }
+            mpz_class value;
+            product->value(value);
+        }, 100, 4) / factors;
+        if (profile.addVotesNs == 0 || ns < profile.addVotesNs) {
+            profile.addVotesNs = max<uint64_t>(1, ns);
+            profile.simd = level;
+        }
+    }
+
+    gmp_randclear(rand_state);
+    return profile;
+}
+
+// Looks up the cached profile for this CPU and a key size.
+bool loadTuningProfile(const string& path, int keySize, TuningProfile& profile) {
+    ifstream file(path);
+    string cpu = cpuModelName();
+    string line;
+    while (getline(file, line)) {
+        TuningProfile candidate;
+        if (parseProfile(line, candidate) && candidate.cpu == cpu && candidate.keySize == keySize) {
+            profile = candidate;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Stores a profile, replacing any cached one for the same CPU model and key size.
+void saveTuningProfile(const string& path, const TuningProfile& profile) {
+    vector<string> kept;
+    {
+        ifstream file(path);
+        string line;
+        while (getline(file, line)) {
+            TuningProfile other;
+            if (parseProfile(line, other) && (other.cpu != profile.cpu || other.keySize != profile.keySize)) {
+                kept.push_back(line);
+            }
+        }
+    }
+    kept.push_back(tuningProfileToJson(profile));
+
+    string tmpPath = path + ".tmp." + to_string(getpid());
+    {
+        ofstream out(tmpPath, ios::trunc);
+        for (const string& line : kept) {
+            out << line << '\n';
+        }
+        if (!out.flush()) {
+            remove(tmpPath.c_str());
+            throw runtime_error("Cannot write tuning profile " + tmpPath);
+        }
+    }
+    if (rename(tmpPath.c_str(), path.c_str()) != 0) {
+        remove(tmpPath.c_str());
+        throw runtime_error("Cannot rename tuning profile to " + path);
+    }
+}
+
+// Returns the cached profile, calibrating and caching one if there is none.
+TuningProfile tuningProfileFor(const string& path, const PaillierKeys& keys, int keySize, bool* calibrated) {
+    TuningProfile profile;
+    bool found = loadTuningProfile(path, keySize, profile);
+    if (!found) {
+        profile = calibrateHost(keys, keySize);
+        saveTuningProfile(path, profile);
+    }
+    if (calibrated) {
+        *calibrated = !found;
+    }
+    return profile;
+}
+
+// Sizes a pipeline from a profile.
+void tunePipeline(const TuningProfile& profile, int threads, PipelineConfig& config) {
+    threads = max(1, threads);
+    double aes = static_cast<double>(profile.aesNs);
+    double paillier = static_cast<double>(profile.encVoteNs);
+    double tally = static_cast<double>(profile.addVotesNs);
+    double total = aes + paillier + tally;
+    if (total <= 0) {
+        sizePipeline(threads, config);
+        return;
+    }
+
+    // Workers in proportion to cost, so every stage keeps up with the others
+    config.aesThreads = max(1, static_cast<int>(lround(threads * aes / total)));
+    config.tallyThreads = max(1, static_cast<int>(lround(threads * tally / total)));
+    config.paillierThreads = max(1, threads - config.aesThreads - config.tallyThreads);
+
+    double cheapest = max(1.0, min(aes, tally));
+    size_t batch = static_cast<size_t>(ceil(BATCH_WORK_NS / cheapest));
+    size_t limit = static_cast<size_t>(BATCH_LIMIT_NS / max(1.0, paillier));
+    config.batchSize = max<size_t>(1, min(min(batch, limit), MAX_BATCH));
+
+    int widest = max(config.paillierThreads, max(config.aesThreads, config.tallyThreads));
+    config.queueDepth = max<size_t>(4, 2 * static_cast<size_t>(widest));
+}
+
+// Serializes a profile as one JSON line.
+string tuningProfileToJson(const TuningProfile& profile, int threads) {
+    JsonWriter w;
+    w.beginObject();
+    w.field("cpu", profile.cpu);
+    w.field("keySize", profile.keySize);
+    w.field("encVoteNs", profile.encVoteNs);
+    w.field("decVoteNs", profile.decVoteNs);
+    w.field("addVotesNs", profile.addVotesNs);
+    w.field("aesNs", profile.aesNs);
+    w.field("simd", simdLevelName(profile.simd));
+    w.field("hwThreads", static_cast<unsigned long>(profile.hwThreads));
+    w.field("calibratedAt", profile.calibratedAt);
+    if (threads > 0) {
+        PipelineConfig config;
+        tunePipeline(profile, threads, config);
+        w.field("threads", threads);
+        w.field("aesThreads", config.aesThreads);
+        w.field("paillierThreads", config.paillierThreads);
+        w.field("tallyThreads", config.tallyThreads);
+        w.field("batchSize", config.batchSize);
+        w.field("queueDepth", config.queueDepth);
+    }
+    w.endObject();
+    return w.str();
+}
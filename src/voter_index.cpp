@@ -0,0 +1,227 @@
+/*
+###########################################################################
+    LIBRARIES
+###########################################################################
+*/
+
+#include "voter_index.h"
+//-------------------------------------------------------------
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+/*
+###########################################################################
+    HELPERS
+###########################################################################
+*/
+
+namespace {
+
+const int BLOOM_PROBES = 7;
+const size_t BLOOM_BITS_PER_VOTER = 10;
+
+inline void splitTag(const VoterTag& tag, uint64_t& lo, uint64_t& hi) {
+    memcpy(&lo, tag.data(), 8);
+    memcpy(&hi, tag.data() + 8, 8);
+}
+
+size_t nextPowerOfTwo(size_t n) {
+    size_t p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+} // namespace
+
+/*
+###########################################################################
+    CLASS DEFINITIONS
+###########################################################################
+*/
+
+VoterIndex::VoterIndex(size_t expected, bool useBloom) : useBloom(useBloom) {
+    rehash(nextPowerOfTwo(max<size_t>(16, 2 * expected)));
+}
+
+// Grows the table for 'expected' voters.
+void VoterIndex::reserve(size_t expected) {
+    if (2 * expected > slots.size()) {
+        rehash(nextPowerOfTwo(2 * expected));
+    }
+}
+
+// Rebuilds the table and Bloom filter at a new capacity.
+void VoterIndex::rehash(size_t newCapacity) {
+    vector<Slot> old;
+    old.swap(slots);
+    slots.assign(newCapacity, Slot{0, 0, 0});
+    mask = newCapacity - 1;
+
+    if (useBloom) {
+        // Table capacity is ~2x the voters it is sized for
+        size_t bits = nextPowerOfTwo(max<size_t>(1024, newCapacity / 2 * BLOOM_BITS_PER_VOTER));
+        bloom.assign(bits / 64, 0);
+        bloomMask = bits - 1;
+    }
+
+    for (const Slot& s : old) {
+        if (s.ballotPlusOne == 0) {
+            continue;
+        }
+        size_t i = s.lo & mask;
+        while (slots[i].ballotPlusOne != 0) {
+            i = (i + 1) & mask;
+        }
+        slots[i] = s;
+        if (useBloom) {
+            bloomAdd(s.lo, s.hi);
+        }
+    }
+}
+
+void VoterIndex::bloomAdd(uint64_t lo, uint64_t hi) {
+    // Double hashing: probe i tests bit (h1 + i*h2)
+    uint64_t h1 = hi;
+    uint64_t h2 = (lo >> 32) | 1;
+    for (int i = 0; i < BLOOM_PROBES; i++) {
+        uint64_t bit = (h1 + i * h2) & bloomMask;
+        bloom[bit >> 6] |= 1ULL << (bit & 63);
+    }
+}
+
+bool VoterIndex::bloomTest(uint64_t lo, uint64_t hi) const {
+    uint64_t h1 = hi;
+    uint64_t h2 = (lo >> 32) | 1;
+    for (int i = 0; i < BLOOM_PROBES; i++) {
+        uint64_t bit = (h1 + i * h2) & bloomMask;
+        if (!(bloom[bit >> 6] & (1ULL << (bit & 63)))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Bloom filter pre-check.
+bool VoterIndex::mayContain(const VoterTag& tag) const {
+    if (!useBloom) {
+        return true;
+    }
+    uint64_t lo, hi;
+    splitTag(tag, lo, hi);
+    return bloomTest(lo, hi);
+}
+
+// Looks up a voter.
+bool VoterIndex::find(const VoterTag& tag, size_t& ballot) const {
+    uint64_t lo, hi;
+    splitTag(tag, lo, hi);
+    if (useBloom && !bloomTest(lo, hi)) {
+        return false;
+    }
+    for (size_t i = lo & mask;; i = (i + 1) & mask) {
+        const Slot& s = slots[i];
+        if (s.ballotPlusOne == 0) {
+            return false;
+        }
+        if (s.lo == lo && s.hi == hi) {
+            ballot = static_cast<size_t>(s.ballotPlusOne - 1);
+            return true;
+        }
+    }
+}
+
+// Points an indexed voter at a different ballot.
+bool VoterIndex::update(const VoterTag& tag, size_t ballot) {
+    uint64_t lo, hi;
+    splitTag(tag, lo, hi);
+    if (useBloom && !bloomTest(lo, hi)) {
+        return false;
+    }
+    for (size_t i = lo & mask;; i = (i + 1) & mask) {
+        Slot& s = slots[i];
+        if (s.ballotPlusOne == 0) {
+            return false;
+        }
+        if (s.lo == lo && s.hi == hi) {
+            s.ballotPlusOne = static_cast<uint64_t>(ballot) + 1;
+            return true;
+        }
+    }
+}
+
+// Adds a voter unless the tag is already present.
+bool VoterIndex::insert(const VoterTag& tag, size_t ballot, size_t* existing) {
+    if (2 * (count + 1) > slots.size()) {
+        rehash(slots.size() * 2);
+    }
+    uint64_t lo, hi;
+    splitTag(tag, lo, hi);
+    bool maybePresent = !useBloom || bloomTest(lo, hi);
+
+    size_t i = lo & mask;
+    while (slots[i].ballotPlusOne != 0) {
+        // Only a Bloom hit can mean the tag is already in the table
+        if (maybePresent && slots[i].lo == lo && slots[i].hi == hi) {
+            if (existing) {
+                *existing = static_cast<size_t>(slots[i].ballotPlusOne - 1);
+            }
+            return false;
+        }
+        i = (i + 1) & mask;
+    }
+    slots[i] = Slot{lo, hi, static_cast<uint64_t>(ballot) + 1};
+    count++;
+    if (useBloom) {
+        bloomAdd(lo, hi);
+    }
+    return true;
+}
+
+/*
+###########################################################################
+    FUNCTION DEFINITIONS
+###########################################################################
+*/
+
+// Canonicalizes PII before tagging.
+string normalizePii(const string& pii) {
+    string out;
+    out.reserve(pii.size());
+    bool pendingSpace = false;
+    for (unsigned char c : pii) {
+        if (isspace(c)) {
+            pendingSpace = !out.empty();
+            continue;
+        }
+        if (pendingSpace) {
+            out += ' ';
+            pendingSpace = false;
+        }
+        out += static_cast<char>(tolower(c));
+    }
+    return out;
+}
+
+// Computes HMAC-SHA256 of the normalized PII, truncated to 128 bits.
+VoterTag computeVoterTag(const HmacSha256& hmac, const string& pii) {
+    string normalized = normalizePii(pii);
+    Digest mac = hmac.mac(reinterpret_cast<const Byte*>(normalized.data()), normalized.size());
+    VoterTag tag;
+    memcpy(tag.data(), mac.data(), tag.size());
+    return tag;
+}
+
+// One byte of HMAC(voterKey, "candidate" || index), XORed with a ballot's candidate.
+Byte candidateMask(const HmacSha256& hmac, size_t index) {
+    Byte message[17] = {'c', 'a', 'n', 'd', 'i', 'd', 'a', 't', 'e'};
+    uint64_t i = index;
+    memcpy(message + 9, &i, sizeof(i));
+    return hmac.mac(message, sizeof(message))[0];
+}
@@ -1,15 +1,53 @@
-import { useState } from 'react';
+import { useEffect, useState } from 'react';
 import axios from 'axios';
 import FullResultsTable from './components/FullResultsTable';
 import { IoReloadSharp } from 'react-icons/io5';
 import { GiCyberEye } from 'react-icons/gi';
 
+// Formats the rate and time left as " (N/s, about Ns left)", or whichever part is known.
+function progressDetail(progress) {
+  const parts = [];
+  if (progress.recordsPerSec) {
+    parts.push(`${Math.round(progress.recordsPerSec)}/s`);
+  }
+  if (progress.etaMs >= 0) {
+    parts.push(`about ${Math.ceil(progress.etaMs / 1000)}s left`);
+  }
+  return parts.length ? ` (${parts.join(', ')})` : '';
+}
+
 function App() {
   const [numCandidates, setNumCandidates] = useState('');
   const [maxVoters, setMaxVoters] = useState('');
   const [numVotes, setNumVotes] = useState('');
   const [tallyData, setTallyData] = useState(null);
   const [loading, setLoading] = useState(false);
+  const [progress, setProgress] = useState(null);
+
+  // Poll the backend for progress while a simulation runs
+  useEffect(() => {
+    if (!loading) {
+      setProgress(null);
+      return undefined;
+    }
+    const timer = setInterval(async () => {
+      try {
+        const res = await axios.get('http://localhost:3001/progress');
+        if (res.data.running) setProgress(res.data);
+      } catch (err) {
+        console.error('Error fetching progress:', err);
+      }
+    }, 500);
+    return () => clearInterval(timer);
+  }, [loading]);
+
+  const cancelSimulation = async () => {
+    try {
+      await axios.post('http://localhost:3001/cancel');
+    } catch (err) {
+      console.error('Error cancelling simulation:', err);
+    }
+  };
 
   const simulateTally = async () => {
     setLoading(true);
@@ -67,7 +105,17 @@ function App() {
       {loading && (
         <div className="flex items-center justify-center mt-4 text-white text-sm space-x-2">
           <IoReloadSharp className="animate-spin text-lg" />
-          <span>Simulating votes, please wait...</span>
+          <span>
+            {progress?.total
+              ? `Encrypted ${progress.records} of ${progress.total} votes` + progressDetail(progress)
+              : 'Simulating votes, please wait...'}
+          </span>
+          <button
+            className="text-white bg-gray-700 hover:bg-gray-600 px-4 py-1 rounded-full"
+            onClick={cancelSimulation}
+          >
+            Cancel
+          </button>
         </div>
       )}
 